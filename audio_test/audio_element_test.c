@@ -22,7 +22,11 @@
  *
  */
 
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "audio_element.h"
+#include "audio_scheduler.h"
 #include "esp_log.h"
 #include "esp_err.h"
 
@@ -194,9 +198,209 @@ void audio_element_input_output_rb()
     rb_destroy(output_rb);
 }
 
+#define SCHED_TEST_CHAINS       (4)
+#define SCHED_TEST_BYTES        (256 * 1024)
+
+/*
+ * SCHED_TEST_CHAINS chains of source -> pass-through -> sink on 2 workers, no element gets a thread of its own.
+ */
+void audio_element_scheduler()
+{
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    audio_scheduler_cfg_t sched_cfg = AUDIO_SCHEDULER_DEFAULT_CFG();
+    sched_cfg.workers = 2;
+    audio_scheduler_handle_t sched = audio_scheduler_create(&sched_cfg);
+    assert(sched != NULL);
+    assert(audio_scheduler_get_workers(sched) == 2);
+    int threads = audio_test_thread_count();
+
+    audio_test_stream_t chains[SCHED_TEST_CHAINS] = { 0 };
+    audio_element_handle_t els[SCHED_TEST_CHAINS][3];
+    ringbuf_handle_t rbs[SCHED_TEST_CHAINS][2];
+    for (int c = 0; c < SCHED_TEST_CHAINS; c++) {
+        chains[c].total = SCHED_TEST_BYTES;
+        for (int i = 0; i < 3; i++) {
+            audio_element_cfg_t cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+            cfg.open = _el_open;
+            cfg.process = audio_test_copy_process;
+            cfg.read = i == 0 ? audio_test_src_read : NULL;
+            cfg.write = i == 2 ? audio_test_sink_write : NULL;
+            cfg.data = &chains[c];
+            els[c][i] = audio_element_init(&cfg);
+            assert(els[c][i] != NULL);
+            assert(audio_element_set_scheduler(els[c][i], sched) == ESP_OK);
+        }
+        rbs[c][0] = rb_create_spsc(4096, 1);
+        rbs[c][1] = rb_create(4096, 1);
+        audio_element_set_output_ringbuf(els[c][0], rbs[c][0]);
+        audio_element_set_input_ringbuf(els[c][1], rbs[c][0]);
+        audio_element_set_output_ringbuf(els[c][1], rbs[c][1]);
+        audio_element_set_input_ringbuf(els[c][2], rbs[c][1]);
+    }
+    for (int c = 0; c < SCHED_TEST_CHAINS; c++) {
+        for (int i = 2; i >= 0; i--) {
+            assert(audio_element_run(els[c][i]) == ESP_OK);
+            assert(audio_element_resume(els[c][i], 0, 2) == ESP_OK);
+        }
+    }
+    assert(audio_test_thread_count() == threads);
+
+    for (int c = 0; c < SCHED_TEST_CHAINS; c++) {
+        assert(audio_element_wait_for_stop_ms(els[c][2], 10) == ESP_OK);
+        assert(audio_element_get_state(els[c][2]) == AEL_STATE_FINISHED);
+        assert(chains[c].received == SCHED_TEST_BYTES);
+        assert(chains[c].errors == 0);
+    }
+
+    for (int c = 0; c < SCHED_TEST_CHAINS; c++) {
+        for (int i = 0; i < 3; i++) {
+            assert(audio_element_deinit(els[c][i]) == ESP_OK);
+        }
+        rb_destroy(rbs[c][0]);
+        rb_destroy(rbs[c][1]);
+    }
+    assert(audio_scheduler_destroy(sched) == ESP_OK);
+}
+
+#define INFO_TEST_ROUNDS    (200000)
+
+static void *_info_writer(void *arg)
+{
+    audio_element_handle_t el = (audio_element_handle_t)arg;
+    audio_element_info_t info = AUDIO_ELEMENT_INFO_DEFAULT();
+    for (int i = 1; i <= INFO_TEST_ROUNDS; i++) {
+        info.sample_rates = i;
+        info.byte_pos = i;
+        info.total_bytes = (int64_t)i * 2;
+        audio_element_setinfo(el, &info);
+    }
+    return NULL;
+}
+
+void audio_element_info_seqlock()
+{
+    ESP_LOGI(TAG, "[✓] concurrent audio_element_getinfo/setinfo");
+    audio_element_cfg_t cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+    audio_element_handle_t el = audio_element_init(&cfg);
+    assert(el != NULL);
+    audio_element_info_t info = AUDIO_ELEMENT_INFO_DEFAULT();
+    audio_element_setinfo(el, &info);
+
+    pthread_t writer;
+    assert(pthread_create(&writer, NULL, _info_writer, el) == 0);
+    int64_t last = 0;
+    while (last < INFO_TEST_ROUNDS) {
+        assert(audio_element_getinfo(el, &info) == ESP_OK);
+        assert(info.total_bytes == info.byte_pos * 2);
+        assert(info.byte_pos >= last);
+        if (info.byte_pos) {
+            assert(info.sample_rates == info.byte_pos);
+        }
+        last = info.byte_pos;
+    }
+    pthread_join(writer, NULL);
+
+    assert(audio_element_update_byte_pos(el, 10) == ESP_OK);
+    assert(audio_element_get_byte_pos(el) == INFO_TEST_ROUNDS + 10);
+    assert(audio_element_get_total_bytes(el) == (int64_t)INFO_TEST_ROUNDS * 2);
+    assert(audio_element_deinit(el) == ESP_OK);
+}
+
+#define STATS_TEST_BYTES    (64 * 1024)
+#define STATS_TEST_BUF      (1024)
+
+static int _stats_process(audio_element_handle_t self, char *in_buffer, int in_len)
+{
+    int r_size = audio_element_input(self, in_buffer, in_len);
+    if (r_size <= 0) {
+        return r_size;
+    }
+    /* Sleeping takes wall time but no CPU time */
+    usleep(1000);
+    return audio_element_output(self, in_buffer, r_size);
+}
+
+static uint64_t stats_hist_total(const audio_element_hist_t *hist)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < AEL_STATS_HIST_BUCKETS; i++) {
+        total += hist->count[i];
+    }
+    return total;
+}
+
+void audio_element_stats()
+{
+    ESP_LOGI(TAG, "[✓] audio_element_get_stats counts calls, bytes and time of a running element");
+    audio_test_stream_t stream = { .total = STATS_TEST_BYTES };
+    audio_element_cfg_t cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+    cfg.open = _el_open;
+    cfg.process = _stats_process;
+    cfg.read = audio_test_src_read;
+    cfg.write = audio_test_sink_write;
+    cfg.buffer_len = STATS_TEST_BUF;
+    cfg.data = &stream;
+    audio_element_handle_t el = audio_element_init(&cfg);
+    assert(el != NULL);
+
+    audio_event_iface_cfg_t evt_cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
+    audio_event_iface_handle_t evt = audio_event_iface_init(&evt_cfg);
+    assert(evt != NULL);
+    assert(audio_element_msg_set_listener(el, evt) == ESP_OK);
+    assert(audio_element_set_stats_report_period(el, 10) == ESP_OK);
+
+    audio_element_stats_t stats;
+    assert(audio_element_run(el) == ESP_OK);
+    assert(audio_element_resume(el, 0, 2) == ESP_OK);
+    uint64_t last = 0;
+    do {
+        /* A snapshot never mixes two updates */
+        assert(audio_element_get_stats(el, &stats) == ESP_OK);
+        assert(stats_hist_total(&stats.process_wall) == stats.process_calls);
+        /* The first call and every 16th after it is timed on the CPU clock */
+        assert(stats_hist_total(&stats.process_cpu) == (stats.process_calls + 15) / 16);
+        assert(stats.bytes_in >= last);
+        last = stats.bytes_in;
+    } while (audio_element_wait_for_stop_ms(el, 0) != ESP_OK);
+    assert(audio_element_wait_for_stop_ms(el, 10) == ESP_OK);
+
+    assert(audio_element_get_stats(el, &stats) == ESP_OK);
+    assert(stream.received == STATS_TEST_BYTES);
+    assert(stream.errors == 0);
+    assert(stats.bytes_in == STATS_TEST_BYTES);
+    assert(stats.bytes_out == STATS_TEST_BYTES);
+    assert(stats.process_calls >= STATS_TEST_BYTES / STATS_TEST_BUF);
+    assert(stats.process_wall_ns >= (STATS_TEST_BYTES / STATS_TEST_BUF) * 1000000ULL);
+    assert(stats.process_cpu_ns < stats.process_wall_ns);
+    assert(stats.input_wait_ns + stats.output_wait_ns < stats.process_wall_ns);
+    uint32_t p50 = audio_element_hist_percentile(&stats.process_wall, 50);
+    assert(p50 >= 1000 && p50 <= stats.process_wall.max_us);
+    assert(audio_element_hist_percentile(&stats.process_wall, 100) == stats.process_wall.max_us);
+    assert(audio_element_hist_percentile(&stats.process_cpu, 50) < p50);
+
+    ESP_LOGI(TAG, "[✓] AEL_MSG_CMD_REPORT_STATS is sent periodically");
+    audio_event_iface_msg_t msg;
+    int reports = 0;
+    while (audio_event_iface_listen(evt, &msg, 0) == ESP_OK) {
+        if (msg.cmd == AEL_MSG_CMD_REPORT_STATS) {
+            assert(msg.source == (void *)el);
+            assert(msg.data_len == sizeof(audio_element_stats_t));
+            reports++;
+        }
+    }
+    assert(reports > 0);
+
+    assert(audio_element_deinit(el) == ESP_OK);
+    audio_event_iface_destroy(evt);
+}
+
 void audio_element_test() {
     audio_element();
     audio_element_input_rb();
     audio_element_input_output_rb();
     audio_element_output_rb();
+    audio_element_scheduler();
+    audio_element_info_seqlock();
+    audio_element_stats();
 }
\ No newline at end of file
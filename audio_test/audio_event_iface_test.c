@@ -22,8 +22,12 @@
  *
  */
 #include <assert.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <unistd.h>
 
 #include "audio_event_iface.h"
+#include "audio_element.h"
 #include "audio_common.h"
 #include "audio_test.h"
 
@@ -38,6 +42,214 @@ static esp_err_t event_on_cmd(audio_event_iface_msg_t *msg, void *context)
     return ESP_OK;
 }
 
+#define EVT_PRODUCERS       (4)
+#define EVT_PRODUCER_MSGS   (10000)
+
+static void *event_producer(void *arg)
+{
+    audio_event_iface_handle_t evt = (audio_event_iface_handle_t)arg;
+    audio_event_iface_msg_t msg = { 0 };
+    msg.source = evt;
+    for (int i = 0; i < EVT_PRODUCER_MSGS; i++) {
+        msg.cmd = i;
+        /* A full listener drops the message rather than blocking, send it again */
+        while (audio_event_iface_sendout(evt, &msg) != ESP_OK) {
+            usleep(100);
+        }
+    }
+    return NULL;
+}
+
+static void audio_event_iface_inproc_test(void)
+{
+    ESP_LOGI(TAG, "[✓] %d producers sendout %d msg each to one in-process listener", EVT_PRODUCERS, EVT_PRODUCER_MSGS);
+    audio_event_iface_cfg_t cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
+    cfg.queue_type = AUDIO_EVENT_IFACE_QUEUE_INPROC;
+    cfg.oflags = O_RDWR | O_CREAT;
+    cfg.internal_queue_size = 8;
+    audio_event_iface_handle_t listener = audio_event_iface_init(&cfg);
+    assert(listener != NULL);
+    assert(audio_event_iface_get_msg_queue_handle(listener) == 0);
+
+    audio_event_iface_handle_t producers[EVT_PRODUCERS];
+    int next_cmd[EVT_PRODUCERS] = { 0 };
+    pthread_t threads[EVT_PRODUCERS];
+    for (int i = 0; i < EVT_PRODUCERS; i++) {
+        cfg.internal_queue_size = 0;
+        producers[i] = audio_event_iface_init(&cfg);
+        assert(producers[i] != NULL);
+        /* Setting a listener discards its pending messages, so attach all of them before any thread sends */
+        assert(audio_event_iface_set_listener(producers[i], listener) == ESP_OK);
+    }
+    for (int i = 0; i < EVT_PRODUCERS; i++) {
+        assert(pthread_create(&threads[i], NULL, event_producer, producers[i]) == 0);
+    }
+
+    audio_event_iface_msg_t msg;
+    for (int n = 0; n < EVT_PRODUCERS * EVT_PRODUCER_MSGS; n++) {
+        assert(audio_event_iface_listen(listener, &msg, pdMS_TO_TICKS(5000)) == ESP_OK);
+        int i;
+        for (i = 0; i < EVT_PRODUCERS && producers[i] != msg.source; i++);
+        assert(i < EVT_PRODUCERS);
+        /* Messages of one producer keep their order */
+        assert(msg.cmd == next_cmd[i]);
+        next_cmd[i]++;
+    }
+    assert(audio_event_iface_has_cmd_msg(listener) == false);
+
+    for (int i = 0; i < EVT_PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+        audio_event_iface_destroy(producers[i]);
+    }
+    audio_event_iface_destroy(listener);
+}
+
+static void audio_event_iface_pubsub_test(void)
+{
+    ESP_LOGI(TAG, "[✓] one emitter publish to 3 filtered listeners");
+    audio_event_iface_cfg_t cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
+    audio_event_iface_handle_t emitter = audio_event_iface_init(&cfg);
+    audio_event_iface_handle_t all = audio_event_iface_init(&cfg);
+    audio_event_iface_handle_t status_only = audio_event_iface_init(&cfg);
+    cfg.internal_queue_size = 2;
+    cfg.drop_policy = AUDIO_EVENT_IFACE_DROP_OLDEST;
+    audio_event_iface_handle_t latest = audio_event_iface_init(&cfg);
+    assert(emitter && all && status_only && latest);
+
+    audio_event_iface_filter_t filter = { 0 };
+    assert(audio_event_iface_set_msg_listener(emitter, all) == ESP_OK);
+    filter.cmd_mask = AUDIO_EVENT_IFACE_BIT(AEL_MSG_CMD_REPORT_STATUS);
+    filter.status_mask = AUDIO_EVENT_IFACE_BIT(AEL_STATUS_STATE_FINISHED);
+    assert(audio_event_iface_subscribe(emitter, status_only, &filter) == ESP_OK);
+    filter = (audio_event_iface_filter_t) { .source = emitter };
+    assert(audio_event_iface_subscribe(emitter, latest, &filter) == ESP_OK);
+
+    audio_event_iface_msg_t msg = { 0 };
+    msg.source = emitter;
+    msg.cmd = AEL_MSG_CMD_REPORT_POSITION;
+    assert(audio_event_iface_sendout(emitter, &msg) == ESP_OK);
+    msg.cmd = AEL_MSG_CMD_REPORT_STATUS;
+    msg.data = (void *)AEL_STATUS_STATE_RUNNING;
+    assert(audio_event_iface_sendout(emitter, &msg) == ESP_OK);
+    msg.data = (void *)AEL_STATUS_STATE_FINISHED;
+    assert(audio_event_iface_sendout(emitter, &msg) == ESP_OK);
+    msg.source = NULL;
+    assert(audio_event_iface_sendout(emitter, &msg) == ESP_OK);
+
+    int count = 0;
+    while (audio_event_iface_listen(all, &msg, 0) == ESP_OK) {
+        count++;
+    }
+    assert(count == 4);
+    count = 0;
+    while (audio_event_iface_listen(status_only, &msg, 0) == ESP_OK) {
+        assert(msg.cmd == AEL_MSG_CMD_REPORT_STATUS && (int)(intptr_t)msg.data == AEL_STATUS_STATE_FINISHED);
+        count++;
+    }
+    assert(count == 2);
+    /* Queue of 2 keeping the latest of the 3 matching messages */
+    assert(audio_event_iface_get_dropped(latest) == 1);
+    assert(audio_event_iface_listen(latest, &msg, 0) == ESP_OK && (int)(intptr_t)msg.data == AEL_STATUS_STATE_RUNNING);
+    assert(audio_event_iface_listen(latest, &msg, 0) == ESP_OK && (int)(intptr_t)msg.data == AEL_STATUS_STATE_FINISHED);
+    assert(audio_event_iface_listen(latest, &msg, 0) == ESP_FAIL);
+
+    ESP_LOGI(TAG, "[✓] removed listener gets nothing, the others keep receiving");
+    assert(audio_event_iface_remove_listener(all, emitter) == ESP_OK);
+    assert(audio_event_iface_remove_listener(all, emitter) == ESP_ERR_INVALID_ARG);
+    assert(audio_event_iface_sendout(emitter, &msg) == ESP_OK);
+    assert(audio_event_iface_listen(all, &msg, 0) == ESP_FAIL);
+    assert(audio_event_iface_listen(status_only, &msg, 0) == ESP_OK);
+
+    audio_event_iface_destroy(emitter);
+    audio_event_iface_destroy(all);
+    audio_event_iface_destroy(status_only);
+    audio_event_iface_destroy(latest);
+}
+
+/* A full blocking listener drops the message instead of stalling the source, a destroyed one is unsubscribed */
+static void audio_event_iface_listener_test(audio_event_iface_queue_t queue_type)
+{
+    ESP_LOGI(TAG, "[✓] sendout to a full blocking %s listener, then to a destroyed one",
+             queue_type == AUDIO_EVENT_IFACE_QUEUE_INPROC ? "in-process" : "mqueue");
+    audio_event_iface_cfg_t cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
+    cfg.queue_type = queue_type;
+    cfg.internal_queue_size = 0;
+    audio_event_iface_handle_t emitter = audio_event_iface_init(&cfg);
+    cfg.oflags = O_RDWR | O_CREAT;
+    cfg.internal_queue_size = 2;
+    audio_event_iface_handle_t blocking = audio_event_iface_init(&cfg);
+    audio_event_iface_handle_t gone = audio_event_iface_init(&cfg);
+    assert(emitter && blocking && gone);
+    assert(audio_event_iface_set_msg_listener(emitter, blocking) == ESP_OK);
+    assert(audio_event_iface_set_msg_listener(emitter, gone) == ESP_OK);
+
+    audio_event_iface_msg_t msg = { .source = emitter, .cmd = AEL_MSG_CMD_REPORT_STATUS };
+    assert(audio_event_iface_sendout(emitter, &msg) == ESP_OK);
+    assert(audio_event_iface_sendout(emitter, &msg) == ESP_OK);
+    assert(audio_event_iface_sendout(emitter, &msg) == ESP_FAIL);
+    assert(audio_event_iface_get_dropped(blocking) == 1);
+
+    assert(audio_event_iface_destroy(gone) == ESP_OK);
+    assert(audio_event_iface_discard(blocking) == ESP_OK);
+    assert(audio_event_iface_sendout(emitter, &msg) == ESP_OK);
+    assert(audio_event_iface_listen(blocking, &msg, 0) == ESP_OK);
+
+    /* The emitter going first leaves nothing behind on its listener */
+    assert(audio_event_iface_destroy(emitter) == ESP_OK);
+    assert(audio_event_iface_destroy(blocking) == ESP_OK);
+}
+
+static void audio_event_iface_epoll_test(audio_event_iface_queue_t queue_type)
+{
+    ESP_LOGI(TAG, "[✓] %d producers sendout to a listener drained from epoll, queue type %d", EVT_PRODUCERS, queue_type);
+    audio_event_iface_cfg_t cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
+    cfg.queue_type = queue_type;
+    cfg.internal_queue_size = 8;
+    cfg.oflags = O_RDWR | O_CREAT;
+    audio_event_iface_handle_t listener = audio_event_iface_init(&cfg);
+    assert(listener != NULL);
+    int fd = audio_event_iface_get_fd(listener);
+    assert(fd >= 0 && audio_event_iface_get_fd(listener) == fd);
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN };
+    assert(ep >= 0 && epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) == 0);
+    assert(epoll_wait(ep, &ev, 1, 0) == 0);
+
+    audio_event_iface_handle_t producers[EVT_PRODUCERS];
+    pthread_t threads[EVT_PRODUCERS];
+    cfg.internal_queue_size = 0;
+    for (int i = 0; i < EVT_PRODUCERS; i++) {
+        producers[i] = audio_event_iface_init(&cfg);
+        assert(producers[i] != NULL);
+        assert(audio_event_iface_set_listener(producers[i], listener) == ESP_OK);
+    }
+    for (int i = 0; i < EVT_PRODUCERS; i++) {
+        assert(pthread_create(&threads[i], NULL, event_producer, producers[i]) == 0);
+    }
+
+    audio_event_iface_msg_t msgs[5];
+    int total = 0;
+    while (total < EVT_PRODUCERS * EVT_PRODUCER_MSGS) {
+        assert(epoll_wait(ep, &ev, 1, 5000) == 1);
+        int n;
+        while ((n = audio_event_iface_listen_batch(listener, msgs, 5)) > 0) {
+            total += n;
+        }
+    }
+    assert(total == EVT_PRODUCERS * EVT_PRODUCER_MSGS);
+    for (int i = 0; i < EVT_PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+        audio_event_iface_destroy(producers[i]);
+    }
+    /* Drained and re-armed, nothing left to report */
+    assert(audio_event_iface_listen_batch(listener, msgs, 5) == 0);
+    assert(epoll_wait(ep, &ev, 1, 0) == 0);
+
+    close(ep);
+    audio_event_iface_destroy(listener);
+}
+
 void audio_event_iface_test()
 {
     ESP_LOGI(TAG, "[✓] audio_event_iface_init evt1");
@@ -133,4 +345,11 @@ void audio_event_iface_test()
     audio_event_iface_destroy(evt1);
     audio_event_iface_destroy(evt2);
     audio_event_iface_destroy(evt3);
+
+    audio_event_iface_inproc_test();
+    audio_event_iface_pubsub_test();
+    audio_event_iface_listener_test(AUDIO_EVENT_IFACE_QUEUE_INPROC);
+    audio_event_iface_listener_test(AUDIO_EVENT_IFACE_QUEUE_MQUEUE);
+    audio_event_iface_epoll_test(AUDIO_EVENT_IFACE_QUEUE_INPROC);
+    audio_event_iface_epoll_test(AUDIO_EVENT_IFACE_QUEUE_MQUEUE);
 }
\ No newline at end of file
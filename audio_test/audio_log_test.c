@@ -0,0 +1,177 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "audio_test.h"
+#include "esp_log.h"
+
+static const char *TAG = "AUDIO_LOG_TEST";
+
+#define LOG_THREADS         (4)
+#define LOG_LOOPS           (2000)
+#define LOG_FLOOD           (1000)
+
+static atomic_int g_lines;
+static atomic_int g_drop_reports;
+static atomic_int g_hold;
+static int g_last[LOG_THREADS];
+static int g_out_of_order;
+
+// Only the writer thread prints while the backend runs
+static int counting_vprintf(const char *format, va_list args)
+{
+    char line[512];
+    int id, index;
+    while (atomic_load(&g_hold)) {
+        usleep(1000);
+    }
+    int len = vsnprintf(line, sizeof(line), format, args);
+    const char *mark = strstr(line, "line ");
+    if (mark && sscanf(mark, "line %d %d", &id, &index) == 2) {
+        if (index <= g_last[id]) {
+            g_out_of_order++;
+        }
+        g_last[id] = index;
+        atomic_fetch_add(&g_lines, 1);
+    } else if (strstr(line, "messages dropped")) {
+        atomic_fetch_add(&g_drop_reports, 1);
+    }
+    return len;
+}
+
+static void *log_worker(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    for (int i = 0; i < LOG_LOOPS; i++) {
+        ESP_LOGI(TAG, "line %d %d", id, i);
+    }
+    return NULL;
+}
+
+// Log a few messages in binary form and check what the decoder makes of them
+static void log_binary_round_trip(void)
+{
+    char path[] = "/tmp/audio_log_test_XXXXXX";
+    char text[4096];
+    char longer[300];
+    int fd = mkstemp(path);
+    TEST_ASSERT_EQUAL(fd >= 0, true);
+    unlink(path);
+    memset(longer, 'x', sizeof(longer) - 1);
+    longer[sizeof(longer) - 1] = '\0';
+
+    TEST_ASSERT_EQUAL(esp_log_set_binary_output(fd), 0);
+    for (int i = 0; i < 2; i++) {
+        ESP_LOGW(TAG, "bin %d %u %lld %zu %.2f %s %c %5.1s|%*d|%% end", -7, 42u, 123456789012LL,
+                 (size_t)4096, 3.5, "str", 'c', "abc", 4, 9);
+    }
+    ESP_LOGW(TAG, "long %s", longer);
+    esp_log_async_flush();
+    TEST_ASSERT_EQUAL(esp_log_set_binary_output(-1), 0);
+
+    int out[2];
+    TEST_ASSERT_EQUAL(pipe(out), 0);
+    lseek(fd, 0, SEEK_SET);
+    TEST_ASSERT_EQUAL(esp_log_binary_decode(fd, out[1], false), 3);
+    close(out[1]);
+    ssize_t len = read(out[0], text, sizeof(text) - 1);
+    assert(len > 0);
+    text[len] = '\0';
+    close(out[0]);
+    close(fd);
+
+    const char *expect = "AUDIO_LOG_TEST: bin -7 42 123456789012 4096 3.50 str c     a|   9|% end";
+    char *first = strstr(text, expect);
+    assert(first != NULL);
+    assert(strstr(first + 1, expect) != NULL);
+    assert(strstr(text, "AUDIO_LOG_TEST: long xxxx") != NULL);
+}
+
+void audio_log_test(void)
+{
+    pthread_t threads[LOG_THREADS];
+
+    ESP_LOGI(TAG, "[✓] %d threads log through the async backend, each in order", LOG_THREADS);
+    vprintf_like_t orig = esp_log_set_vprintf(counting_vprintf);
+    for (int i = 0; i < LOG_THREADS; i++) {
+        g_last[i] = -1;
+    }
+    TEST_ASSERT_EQUAL(esp_log_async_start(), 0);
+    uint32_t dropped = esp_log_async_get_dropped();
+    for (int i = 0; i < LOG_THREADS; i++) {
+        TEST_ASSERT_EQUAL(pthread_create(&threads[i], NULL, log_worker, (void *)(intptr_t)i), 0);
+    }
+    for (int i = 0; i < LOG_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    esp_log_async_flush();
+    TEST_ASSERT_EQUAL(g_out_of_order, 0);
+    TEST_ASSERT_EQUAL(atomic_load(&g_lines) + (int)(esp_log_async_get_dropped() - dropped), LOG_THREADS * LOG_LOOPS);
+
+    ESP_LOGI(TAG, "[✓] a stalled output drops and reports messages instead of blocking the caller");
+    atomic_store(&g_lines, 0);
+    g_last[0] = -1;
+    dropped = esp_log_async_get_dropped();
+    atomic_store(&g_hold, 1);
+    for (int i = 0; i < LOG_FLOOD; i++) {
+        ESP_LOGI(TAG, "line 0 %d", i);
+    }
+    assert(esp_log_async_get_dropped() - dropped > 0);
+    atomic_store(&g_hold, 0);
+    esp_log_async_flush();
+    TEST_ASSERT_EQUAL(atomic_load(&g_lines) + (int)(esp_log_async_get_dropped() - dropped), LOG_FLOOD);
+    assert(atomic_load(&g_drop_reports) > 0);
+
+    ESP_LOGI(TAG, "[✓] binary records go through the async backend and decode back to the same text");
+    log_binary_round_trip();
+
+    ESP_LOGI(TAG, "[✓] logs print synchronously once the backend is stopped");
+    esp_log_async_stop();
+    atomic_store(&g_lines, 0);
+    g_last[0] = -1;
+    ESP_LOGI(TAG, "line 0 0");
+    TEST_ASSERT_EQUAL(atomic_load(&g_lines), 1);
+    esp_log_set_vprintf(orig);
+
+    ESP_LOGI(TAG, "[✓] binary records are written directly without the async backend");
+    log_binary_round_trip();
+
+    ESP_LOGI(TAG, "[✓] a level no tag is set to skips the arguments of the call");
+    int evaluated = 0;
+    esp_log_level_set("*", ESP_LOG_WARN);
+    ESP_LOGI(TAG, "not shown %d", ++evaluated);
+    TEST_ASSERT_EQUAL(evaluated, 0);
+    esp_log_level_set(TAG, ESP_LOG_INFO);
+    ESP_LOGI(TAG, "shown %d", ++evaluated);
+    TEST_ASSERT_EQUAL(evaluated, 1);
+    esp_log_level_set("*", ESP_LOG_INFO);
+}
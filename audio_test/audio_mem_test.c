@@ -1,7 +1,11 @@
 #include <assert.h>
 #include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
 
 #include "audio_mem.h"
+#include "audio_arena.h"
 #include "audio_test.h"
 #include "esp_log.h"
 #include "esp_err.h"
@@ -63,8 +67,168 @@ void audio_realloc_test()
 }
 
 
+#define MEM_TEST_BLOCKS     (10)
+
+void audio_mem_accounting()
+{
+    ESP_LOGI(TAG, "[✓] audio_mem_get_stats, audio_mem_get_site_stats, audio_mem_dump_samples");
+    audio_mem_stats_t before, after;
+    assert(ESP_OK == audio_mem_get_stats(&before));
+    assert(before.site == NULL);
+
+    void *blocks[MEM_TEST_BLOCKS];
+    for (int i = 0; i < MEM_TEST_BLOCKS; i++) {
+        blocks[i] = audio_malloc(777);
+        assert(blocks[i] != NULL);
+    }
+    assert(ESP_OK == audio_mem_get_stats(&after));
+    assert(after.live_bytes >= before.live_bytes + MEM_TEST_BLOCKS * 777);
+    assert(after.peak_bytes >= after.live_bytes);
+    assert(after.allocs == before.allocs + MEM_TEST_BLOCKS);
+
+    /* All blocks come from one call site, the one holding the most memory right now */
+    audio_mem_stats_t sites[4];
+    int n = audio_mem_get_site_stats(sites, 4);
+    assert(n >= 1);
+    assert(sites[0].site != NULL);
+    assert(sites[0].live_bytes >= MEM_TEST_BLOCKS * 777);
+    assert(sites[0].allocs - sites[0].frees >= MEM_TEST_BLOCKS);
+    for (int i = 1; i < n; i++) {
+        assert(sites[i].live_bytes <= sites[i - 1].live_bytes);
+    }
+    AUDIO_MEM_SHOW(TAG);
+
+    for (int i = 0; i < MEM_TEST_BLOCKS; i++) {
+        audio_free(blocks[i]);
+    }
+    assert(ESP_OK == audio_mem_get_stats(&after));
+    assert(after.live_bytes == before.live_bytes);
+    assert(after.frees == before.frees + MEM_TEST_BLOCKS);
+
+    /* A block from plain malloc is freed without being counted, realloc moves the accounting along */
+    audio_free(malloc(100));
+    char *pdata = audio_realloc(NULL, 10);
+    assert(pdata != NULL);
+    memcpy(pdata, "realloc", 8);
+    pdata = audio_realloc(pdata, 4096);
+    assert(pdata != NULL && strcmp(pdata, "realloc") == 0);
+    audio_mem_get_stats(&after);
+    assert(after.live_bytes >= before.live_bytes + 4096);
+    audio_free(pdata);
+    audio_mem_get_stats(&after);
+    assert(after.live_bytes == before.live_bytes);
+
+    audio_mem_set_sample_rate(1);
+    for (int i = 0; i < 3; i++) {
+        blocks[i] = audio_calloc(1, 64);
+    }
+    audio_mem_set_sample_rate(0);
+    assert(audio_mem_dump_samples(TAG) == 3);
+    for (int i = 0; i < 3; i++) {
+        audio_free(blocks[i]);
+    }
+    assert(audio_mem_dump_samples(TAG) == 0);
+}
+
+#define ARENA_TEST_THREADS  (4)
+#define ARENA_TEST_LOOPS    (20000)
+
+static void *_arena_worker(void *arg)
+{
+    audio_arena_handle_t arena = (audio_arena_handle_t)arg;
+    void *held[8] = { 0 };
+    for (int i = 0; i < ARENA_TEST_LOOPS; i++) {
+        int slot = i % 8;
+        audio_arena_free(held[slot]);
+        size_t size = 1 + (i * 37) % 700;
+        held[slot] = audio_arena_malloc(arena, size);
+        assert(held[slot] != NULL);
+        memset(held[slot], slot, size);
+    }
+    for (int i = 0; i < 8; i++) {
+        audio_arena_free(held[i]);
+    }
+    return NULL;
+}
+
+void audio_arena_test()
+{
+    ESP_LOGI(TAG, "[✓] audio_arena");
+    /* Without an arena the blocks come from the heap */
+    uint8_t *pdata = audio_arena_calloc(NULL, 4, 8);
+    assert(pdata != NULL);
+    for (int i = 0; i < 32; i++) {
+        assert(pdata[i] == 0);
+    }
+    audio_arena_free(pdata);
+
+    audio_arena_handle_t arena = audio_arena_create(1024);
+    assert(arena != NULL);
+    pdata = audio_arena_malloc(arena, 100);
+    assert(pdata != NULL);
+    assert(((uintptr_t)pdata & 15) == 0);
+    assert(audio_arena_get_used(arena) == 128);
+    int reserved = audio_arena_get_reserved(arena);
+    assert(reserved > 1024);
+
+    /* A freed block is handed out again for the same size class, dirty memory is cleared by calloc */
+    memset(pdata, 0xff, 100);
+    audio_arena_free(pdata);
+    assert(audio_arena_get_used(arena) == 0);
+    uint8_t *again = audio_arena_calloc(arena, 1, 120);
+    assert(again == pdata);
+    for (int i = 0; i < 120; i++) {
+        assert(again[i] == 0);
+    }
+    audio_arena_free(again);
+    /* Once every class has been carved, cycling through them takes nothing more from the heap */
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 1000; i++) {
+            void *a = audio_arena_malloc(arena, 16 + i % 200);
+            void *b = audio_arena_malloc(arena, 300);
+            assert(a && b);
+            audio_arena_free(b);
+            audio_arena_free(a);
+        }
+        if (round == 0) {
+            reserved = audio_arena_get_reserved(arena);
+        }
+    }
+    assert(audio_arena_get_reserved(arena) == reserved);
+
+    /* A block larger than a chunk gets a chunk of its own, small ones keep using the current chunk */
+    pdata = audio_arena_malloc(arena, 5000);
+    assert(pdata != NULL);
+    memset(pdata, 0x5a, 5000);
+    assert(audio_arena_get_reserved(arena) >= reserved + 5000);
+    reserved = audio_arena_get_reserved(arena);
+    void *small = audio_arena_malloc(arena, 32);
+    assert(small != NULL);
+    assert(audio_arena_get_reserved(arena) == reserved);
+    audio_arena_free(small);
+    audio_arena_free(pdata);
+
+    pthread_t threads[ARENA_TEST_THREADS];
+    for (int i = 0; i < ARENA_TEST_THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, _arena_worker, arena) == 0);
+    }
+    for (int i = 0; i < ARENA_TEST_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    assert(audio_arena_get_used(arena) == 0);
+
+    /* A block still in use keeps the arena alive after the handle is dropped */
+    pdata = audio_arena_malloc(arena, 64);
+    assert(pdata != NULL);
+    assert(ESP_OK == audio_arena_destroy(arena));
+    memset(pdata, 0, 64);
+    audio_arena_free(pdata);
+}
+
 void audio_mem_test() {
     audio_mem();
     audio_strdup_test();
     audio_realloc_test();
+    audio_mem_accounting();
+    audio_arena_test();
 }
@@ -0,0 +1,126 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "audio_mutex.h"
+#include "audio_sem.h"
+#include "event_groups.h"
+#include "audio_test.h"
+#include "esp_log.h"
+
+static const char *TAG = "AUDIO_MUTEX_TEST";
+
+#define SYNC_THREADS        (4)
+#define SYNC_LOOPS          (100000)
+
+static pthread_mutex_t *g_mutex;
+static int g_counter;
+
+static void *mutex_worker(void *arg)
+{
+    for (int i = 0; i < SYNC_LOOPS; i++) {
+        mutex_lock(g_mutex);
+        g_counter++;
+        mutex_unlock(g_mutex);
+    }
+    return NULL;
+}
+
+static void *event_setter(void *arg)
+{
+    EventGroupHandle_t group = (EventGroupHandle_t)arg;
+    usleep(20 * 1000);
+    xEventGroupSetBits(group, BIT3);
+    usleep(20 * 1000);
+    xEventGroupSetBits(group, BIT7);
+    return NULL;
+}
+
+static void *sem_giver(void *arg)
+{
+    audio_sem_handle_t sem = (audio_sem_handle_t)arg;
+    for (int i = 0; i < SYNC_LOOPS; i++) {
+        while (audio_sem_give(sem) == EOVERFLOW) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+void audio_mutex_test(void)
+{
+    pthread_t threads[SYNC_THREADS];
+
+    ESP_LOGI(TAG, "[✓] %d threads increment a counter under mutex_lock", SYNC_THREADS);
+    g_mutex = mutex_create();
+    TEST_ASSERT_NOT_NULL(g_mutex);
+    for (int i = 0; i < SYNC_THREADS; i++) {
+        TEST_ASSERT_EQUAL(pthread_create(&threads[i], NULL, mutex_worker, NULL), 0);
+    }
+    for (int i = 0; i < SYNC_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    TEST_ASSERT_EQUAL(g_counter, SYNC_THREADS * SYNC_LOOPS);
+    mutex_destroy(g_mutex);
+
+    ESP_LOGI(TAG, "[✓] priority inheritance mutex times out while held");
+    pthread_mutex_t *pi = mutex_create_prio_inherit();
+    TEST_ASSERT_NOT_NULL(pi);
+    TEST_ASSERT_EQUAL(mutex_lock(pi), 0);
+    TEST_ASSERT_EQUAL(mutex_lock_timeout(pi, 0), EBUSY);
+    mutex_unlock(pi);
+    mutex_destroy(pi);
+
+    ESP_LOGI(TAG, "[✓] event group waits for any and for all of several bits");
+    EventGroupHandle_t group = xEventGroupCreate();
+    TEST_ASSERT_NOT_NULL(group);
+    TEST_ASSERT_EQUAL(xEventGroupWaitBits(group, BIT0 | BIT1, pdFALSE, pdFALSE, 0), 0);
+    TEST_ASSERT_EQUAL(pthread_create(&threads[0], NULL, event_setter, group), 0);
+    EventBits_t bits = xEventGroupWaitBits(group, BIT3 | BIT7, pdFALSE, pdFALSE, portMAX_DELAY);
+    assert(bits & BIT3);
+    bits = xEventGroupWaitBits(group, BIT3 | BIT7, pdTRUE, pdTRUE, portMAX_DELAY);
+    TEST_ASSERT_EQUAL(bits & (BIT3 | BIT7), BIT3 | BIT7);
+    TEST_ASSERT_EQUAL(xEventGroupGetBits(group), 0);
+    pthread_join(threads[0], NULL);
+    xEventGroupSetBits(group, BIT1);
+    TEST_ASSERT_EQUAL(xEventGroupWaitBits(group, BIT1 | BIT2, pdFALSE, pdTRUE, pdMS_TO_TICKS(10)), BIT1);
+    vEventGroupDelete(group);
+
+    ESP_LOGI(TAG, "[✓] counting semaphore passes %d gives to one taker", SYNC_LOOPS);
+    audio_sem_handle_t sem = audio_sem_create(0, 4);
+    TEST_ASSERT_NOT_NULL(sem);
+    TEST_ASSERT_EQUAL(audio_sem_take(sem, 0), EBUSY);
+    TEST_ASSERT_EQUAL(audio_sem_take(sem, pdMS_TO_TICKS(10)), ETIMEDOUT);
+    TEST_ASSERT_EQUAL(pthread_create(&threads[0], NULL, sem_giver, sem), 0);
+    for (int i = 0; i < SYNC_LOOPS; i++) {
+        TEST_ASSERT_EQUAL(audio_sem_take(sem, portMAX_DELAY), 0);
+    }
+    pthread_join(threads[0], NULL);
+    TEST_ASSERT_EQUAL(audio_sem_get_count(sem), 0);
+    audio_sem_destroy(sem);
+}
@@ -23,7 +23,14 @@
  */
 
 
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include "audio_pipeline.h"
+#include "audio_pipeline_exporter.h"
+#include "audio_trace.h"
+#include "audio_time.h"
 #include "esp_log.h"
 #include "esp_err.h"
 #include "audio_test.h"
@@ -61,6 +68,490 @@ static esp_err_t _el_close(audio_element_handle_t self)
     return ESP_OK;
 }
 
+#define FUSED_TEST_BYTES    (256 * 1024)
+
+/* Hands the upstream buffer straight on, a smaller read size than upstream splits each push in several calls */
+static int _fused_peek_process(audio_element_handle_t self, char *in_buffer, int in_len)
+{
+    char *data = NULL;
+    int r_size = audio_element_input_peek(self, &data, 1000);
+    if (r_size <= 0) {
+        return r_size;
+    }
+    int w_size = audio_element_output(self, data, r_size);
+    audio_element_input_consume(self, r_size);
+    return w_size;
+}
+
+/* Waits for a whole frame, more than one push of upstream, before it consumes anything */
+#define FUSED_TEST_FRAME    (4096)
+static int _fused_frame_process(audio_element_handle_t self, char *in_buffer, int in_len)
+{
+    char *data = NULL;
+    int r_size = audio_element_input_peek(self, &data, FUSED_TEST_FRAME);
+    if (r_size < FUSED_TEST_FRAME) {
+        return r_size <= 0 ? r_size : AEL_IO_TIMEOUT;
+    }
+    int w_size = audio_element_output(self, data, r_size);
+    audio_element_input_consume(self, r_size);
+    return w_size;
+}
+
+/*
+ * source -> pass-through -> zero-copy pass-through -> framer -> sink linked in fused mode: a single element task,
+ * no ringbuffer.
+ */
+void audio_pipeline_fused()
+{
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    audio_test_stream_t test = { .total = FUSED_TEST_BYTES };
+    audio_element_handle_t els[5];
+    for (int i = 0; i < 5; i++) {
+        audio_element_cfg_t cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+        cfg.open = _el_open;
+        cfg.close = _el_close;
+        cfg.process = i == 2 ? _fused_peek_process : i == 3 ? _fused_frame_process : audio_test_copy_process;
+        cfg.read = i == 0 ? audio_test_src_read : NULL;
+        cfg.write = i == 4 ? audio_test_sink_write : NULL;
+        cfg.data = &test;
+        els[i] = audio_element_init(&cfg);
+        assert(els[i] != NULL);
+    }
+
+    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+    pipeline_cfg.fused = true;
+    audio_pipeline_handle_t pipeline = audio_pipeline_init(&pipeline_cfg);
+    assert(pipeline != NULL);
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[0], "src"));
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[1], "copy"));
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[2], "peek"));
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[3], "frame"));
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[4], "sink"));
+    assert(ESP_OK == audio_pipeline_link(pipeline, (const char *[]){"src", "copy", "peek", "frame", "sink"}, 5));
+    assert(audio_element_get_fused_output(els[0]) == els[1]);
+    assert(audio_element_get_fused_output(els[3]) == els[4]);
+    assert(audio_element_get_output_ringbuf(els[1]) == NULL);
+    assert(audio_element_get_fused_output(els[4]) == NULL);
+
+    int threads = audio_test_thread_count();
+    assert(ESP_OK == audio_pipeline_run(pipeline));
+    assert(audio_test_thread_count() <= threads + 1);
+    /* The chain drains before the first element finishes */
+    assert(ESP_OK == audio_element_wait_for_stop_ms(els[0], portMAX_DELAY));
+    for (int i = 0; i < 5; i++) {
+        assert(audio_element_get_state(els[i]) == AEL_STATE_FINISHED);
+    }
+    assert(ESP_OK == audio_pipeline_wait_for_stop(pipeline));
+    assert(test.received == FUSED_TEST_BYTES);
+    assert(test.errors == 0);
+
+    assert(ESP_OK == audio_pipeline_terminate(pipeline));
+    assert(ESP_OK == audio_pipeline_unlink(pipeline));
+    assert(audio_element_get_fused_output(els[0]) == NULL);
+    assert(ESP_OK == audio_pipeline_deinit(pipeline));
+}
+
+/* Passes buffers on by pointer where the link allows it */
+static int _desc_process(audio_element_handle_t self, char *in_buffer, int in_len)
+{
+    audio_buf_t *buf = NULL;
+    int r_size = audio_element_input_buf(self, &buf);
+    if (r_size <= 0) {
+        return r_size;
+    }
+    return audio_element_output_buf(self, buf);
+}
+
+/*
+ * source =desc=> pass-through =desc=> byte pass-through -> pass-through -> sink: descriptor links between buffer
+ * elements, the byte shim on both sides of the legacy element in the middle.
+ */
+void audio_pipeline_desc()
+{
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    audio_test_stream_t test = { .total = FUSED_TEST_BYTES };
+    audio_element_handle_t els[4];
+    for (int i = 0; i < 4; i++) {
+        audio_element_cfg_t cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+        cfg.open = _el_open;
+        cfg.close = _el_close;
+        cfg.process = i == 2 ? audio_test_copy_process : _desc_process;
+        cfg.read = i == 0 ? audio_test_src_read : NULL;
+        cfg.write = i == 3 ? audio_test_sink_write : NULL;
+        cfg.out_rb_desc = i < 2;
+        cfg.data = &test;
+        els[i] = audio_element_init(&cfg);
+        assert(els[i] != NULL);
+    }
+
+    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+    audio_pipeline_handle_t pipeline = audio_pipeline_init(&pipeline_cfg);
+    assert(pipeline != NULL);
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[0], "src"));
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[1], "desc"));
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[2], "copy"));
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[3], "sink"));
+    assert(ESP_OK == audio_pipeline_link(pipeline, (const char *[]){"src", "desc", "copy", "sink"}, 4));
+    assert(rb_is_desc(audio_element_get_output_ringbuf(els[0])));
+    assert(rb_is_desc(audio_element_get_output_ringbuf(els[1])));
+    assert(!rb_is_desc(audio_element_get_output_ringbuf(els[2])));
+
+    assert(ESP_OK == audio_pipeline_run(pipeline));
+    assert(ESP_OK == audio_element_wait_for_stop_ms(els[3], portMAX_DELAY));
+    assert(audio_element_get_state(els[3]) == AEL_STATE_FINISHED);
+    assert(ESP_OK == audio_pipeline_wait_for_stop(pipeline));
+    assert(test.received == FUSED_TEST_BYTES);
+    assert(test.errors == 0);
+
+    assert(ESP_OK == audio_pipeline_terminate(pipeline));
+    assert(ESP_OK == audio_pipeline_unlink(pipeline));
+    assert(ESP_OK == audio_pipeline_deinit(pipeline));
+}
+
+/*
+ * source -> pass-through =desc=> sink with the pipeline on a shared arena: relinking recycles the list nodes and
+ * ringbuffers of the previous link, and everything is back in the arena once the pipeline is gone.
+ */
+void audio_pipeline_arena()
+{
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    audio_test_stream_t test = { .total = FUSED_TEST_BYTES };
+    audio_element_handle_t els[3];
+    for (int i = 0; i < 3; i++) {
+        audio_element_cfg_t cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+        cfg.open = _el_open;
+        cfg.close = _el_close;
+        cfg.process = audio_test_copy_process;
+        cfg.read = i == 0 ? audio_test_src_read : NULL;
+        cfg.write = i == 2 ? audio_test_sink_write : NULL;
+        cfg.out_rb_desc = i == 1;
+        cfg.data = &test;
+        els[i] = audio_element_init(&cfg);
+        assert(els[i] != NULL);
+    }
+
+    audio_arena_handle_t arena = audio_arena_create(DEFAULT_PIPELINE_ARENA_SIZE);
+    assert(arena != NULL);
+    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+    pipeline_cfg.arena = arena;
+    audio_pipeline_handle_t pipeline = audio_pipeline_init(&pipeline_cfg);
+    assert(pipeline != NULL);
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[0], "src"));
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[1], "copy"));
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[2], "sink"));
+    assert(audio_element_get_arena(els[2]) == arena);
+    assert(ESP_OK == audio_pipeline_unregister(pipeline, els[2]));
+    assert(audio_element_get_arena(els[2]) == NULL);
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[2], "sink"));
+    assert(audio_element_get_arena(els[2]) == arena);
+
+    const char *link_tag[] = {"src", "copy", "sink"};
+    assert(ESP_OK == audio_pipeline_link(pipeline, link_tag, 3));
+    int reserved = audio_arena_get_reserved(arena);
+    for (int i = 0; i < 100; i++) {
+        assert(ESP_OK == audio_pipeline_unlink(pipeline));
+        assert(ESP_OK == audio_pipeline_link(pipeline, link_tag, 3));
+    }
+    assert(audio_arena_get_reserved(arena) == reserved);
+    assert(rb_is_desc(audio_element_get_output_ringbuf(els[1])));
+
+    assert(ESP_OK == audio_pipeline_run(pipeline));
+    assert(ESP_OK == audio_element_wait_for_stop_ms(els[2], portMAX_DELAY));
+    assert(ESP_OK == audio_pipeline_wait_for_stop(pipeline));
+    assert(test.received == FUSED_TEST_BYTES);
+    assert(test.errors == 0);
+
+    assert(ESP_OK == audio_pipeline_terminate(pipeline));
+    assert(ESP_OK == audio_pipeline_deinit(pipeline));
+    assert(audio_arena_get_used(arena) == 0);
+    assert(ESP_OK == audio_arena_destroy(arena));
+}
+
+#define STATS_TEST_SOCKET   "/tmp/audio_pipeline_test.sock"
+#define STATS_TEST_FILE     "/tmp/audio_pipeline_test.prom"
+
+/* Scrape the socket exporter the way `curl --unix-socket` does */
+static int stats_test_scrape(char *buf, int size)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX, .sun_path = STATS_TEST_SOCKET };
+    static const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    assert(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(write(fd, request, sizeof(request) - 1) == sizeof(request) - 1);
+    int len = 0, n;
+    while ((n = read(fd, buf + len, size - 1 - len)) > 0) {
+        len += n;
+    }
+    close(fd);
+    buf[len] = '\0';
+    return len;
+}
+
+/*
+ * source -> pass-through -> sink with both exporters running: the snapshot counts every byte through both
+ * ringbuffers and elements, and the text served over the socket and in the file is the Prometheus format.
+ */
+/* Registered and linked source -> pass-through -> sink, tagged "src", "copy" and "sink" */
+static audio_pipeline_handle_t stats_test_chain(audio_test_stream_t *test, audio_element_handle_t els[3])
+{
+    for (int i = 0; i < 3; i++) {
+        audio_element_cfg_t cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+        cfg.open = _el_open;
+        cfg.close = _el_close;
+        cfg.process = audio_test_copy_process;
+        cfg.read = i == 0 ? audio_test_src_read : NULL;
+        cfg.write = i == 2 ? audio_test_sink_write : NULL;
+        cfg.data = test;
+        els[i] = audio_element_init(&cfg);
+        assert(els[i] != NULL);
+    }
+    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+    audio_pipeline_handle_t pipeline = audio_pipeline_init(&pipeline_cfg);
+    assert(pipeline != NULL);
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[0], "src"));
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[1], "copy"));
+    assert(ESP_OK == audio_pipeline_register(pipeline, els[2], "sink"));
+    assert(ESP_OK == audio_pipeline_link(pipeline, (const char *[]){"src", "copy", "sink"}, 3));
+    return pipeline;
+}
+
+void audio_pipeline_stats()
+{
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    audio_test_stream_t test = { .total = FUSED_TEST_BYTES };
+    audio_element_handle_t els[3];
+    audio_pipeline_handle_t pipeline = stats_test_chain(&test, els);
+
+    audio_pipeline_exporter_cfg_t exporter_cfg = AUDIO_PIPELINE_EXPORTER_DEFAULT_CFG();
+    exporter_cfg.type = AUDIO_PIPELINE_EXPORT_UNIX_SOCKET;
+    exporter_cfg.path = STATS_TEST_SOCKET;
+    audio_pipeline_exporter_handle_t sock_exporter = audio_pipeline_exporter_start(pipeline, &exporter_cfg);
+    assert(sock_exporter != NULL);
+
+    assert(ESP_OK == audio_pipeline_run(pipeline));
+    assert(ESP_OK == audio_element_wait_for_stop_ms(els[2], portMAX_DELAY));
+    assert(ESP_OK == audio_pipeline_wait_for_stop(pipeline));
+    assert(test.received == FUSED_TEST_BYTES);
+
+    ESP_LOGI(TAG, "[✓] audio_pipeline_get_stats");
+    audio_pipeline_stats_t *stats = audio_pipeline_get_stats(pipeline, true);
+    assert(stats != NULL);
+    assert(stats->el_num == 3 && stats->rb_num == 2);
+    assert(strcmp(stats->els[1].tag, "copy") == 0);
+    assert(stats->els[1].stats.bytes_in == FUSED_TEST_BYTES);
+    assert(stats->els[1].stats.bytes_out == FUSED_TEST_BYTES);
+    assert(stats->els[2].state == audio_element_get_state(els[2]));
+    for (int i = 0; i < 2; i++) {
+        const rb_stats_t *rb = &stats->rbs[i].stats;
+        assert(strcmp(stats->rbs[i].writer, stats->els[i].tag) == 0);
+        assert(strcmp(stats->rbs[i].reader, stats->els[i + 1].tag) == 0);
+        assert(rb->bytes_written == FUSED_TEST_BYTES && rb->bytes_read == FUSED_TEST_BYTES);
+        assert(rb->filled == 0 && rb->fill_min == 0);
+        assert(rb->fill_max > 0 && rb->fill_max <= rb->size);
+        assert(rb->reader_wakeups <= rb->reader_waits && rb->writer_wakeups <= rb->writer_waits);
+    }
+
+    ESP_LOGI(TAG, "[✓] audio_pipeline_stats_to_prometheus");
+    char text[16 * 1024];
+    int len = audio_pipeline_stats_to_prometheus(stats, text, sizeof(text));
+    assert(len > 0 && len < sizeof(text));
+    assert(strstr(text, "# TYPE audio_ringbuf_fill_max_bytes gauge\n"));
+    assert(strstr(text, "audio_ringbuf_read_bytes_total{writer=\"copy\",reader=\"sink\"} 262144\n"));
+    assert(strstr(text, "audio_element_in_bytes_total{element=\"copy\"} 262144\n"));
+    assert(strstr(text, "audio_element_process_latency_seconds_count{element=\"src\"}"));
+    /* Cut like snprintf, same length */
+    assert(audio_pipeline_stats_to_prometheus(stats, text, 100) == len);
+    assert(strlen(text) == 99);
+    audio_pipeline_free_stats(stats);
+
+    ESP_LOGI(TAG, "[✓] audio_pipeline_exporter_start");
+    len = stats_test_scrape(text, sizeof(text));
+    assert(strncmp(text, "HTTP/1.0 200 OK\r\n", 17) == 0);
+    assert(strstr(text, "audio_element_out_bytes_total{element=\"copy\"} 262144\n"));
+    /* The snapshot above restarted the fill range at the empty level */
+    assert(strstr(text, "audio_ringbuf_fill_max_bytes{writer=\"src\",reader=\"copy\"} 0\n"));
+    exporter_cfg.type = AUDIO_PIPELINE_EXPORT_FILE;
+    exporter_cfg.path = STATS_TEST_FILE;
+    exporter_cfg.period_ms = 10;
+    audio_pipeline_exporter_handle_t file_exporter = audio_pipeline_exporter_start(pipeline, &exporter_cfg);
+    assert(file_exporter != NULL);
+    usleep(50000);
+    FILE *file = fopen(STATS_TEST_FILE, "r");
+    assert(file != NULL);
+    len = fread(text, 1, sizeof(text) - 1, file);
+    text[len] = '\0';
+    fclose(file);
+    assert(strstr(text, "audio_ringbuf_written_bytes_total{writer=\"src\",reader=\"copy\"} 262144\n"));
+    assert(ESP_OK == audio_pipeline_exporter_stop(sock_exporter));
+    assert(access(STATS_TEST_SOCKET, F_OK) != 0);
+    assert(ESP_OK == audio_pipeline_exporter_stop(file_exporter));
+    unlink(STATS_TEST_FILE);
+
+    assert(ESP_OK == audio_pipeline_terminate(pipeline));
+    assert(ESP_OK == audio_pipeline_deinit(pipeline));
+}
+
+#define TRACE_TEST_FILE     "/tmp/audio_pipeline_test.json"
+
+/* The saved trace has a track per element task with its process calls, commands and state changes */
+void audio_pipeline_trace()
+{
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    audio_test_stream_t test = { .total = FUSED_TEST_BYTES };
+    audio_element_handle_t els[3];
+    audio_pipeline_handle_t pipeline = stats_test_chain(&test, els);
+
+    ESP_LOGI(TAG, "[✓] audio_trace_start");
+    assert(ESP_OK == audio_trace_start());
+    assert(ESP_OK == audio_pipeline_run(pipeline));
+    assert(ESP_OK == audio_element_wait_for_stop_ms(els[2], portMAX_DELAY));
+    assert(ESP_OK == audio_pipeline_wait_for_stop(pipeline));
+    assert(ESP_OK == audio_trace_stop());
+    assert(test.received == FUSED_TEST_BYTES);
+
+    ESP_LOGI(TAG, "[✓] audio_trace_save");
+    assert(ESP_OK == audio_trace_save(TRACE_TEST_FILE));
+    FILE *file = fopen(TRACE_TEST_FILE, "r");
+    assert(file != NULL);
+    static char text[4 * 1024 * 1024];
+    int len = fread(text, 1, sizeof(text) - 1, file);
+    fclose(file);
+    assert(len > 0 && len < sizeof(text) - 1);
+    text[len] = '\0';
+    assert(strncmp(text, "{\"traceEvents\":[", 15) == 0);
+    assert(strstr(text, "\"name\":\"thread_name\""));
+    assert(strstr(text, "\"name\":\"process\",\"cat\":\"element\""));
+    assert(strstr(text, "\"name\":\"RUNNING\""));
+    assert(strstr(text, "\"name\":\"FINISHED\""));
+    assert(strstr(text, "\"obj\":\"copy\""));
+    /* 256K through the default ringbuffers, a side has to block */
+    assert(strstr(text, "\"name\":\"rb_read_wait\"") || strstr(text, "\"name\":\"rb_write_wait\""));
+    assert(strstr(text, "\"ph\":\"X\",\"dur\":"));
+    assert(audio_trace_get_dropped() == 0);
+    unlink(TRACE_TEST_FILE);
+
+    /* Nothing is recorded once stopped, and a new trace starts empty */
+    assert(ESP_OK == audio_trace_start());
+    assert(ESP_OK == audio_trace_stop());
+    assert(ESP_OK == audio_pipeline_terminate(pipeline));
+    assert(ESP_OK == audio_trace_save(TRACE_TEST_FILE));
+    file = fopen(TRACE_TEST_FILE, "r");
+    assert(file != NULL);
+    len = fread(text, 1, sizeof(text) - 1, file);
+    fclose(file);
+    text[len] = '\0';
+    assert(strstr(text, "\"ph\":\"X\"") == NULL && strstr(text, "\"ph\":\"i\"") == NULL);
+    unlink(TRACE_TEST_FILE);
+
+    assert(ESP_OK == audio_pipeline_deinit(pipeline));
+}
+
+/* 48 kHz stereo 16 bit */
+#define TS_TEST_BYTES_PER_SEC   (192000)
+#define TS_TEST_US(bytes)       ((int64_t)(bytes) * 1000000 / TS_TEST_BYTES_PER_SEC)
+
+static int _ts_src_read(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context)
+{
+    audio_test_stream_t *test = (audio_test_stream_t *)audio_element_getdata(self);
+    int64_t pts = TS_TEST_US(test->sent);
+    int n = audio_test_src_read(self, buffer, len, ticks_to_wait, context);
+    if (n > 0) {
+        audio_element_set_output_timestamp(self, pts, audio_time_now_ns());
+    }
+    return n;
+}
+
+/* Presents the end of every buffer right away, so the media time ends at the duration of the stream */
+static int _ts_sink_write(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context)
+{
+    audio_test_stream_t *test = (audio_test_stream_t *)audio_element_getdata(self);
+    rb_timestamp_t ts;
+    if (audio_element_get_input_timestamp(self, &ts) != ESP_OK) {
+        test->errors++;
+        return audio_test_sink_write(self, buffer, len, ticks_to_wait, context);
+    }
+    /* The stamps land on the bytes the source set them on, each hop rounds to a microsecond */
+    int64_t diff = ts.pts + TS_TEST_US(ts.offset) - TS_TEST_US(test->received);
+    if (diff < -3 || diff > 3) {
+        test->errors++;
+    }
+    audio_element_set_presentation(self, ts.pts + TS_TEST_US(ts.offset + len), ts.origin_ns);
+    return audio_test_sink_write(self, buffer, len, ticks_to_wait, context);
+}
+
+void audio_pipeline_timestamps()
+{
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    audio_test_stream_t test = { .total = FUSED_TEST_BYTES };
+    audio_element_handle_t els[3];
+    audio_pipeline_handle_t pipeline = stats_test_chain(&test, els);
+    assert(ESP_OK == audio_element_set_read_cb(els[0], _ts_src_read, NULL));
+    assert(ESP_OK == audio_element_set_write_cb(els[2], _ts_sink_write, NULL));
+    /* The copy passes the stamps on, moved by the PCM it was into its input */
+    assert(ESP_OK == audio_element_set_music_info(els[1], 48000, 2, 16));
+
+    int64_t media_time_us, latency_us;
+    assert(ESP_ERR_NOT_FOUND == audio_pipeline_get_media_time(pipeline, &media_time_us, &latency_us));
+
+    ESP_LOGI(TAG, "[✓] audio_pipeline_get_media_time");
+    assert(ESP_OK == audio_pipeline_run(pipeline));
+    assert(ESP_OK == audio_element_wait_for_stop_ms(els[2], portMAX_DELAY));
+    assert(ESP_OK == audio_pipeline_wait_for_stop(pipeline));
+    assert(test.received == FUSED_TEST_BYTES);
+    assert(test.errors == 0);
+    assert(ESP_OK == audio_pipeline_get_media_time(pipeline, &media_time_us, &latency_us));
+    /* Stopped, so the media time stays at the last report */
+    int64_t diff = media_time_us - TS_TEST_US(FUSED_TEST_BYTES);
+    assert(diff >= -3 && diff <= 3);
+    assert(latency_us >= 0 && latency_us < 5000000);
+    assert(ESP_OK == audio_pipeline_get_media_time(pipeline, &media_time_us, NULL));
+
+    assert(ESP_OK == audio_pipeline_terminate(pipeline));
+    assert(ESP_OK == audio_pipeline_deinit(pipeline));
+}
+
+/* On the default in-process listener, which has no mqd_t to read the events from */
+void audio_pipeline_listen()
+{
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    audio_test_stream_t test = { .total = FUSED_TEST_BYTES };
+    audio_element_handle_t els[3];
+    audio_pipeline_handle_t pipeline = stats_test_chain(&test, els);
+    audio_event_iface_cfg_t evt_cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
+    audio_event_iface_handle_t listener = audio_event_iface_init(&evt_cfg);
+    assert(listener != NULL);
+    assert(ESP_OK == audio_pipeline_set_listener(pipeline, listener));
+    audio_element_cfg_t cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+    audio_element_handle_t extra = audio_element_init(&cfg);
+    assert(extra != NULL);
+
+    ESP_LOGI(TAG, "[✓] audio_pipeline_listen_more drops the pending events and listens to the extra element");
+    assert(ESP_OK == audio_pipeline_run(pipeline));
+    assert(ESP_OK == audio_pipeline_wait_for_stop(pipeline));
+    audio_event_iface_msg_t msg;
+    assert(audio_event_iface_listen_batch(listener, &msg, 1) == 1);
+    assert(ESP_OK == audio_pipeline_listen_more(pipeline, els[0], extra, NULL));
+    assert(audio_event_iface_listen_batch(listener, &msg, 1) == 0);
+    assert(ESP_OK == audio_element_report_status(extra, AEL_STATUS_STATE_PAUSED));
+    assert(audio_event_iface_listen_batch(listener, &msg, 1) == 1);
+    assert(msg.source == (void *)extra);
+
+    assert(ESP_OK == audio_element_msg_remove_listener(extra, listener));
+    assert(ESP_OK == audio_element_deinit(extra));
+    assert(ESP_OK == audio_pipeline_terminate(pipeline));
+    assert(ESP_OK == audio_pipeline_remove_listener(pipeline));
+    assert(ESP_OK == audio_pipeline_deinit(pipeline));
+    assert(ESP_OK == audio_event_iface_destroy(listener));
+}
+
 void audio_pipeline_test()
 {
     esp_log_level_set("*", ESP_LOG_INFO);
@@ -114,4 +605,11 @@ void audio_pipeline_test()
     // assert(ESP_OK == audio_element_deinit(mid_el));
     // assert(ESP_OK == audio_element_deinit(last_el));
 
+    audio_pipeline_fused();
+    audio_pipeline_desc();
+    audio_pipeline_arena();
+    audio_pipeline_stats();
+    audio_pipeline_trace();
+    audio_pipeline_timestamps();
+    audio_pipeline_listen();
 }
@@ -5,10 +5,31 @@
  * Included Files
  ****************************************************************************/
 #include <assert.h>
+#include "audio_element.h"
 #define STACKSIZE 8192
 
 #define TEST_ASSERT_NOT_NULL(pointer)  assert((pointer) != NULL)
 #define TEST_ASSERT_EQUAL(left, right)  assert((left) == (right))
+/* A counted byte stream through a chain of elements, set as the `data` of its source and sink */
+typedef struct {
+    int total;      /* Bytes the source produces */
+    int sent;
+    int received;
+    int errors;     /* Bytes that reached the sink changed */
+} audio_test_stream_t;
+
+/* Read callback of a source producing `total` bytes of a known pattern */
+int audio_test_src_read(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context);
+
+/* Process callback passing its input through unchanged */
+int audio_test_copy_process(audio_element_handle_t self, char *in_buffer, int in_len);
+
+/* Write callback of a sink counting the bytes and checking them against the pattern */
+int audio_test_sink_write(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context);
+
+/* Threads of the process, to tell which elements got a task of their own */
+int audio_test_thread_count(void);
+
 // Add test function declaration
 
 void audio_mem_test(void);
@@ -19,8 +40,12 @@ void audio_event_iface_test(void);
 
 void audio_mutex_test(void);
 
+void audio_log_test(void);
+
 void audio_thread_test(void);
 
+void ringbuf_test(void);
+
 void audio_element_test(void);
 
 void audio_pipeline_test(void);
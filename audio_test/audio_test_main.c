@@ -92,6 +92,16 @@ int main(){
   // // audio_mutex_test();
   // // check_test_memory_usage();
 
+  // /* Checkout log_async.c */
+  // printf("\n--------------------------audio_test_main:  audio_log_test() test --------------------------\n");
+  // audio_log_test();
+  // check_test_memory_usage();
+
+  // /* Checkout ringbuf.c */
+  // printf("\n--------------------------audio_test_main:  ringbuf_test() test --------------------------\n");
+  // ringbuf_test();
+  // check_test_memory_usage();
+
   // /* Checkout audio_mutex_test.c */
   // printf("\n--------------------------audio_test_main:  audio_element_test() test --------------------------\n");
   // audio_element_test();
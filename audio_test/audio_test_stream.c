@@ -0,0 +1,78 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <dirent.h>
+#include "audio_element.h"
+#include "audio_test.h"
+
+/* The byte at offset `pos` of a test stream */
+#define TEST_STREAM_BYTE(pos)   ((char)((pos) * 7))
+
+int audio_test_src_read(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context)
+{
+    audio_test_stream_t *stream = (audio_test_stream_t *)audio_element_getdata(self);
+    int n = stream->total - stream->sent;
+    if (n == 0) {
+        return AEL_IO_DONE;
+    }
+    n = n < len ? n : len;
+    for (int i = 0; i < n; i++) {
+        buffer[i] = TEST_STREAM_BYTE(stream->sent + i);
+    }
+    stream->sent += n;
+    return n;
+}
+
+int audio_test_copy_process(audio_element_handle_t self, char *in_buffer, int in_len)
+{
+    int r_size = audio_element_input(self, in_buffer, in_len);
+    if (r_size <= 0) {
+        return r_size;
+    }
+    return audio_element_output(self, in_buffer, r_size);
+}
+
+int audio_test_sink_write(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context)
+{
+    audio_test_stream_t *stream = (audio_test_stream_t *)audio_element_getdata(self);
+    for (int i = 0; i < len; i++) {
+        if (buffer[i] != TEST_STREAM_BYTE(stream->received + i)) {
+            stream->errors++;
+        }
+    }
+    stream->received += len;
+    return len;
+}
+
+int audio_test_thread_count(void)
+{
+    int count = 0;
+    DIR *dir = opendir("/proc/self/task");
+    assert(dir);
+    while (readdir(dir)) {
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
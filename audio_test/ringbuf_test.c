@@ -0,0 +1,568 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "ringbuf.h"
+#include "audio_time.h"
+#include "esp_log.h"
+#include "esp_err.h"
+
+#include "audio_test.h"
+
+static const char *TAG = "RINGBUF_TEST";
+
+#define RB_TEST_TOTAL_BYTES     (1024 * 1024)
+#define RB_TEST_CHUNK_SIZE      (1000)
+
+static void *_rb_producer(void *arg)
+{
+    ringbuf_handle_t rb = (ringbuf_handle_t)arg;
+    char chunk[RB_TEST_CHUNK_SIZE];
+    int sent = 0;
+
+    while (sent < RB_TEST_TOTAL_BYTES) {
+        int len = RB_TEST_TOTAL_BYTES - sent < RB_TEST_CHUNK_SIZE ? RB_TEST_TOTAL_BYTES - sent : RB_TEST_CHUNK_SIZE;
+        for (int i = 0; i < len; i++) {
+            chunk[i] = (char)(sent + i);
+        }
+        int ret = rb_write(rb, chunk, len, portMAX_DELAY);
+        assert(ret == len);
+        sent += ret;
+    }
+    rb_done_write(rb);
+    return NULL;
+}
+
+static void ringbuf_stream(ringbuf_handle_t rb)
+{
+    pthread_t producer;
+    char buf[777];
+    int received = 0;
+    int ret;
+
+    assert(pthread_create(&producer, NULL, _rb_producer, rb) == 0);
+    while ((ret = rb_read(rb, buf, sizeof(buf), portMAX_DELAY)) > 0) {
+        for (int i = 0; i < ret; i++) {
+            assert(buf[i] == (char)(received + i));
+        }
+        received += ret;
+    }
+    TEST_ASSERT_EQUAL(ret, RB_DONE);
+    TEST_ASSERT_EQUAL(received, RB_TEST_TOTAL_BYTES);
+    pthread_join(producer, NULL);
+}
+
+static void *_rb_aborter(void *arg)
+{
+    usleep(100000);
+    rb_abort((ringbuf_handle_t)arg);
+    return NULL;
+}
+
+static void ringbuf_states(ringbuf_handle_t rb)
+{
+    pthread_t aborter;
+    char buf[16] = {0};
+
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, sizeof(buf), 0), RB_TIMEOUT);
+    int64_t start = audio_time_now_ns();
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, sizeof(buf), pdMS_TO_TICKS(50)), RB_TIMEOUT);
+    int64_t waited = audio_time_now_ns() - start;
+    assert(waited >= 50 * 1000000LL && waited < 500 * 1000000LL);
+    char *fill = calloc(1, rb_get_size(rb));
+    TEST_ASSERT_NOT_NULL(fill);
+    TEST_ASSERT_EQUAL(rb_write(rb, fill, rb_get_size(rb), 0), rb_get_size(rb));
+    free(fill);
+    TEST_ASSERT_EQUAL(rb_bytes_available(rb), 0);
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, sizeof(buf), 0), RB_TIMEOUT);
+
+    assert(pthread_create(&aborter, NULL, _rb_aborter, rb) == 0);
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, sizeof(buf), portMAX_DELAY), RB_ABORT);
+    pthread_join(aborter, NULL);
+
+    TEST_ASSERT_EQUAL(rb_reset(rb), ESP_OK);
+    TEST_ASSERT_EQUAL(rb_bytes_filled(rb), 0);
+    rb_unblock_reader(rb);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, sizeof(buf), portMAX_DELAY), RB_TIMEOUT);
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, 6, 0), 6);
+    rb_done_write(rb);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, sizeof(buf), portMAX_DELAY), 6);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, sizeof(buf), portMAX_DELAY), RB_DONE);
+}
+
+static void ringbuf_zero_copy(ringbuf_handle_t rb)
+{
+    char *span = NULL;
+    char buf[16];
+
+    /* Fill to 1000 bytes and drain, so the next acquire starts close to the end of the buffer */
+    TEST_ASSERT_EQUAL(rb_acquire_write(rb, &span, 1000, 0), 1000);
+    memset(span, 0x5a, 1000);
+    TEST_ASSERT_EQUAL(rb_commit_write(rb, 1000), ESP_OK);
+    TEST_ASSERT_EQUAL(rb_bytes_filled(rb), 1000);
+    TEST_ASSERT_EQUAL(rb_peek_read(rb, &span, 4096, 0), 1000);
+    TEST_ASSERT_EQUAL(span[999], 0x5a);
+    TEST_ASSERT_EQUAL(rb_consume(rb, 1001), ESP_FAIL);
+    TEST_ASSERT_EQUAL(rb_consume(rb, 1000), ESP_OK);
+    TEST_ASSERT_EQUAL(rb_peek_read(rb, &span, 16, 0), RB_TIMEOUT);
+
+    /* The writable span stops at the end of the buffer, the rest is available after the wrap */
+    TEST_ASSERT_EQUAL(rb_acquire_write(rb, &span, 64, 0), 24);
+    memcpy(span, "0123456789abcdefghijklmn", 24);
+    TEST_ASSERT_EQUAL(rb_commit_write(rb, 24), ESP_OK);
+    TEST_ASSERT_EQUAL(rb_write(rb, "opqrstuv", 8, 0), 8);
+    TEST_ASSERT_EQUAL(rb_peek_read(rb, &span, 64, 0), 24);
+    TEST_ASSERT_EQUAL(rb_consume(rb, 20), ESP_OK);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, 12, 0), 12);
+    TEST_ASSERT_EQUAL(memcmp(buf, "klmnopqrstuv", 12), 0);
+
+    rb_done_write(rb);
+    TEST_ASSERT_EQUAL(rb_peek_read(rb, &span, 16, portMAX_DELAY), RB_DONE);
+    TEST_ASSERT_EQUAL(span, NULL);
+}
+
+static void ringbuf_mirrored(void)
+{
+    ringbuf_handle_t rb = rb_create_mirrored(1000, 1);
+    char *span = NULL;
+    char buf[200];
+    int size;
+
+    TEST_ASSERT_NOT_NULL(rb);
+    TEST_ASSERT_EQUAL(rb_is_mirrored(rb), true);
+    size = rb_get_size(rb);
+    TEST_ASSERT_EQUAL(size % sysconf(_SC_PAGESIZE), 0);
+
+    /* Move the read position 100 bytes before the end, then write across the wrap */
+    TEST_ASSERT_EQUAL(rb_acquire_write(rb, &span, size - 100, 0), size - 100);
+    TEST_ASSERT_EQUAL(rb_commit_write(rb, size - 100), ESP_OK);
+    TEST_ASSERT_EQUAL(rb_read(rb, NULL, size - 100, 0), size - 100);
+    for (int i = 0; i < sizeof(buf); i++) {
+        buf[i] = (char)i;
+    }
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, sizeof(buf), 0), sizeof(buf));
+
+    /* The whole record is one span, although half of it sits at the start of the buffer */
+    TEST_ASSERT_EQUAL(rb_peek_read(rb, &span, sizeof(buf), 0), sizeof(buf));
+    TEST_ASSERT_EQUAL(memcmp(span, buf, sizeof(buf)), 0);
+    TEST_ASSERT_EQUAL(rb_consume(rb, sizeof(buf)), ESP_OK);
+    TEST_ASSERT_EQUAL(rb_bytes_filled(rb), 0);
+    rb_destroy(rb);
+}
+
+static void ringbuf_packet(void)
+{
+    ringbuf_handle_t rb = rb_create_packet(256, 1);
+    rb_packet_info_t info = {
+        .flags = RB_PACKET_FLAG_FORMAT_CHANGE,
+        .timestamp = 1234567890123LL,
+    };
+    char buf[128];
+    char *span = NULL;
+
+    TEST_ASSERT_NOT_NULL(rb);
+    TEST_ASSERT_EQUAL(rb_is_packet(rb), true);
+    TEST_ASSERT_EQUAL(rb_write_packet(rb, "abcdefg", 7, &info, 0), 7);
+    TEST_ASSERT_EQUAL(rb_write(rb, "hi", 2, 0), 2);
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, 256, 0), RB_FAIL);
+    TEST_ASSERT_EQUAL(rb_peek_read(rb, &span, 16, 0), RB_FAIL);
+
+    /* Records come back whole and one at a time, even when the buffer is larger, and without rounding */
+    memset(&info, 0, sizeof(info));
+    TEST_ASSERT_EQUAL(rb_read_packet(rb, buf, sizeof(buf), &info, 0), 7);
+    TEST_ASSERT_EQUAL(memcmp(buf, "abcdefg", 7), 0);
+    TEST_ASSERT_EQUAL(info.flags, RB_PACKET_FLAG_FORMAT_CHANGE);
+    TEST_ASSERT_EQUAL(info.timestamp, 1234567890123LL);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, 1, 0), RB_FAIL);
+    /* A record too long for the buffer stays, with its length in info */
+    TEST_ASSERT_EQUAL(rb_read_packet(rb, buf, 1, &info, 0), RB_FAIL);
+    TEST_ASSERT_EQUAL(info.len, 2);
+    TEST_ASSERT_EQUAL(rb_read_packet(rb, buf, info.len, &info, 0), 2);
+    TEST_ASSERT_EQUAL(info.len, 2);
+    TEST_ASSERT_EQUAL(info.flags, 0);
+    TEST_ASSERT_EQUAL(rb_write(rb, "xyz", 3, 0), 3);
+    TEST_ASSERT_EQUAL(rb_read_packet(rb, NULL, 0, NULL, 0), 3);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, sizeof(buf), 0), RB_TIMEOUT);
+
+    /* Records wrap around the end of the buffer */
+    for (int i = 0; i < 20; i++) {
+        memset(buf, i, 100);
+        info.timestamp = i;
+        TEST_ASSERT_EQUAL(rb_write_packet(rb, buf, 100, &info, 0), 100);
+        TEST_ASSERT_EQUAL(rb_read_packet(rb, buf, sizeof(buf), &info, 0), 100);
+        TEST_ASSERT_EQUAL(buf[99], i);
+        TEST_ASSERT_EQUAL(info.timestamp, i);
+    }
+    rb_done_write(rb);
+    TEST_ASSERT_EQUAL(rb_read_packet(rb, buf, sizeof(buf), NULL, portMAX_DELAY), RB_DONE);
+    rb_destroy(rb);
+}
+
+static void ringbuf_watermark(ringbuf_handle_t rb)
+{
+    char *buf = audio_calloc(1, rb_get_size(rb));
+    TEST_ASSERT_NOT_NULL(buf);
+
+    TEST_ASSERT_EQUAL(rb_set_watermark(rb, 600, 600), ESP_ERR_INVALID_ARG);
+    TEST_ASSERT_EQUAL(rb_set_watermark(rb, 256, 512), ESP_OK);
+
+    /* The reader takes nothing until the wanted size or the high watermark is there */
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, 100, 0), 100);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, 1000, 0), RB_TIMEOUT);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, 64, 0), 64);
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, 476, 0), 476);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, 1000, 0), 512);
+
+    /* The writer puts nothing until the size to write or the low watermark is free */
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, 1024, 0), 1024);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, 100, 0), 100);
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, 200, 0), RB_TIMEOUT);
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, 100, 0), 100);
+    audio_free(buf);
+
+    /* Same stream as without watermarks, only with fewer wakeups */
+    rb_reset(rb);
+    ringbuf_stream(rb);
+    rb_reset(rb);
+    rb_set_watermark(rb, 0, 0);
+}
+
+static void ringbuf_timestamps(ringbuf_handle_t rb)
+{
+    char buf[256];
+    char *span;
+    rb_timestamp_t ts;
+
+    TEST_ASSERT_EQUAL(rb_get_timestamp(rb, &ts), ESP_ERR_NOT_FOUND);
+
+    /* A stamp holds up to the next one, the offset counts from the stamped byte */
+    TEST_ASSERT_EQUAL(rb_set_timestamp(rb, 1000, 5), ESP_OK);
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, 100, 0), 100);
+    TEST_ASSERT_EQUAL(rb_set_timestamp(rb, 2000, 6), ESP_OK);
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, 100, 0), 100);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, 60, 0), 60);
+    TEST_ASSERT_EQUAL(rb_get_timestamp(rb, &ts), ESP_OK);
+    TEST_ASSERT_EQUAL(ts.pts, 1000);
+    TEST_ASSERT_EQUAL(ts.origin_ns, 5);
+    TEST_ASSERT_EQUAL(ts.offset, 0);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, 60, 0), 60);
+    TEST_ASSERT_EQUAL(rb_get_timestamp(rb, &ts), ESP_OK);
+    TEST_ASSERT_EQUAL(ts.pts, 1000);
+    TEST_ASSERT_EQUAL(ts.offset, 60);
+    TEST_ASSERT_EQUAL(rb_peek_read(rb, &span, 4, 0), 4);
+    TEST_ASSERT_EQUAL(rb_get_timestamp(rb, &ts), ESP_OK);
+    TEST_ASSERT_EQUAL(ts.pts, 2000);
+    TEST_ASSERT_EQUAL(ts.origin_ns, 6);
+    TEST_ASSERT_EQUAL(ts.offset, 20);
+    TEST_ASSERT_EQUAL(rb_consume(rb, 80), ESP_OK);
+    TEST_ASSERT_EQUAL(rb_get_timestamp(rb, &ts), ESP_OK);
+    TEST_ASSERT_EQUAL(ts.offset, 20);
+
+    /* A reader more stamps behind than are kept gets the last one it found, with a larger offset */
+    for (int i = 0; i < 20; i++) {
+        TEST_ASSERT_EQUAL(rb_set_timestamp(rb, 3000 + i, 0), ESP_OK);
+        TEST_ASSERT_EQUAL(rb_write(rb, buf, 4, 0), 4);
+    }
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, 4, 0), 4);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, 16, 0), 16);
+    TEST_ASSERT_EQUAL(rb_get_timestamp(rb, &ts), ESP_OK);
+    TEST_ASSERT_EQUAL(ts.pts, 2000);
+    TEST_ASSERT_EQUAL(ts.offset, 104);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, 4, 0), 4);
+    TEST_ASSERT_EQUAL(rb_get_timestamp(rb, &ts), ESP_OK);
+    TEST_ASSERT_EQUAL(ts.pts, 3005);
+    TEST_ASSERT_EQUAL(ts.offset, 0);
+
+    rb_reset(rb);
+    TEST_ASSERT_EQUAL(rb_get_timestamp(rb, &ts), ESP_ERR_NOT_FOUND);
+}
+
+static void *_rb_broadcast_reader(void *arg)
+{
+    ringbuf_handle_t rb = (ringbuf_handle_t)arg;
+    char buf[555];
+    int received = 0;
+    int ret;
+
+    while ((ret = rb_read(rb, buf, sizeof(buf), portMAX_DELAY)) > 0) {
+        for (int i = 0; i < ret; i++) {
+            assert(buf[i] == (char)(received + i));
+        }
+        received += ret;
+    }
+    TEST_ASSERT_EQUAL(ret, RB_DONE);
+    TEST_ASSERT_EQUAL(received, RB_TEST_TOTAL_BYTES);
+    return NULL;
+}
+
+static void ringbuf_broadcast(void)
+{
+    pthread_t producer;
+    pthread_t readers[3];
+    char buf[1024];
+    char *span;
+    rb_timestamp_t ts;
+
+    ringbuf_handle_t rb = rb_create_broadcast(1000, 1, 3, RB_BROADCAST_BLOCK);
+    TEST_ASSERT_NOT_NULL(rb);
+    TEST_ASSERT_EQUAL(rb_get_size(rb), 1024);
+    TEST_ASSERT_EQUAL(rb_broadcast_get_reader(rb, 3), NULL);
+    for (int i = 0; i < 3; i++) {
+        assert(pthread_create(&readers[i], NULL, _rb_broadcast_reader, rb_broadcast_get_reader(rb, i)) == 0);
+    }
+    assert(pthread_create(&producer, NULL, _rb_producer, rb) == 0);
+    pthread_join(producer, NULL);
+    for (int i = 0; i < 3; i++) {
+        pthread_join(readers[i], NULL);
+    }
+
+    /* The writer waits for the slowest reader, an aborted reader no longer counts */
+    rb_reset(rb);
+    ringbuf_handle_t fast = rb_broadcast_get_reader(rb, 0);
+    ringbuf_handle_t slow = rb_broadcast_get_reader(rb, 1);
+    rb_abort(rb_broadcast_get_reader(rb, 2));
+    memset(buf, 0x5a, sizeof(buf));
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, sizeof(buf), 0), sizeof(buf));
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, 4, 0), RB_TIMEOUT);
+    TEST_ASSERT_EQUAL(rb_read(fast, buf, 512, 0), 512);
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, 4, 0), RB_TIMEOUT);
+    TEST_ASSERT_EQUAL(rb_read(slow, buf, 512, 0), 512);
+    TEST_ASSERT_EQUAL(rb_bytes_filled(rb), 512);
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, 512, 0), 512);
+    TEST_ASSERT_EQUAL(rb_bytes_filled(fast), 1024);
+    TEST_ASSERT_EQUAL(rb_read(rb_broadcast_get_reader(rb, 2), buf, 4, 0), RB_ABORT);
+    TEST_ASSERT_EQUAL(rb_peek_read(fast, &span, 4, 0), RB_FAIL);
+    rb_done_write(rb);
+    TEST_ASSERT_EQUAL(rb_read(slow, buf, sizeof(buf), 0), sizeof(buf));
+    TEST_ASSERT_EQUAL(rb_read(slow, buf, sizeof(buf), 0), RB_DONE);
+    rb_destroy(rb);
+
+    /* Drop-oldest keeps the writer going and skips the lagging reader to the newest data */
+    rb = rb_create_broadcast(1024, 1, 2, RB_BROADCAST_DROP_OLDEST);
+    TEST_ASSERT_NOT_NULL(rb);
+    fast = rb_broadcast_get_reader(rb, 0);
+    slow = rb_broadcast_get_reader(rb, 1);
+    TEST_ASSERT_EQUAL(rb_set_timestamp(fast, 0, 0), ESP_ERR_INVALID_ARG);
+    for (int n = 0; n < 4; n++) {
+        for (int i = 0; i < 512; i++) {
+            buf[i] = (char)(n * 512 + i);
+        }
+        TEST_ASSERT_EQUAL(rb_set_timestamp(rb, n * 1000, 0), ESP_OK);
+        TEST_ASSERT_EQUAL(rb_write(rb, buf, 512, 0), 512);
+        TEST_ASSERT_EQUAL(rb_read(fast, buf, 512, 0), 512);
+        TEST_ASSERT_EQUAL(buf[511], (char)(n * 512 + 511));
+    }
+    TEST_ASSERT_EQUAL(rb_broadcast_get_dropped(fast), 0);
+    TEST_ASSERT_EQUAL(rb_broadcast_get_dropped(slow), 1024);
+    TEST_ASSERT_EQUAL(rb_read(slow, buf, 1024, 0), 1024);
+    TEST_ASSERT_EQUAL(buf[0], (char)1024);
+    /* The stamps follow the dropped bytes */
+    TEST_ASSERT_EQUAL(rb_get_timestamp(slow, &ts), ESP_OK);
+    TEST_ASSERT_EQUAL(ts.pts, 2000);
+    TEST_ASSERT_EQUAL(ts.offset, 0);
+    TEST_ASSERT_EQUAL(rb_broadcast_get_dropped(rb), ESP_FAIL);
+    rb_destroy(rb);
+}
+
+static void *_rb_buf_releaser(void *arg)
+{
+    usleep(100000);
+    audio_buf_unref((audio_buf_t *)arg);
+    return NULL;
+}
+
+static void _rb_count_notify(ringbuf_handle_t rb, void *ctx)
+{
+    (*(int *)ctx)++;
+}
+
+static void ringbuf_desc(void)
+{
+    audio_buf_pool_handle_t pool = audio_buf_pool_create(256, 4);
+    TEST_ASSERT_NOT_NULL(pool);
+    ringbuf_handle_t rb = rb_create_desc(pool, 2);
+    TEST_ASSERT_NOT_NULL(rb);
+    /* The ring keeps its own reference, the pool stays alive */
+    audio_buf_pool_destroy(pool);
+    TEST_ASSERT_EQUAL(rb_is_desc(rb), true);
+    TEST_ASSERT_EQUAL(rb_get_size(rb), 512);
+
+    /* Buffers are handed over by pointer, with their metadata */
+    audio_buf_t *out = NULL;
+    audio_buf_t *in = NULL;
+    TEST_ASSERT_EQUAL(rb_alloc_buf(rb, &out, 0), 256);
+    memcpy(out->data, "abcdefgh", 8);
+    out->len = 8;
+    out->timestamp = 1234567890123LL;
+    out->flags = AUDIO_BUF_FLAG_DISCONTINUITY;
+    out->fmt.sample_rates = 48000;
+    TEST_ASSERT_EQUAL(rb_write_buf(rb, out, 0), 8);
+    TEST_ASSERT_EQUAL(rb_bytes_filled(rb), 8);
+    TEST_ASSERT_EQUAL(rb_read_buf(rb, &in, 0), 8);
+    TEST_ASSERT_EQUAL(in, out);
+    TEST_ASSERT_EQUAL(in->timestamp, 1234567890123LL);
+    TEST_ASSERT_EQUAL(in->flags, AUDIO_BUF_FLAG_DISCONTINUITY);
+    TEST_ASSERT_EQUAL(in->fmt.sample_rates, 48000);
+    TEST_ASSERT_EQUAL(rb_bytes_filled(rb), 0);
+    TEST_ASSERT_EQUAL(audio_buf_pool_get_free(pool), 3);
+    TEST_ASSERT_EQUAL(audio_buf_get_refs(audio_buf_ref(in)), 2);
+    audio_buf_unref(in);
+    TEST_ASSERT_EQUAL(audio_buf_pool_get_free(pool), 3);
+    audio_buf_unref(in);
+    TEST_ASSERT_EQUAL(audio_buf_pool_get_free(pool), 4);
+    TEST_ASSERT_EQUAL(rb_read_buf(rb, &in, 0), RB_TIMEOUT);
+
+    /* Byte shim: writes are split into pool buffers, peek hands out the rest of the current one */
+    char buf[300];
+    char *span = NULL;
+    for (int i = 0; i < sizeof(buf); i++) {
+        buf[i] = (char)i;
+    }
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, 300, 0), 300);
+    TEST_ASSERT_EQUAL(rb_bytes_filled(rb), 300);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, 100, 0), 100);
+    TEST_ASSERT_EQUAL(buf[99], 99);
+    TEST_ASSERT_EQUAL(rb_peek_read(rb, &span, 300, 0), 156);
+    TEST_ASSERT_EQUAL(span[0], 100);
+    TEST_ASSERT_EQUAL(rb_consume(rb, 157), ESP_FAIL);
+    TEST_ASSERT_EQUAL(rb_consume(rb, 56), ESP_OK);
+    TEST_ASSERT_EQUAL(rb_bytes_filled(rb), 144);
+    /* What the shim left of a buffer comes out of rb_read_buf */
+    TEST_ASSERT_EQUAL(rb_read_buf(rb, &in, 0), 100);
+    TEST_ASSERT_EQUAL(in->data[in->offset], (char)156);
+    audio_buf_unref(in);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, 44, 0), 44);
+    TEST_ASSERT_EQUAL(buf[43], (char)299);
+    TEST_ASSERT_EQUAL(audio_buf_pool_get_free(pool), 4);
+
+    /* Acquire hands out a whole buffer, commit queues it */
+    TEST_ASSERT_EQUAL(rb_acquire_write(rb, &span, 1000, 0), 256);
+    memset(span, 0x5a, 16);
+    TEST_ASSERT_EQUAL(rb_commit_write(rb, 16), ESP_OK);
+    TEST_ASSERT_EQUAL(rb_read(rb, buf, 16, 0), 16);
+    TEST_ASSERT_EQUAL(buf[15], 0x5a);
+
+    /* A writer waiting for a buffer is woken up when one goes back to the pool */
+    audio_buf_t *held[4];
+    pthread_t releaser;
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL(rb_alloc_buf(rb, &held[i], 0), 256);
+    }
+    TEST_ASSERT_EQUAL(rb_write_ready(rb, 1), false);
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, 1, 0), RB_TIMEOUT);
+    assert(pthread_create(&releaser, NULL, _rb_buf_releaser, held[0]) == 0);
+    TEST_ASSERT_EQUAL(rb_write(rb, buf, 1, portMAX_DELAY), 1);
+    pthread_join(releaser, NULL);
+    for (int i = 1; i < 4; i++) {
+        audio_buf_unref(held[i]);
+    }
+    TEST_ASSERT_EQUAL(rb_reset(rb), ESP_OK);
+    TEST_ASSERT_EQUAL(audio_buf_pool_get_free(pool), 4);
+
+    /* Rings sharing a pool are each told when a buffer goes back, until they are destroyed */
+    ringbuf_handle_t rb2 = rb_create_desc(rb_desc_get_pool(rb), 2);
+    TEST_ASSERT_NOT_NULL(rb2);
+    int woken = 0, woken2 = 0;
+    TEST_ASSERT_EQUAL(rb_set_writer_notify(rb, _rb_count_notify, &woken), ESP_OK);
+    TEST_ASSERT_EQUAL(rb_set_writer_notify(rb2, _rb_count_notify, &woken2), ESP_OK);
+    TEST_ASSERT_EQUAL(rb_alloc_buf(rb2, &out, 0), 256);
+    audio_buf_unref(out);
+    TEST_ASSERT_EQUAL(woken, 1);
+    TEST_ASSERT_EQUAL(woken2, 1);
+    rb_destroy(rb2);
+    TEST_ASSERT_EQUAL(rb_alloc_buf(rb, &out, 0), 256);
+    audio_buf_unref(out);
+    TEST_ASSERT_EQUAL(woken, 2);
+    TEST_ASSERT_EQUAL(woken2, 1);
+    TEST_ASSERT_EQUAL(rb_set_writer_notify(rb, NULL, NULL), ESP_OK);
+
+    /* A buffer in flight outlives the ring and its pool */
+    TEST_ASSERT_EQUAL(rb_alloc_buf(rb, &out, 0), 256);
+    rb_destroy(rb);
+    memset(out->data, 0, out->size);
+    audio_buf_unref(out);
+}
+
+void ringbuf_test(void)
+{
+    ringbuf_handle_t rb;
+
+    ESP_LOGI(TAG, "[✓] rb_create ringbuffer");
+    rb = rb_create(1024, 1);
+    TEST_ASSERT_NOT_NULL(rb);
+    ringbuf_stream(rb);
+    rb_reset(rb);
+    ringbuf_states(rb);
+    rb_reset(rb);
+    ringbuf_zero_copy(rb);
+    rb_reset(rb);
+    ringbuf_watermark(rb);
+    rb_reset(rb);
+    ringbuf_timestamps(rb);
+    rb_destroy(rb);
+
+    ESP_LOGI(TAG, "[✓] rb_create_spsc ringbuffer");
+    rb = rb_create_spsc(1024, 1);
+    TEST_ASSERT_NOT_NULL(rb);
+    ringbuf_stream(rb);
+    rb_reset(rb);
+    ringbuf_states(rb);
+    rb_reset(rb);
+    ringbuf_zero_copy(rb);
+    rb_reset(rb);
+    ringbuf_watermark(rb);
+    rb_reset(rb);
+    ringbuf_timestamps(rb);
+    rb_destroy(rb);
+
+    ESP_LOGI(TAG, "[✓] rb_create_mirrored ringbuffer");
+    rb = rb_create_mirrored(1024, 1);
+    TEST_ASSERT_NOT_NULL(rb);
+    ringbuf_stream(rb);
+    rb_reset(rb);
+    ringbuf_states(rb);
+    rb_destroy(rb);
+    ringbuf_mirrored();
+
+    ESP_LOGI(TAG, "[✓] rb_create_packet ringbuffer");
+    ringbuf_packet();
+
+    ESP_LOGI(TAG, "[✓] rb_create_broadcast ringbuffer");
+    ringbuf_broadcast();
+
+    ESP_LOGI(TAG, "[✓] rb_create_desc ringbuffer");
+    audio_buf_pool_handle_t pool = audio_buf_pool_create(128, 10);
+    TEST_ASSERT_NOT_NULL(pool);
+    rb = rb_create_desc(pool, 8);
+    audio_buf_pool_destroy(pool);
+    TEST_ASSERT_NOT_NULL(rb);
+    ringbuf_stream(rb);
+    rb_reset(rb);
+    ringbuf_states(rb);
+    rb_destroy(rb);
+    ringbuf_desc();
+}
@@ -0,0 +1,237 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "esp_log.h"
+#include "audio_mem.h"
+#include "audio_arena.h"
+#include "audio_error.h"
+#include "audio_mpsc_queue.h"
+#include "audio_buf.h"
+
+static const char *TAG = "AUDIO_BUF";
+
+typedef struct {
+    audio_buf_t                 buf;            /* Must stay first, the public pointer is the item pointer */
+    atomic_int                  refs;
+    audio_buf_pool_handle_t     pool;
+} audio_buf_item_t;
+
+struct audio_buf_pool {
+    audio_buf_item_t            *items;
+    char                        *mem;
+    int                         buf_size;
+    int                         n_bufs;
+    audio_mpsc_queue_handle_t   free_list;      /* Pointers to the free items */
+    atomic_int                  refs;           /* Handle references plus buffers in use */
+    pthread_mutex_t             waiter_lock;    /* Held while the waiters are called, see audio_buf_pool_remove_waiter */
+    audio_buf_pool_waiter_t     *waiters;
+    atomic_int                  waiter_num;     /* Lets a release skip the lock while there is nobody to call */
+};
+
+static void audio_buf_pool_free(audio_buf_pool_handle_t pool)
+{
+    pthread_mutex_destroy(&pool->waiter_lock);
+    if (pool->free_list) {
+        audio_mpsc_queue_destroy(pool->free_list);
+    }
+    audio_arena_free(pool->mem);
+    audio_arena_free(pool->items);
+    audio_arena_free(pool);
+}
+
+static void audio_buf_pool_unref(audio_buf_pool_handle_t pool)
+{
+    if (atomic_fetch_sub_explicit(&pool->refs, 1, memory_order_acq_rel) == 1) {
+        audio_buf_pool_free(pool);
+    }
+}
+
+audio_buf_pool_handle_t audio_buf_pool_create_in(audio_arena_handle_t arena, int buf_size, int n_bufs)
+{
+    if (buf_size <= 0 || n_bufs <= 0) {
+        ESP_LOGE(TAG, "Invalid pool %d x %d", n_bufs, buf_size);
+        return NULL;
+    }
+    audio_buf_pool_handle_t pool = audio_arena_calloc(arena, 1, sizeof(struct audio_buf_pool));
+    AUDIO_MEM_CHECK(TAG, pool, return NULL);
+    pthread_mutex_init(&pool->waiter_lock, NULL);
+
+    /* Non blocking, so that a wait of 0 in audio_buf_alloc tries once */
+    bool _success = (
+                        (pool->items        = audio_arena_calloc(arena, n_bufs, sizeof(audio_buf_item_t))) &&
+                        (pool->mem          = audio_arena_calloc(arena, n_bufs, buf_size))                  &&
+                        (pool->free_list    = audio_mpsc_queue_create(n_bufs, sizeof(audio_buf_item_t *), true))
+                    );
+    AUDIO_MEM_CHECK(TAG, _success, {
+        audio_buf_pool_free(pool);
+        return NULL;
+    });
+
+    pool->buf_size = buf_size;
+    pool->n_bufs = n_bufs;
+    atomic_init(&pool->refs, 1);
+    atomic_init(&pool->waiter_num, 0);
+    for (int i = 0; i < n_bufs; i++) {
+        audio_buf_item_t *item = &pool->items[i];
+        item->buf.data = pool->mem + (size_t)i * buf_size;
+        item->buf.size = buf_size;
+        item->pool = pool;
+        audio_mpsc_queue_send(pool->free_list, &item, 0);
+    }
+    return pool;
+}
+
+audio_buf_pool_handle_t audio_buf_pool_create(int buf_size, int n_bufs)
+{
+    return audio_buf_pool_create_in(NULL, buf_size, n_bufs);
+}
+
+esp_err_t audio_buf_pool_destroy(audio_buf_pool_handle_t pool)
+{
+    if (pool == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    audio_buf_pool_unref(pool);
+    return ESP_OK;
+}
+
+audio_buf_pool_handle_t audio_buf_pool_ref(audio_buf_pool_handle_t pool)
+{
+    if (pool) {
+        atomic_fetch_add_explicit(&pool->refs, 1, memory_order_relaxed);
+    }
+    return pool;
+}
+
+esp_err_t audio_buf_pool_add_waiter(audio_buf_pool_handle_t pool, audio_buf_pool_waiter_t *waiter)
+{
+    if (pool == NULL || waiter == NULL || waiter->notify == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&pool->waiter_lock);
+    waiter->next = pool->waiters;
+    pool->waiters = waiter;
+    atomic_fetch_add_explicit(&pool->waiter_num, 1, memory_order_release);
+    pthread_mutex_unlock(&pool->waiter_lock);
+    return ESP_OK;
+}
+
+esp_err_t audio_buf_pool_remove_waiter(audio_buf_pool_handle_t pool, audio_buf_pool_waiter_t *waiter)
+{
+    if (pool == NULL || waiter == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    /* Waits for a release calling the waiters to be done with them */
+    pthread_mutex_lock(&pool->waiter_lock);
+    audio_buf_pool_waiter_t **prev = &pool->waiters;
+    while (*prev && *prev != waiter) {
+        prev = &(*prev)->next;
+    }
+    bool found = *prev != NULL;
+    if (found) {
+        *prev = waiter->next;
+        waiter->next = NULL;
+        atomic_fetch_sub_explicit(&pool->waiter_num, 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&pool->waiter_lock);
+    return found ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+int audio_buf_pool_get_free(audio_buf_pool_handle_t pool)
+{
+    if (pool == NULL) {
+        return 0;
+    }
+    return audio_mpsc_queue_message_available(pool->free_list);
+}
+
+int audio_buf_pool_get_buf_size(audio_buf_pool_handle_t pool)
+{
+    if (pool == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return pool->buf_size;
+}
+
+audio_buf_t *audio_buf_alloc(audio_buf_pool_handle_t pool, TickType_t ticks_to_wait)
+{
+    audio_buf_item_t *item = NULL;
+    if (pool == NULL) {
+        return NULL;
+    }
+    if (audio_mpsc_queue_recv(pool->free_list, &item, ticks_to_wait) < 0) {
+        return NULL;
+    }
+    /* A buffer in use keeps the pool alive */
+    atomic_fetch_add_explicit(&pool->refs, 1, memory_order_relaxed);
+    atomic_store_explicit(&item->refs, 1, memory_order_relaxed);
+    item->buf.offset = 0;
+    item->buf.len = 0;
+    memset(&item->buf.fmt, 0, sizeof(item->buf.fmt));
+    item->buf.timestamp = 0;
+    item->buf.flags = 0;
+    return &item->buf;
+}
+
+audio_buf_t *audio_buf_ref(audio_buf_t *buf)
+{
+    if (buf) {
+        atomic_fetch_add_explicit(&((audio_buf_item_t *)buf)->refs, 1, memory_order_relaxed);
+    }
+    return buf;
+}
+
+void audio_buf_unref(audio_buf_t *buf)
+{
+    if (buf == NULL) {
+        return;
+    }
+    audio_buf_item_t *item = (audio_buf_item_t *)buf;
+    if (atomic_fetch_sub_explicit(&item->refs, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    audio_buf_pool_handle_t pool = item->pool;
+    /* Never blocks, the free list has room for every buffer of the pool */
+    audio_mpsc_queue_send(pool->free_list, &item, 0);
+    if (atomic_load_explicit(&pool->waiter_num, memory_order_acquire)) {
+        pthread_mutex_lock(&pool->waiter_lock);
+        for (audio_buf_pool_waiter_t *waiter = pool->waiters; waiter; waiter = waiter->next) {
+            waiter->notify(pool, waiter->ctx);
+        }
+        pthread_mutex_unlock(&pool->waiter_lock);
+    }
+    audio_buf_pool_unref(pool);
+}
+
+int audio_buf_get_refs(audio_buf_t *buf)
+{
+    if (buf == NULL) {
+        return 0;
+    }
+    return atomic_load_explicit(&((audio_buf_item_t *)buf)->refs, memory_order_relaxed);
+}
@@ -25,17 +25,37 @@
 #include <stdlib.h>
 #include <string.h>
 #include <semaphore.h>
+#include <sched.h>
+#include <stdatomic.h>
 
 #include "event_groups.h"
 #include "esp_log.h"
 #include "audio_element.h"
 #include "audio_mem.h"
 #include "audio_mutex.h"
+#include "audio_arena.h"
 #include "audio_error.h"
 #include "audio_thread.h"
+#include "audio_time.h"
+#include "audio_trace.h"
+#include "audio_usdt.h"
 
 static const char *TAG = "AUDIO_ELEMENT";
 #define DEFAULT_MAX_WAIT_TIME       2
+#define ELEMENT_BUF_POOL_SIZE       2   /* Buffers of the private pool, see audio_element_alloc_buf */
+
+#ifndef CONFIG_AUDIO_ELEMENT_STATS
+#define CONFIG_AUDIO_ELEMENT_STATS  1   /* 0 compiles the counters of audio_element_get_stats out */
+#endif
+
+#ifndef CONFIG_AUDIO_ELEMENT_STATS_CPU_PERIOD
+#define CONFIG_AUDIO_ELEMENT_STATS_CPU_PERIOD   16  /* Process calls per CPU time sample, a read is a syscall. 0 for none */
+#endif
+
+_Static_assert(AUDIO_BUF_FLAG_FORMAT_CHANGE == RB_PACKET_FLAG_FORMAT_CHANGE
+               && AUDIO_BUF_FLAG_DISCONTINUITY == RB_PACKET_FLAG_DISCONTINUITY
+               && AUDIO_BUF_FLAG_USER_SHIFT == RB_PACKET_FLAG_USER_SHIFT,
+               "buffer flags are passed to packet ringbufs as is");
 
 /**
  *  I/O Element Abstract
@@ -61,6 +81,7 @@ typedef struct audio_multi_rb {
 typedef enum {
     IO_TYPE_RB = 1, /* I/O through ringbuffer */
     IO_TYPE_CB,     /* I/O through callback */
+    IO_TYPE_FUSED,  /* I/O by direct call of the fused neighbour */
 } io_type_t;
 
 typedef enum {
@@ -79,12 +100,22 @@ struct audio_element {
     union {
         ringbuf_handle_t        input_rb;
         io_callback_t           read_cb;
+        audio_element_handle_t  fused;
     } in;
     io_type_t                   write_type;
     union {
         ringbuf_handle_t        output_rb;
         io_callback_t           write_cb;
+        audio_element_handle_t  fused;
     } out;
+    struct {
+        char                    *buf;
+        int                     len;
+        bool                    done;
+        char                    *stash;         /* What process() left of the previous push, see fused_push */
+        int                     stash_len;
+        int                     stash_size;
+    } fused_in;
 
     audio_multi_rb_t            multi_in;
     audio_multi_rb_t            multi_out;
@@ -99,6 +130,8 @@ struct audio_element {
 
     int                         buf_size;
     char                        *buf;
+    audio_buf_pool_handle_t     buf_pool;           /* Private pool of audio_element_alloc_buf, created on first use */
+    audio_arena_handle_t        arena;              /* Buffers are drawn from here, NULL for the heap */
 
     char                        *tag;
     int                         task_stack;
@@ -106,18 +139,38 @@ struct audio_element {
     int                         task_core;
     pthread_mutex_t            *lock;
     audio_element_info_t        info;
+    atomic_uint                 info_seq;           /* Seqlock over `info`, odd while a writer updates it */
     audio_element_info_t        *report_info;
+    audio_element_stats_t       stats;              /* Written by the thread running the Element only */
+    atomic_uint                 stats_seq;          /* Seqlock over `stats`, odd while the counters are updated */
+    int64_t                     stats_period_ns;    /* Of AEL_MSG_CMD_REPORT_STATS, 0 for none */
+    int64_t                     stats_reported_ns;
+    uint32_t                    stats_cpu_skip;     /* Process calls until the next CPU time sample */
+    audio_element_stats_t       *report_stats;
+    rb_timestamp_t              in_ts;              /* Stamp of the last input, see audio_element_get_input_timestamp */
+    bool                        in_ts_valid;
+    bool                        in_ts_fresh;        /* in_ts changed and was not passed on to the output yet */
+    bool                        out_ts_explicit;    /* The Element stamps its output itself */
+    atomic_uint                 pres_seq;           /* Seqlock over the presentation, odd while it is updated */
+    atomic_llong                pres_pts;
+    atomic_llong                pres_origin_ns;
+    atomic_llong                pres_time_ns;       /* 0 for no presentation reported since the open */
 
     bool                        stack_in_ext;
+    bool                        task_real_time;
     audio_thread_t              audio_thread;
+    audio_scheduler_handle_t    scheduler;
+    audio_scheduler_task_t      sched_task;
 
     /* PrivateData */
     void                        *data;
     EventGroupHandle_t          state_event;
-    int                         input_wait_time;
-    int                         output_wait_time;
+    TickType_t                  input_wait_time;
+    TickType_t                  output_wait_time;
     int                         out_buf_size_expect;
     int                         out_rb_size;
+    bool                        out_rb_packet;
+    bool                        out_rb_desc;
     volatile bool               is_running;
     volatile bool               task_run;
     volatile bool               stopping;
@@ -133,10 +186,51 @@ const static int RESUMED_BIT = BIT6;
 
 static esp_err_t audio_element_on_cmd_error(audio_element_handle_t el);
 static esp_err_t audio_element_on_cmd_stop(audio_element_handle_t el);
+static void audio_element_sched_notify(ringbuf_handle_t rb, void *ctx);
+static esp_err_t audio_element_fused_open(audio_element_handle_t el);
+static void audio_element_fused_close(audio_element_handle_t el);
+static void audio_element_info_load_format(audio_element_handle_t el, audio_buf_format_t *fmt);
+
+static const char *const ael_state_names[] = {
+    [AEL_STATE_NONE]            = "NONE",
+    [AEL_STATE_INIT]            = "INIT",
+    [AEL_STATE_INITIALIZING]    = "INITIALIZING",
+    [AEL_STATE_RUNNING]         = "RUNNING",
+    [AEL_STATE_PAUSED]          = "PAUSED",
+    [AEL_STATE_STOPPED]         = "STOPPED",
+    [AEL_STATE_FINISHED]        = "FINISHED",
+    [AEL_STATE_ERROR]           = "ERROR",
+};
+
+static const char *const ael_cmd_names[] = {
+    [AEL_MSG_CMD_NONE]              = "CMD_NONE",
+    [AEL_MSG_CMD_FINISH]            = "CMD_FINISH",
+    [AEL_MSG_CMD_STOP]              = "CMD_STOP",
+    [AEL_MSG_CMD_PAUSE]             = "CMD_PAUSE",
+    [AEL_MSG_CMD_RESUME]            = "CMD_RESUME",
+    [AEL_MSG_CMD_DESTROY]           = "CMD_DESTROY",
+    [AEL_MSG_CMD_REPORT_STATUS]     = "CMD_REPORT_STATUS",
+    [AEL_MSG_CMD_REPORT_MUSIC_INFO] = "CMD_REPORT_MUSIC_INFO",
+    [AEL_MSG_CMD_REPORT_CODEC_FMT]  = "CMD_REPORT_CODEC_FMT",
+    [AEL_MSG_CMD_REPORT_POSITION]   = "CMD_REPORT_POSITION",
+    [AEL_MSG_CMD_REPORT_STATS]      = "CMD_REPORT_STATS",
+};
 
+static const char *audio_element_cmd_name(int cmd)
+{
+    if (cmd < 0 || cmd >= sizeof(ael_cmd_names) / sizeof(ael_cmd_names[0]) || ael_cmd_names[cmd] == NULL) {
+        return "CMD_UNKNOWN";
+    }
+    return ael_cmd_names[cmd];
+}
+
+/* Every state change goes through here, so that the trace shows it on the timeline of the thread that made it */
 static esp_err_t audio_element_force_set_state(audio_element_handle_t el, audio_element_state_t new_state)
 {
     el->state = new_state;
+    if (audio_trace_enabled()) {
+        audio_trace_instant("element", ael_state_names[new_state], el->tag, (uintptr_t)el, new_state);
+    }
     return ESP_OK;
 }
 
@@ -148,7 +242,11 @@ static esp_err_t audio_element_cmd_send(audio_element_handle_t el, audio_element
         .cmd = cmd,
     };
     ESP_LOGV(TAG, "[%s]evt internal cmd = %d", el->tag, msg.cmd);
-    return audio_event_iface_cmd(el->iface_event, &msg);
+    esp_err_t ret = audio_event_iface_cmd(el->iface_event, &msg);
+    if (ret == ESP_OK && el->sched_task) {
+        audio_scheduler_task_wake(el->sched_task);
+    }
+    return ret;
 }
 
 static esp_err_t audio_element_msg_sendout(audio_element_handle_t el, audio_event_iface_msg_t *msg)
@@ -161,8 +259,11 @@ static esp_err_t audio_element_msg_sendout(audio_element_handle_t el, audio_even
     return audio_event_iface_sendout(el->iface_event, msg);
 }
 
-esp_err_t audio_element_process_init(audio_element_handle_t el)
+static esp_err_t audio_element_process_open(audio_element_handle_t el)
 {
+    el->in_ts_valid = false;
+    el->in_ts_fresh = false;
+    atomic_store_explicit(&el->pres_time_ns, 0, memory_order_relaxed);
     if (el->open == NULL) {
         el->is_open = true;
         xEventGroupSetBits(el->state_event, STARTED_BIT);
@@ -194,6 +295,20 @@ esp_err_t audio_element_process_init(audio_element_handle_t el)
     return ESP_FAIL;
 }
 
+esp_err_t audio_element_process_init(audio_element_handle_t el)
+{
+    if (audio_element_process_open(el) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (el->write_type == IO_TYPE_FUSED && audio_element_fused_open(el->out.fused) != ESP_OK) {
+        ESP_LOGE(TAG, "[%s] Fused element [%s] failed to open", el->tag, el->out.fused->tag);
+        audio_element_report_status(el, AEL_STATUS_ERROR_OUTPUT);
+        audio_element_on_cmd_error(el);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
 esp_err_t audio_element_process_deinit(audio_element_handle_t el)
 {
     if (el->is_open && el->close) {
@@ -201,6 +316,9 @@ esp_err_t audio_element_process_deinit(audio_element_handle_t el)
         el->close(el);
     }
     el->is_open = false;
+    if (el->write_type == IO_TYPE_FUSED) {
+        audio_element_fused_close(el->out.fused);
+    }
     return ESP_OK;
 }
 
@@ -209,7 +327,7 @@ static esp_err_t audio_element_on_cmd_error(audio_element_handle_t el)
     if (el->state != AEL_STATE_STOPPED) {
         ESP_LOGW(TAG, "[%s] audio_element_on_cmd_error,%d", el->tag, el->state);
         audio_element_process_deinit(el);
-        el->state = AEL_STATE_ERROR;
+        audio_element_force_set_state(el, AEL_STATE_ERROR);
         audio_event_iface_set_cmd_waiting_timeout(el->iface_event, portMAX_DELAY);
         el->is_running = false;
         xEventGroupSetBits(el->state_event, STOPPED_BIT);
@@ -221,7 +339,7 @@ static esp_err_t audio_element_on_cmd_stop(audio_element_handle_t el)
 {
     if ((el->state != AEL_STATE_FINISHED) && (el->state != AEL_STATE_STOPPED)) {
         audio_element_process_deinit(el);
-        el->state = AEL_STATE_STOPPED;
+        audio_element_force_set_state(el, AEL_STATE_STOPPED);
         audio_event_iface_set_cmd_waiting_timeout(el->iface_event, portMAX_DELAY);
         audio_element_report_status(el, AEL_STATUS_STATE_STOPPED);
         el->is_running = false;
@@ -236,7 +354,7 @@ static esp_err_t audio_element_on_cmd_stop(audio_element_handle_t el)
             el->stopping = false;
             return ESP_OK;
         }
-        el->state = AEL_STATE_STOPPED;
+        audio_element_force_set_state(el, AEL_STATE_STOPPED);
         el->is_running = false;
         el->stopping = false;
         audio_element_report_status(el, AEL_STATUS_STATE_STOPPED);
@@ -253,7 +371,7 @@ static esp_err_t audio_element_on_cmd_finish(audio_element_handle_t el)
         return ESP_OK;
     }
     audio_element_process_deinit(el);
-    el->state = AEL_STATE_FINISHED;
+    audio_element_force_set_state(el, AEL_STATE_FINISHED);
     audio_event_iface_set_cmd_waiting_timeout(el->iface_event, portMAX_DELAY);
     audio_element_report_status(el, AEL_STATUS_STATE_FINISHED);
     el->is_running = false;
@@ -294,6 +412,7 @@ static esp_err_t audio_element_on_cmd(audio_event_iface_msg_t *msg, void *contex
         return ESP_FAIL;
     }
     esp_err_t ret = ESP_OK;
+    int64_t trace_start = audio_trace_begin();
     //process an event
     switch (msg->cmd) {
         case AEL_MSG_CMD_FINISH:
@@ -305,7 +424,7 @@ static esp_err_t audio_element_on_cmd(audio_event_iface_msg_t *msg, void *contex
             ret = audio_element_on_cmd_stop(el);
             break;
         case AEL_MSG_CMD_PAUSE:
-            el->state = AEL_STATE_PAUSED;
+            audio_element_force_set_state(el, AEL_STATE_PAUSED);
             audio_element_process_deinit(el);
             audio_event_iface_set_cmd_waiting_timeout(el->iface_event, portMAX_DELAY);
             audio_element_report_status(el, AEL_STATUS_STATE_PAUSED);
@@ -322,16 +441,156 @@ static esp_err_t audio_element_on_cmd(audio_event_iface_msg_t *msg, void *contex
             ESP_LOGD(TAG, "[%s] AEL_MSG_CMD_DESTROY", el->tag);
             ret = AEL_IO_ABORT;
     }
+    audio_trace_span("element", audio_element_cmd_name(msg->cmd), el->tag, (uintptr_t)el, ret, trace_start);
     return ret;
 }
 
+/*
+ * Counters of audio_element_get_stats. Only the thread running the Element writes them, so an update is a plain
+ * load and store inside a seqlock write section, which keeps a snapshot consistent without a lock on either side.
+ */
+#if CONFIG_AUDIO_ELEMENT_STATS
+
+#define AEL_STATS_ADD(el, field, value) \
+    __atomic_store_n(&(el)->stats.field, __atomic_load_n(&(el)->stats.field, __ATOMIC_RELAXED) + (value), __ATOMIC_RELAXED)
+
+static inline void audio_element_stats_write_begin(audio_element_handle_t el)
+{
+    atomic_store_explicit(&el->stats_seq, atomic_load_explicit(&el->stats_seq, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void audio_element_stats_write_end(audio_element_handle_t el)
+{
+    atomic_store_explicit(&el->stats_seq, atomic_load_explicit(&el->stats_seq, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+static inline int64_t audio_element_stats_now(void)
+{
+    return audio_time_now_ns();
+}
+
+/* CPU time of the thread when this process call is sampled, -1 otherwise */
+static inline int64_t audio_element_stats_cpu_begin(audio_element_handle_t el)
+{
+#if CONFIG_AUDIO_ELEMENT_STATS_CPU_PERIOD
+    if (el->stats_cpu_skip > 0) {
+        el->stats_cpu_skip--;
+        return -1;
+    }
+    el->stats_cpu_skip = CONFIG_AUDIO_ELEMENT_STATS_CPU_PERIOD - 1;
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#else
+    return -1;
+#endif
+}
+
+static inline int64_t audio_element_stats_cpu_end(int64_t cpu_start)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec - cpu_start;
+}
+
+static inline uint32_t audio_element_hist_bucket(uint32_t us)
+{
+    const uint32_t sub = 1 << AEL_STATS_HIST_SUB_BITS;
+    if (us < sub) {
+        return us;
+    }
+    uint32_t msb = 31 - __builtin_clz(us);
+    uint32_t bucket = ((msb - AEL_STATS_HIST_SUB_BITS + 1) << AEL_STATS_HIST_SUB_BITS)
+                      | ((us >> (msb - AEL_STATS_HIST_SUB_BITS)) & (sub - 1));
+    return bucket < AEL_STATS_HIST_BUCKETS ? bucket : AEL_STATS_HIST_BUCKETS - 1;
+}
+
+static inline void audio_element_hist_add(audio_element_hist_t *hist, int64_t ns)
+{
+    uint32_t us = (ns / 1000 > UINT32_MAX) ? UINT32_MAX : (uint32_t)(ns / 1000);
+    uint32_t *count = &hist->count[audio_element_hist_bucket(us)];
+    __atomic_store_n(count, __atomic_load_n(count, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    if (us > __atomic_load_n(&hist->max_us, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&hist->max_us, us, __ATOMIC_RELAXED);
+    }
+}
+
+static void audio_element_stats_io(audio_element_handle_t el, bool input, int64_t start, int len)
+{
+    int64_t ns = audio_element_stats_now() - start;
+    audio_element_stats_write_begin(el);
+    if (input) {
+        AEL_STATS_ADD(el, input_wait_ns, ns);
+        AEL_STATS_ADD(el, bytes_in, len > 0 ? len : 0);
+    } else {
+        AEL_STATS_ADD(el, output_wait_ns, ns);
+        AEL_STATS_ADD(el, bytes_out, len > 0 ? len : 0);
+    }
+    audio_element_stats_write_end(el);
+}
+
+static void audio_element_stats_process(audio_element_handle_t el, int64_t wall_start, int64_t cpu_start)
+{
+    int64_t now = audio_element_stats_now();
+    int64_t wall = now - wall_start;
+    int64_t cpu = cpu_start >= 0 ? audio_element_stats_cpu_end(cpu_start) : 0;
+    audio_element_stats_write_begin(el);
+    AEL_STATS_ADD(el, process_calls, 1);
+    AEL_STATS_ADD(el, process_wall_ns, wall);
+    audio_element_hist_add(&el->stats.process_wall, wall);
+    if (cpu_start >= 0) {
+        /* A sample stands for the calls skipped since the last one */
+        AEL_STATS_ADD(el, process_cpu_ns, cpu * CONFIG_AUDIO_ELEMENT_STATS_CPU_PERIOD);
+        audio_element_hist_add(&el->stats.process_cpu, cpu);
+    }
+    audio_element_stats_write_end(el);
+
+    int64_t period = __atomic_load_n(&el->stats_period_ns, __ATOMIC_RELAXED);
+    if (period > 0 && now - el->stats_reported_ns >= period) {
+        el->stats_reported_ns = now;
+        audio_element_report_stats(el);
+    }
+}
+
+#else
+
+static inline int64_t audio_element_stats_now(void)
+{
+    return 0;
+}
+
+static inline int64_t audio_element_stats_cpu_begin(audio_element_handle_t el)
+{
+    return -1;
+}
+
+static inline void audio_element_stats_io(audio_element_handle_t el, bool input, int64_t start, int len)
+{
+}
+
+static inline void audio_element_stats_process(audio_element_handle_t el, int64_t wall_start, int64_t cpu_start)
+{
+}
+
+#endif /* CONFIG_AUDIO_ELEMENT_STATS */
+
 static esp_err_t audio_element_process_running(audio_element_handle_t el)
 {
     int process_len = -1;
     if (el->state < AEL_STATE_RUNNING || !el->is_running) {
         return ESP_ERR_INVALID_STATE;
     }
+    int64_t wall_start = audio_element_stats_now();
+    int64_t cpu_start = audio_element_stats_cpu_begin(el);
+    int64_t trace_start = audio_trace_begin();
+    AUDIO_USDT2(element_process_entry, el, el->tag);
     process_len = el->process(el, el->buf, el->buf_size);
+    AUDIO_USDT3(element_process_return, el, el->tag, process_len);
+    audio_trace_span("element", "process", el->tag, (uintptr_t)el, process_len, trace_start);
+    audio_element_stats_process(el, wall_start, cpu_start);
     if (process_len <= 0) {
         switch (process_len) {
             case AEL_IO_ABORT:
@@ -368,26 +627,8 @@ static esp_err_t audio_element_process_running(audio_element_handle_t el)
     return ESP_OK;
 }
 
-audio_element_err_t audio_element_input(audio_element_handle_t el, char *buffer, int wanted_size)
+static void audio_element_input_check(audio_element_handle_t el, int in_len)
 {
-    int in_len = 0;
-    if (el->read_type == IO_TYPE_CB) {
-        if (el->in.read_cb.cb == NULL) {
-            ESP_LOGE(TAG, "[%s] Read IO Type callback but callback not set", el->tag);
-            return ESP_FAIL;
-        }
-        in_len = el->in.read_cb.cb(el, buffer, wanted_size, el->input_wait_time,
-                                   el->in.read_cb.ctx);
-    } else if (el->read_type == IO_TYPE_RB) {
-        if (el->in.input_rb == NULL) {
-            ESP_LOGE(TAG, "[%s] Read IO type ringbuf but ringbuf not set", el->tag);
-            return ESP_FAIL;
-        }
-        in_len = rb_read(el->in.input_rb, buffer, wanted_size, el->input_wait_time);
-    } else {
-        ESP_LOGE(TAG, "[%s] Invalid read IO type", el->tag);
-        return ESP_FAIL;
-    }
     if (in_len <= 0) {
         switch (in_len) {
             case AEL_IO_ABORT:
@@ -409,25 +650,10 @@ audio_element_err_t audio_element_input(audio_element_handle_t el, char *buffer,
                 break;
         }
     }
-    return in_len;
 }
 
-audio_element_err_t audio_element_output(audio_element_handle_t el, char *buffer, int write_size)
+static void audio_element_output_check(audio_element_handle_t el, int output_len)
 {
-    int output_len = 0;
-    if (el->write_type == IO_TYPE_CB) {
-        if (el->out.write_cb.cb && write_size) {
-            output_len = el->out.write_cb.cb(el, buffer, write_size, el->output_wait_time,
-                                             el->out.write_cb.ctx);
-        }
-    } else if (el->write_type == IO_TYPE_RB) {
-        if (el->out.output_rb && write_size) {
-            output_len = rb_write(el->out.output_rb, buffer, write_size, el->output_wait_time);
-            if ((rb_bytes_filled(el->out.output_rb) > el->out_buf_size_expect) || (output_len < 0)) {
-                xEventGroupSetBits(el->state_event, BUFFER_REACH_LEVEL_BIT);
-            }
-        }
-    }
     if (output_len <= 0) {
         switch (output_len) {
             case AEL_IO_ABORT:
@@ -449,56 +675,604 @@ audio_element_err_t audio_element_output(audio_element_handle_t el, char *buffer
                 break;
         }
     }
+}
+
+/*
+ * Fused chains: an element fed through IO_TYPE_FUSED has no task and no input ringbuf. Its process() is called right
+ * away, in the thread of the element feeding it, on the very buffer that element outputs.
+ */
+static inline bool audio_element_is_taskless(audio_element_handle_t el)
+{
+    return el->task_stack <= 0 || el->read_type == IO_TYPE_FUSED;
+}
+
+static int audio_element_fused_peek(audio_element_handle_t el, char **buffer, int wanted_size)
+{
+    if (el->fused_in.len <= 0) {
+        return el->fused_in.done ? AEL_IO_DONE : AEL_IO_TIMEOUT;
+    }
+    *buffer = el->fused_in.buf;
+    return wanted_size < el->fused_in.len ? wanted_size : el->fused_in.len;
+}
+
+static esp_err_t audio_element_fused_consume(audio_element_handle_t el, int len)
+{
+    if (len < 0 || len > el->fused_in.len) {
+        return ESP_FAIL;
+    }
+    el->fused_in.buf += len;
+    el->fused_in.len -= len;
+    return ESP_OK;
+}
+
+/* The lock keeps the arena referenced while a block is taken from it */
+static void *audio_element_mem_calloc(audio_element_handle_t el, size_t nmemb, size_t size)
+{
+    mutex_lock(el->lock);
+    void *ptr = audio_arena_calloc(el->arena, nmemb, size);
+    mutex_unlock(el->lock);
+    return ptr;
+}
+
+/* Make room for `size` bytes in the stash, keeping the `stash_len` bytes already there */
+static esp_err_t audio_element_fused_reserve(audio_element_handle_t el, int size)
+{
+    if (size <= el->fused_in.stash_size) {
+        return ESP_OK;
+    }
+    char *stash = audio_element_mem_calloc(el, 1, size);
+    AUDIO_MEM_CHECK(TAG, stash, return ESP_FAIL);
+    if (el->fused_in.stash_len > 0) {
+        memcpy(stash, el->fused_in.stash, el->fused_in.stash_len);
+    }
+    audio_arena_free(el->fused_in.stash);
+    el->fused_in.stash = stash;
+    el->fused_in.stash_size = size;
+    return ESP_OK;
+}
+
+/*
+ * Hand a buffer to process() until it is used up. A process() call that consumes nothing waits for more than there
+ * is, e.g. a whole frame: the rest is stashed and the next push is appended to it, rather than calling it again.
+ */
+static int audio_element_fused_push(audio_element_handle_t el, char *buffer, int len)
+{
+    if (el->fused_in.stash_len > 0) {
+        if (audio_element_fused_reserve(el, el->fused_in.stash_len + len) != ESP_OK) {
+            return AEL_IO_FAIL;
+        }
+        memcpy(el->fused_in.stash + el->fused_in.stash_len, buffer, len);
+        el->fused_in.buf = el->fused_in.stash;
+        el->fused_in.len = el->fused_in.stash_len + len;
+        el->fused_in.stash_len = 0;
+    } else {
+        el->fused_in.buf = buffer;
+        el->fused_in.len = len;
+    }
+    while (el->fused_in.len > 0 && el->is_running && el->state == AEL_STATE_RUNNING) {
+        int before = el->fused_in.len;
+        audio_element_process_running(el);
+        if (el->fused_in.len == before) {
+            break;
+        }
+    }
+    int left = el->fused_in.len;
+    int ret = len;
+    if (left > 0 && el->is_running && el->state == AEL_STATE_RUNNING) {
+        if (el->fused_in.buf != el->fused_in.stash && audio_element_fused_reserve(el, left) != ESP_OK) {
+            ret = AEL_IO_FAIL;
+        } else {
+            memmove(el->fused_in.stash, el->fused_in.buf, left);
+            el->fused_in.stash_len = left;
+        }
+    } else if (left > 0) {
+        ret = el->state == AEL_STATE_FINISHED ? AEL_IO_DONE : AEL_IO_ABORT;
+    }
+    el->fused_in.buf = NULL;
+    el->fused_in.len = 0;
+    return ret;
+}
+
+static void audio_element_fused_done(audio_element_handle_t el)
+{
+    el->fused_in.done = true;
+    el->fused_in.buf = el->fused_in.stash;
+    el->fused_in.len = el->fused_in.stash_len;
+    el->fused_in.stash_len = 0;
+    while (el->is_running && el->state == AEL_STATE_RUNNING) {
+        int before = el->fused_in.len;
+        audio_element_process_running(el);
+        if (before > 0 && el->fused_in.len == before) {
+            /* No more is coming, so the element sees the end of the stream next */
+            ESP_LOGW(TAG, "[%s] %d bytes left unread at the end of the stream", el->tag, before);
+            el->fused_in.len = 0;
+        }
+    }
+    el->fused_in.buf = NULL;
+    el->fused_in.len = 0;
+}
+
+static esp_err_t audio_element_fused_open(audio_element_handle_t el)
+{
+    if (el->buf == NULL && el->buf_size > 0) {
+        el->buf = audio_element_mem_calloc(el, 1, el->buf_size);
+        AUDIO_MEM_CHECK(TAG, el->buf, return ESP_FAIL);
+    }
+    el->fused_in.len = 0;
+    el->fused_in.stash_len = 0;
+    el->fused_in.done = false;
+    el->is_running = true;
+    xEventGroupClearBits(el->state_event, STOPPED_BIT);
+    if (audio_element_process_init(el) != ESP_OK) {
+        el->is_running = false;
+        return ESP_FAIL;
+    }
+    audio_element_force_set_state(el, AEL_STATE_RUNNING);
+    return ESP_OK;
+}
+
+static void audio_element_fused_close(audio_element_handle_t el)
+{
+    if (el->is_running) {
+        audio_element_on_cmd_stop(el);
+    } else {
+        audio_element_process_deinit(el);
+    }
+    audio_arena_free(el->buf);
+    el->buf = NULL;
+    audio_arena_free(el->fused_in.stash);
+    el->fused_in.stash = NULL;
+    el->fused_in.stash_len = 0;
+    el->fused_in.stash_size = 0;
+}
+
+static void audio_element_input_stamp(audio_element_handle_t el, ringbuf_handle_t rb)
+{
+    rb_timestamp_t ts;
+    if (rb_get_timestamp(rb, &ts) != ESP_OK) {
+        return;
+    }
+    if (!el->in_ts_valid || ts.pts != el->in_ts.pts || ts.origin_ns != el->in_ts.origin_ns) {
+        el->in_ts_fresh = true;
+    }
+    el->in_ts = ts;
+    el->in_ts_valid = true;
+}
+
+static esp_err_t audio_element_output_stamp(audio_element_handle_t el, int64_t pts, int64_t origin_ns)
+{
+    if (el->write_type == IO_TYPE_RB) {
+        return el->out.output_rb ? rb_set_timestamp(el->out.output_rb, pts, origin_ns) : ESP_FAIL;
+    } else if (el->write_type == IO_TYPE_FUSED) {
+        audio_element_handle_t next = el->out.fused;
+        next->in_ts.pts = pts;
+        next->in_ts.origin_ns = origin_ns;
+        next->in_ts.offset = 0;
+        next->in_ts_valid = true;
+        next->in_ts_fresh = true;
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+/* Pass a new input stamp on, for an Element that does not stamp its output itself */
+static void audio_element_forward_stamp(audio_element_handle_t el)
+{
+    if (!el->in_ts_fresh || el->out_ts_explicit) {
+        return;
+    }
+    el->in_ts_fresh = false;
+    int64_t pts = el->in_ts.pts;
+    if (pts != RB_PTS_NONE && el->in_ts.offset > 0) {
+        audio_buf_format_t fmt;
+        audio_element_info_load_format(el, &fmt);
+        int frame_size = fmt.channels * fmt.bits / 8;
+        bool pcm = fmt.codec_fmt == ESP_CODEC_TYPE_UNKNOW || fmt.codec_fmt == ESP_CODEC_TYPE_RAW
+                   || fmt.codec_fmt == ESP_CODEC_TYPE_PCM;
+        if (pcm && frame_size > 0 && fmt.sample_rates > 0) {
+            pts += el->in_ts.offset / frame_size * 1000000LL / fmt.sample_rates;
+        }
+    }
+    audio_element_output_stamp(el, pts, el->in_ts.origin_ns);
+}
+
+audio_element_err_t audio_element_input(audio_element_handle_t el, char *buffer, int wanted_size)
+{
+    int in_len = 0;
+    int64_t start = audio_element_stats_now();
+    AUDIO_USDT3(element_input_entry, el, el->tag, wanted_size);
+    if (el->read_type == IO_TYPE_CB) {
+        if (el->in.read_cb.cb == NULL) {
+            ESP_LOGE(TAG, "[%s] Read IO Type callback but callback not set", el->tag);
+            return ESP_FAIL;
+        }
+        in_len = el->in.read_cb.cb(el, buffer, wanted_size, el->input_wait_time,
+                                   el->in.read_cb.ctx);
+    } else if (el->read_type == IO_TYPE_RB) {
+        if (el->in.input_rb == NULL) {
+            ESP_LOGE(TAG, "[%s] Read IO type ringbuf but ringbuf not set", el->tag);
+            return ESP_FAIL;
+        }
+        in_len = rb_read(el->in.input_rb, buffer, wanted_size, el->input_wait_time);
+        if (in_len > 0) {
+            audio_element_input_stamp(el, el->in.input_rb);
+        }
+    } else if (el->read_type == IO_TYPE_FUSED) {
+        char *data = NULL;
+        in_len = audio_element_fused_peek(el, &data, wanted_size);
+        if (in_len > 0) {
+            memcpy(buffer, data, in_len);
+            audio_element_fused_consume(el, in_len);
+        }
+    } else {
+        ESP_LOGE(TAG, "[%s] Invalid read IO type", el->tag);
+        return ESP_FAIL;
+    }
+    AUDIO_USDT3(element_input_return, el, el->tag, in_len);
+    audio_element_stats_io(el, true, start, in_len);
+    audio_element_input_check(el, in_len);
+    return in_len;
+}
+
+audio_element_err_t audio_element_output(audio_element_handle_t el, char *buffer, int write_size)
+{
+    int output_len = 0;
+    int64_t start = audio_element_stats_now();
+    AUDIO_USDT3(element_output_entry, el, el->tag, write_size);
+    if (write_size > 0) {
+        audio_element_forward_stamp(el);
+    }
+    if (el->write_type == IO_TYPE_CB) {
+        if (el->out.write_cb.cb && write_size) {
+            output_len = el->out.write_cb.cb(el, buffer, write_size, el->output_wait_time,
+                                             el->out.write_cb.ctx);
+        }
+    } else if (el->write_type == IO_TYPE_RB) {
+        if (el->out.output_rb && write_size) {
+            output_len = rb_write(el->out.output_rb, buffer, write_size, el->output_wait_time);
+            if ((rb_bytes_filled(el->out.output_rb) > el->out_buf_size_expect) || (output_len < 0)) {
+                xEventGroupSetBits(el->state_event, BUFFER_REACH_LEVEL_BIT);
+            }
+        }
+    } else if (el->write_type == IO_TYPE_FUSED) {
+        if (write_size) {
+            output_len = audio_element_fused_push(el->out.fused, buffer, write_size);
+        }
+    }
+    AUDIO_USDT3(element_output_return, el, el->tag, output_len);
+    audio_element_stats_io(el, false, start, output_len);
+    audio_element_output_check(el, output_len);
     return output_len;
 }
-void* audio_element_task(void *pv)
+
+audio_element_err_t audio_element_input_packet(audio_element_handle_t el, char *buffer, int wanted_size, rb_packet_info_t *info)
+{
+    if (el->read_type != IO_TYPE_RB || !rb_is_packet(el->in.input_rb)) {
+        ESP_LOGE(TAG, "[%s] Packet input needs a packet mode input ringbuf", el->tag);
+        return AEL_IO_FAIL;
+    }
+    int64_t start = audio_element_stats_now();
+    AUDIO_USDT3(element_input_entry, el, el->tag, wanted_size);
+    int in_len = rb_read_packet(el->in.input_rb, buffer, wanted_size, info, el->input_wait_time);
+    if (in_len > 0) {
+        audio_element_input_stamp(el, el->in.input_rb);
+    }
+    AUDIO_USDT3(element_input_return, el, el->tag, in_len);
+    audio_element_stats_io(el, true, start, in_len);
+    audio_element_input_check(el, in_len);
+    return in_len;
+}
+
+audio_element_err_t audio_element_output_packet(audio_element_handle_t el, char *buffer, int write_size, const rb_packet_info_t *info)
+{
+    if (el->write_type != IO_TYPE_RB || !rb_is_packet(el->out.output_rb)) {
+        return audio_element_output(el, buffer, write_size);
+    }
+    int64_t start = audio_element_stats_now();
+    AUDIO_USDT3(element_output_entry, el, el->tag, write_size);
+    audio_element_forward_stamp(el);
+    int output_len = rb_write_packet(el->out.output_rb, buffer, write_size, info, el->output_wait_time);
+    AUDIO_USDT3(element_output_return, el, el->tag, output_len);
+    audio_element_stats_io(el, false, start, output_len);
+    if ((rb_bytes_filled(el->out.output_rb) > el->out_buf_size_expect) || (output_len < 0)) {
+        xEventGroupSetBits(el->state_event, BUFFER_REACH_LEVEL_BIT);
+    }
+    audio_element_output_check(el, output_len);
+    return output_len;
+}
+
+audio_element_err_t audio_element_input_peek(audio_element_handle_t el, char **buffer, int wanted_size)
+{
+    if (el->read_type == IO_TYPE_FUSED) {
+        int in_len = audio_element_fused_peek(el, buffer, wanted_size);
+        audio_element_input_check(el, in_len);
+        return in_len;
+    }
+    if (el->read_type != IO_TYPE_RB || el->in.input_rb == NULL) {
+        ESP_LOGE(TAG, "[%s] Peek needs an input ringbuf", el->tag);
+        return AEL_IO_FAIL;
+    }
+    int64_t start = audio_element_stats_now();
+    int in_len = rb_peek_read(el->in.input_rb, buffer, wanted_size, el->input_wait_time);
+    if (in_len > 0) {
+        audio_element_input_stamp(el, el->in.input_rb);
+    }
+    /* The bytes are counted once consumed */
+    audio_element_stats_io(el, true, start, 0);
+    audio_element_input_check(el, in_len);
+    return in_len;
+}
+
+esp_err_t audio_element_input_consume(audio_element_handle_t el, int len)
+{
+    esp_err_t ret;
+    if (el->read_type == IO_TYPE_FUSED) {
+        ret = audio_element_fused_consume(el, len);
+    } else if (el->read_type != IO_TYPE_RB || el->in.input_rb == NULL) {
+        return ESP_FAIL;
+    } else if ((ret = rb_consume(el->in.input_rb, len)) == ESP_OK) {
+        audio_element_input_stamp(el, el->in.input_rb);
+    }
+    if (ret == ESP_OK) {
+        audio_element_stats_io(el, true, audio_element_stats_now(), len);
+    }
+    return ret;
+}
+
+audio_element_err_t audio_element_output_acquire(audio_element_handle_t el, char **buffer, int wanted_size)
+{
+    if (el->write_type != IO_TYPE_RB || el->out.output_rb == NULL) {
+        ESP_LOGE(TAG, "[%s] Acquire needs an output ringbuf", el->tag);
+        return AEL_IO_FAIL;
+    }
+    int64_t start = audio_element_stats_now();
+    int output_len = rb_acquire_write(el->out.output_rb, buffer, wanted_size, el->output_wait_time);
+    /* The bytes are counted once committed */
+    audio_element_stats_io(el, false, start, 0);
+    if (output_len < 0) {
+        xEventGroupSetBits(el->state_event, BUFFER_REACH_LEVEL_BIT);
+    }
+    audio_element_output_check(el, output_len);
+    return output_len;
+}
+
+audio_element_err_t audio_element_output_commit(audio_element_handle_t el, int len)
+{
+    if (el->write_type != IO_TYPE_RB || el->out.output_rb == NULL) {
+        return AEL_IO_FAIL;
+    }
+    if (len > 0) {
+        audio_element_forward_stamp(el);
+    }
+    if (rb_commit_write(el->out.output_rb, len) != ESP_OK) {
+        audio_element_output_check(el, AEL_IO_FAIL);
+        return AEL_IO_FAIL;
+    }
+    if (rb_bytes_filled(el->out.output_rb) > el->out_buf_size_expect) {
+        xEventGroupSetBits(el->state_event, BUFFER_REACH_LEVEL_BIT);
+    }
+    audio_element_stats_io(el, false, audio_element_stats_now(), len);
+    return len;
+}
+
+static inline bool audio_element_output_is_desc(audio_element_handle_t el)
+{
+    return el->write_type == IO_TYPE_RB && rb_is_desc(el->out.output_rb);
+}
+
+audio_element_err_t audio_element_alloc_buf(audio_element_handle_t el, audio_buf_t **buf)
+{
+    *buf = NULL;
+    if (audio_element_output_is_desc(el)) {
+        /* Filled in place and queued on the output as is, waiting for a free buffer is waiting for room */
+        int64_t start = audio_element_stats_now();
+        int ret = rb_alloc_buf(el->out.output_rb, buf, el->output_wait_time);
+        audio_element_stats_io(el, false, start, 0);
+        audio_element_output_check(el, ret);
+        return ret;
+    }
+    if (el->buf_pool == NULL) {
+        mutex_lock(el->lock);
+        el->buf_pool = audio_buf_pool_create_in(el->arena, el->buf_size, ELEMENT_BUF_POOL_SIZE);
+        mutex_unlock(el->lock);
+        AUDIO_MEM_CHECK(TAG, el->buf_pool, return AEL_IO_FAIL);
+    }
+    *buf = audio_buf_alloc(el->buf_pool, el->output_wait_time);
+    return *buf ? (*buf)->size : AEL_IO_TIMEOUT;
+}
+
+audio_element_err_t audio_element_input_buf(audio_element_handle_t el, audio_buf_t **buf)
+{
+    int in_len;
+    *buf = NULL;
+    if (el->read_type == IO_TYPE_RB && rb_is_desc(el->in.input_rb)) {
+        int64_t start = audio_element_stats_now();
+        in_len = rb_read_buf(el->in.input_rb, buf, el->input_wait_time);
+        if (in_len > 0) {
+            audio_element_input_stamp(el, el->in.input_rb);
+        }
+        audio_element_stats_io(el, true, start, in_len);
+        audio_element_input_check(el, in_len);
+        return in_len;
+    }
+
+    /* Shim for byte inputs, the data is read once into a buffer the output can pass on */
+    audio_buf_t *desc = NULL;
+    rb_packet_info_t info = { 0 };
+    in_len = audio_element_alloc_buf(el, &desc);
+    if (in_len <= 0) {
+        return in_len;
+    }
+    if (el->read_type == IO_TYPE_RB && rb_is_packet(el->in.input_rb)) {
+        in_len = audio_element_input_packet(el, desc->data, desc->size, &info);
+    } else {
+        in_len = audio_element_input(el, desc->data, desc->size);
+    }
+    if (in_len <= 0) {
+        audio_buf_unref(desc);
+        return in_len;
+    }
+    desc->len = in_len;
+    desc->timestamp = info.timestamp;
+    desc->flags = info.flags;
+    audio_element_info_load_format(el, &desc->fmt);
+    *buf = desc;
+    return in_len;
+}
+
+audio_element_err_t audio_element_output_buf(audio_element_handle_t el, audio_buf_t *buf)
+{
+    int output_len;
+    if (!audio_element_output_is_desc(el)) {
+        /* Shim for byte outputs, packet ringbufs keep the timestamp and flags */
+        rb_packet_info_t info = {
+            .flags = buf->flags,
+            .timestamp = buf->timestamp,
+        };
+        output_len = audio_element_output_packet(el, buf->data + buf->offset, buf->len, &info);
+        audio_buf_unref(buf);
+        return output_len;
+    }
+    int64_t start = audio_element_stats_now();
+    audio_element_forward_stamp(el);
+    output_len = rb_write_buf(el->out.output_rb, buf, el->output_wait_time);
+    audio_element_stats_io(el, false, start, output_len);
+    if ((rb_bytes_filled(el->out.output_rb) > el->out_buf_size_expect) || (output_len < 0)) {
+        xEventGroupSetBits(el->state_event, BUFFER_REACH_LEVEL_BIT);
+    }
+    if (output_len <= 0) {
+        audio_buf_unref(buf);
+    }
+    audio_element_output_check(el, output_len);
+    return output_len;
+}
+
+static void audio_element_task_init(audio_element_handle_t el)
 {
-    audio_element_handle_t el = (audio_element_handle_t)pv;
     el->task_run = true;
     xEventGroupSetBits(el->state_event, TASK_CREATED_BIT);
     audio_element_force_set_state(el, AEL_STATE_INIT);
     audio_event_iface_set_cmd_waiting_timeout(el->iface_event, portMAX_DELAY);
     if (el->buf_size > 0) {
-        el->buf = audio_calloc(1, el->buf_size);
+        el->buf = audio_element_mem_calloc(el, 1, el->buf_size);
         AUDIO_MEM_CHECK(TAG, el->buf, {
             el->task_run = false;
             ESP_LOGE(TAG, "[%s] Error malloc element buffer", el->tag);
         });
     }
-    xEventGroupClearBits(el->state_event, STOPPED_BIT);
+    xEventGroupClearBits(el->state_event, STOPPED_BIT);
+}
+
+static void audio_element_task_deinit(audio_element_handle_t el)
+{
+    if (el->is_open && el->close) {
+        ESP_LOGD(TAG, "[%s-%p] el closed", el->tag, el);
+        el->close(el);
+        audio_element_force_set_state(el, AEL_STATE_STOPPED);
+    }
+    el->is_open = false;
+    if (el->write_type == IO_TYPE_FUSED) {
+        audio_element_fused_close(el->out.fused);
+    }
+    audio_arena_free(el->buf);
+    el->buf = NULL;
+    el->stopping = false;
+    el->task_run = false;
+    ESP_LOGD(TAG, "[%s-%p] el task deleted", el->tag, el);
+    xEventGroupSetBits(el->state_event, STOPPED_BIT);
+    xEventGroupSetBits(el->state_event, RESUMED_BIT);
+    xEventGroupSetBits(el->state_event, TASK_DESTROYED_BIT);
+}
+
+void* audio_element_task(void *pv)
+{
+    audio_element_handle_t el = (audio_element_handle_t)pv;
+    audio_element_task_init(el);
+    esp_err_t ret = ESP_OK;
+    while (el->task_run) {
+        if ((ret = audio_event_iface_waiting_cmd_msg(el->iface_event)) != ESP_OK) {
+            xEventGroupSetBits(el->state_event, STOPPED_BIT);
+            /*
+             * Do not exit task when audio_element_process_init failure to
+             * make call audio_element_deinit safety.
+            */
+            if (ret == AEL_IO_ABORT) {
+                break;
+            }
+        }
+        if (audio_element_process_running(el) != ESP_OK) {
+            // continue;
+        }
+    }
+    audio_element_task_deinit(el);
+    /* The element may be freed from here on */
+    audio_thread_delete_task(NULL);
+    return NULL;
+}
+
+/*
+ * Scheduler mode: a running element is only worth a slice once process() can read `buf_size` bytes and write
+ * half of the output ringbuf without blocking its worker. Callback I/O is always taken as ready.
+ */
+static bool audio_element_sched_ready(audio_element_handle_t el)
+{
+    if (!el->is_running || el->state < AEL_STATE_RUNNING) {
+        return false;
+    }
+    if (el->read_type == IO_TYPE_RB && el->in.input_rb
+        && !rb_read_ready(el->in.input_rb, el->buf_size)) {
+        return false;
+    }
+    if (el->write_type == IO_TYPE_RB && el->out.output_rb
+        && !rb_write_ready(el->out.output_rb, rb_get_size(el->out.output_rb) / 2)) {
+        return false;
+    }
+    return true;
+}
+
+static void audio_element_sched_notify(ringbuf_handle_t rb, void *ctx)
+{
+    audio_element_handle_t el = (audio_element_handle_t)ctx;
+    if (audio_element_sched_ready(el)) {
+        audio_scheduler_task_wake(el->sched_task);
+    }
+}
+
+static void audio_element_sched_hook(audio_element_handle_t el, bool enable)
+{
+    if (el->read_type == IO_TYPE_RB && el->in.input_rb) {
+        rb_set_reader_notify(el->in.input_rb, enable ? audio_element_sched_notify : NULL, el);
+    }
+    if (el->write_type == IO_TYPE_RB && el->out.output_rb) {
+        rb_set_writer_notify(el->out.output_rb, enable ? audio_element_sched_notify : NULL, el);
+    }
+}
+
+/*
+ * One step of audio_element_task on a scheduler worker: the pending commands, then one process() call.
+ */
+static audio_scheduler_ret_t audio_element_sched_step(void *ctx)
+{
+    audio_element_handle_t el = (audio_element_handle_t)ctx;
     esp_err_t ret = ESP_OK;
-    while (el->task_run) {
+    while (el->task_run && audio_event_iface_has_cmd_msg(el->iface_event)) {
         if ((ret = audio_event_iface_waiting_cmd_msg(el->iface_event)) != ESP_OK) {
             xEventGroupSetBits(el->state_event, STOPPED_BIT);
-            /*
-             * Do not exit task when audio_element_process_init failure to
-             * make call audio_element_deinit safety.
-            */
             if (ret == AEL_IO_ABORT) {
                 break;
             }
         }
-        if (audio_element_process_running(el) != ESP_OK) {
-            // continue;
-        }
     }
-
-    if (el->is_open && el->close) {
-        ESP_LOGD(TAG, "[%s-%p] el closed", el->tag, el);
-        el->close(el);
-        audio_element_force_set_state(el, AEL_STATE_STOPPED);
+    if (!el->task_run || ret == AEL_IO_ABORT) {
+        audio_element_sched_hook(el, false);
+        audio_element_task_deinit(el);
+        return AUDIO_SCHED_EXIT;
     }
-    el->is_open = false;
-    audio_free(el->buf);
-    el->buf = NULL;
-    el->stopping = false;
-    el->task_run = false;
-    ESP_LOGD(TAG, "[%s-%p] el task deleted", el->tag, el);
-    xEventGroupSetBits(el->state_event, STOPPED_BIT);
-    xEventGroupSetBits(el->state_event, RESUMED_BIT);
-    xEventGroupSetBits(el->state_event, TASK_DESTROYED_BIT);
-    audio_thread_delete_task(&el->audio_thread);
-    return NULL;
+    if (!audio_element_sched_ready(el)) {
+        return AUDIO_SCHED_IDLE;
+    }
+    audio_element_process_running(el);
+    return AUDIO_SCHED_READY;
 }
 
 esp_err_t audio_element_reset_state(audio_element_handle_t el)
@@ -554,30 +1328,84 @@ char *audio_element_get_tag(audio_element_handle_t el)
     return el->tag;
 }
 
-esp_err_t audio_element_set_uri(audio_element_handle_t el, const char *uri)
+/*
+ * `info` is a seqlock: writers still serialize on `el->lock`, readers take no lock and retry if a writer ran
+ * meanwhile, so position polling never contends with the I/O thread. Fields are accessed with relaxed atomics
+ * so a torn read is only ever discarded, never acted on.
+ */
+_Static_assert(sizeof(audio_element_info_t) % sizeof(uint64_t) == 0, "audio_element_info_t is copied in 64-bit words");
+
+#define AUDIO_ELEMENT_INFO_STORE(el, field, value)  __atomic_store_n(&(el)->info.field, (value), __ATOMIC_RELAXED)
+
+#define AUDIO_ELEMENT_INFO_LOAD(el, field, out) do {                                \
+        uint32_t _seq;                                                              \
+        do {                                                                        \
+            _seq = audio_element_info_read_begin(el);                               \
+            (out) = __atomic_load_n(&(el)->info.field, __ATOMIC_RELAXED);           \
+        } while (audio_element_info_read_retry(el, _seq));                          \
+    } while (0)
+
+static void audio_element_info_write_begin(audio_element_handle_t el)
 {
     mutex_lock(el->lock);
-    if (el->info.uri) {
-        audio_free(el->info.uri);
-        el->info.uri = NULL;
+    atomic_store_explicit(&el->info_seq, atomic_load_explicit(&el->info_seq, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void audio_element_info_write_end(audio_element_handle_t el)
+{
+    atomic_store_explicit(&el->info_seq, atomic_load_explicit(&el->info_seq, memory_order_relaxed) + 1,
+                          memory_order_release);
+    mutex_unlock(el->lock);
+}
+
+static inline uint32_t audio_element_info_read_begin(audio_element_handle_t el)
+{
+    uint32_t seq;
+    while ((seq = atomic_load_explicit(&el->info_seq, memory_order_acquire)) & 1) {
+        sched_yield();
     }
+    return seq;
+}
+
+static inline bool audio_element_info_read_retry(audio_element_handle_t el, uint32_t seq)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&el->info_seq, memory_order_relaxed) != seq;
+}
+
+static void audio_element_info_load_format(audio_element_handle_t el, audio_buf_format_t *fmt)
+{
+    uint32_t seq;
+    do {
+        seq = audio_element_info_read_begin(el);
+        fmt->sample_rates = __atomic_load_n(&el->info.sample_rates, __ATOMIC_RELAXED);
+        fmt->channels = __atomic_load_n(&el->info.channels, __ATOMIC_RELAXED);
+        fmt->bits = __atomic_load_n(&el->info.bits, __ATOMIC_RELAXED);
+        fmt->codec_fmt = __atomic_load_n(&el->info.codec_fmt, __ATOMIC_RELAXED);
+    } while (audio_element_info_read_retry(el, seq));
+}
 
+esp_err_t audio_element_set_uri(audio_element_handle_t el, const char *uri)
+{
+    char *dup = NULL;
     if (uri) {
-        el->info.uri = audio_strdup(uri);
-        AUDIO_MEM_CHECK(TAG, el->info.uri, {
-            mutex_unlock(el->lock);
-            return ESP_ERR_NO_MEM;
-        });
-    }
-    mutex_unlock(el->lock);
+        dup = audio_strdup(uri);
+        AUDIO_MEM_CHECK(TAG, dup, return ESP_ERR_NO_MEM);
+    }
+    audio_element_info_write_begin(el);
+    char *old = el->info.uri;
+    AUDIO_ELEMENT_INFO_STORE(el, uri, dup);
+    audio_element_info_write_end(el);
+    audio_free(old);
     return ESP_OK;
 }
 
 char *audio_element_get_uri(audio_element_handle_t el)
 {
-    mutex_lock(el->lock);
-    char *uri = el->info.uri;
-    mutex_unlock(el->lock);
+    char *uri;
+    AUDIO_ELEMENT_INFO_LOAD(el, uri, uri);
     return uri;
 }
 
@@ -594,6 +1422,13 @@ esp_err_t audio_element_msg_set_listener(audio_element_handle_t el, audio_event_
     return audio_event_iface_set_listener(el->iface_event, listener);
 }
 
+esp_err_t audio_element_msg_subscribe(audio_element_handle_t el, audio_event_iface_handle_t listener,
+                                     const audio_event_iface_filter_t *filter)
+{
+    _Static_assert(AEL_MSG_CMD_REPORT_STATUS == AUDIO_EVENT_IFACE_STATUS_CMD, "status filter command mismatch");
+    return audio_event_iface_subscribe(el->iface_event, listener, filter);
+}
+
 esp_err_t audio_element_msg_remove_listener(audio_element_handle_t el, audio_event_iface_handle_t listener)
 {
     return audio_event_iface_remove_listener(listener, el->iface_event);
@@ -602,10 +1437,13 @@ esp_err_t audio_element_msg_remove_listener(audio_element_handle_t el, audio_eve
 esp_err_t audio_element_setinfo(audio_element_handle_t el, audio_element_info_t *info)
 {
     if (info && el) {
-        //FIXME: We will got reset if lock mutex here
-        mutex_lock(el->lock);
-        memcpy(&el->info, info, sizeof(audio_element_info_t));
-        mutex_unlock(el->lock);
+        audio_element_info_write_begin(el);
+        const uint64_t *src = (const uint64_t *)info;
+        uint64_t *dst = (uint64_t *)&el->info;
+        for (size_t i = 0; i < sizeof(audio_element_info_t) / sizeof(uint64_t); i++) {
+            __atomic_store_n(&dst[i], src[i], __ATOMIC_RELAXED);
+        }
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -614,14 +1452,34 @@ esp_err_t audio_element_setinfo(audio_element_handle_t el, audio_element_info_t
 esp_err_t audio_element_getinfo(audio_element_handle_t el, audio_element_info_t *info)
 {
     if (info && el) {
-        mutex_lock(el->lock);
-        memcpy(info, &el->info, sizeof(audio_element_info_t));
-        mutex_unlock(el->lock);
+        uint32_t seq;
+        do {
+            seq = audio_element_info_read_begin(el);
+            const uint64_t *src = (const uint64_t *)&el->info;
+            uint64_t *dst = (uint64_t *)info;
+            for (size_t i = 0; i < sizeof(audio_element_info_t) / sizeof(uint64_t); i++) {
+                dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+            }
+        } while (audio_element_info_read_retry(el, seq));
         return ESP_OK;
     }
     return ESP_FAIL;
 }
 
+int64_t audio_element_get_byte_pos(audio_element_handle_t el)
+{
+    int64_t byte_pos;
+    AUDIO_ELEMENT_INFO_LOAD(el, byte_pos, byte_pos);
+    return byte_pos;
+}
+
+int64_t audio_element_get_total_bytes(audio_element_handle_t el)
+{
+    int64_t total_bytes;
+    AUDIO_ELEMENT_INFO_LOAD(el, total_bytes, total_bytes);
+    return total_bytes;
+}
+
 esp_err_t audio_element_report_info(audio_element_handle_t el)
 {
     if (el) {
@@ -667,7 +1525,7 @@ esp_err_t audio_element_report_pos(audio_element_handle_t el)
         audio_event_iface_msg_t msg = { 0 };
         msg.cmd = AEL_MSG_CMD_REPORT_POSITION;
         if (el->report_info == NULL) {
-            el->report_info = audio_calloc(1, sizeof(audio_element_info_t));
+            el->report_info = audio_element_mem_calloc(el, 1, sizeof(audio_element_info_t));
             AUDIO_MEM_CHECK(TAG, el->report_info, return ESP_ERR_NO_MEM);
         }
 
@@ -681,10 +1539,164 @@ esp_err_t audio_element_report_pos(audio_element_handle_t el)
     return ESP_FAIL;
 }
 
+#if CONFIG_AUDIO_ELEMENT_STATS
+esp_err_t audio_element_report_stats(audio_element_handle_t el)
+{
+    if (el) {
+        audio_event_iface_msg_t msg = { 0 };
+        msg.cmd = AEL_MSG_CMD_REPORT_STATS;
+        if (el->report_stats == NULL) {
+            el->report_stats = audio_element_mem_calloc(el, 1, sizeof(audio_element_stats_t));
+            AUDIO_MEM_CHECK(TAG, el->report_stats, return ESP_ERR_NO_MEM);
+        }
+        audio_element_get_stats(el, el->report_stats);
+        msg.data = el->report_stats;
+        msg.data_len = sizeof(audio_element_stats_t);
+        ESP_LOGD(TAG, "REPORT_STATS,[%s]evt out cmd:%d,", el->tag, msg.cmd);
+        audio_element_msg_sendout(el, &msg);
+        return ESP_OK;
+    }
+    return ESP_FAIL;
+}
+
+static void audio_element_hist_load(audio_element_hist_t *dst, const audio_element_hist_t *src)
+{
+    for (int i = 0; i < AEL_STATS_HIST_BUCKETS; i++) {
+        dst->count[i] = __atomic_load_n(&src->count[i], __ATOMIC_RELAXED);
+    }
+    dst->max_us = __atomic_load_n(&src->max_us, __ATOMIC_RELAXED);
+}
+
+esp_err_t audio_element_get_stats(audio_element_handle_t el, audio_element_stats_t *stats)
+{
+    if (el == NULL || stats == NULL) {
+        return ESP_FAIL;
+    }
+    uint32_t seq;
+    do {
+        while ((seq = atomic_load_explicit(&el->stats_seq, memory_order_acquire)) & 1) {
+            sched_yield();
+        }
+        stats->process_calls = __atomic_load_n(&el->stats.process_calls, __ATOMIC_RELAXED);
+        stats->bytes_in = __atomic_load_n(&el->stats.bytes_in, __ATOMIC_RELAXED);
+        stats->bytes_out = __atomic_load_n(&el->stats.bytes_out, __ATOMIC_RELAXED);
+        stats->process_wall_ns = __atomic_load_n(&el->stats.process_wall_ns, __ATOMIC_RELAXED);
+        stats->process_cpu_ns = __atomic_load_n(&el->stats.process_cpu_ns, __ATOMIC_RELAXED);
+        stats->input_wait_ns = __atomic_load_n(&el->stats.input_wait_ns, __ATOMIC_RELAXED);
+        stats->output_wait_ns = __atomic_load_n(&el->stats.output_wait_ns, __ATOMIC_RELAXED);
+        audio_element_hist_load(&stats->process_wall, &el->stats.process_wall);
+        audio_element_hist_load(&stats->process_cpu, &el->stats.process_cpu);
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&el->stats_seq, memory_order_relaxed) != seq);
+    return ESP_OK;
+}
+#else
+esp_err_t audio_element_report_stats(audio_element_handle_t el)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t audio_element_get_stats(audio_element_handle_t el, audio_element_stats_t *stats)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif /* CONFIG_AUDIO_ELEMENT_STATS */
+
+esp_err_t audio_element_set_output_timestamp(audio_element_handle_t el, int64_t pts, int64_t origin_ns)
+{
+    if (el == NULL) {
+        return ESP_FAIL;
+    }
+    el->out_ts_explicit = true;
+    return audio_element_output_stamp(el, pts, origin_ns);
+}
+
+esp_err_t audio_element_get_input_timestamp(audio_element_handle_t el, rb_timestamp_t *ts)
+{
+    if (el == NULL || ts == NULL) {
+        return ESP_FAIL;
+    }
+    if (!el->in_ts_valid) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *ts = el->in_ts;
+    return ESP_OK;
+}
+
+esp_err_t audio_element_set_presentation(audio_element_handle_t el, int64_t pts, int64_t origin_ns)
+{
+    if (el == NULL) {
+        return ESP_FAIL;
+    }
+    uint32_t seq = atomic_load_explicit(&el->pres_seq, memory_order_relaxed);
+    atomic_store_explicit(&el->pres_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&el->pres_pts, pts, memory_order_relaxed);
+    atomic_store_explicit(&el->pres_origin_ns, origin_ns, memory_order_relaxed);
+    atomic_store_explicit(&el->pres_time_ns, audio_time_now_ns(), memory_order_relaxed);
+    atomic_store_explicit(&el->pres_seq, seq + 2, memory_order_release);
+    return ESP_OK;
+}
+
+esp_err_t audio_element_get_presentation(audio_element_handle_t el, audio_element_presentation_t *pres)
+{
+    if (el == NULL || pres == NULL) {
+        return ESP_FAIL;
+    }
+    uint32_t seq;
+    do {
+        while ((seq = atomic_load_explicit(&el->pres_seq, memory_order_acquire)) & 1) {
+            sched_yield();
+        }
+        pres->pts = atomic_load_explicit(&el->pres_pts, memory_order_relaxed);
+        pres->origin_ns = atomic_load_explicit(&el->pres_origin_ns, memory_order_relaxed);
+        pres->time_ns = atomic_load_explicit(&el->pres_time_ns, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&el->pres_seq, memory_order_relaxed) != seq);
+    return pres->time_ns ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t audio_element_set_stats_report_period(audio_element_handle_t el, int period_ms)
+{
+    if (el == NULL || period_ms < 0) {
+        return ESP_FAIL;
+    }
+    __atomic_store_n(&el->stats_period_ns, (int64_t)period_ms * 1000000, __ATOMIC_RELAXED);
+    return ESP_OK;
+}
+
+uint32_t audio_element_hist_percentile(const audio_element_hist_t *hist, double percentile)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < AEL_STATS_HIST_BUCKETS; i++) {
+        total += hist->count[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * total + 0.5);
+    rank = rank < 1 ? 1 : (rank > total ? total : rank);
+    uint64_t seen = 0;
+    for (int i = 0; i < AEL_STATS_HIST_BUCKETS; i++) {
+        seen += hist->count[i];
+        if (seen < rank) {
+            continue;
+        }
+        const uint32_t sub = 1 << AEL_STATS_HIST_SUB_BITS;
+        uint32_t upper = i;
+        if (i >= sub) {
+            uint32_t shift = i / sub - 1;
+            upper = ((sub | (i & (sub - 1))) << shift) + (1 << shift) - 1;
+        }
+        return (upper < hist->max_us && i < AEL_STATS_HIST_BUCKETS - 1) ? upper : hist->max_us;
+    }
+    return hist->max_us;
+}
+
 esp_err_t audio_element_finish_state(audio_element_handle_t el)
 {
-    if (el->task_stack <= 0) {
-        el->state = AEL_STATE_FINISHED;
+    if (audio_element_is_taskless(el)) {
+        audio_element_force_set_state(el, AEL_STATE_FINISHED);
         audio_element_report_status(el, AEL_STATUS_STATE_FINISHED);
         el->is_running = false;
         xEventGroupSetBits(el->state_event, STOPPED_BIT);
@@ -773,7 +1785,9 @@ esp_err_t audio_element_set_ringbuf_done(audio_element_handle_t el)
     if (NULL == el) {
         return ESP_FAIL;
     }
-    if (el->out.output_rb && el->write_type == IO_TYPE_RB) {
+    if (el->write_type == IO_TYPE_FUSED) {
+        audio_element_fused_done(el->out.fused);
+    } else if (el->out.output_rb && el->write_type == IO_TYPE_RB) {
         ret |= rb_done_write(el->out.output_rb);
         for (int i = 0; i < el->multi_out.max_rb_num; ++i) {
             if (el->multi_out.rb[i]) {
@@ -786,12 +1800,22 @@ esp_err_t audio_element_set_ringbuf_done(audio_element_handle_t el)
 
 esp_err_t audio_element_set_input_ringbuf(audio_element_handle_t el, ringbuf_handle_t rb)
 {
+    if (rb && el->read_type == IO_TYPE_FUSED) {
+        ESP_LOGE(TAG, "[%s] The input is fused, unfuse it first", el->tag);
+        return ESP_FAIL;
+    }
+    if (el->sched_task && el->task_run && el->read_type == IO_TYPE_RB && el->in.input_rb) {
+        rb_set_reader_notify(el->in.input_rb, NULL, NULL);
+    }
     if (rb) {
         el->in.input_rb = rb;
         el->read_type = IO_TYPE_RB;
     } else if (el->read_type == IO_TYPE_RB) {
         el->in.input_rb = rb;
     }
+    if (el->sched_task && el->task_run) {
+        audio_element_sched_hook(el, true);
+    }
     return ESP_OK;
 }
 
@@ -806,12 +1830,22 @@ ringbuf_handle_t audio_element_get_input_ringbuf(audio_element_handle_t el)
 
 esp_err_t audio_element_set_output_ringbuf(audio_element_handle_t el, ringbuf_handle_t rb)
 {
+    if (rb && el->write_type == IO_TYPE_FUSED) {
+        ESP_LOGE(TAG, "[%s] The output is fused, unfuse it first", el->tag);
+        return ESP_FAIL;
+    }
+    if (el->sched_task && el->task_run && el->write_type == IO_TYPE_RB && el->out.output_rb) {
+        rb_set_writer_notify(el->out.output_rb, NULL, NULL);
+    }
     if (rb) {
         el->out.output_rb = rb;
         el->write_type = IO_TYPE_RB;
     } else if (el->write_type == IO_TYPE_RB) {
         el->out.output_rb = rb;
     }
+    if (el->sched_task && el->task_run) {
+        audio_element_sched_hook(el, true);
+    }
     return ESP_OK;
 }
 
@@ -824,6 +1858,45 @@ ringbuf_handle_t audio_element_get_output_ringbuf(audio_element_handle_t el)
     }
 }
 
+esp_err_t audio_element_set_fused_output(audio_element_handle_t el, audio_element_handle_t next)
+{
+    if (el == next || el->is_running || (next && (next->is_running || (next->task_run && next->read_type != IO_TYPE_FUSED)))) {
+        ESP_LOGE(TAG, "[%s] Can not fuse the output to [%s]", el->tag, next ? next->tag : "NULL");
+        return ESP_FAIL;
+    }
+    if (next && next->read_type == IO_TYPE_FUSED && next->in.fused != el) {
+        audio_element_set_fused_output(next->in.fused, NULL);
+    }
+    if (el->write_type == IO_TYPE_FUSED) {
+        audio_element_handle_t old = el->out.fused;
+        if (old->is_running) {
+            ESP_LOGE(TAG, "[%s] Fused element [%s] still running", el->tag, old->tag);
+            return ESP_FAIL;
+        }
+        /* It has been run without a task, the next run starts one */
+        old->task_run = false;
+        old->read_type = IO_TYPE_RB;
+        old->in.input_rb = NULL;
+        el->write_type = IO_TYPE_RB;
+        el->out.output_rb = NULL;
+    }
+    if (next) {
+        el->write_type = IO_TYPE_FUSED;
+        el->out.fused = next;
+        next->read_type = IO_TYPE_FUSED;
+        next->in.fused = el;
+    }
+    return ESP_OK;
+}
+
+audio_element_handle_t audio_element_get_fused_output(audio_element_handle_t el)
+{
+    if (el->write_type == IO_TYPE_FUSED) {
+        return el->out.fused;
+    }
+    return NULL;
+}
+
 esp_err_t audio_element_set_input_timeout(audio_element_handle_t el, TickType_t timeout)
 {
     if (el) {
@@ -859,6 +1932,64 @@ esp_err_t audio_element_set_output_ringbuf_size(audio_element_handle_t el, int r
     return ESP_FAIL;
 }
 
+esp_err_t audio_element_set_output_ringbuf_packet(audio_element_handle_t el, bool packet)
+{
+    if (el) {
+        el->out_rb_packet = packet;
+        return ESP_OK;
+    }
+    return ESP_FAIL;
+}
+
+bool audio_element_is_output_ringbuf_packet(audio_element_handle_t el)
+{
+    if (el) {
+        return el->out_rb_packet;
+    }
+    return false;
+}
+
+esp_err_t audio_element_set_output_ringbuf_desc(audio_element_handle_t el, bool desc)
+{
+    if (el) {
+        el->out_rb_desc = desc;
+        return ESP_OK;
+    }
+    return ESP_FAIL;
+}
+
+bool audio_element_is_output_ringbuf_desc(audio_element_handle_t el)
+{
+    if (el) {
+        return el->out_rb_desc;
+    }
+    return false;
+}
+
+esp_err_t audio_element_set_arena(audio_element_handle_t el, audio_arena_handle_t arena)
+{
+    if (el == NULL) {
+        return ESP_FAIL;
+    }
+    mutex_lock(el->lock);
+    audio_arena_handle_t old = el->arena;
+    el->arena = audio_arena_ref(arena);
+    mutex_unlock(el->lock);
+    /* Blocks already taken keep the old arena alive until they are freed */
+    if (old) {
+        audio_arena_destroy(old);
+    }
+    return ESP_OK;
+}
+
+audio_arena_handle_t audio_element_get_arena(audio_element_handle_t el)
+{
+    if (el) {
+        return el->arena;
+    }
+    return NULL;
+}
+
 esp_err_t audio_element_set_read_cb(audio_element_handle_t el, stream_func fn, void *context)
 {
     if (el) {
@@ -972,6 +2103,7 @@ audio_element_handle_t audio_element_init(audio_element_cfg_t *config)
         el->task_stack = config->task_stack;
         el->stack_in_ext = config->stack_in_ext;
     }
+    el->task_real_time = config->task_real_time;
     if (config->task_prio) {
         el->task_prio = config->task_prio;
     } else {
@@ -982,6 +2114,8 @@ audio_element_handle_t audio_element_init(audio_element_cfg_t *config)
     } else {
         el->task_core = DEFAULT_ELEMENT_TASK_CORE;
     }
+    el->out_rb_packet = config->out_rb_packet;
+    el->out_rb_desc = config->out_rb_desc;
     if (config->out_rb_size > 0) {
         el->out_rb_size = config->out_rb_size;
     } else {
@@ -1047,6 +2181,11 @@ esp_err_t audio_element_deinit(audio_element_handle_t el)
     audio_element_stop(el);
     audio_element_wait_for_stop(el);
     audio_element_terminate(el);
+    if (el->sched_task) {
+        /* The worker may still be returning from the last step */
+        audio_scheduler_task_destroy(el->sched_task);
+        el->sched_task = NULL;
+    }
     vEventGroupDelete(el->state_event);
     el->state_event = NULL;
 
@@ -1064,8 +2203,20 @@ esp_err_t audio_element_deinit(audio_element_handle_t el)
         audio_free(el->multi_out.rb);
         el->multi_out.rb = NULL;
     }
+    if (el->report_stats) {
+        audio_arena_free(el->report_stats);
+    }
     if (el->report_info) {
-        audio_free(el->report_info);
+        audio_arena_free(el->report_info);
+    }
+    if (el->buf_pool) {
+        /* Freed once the last buffer in flight comes back */
+        audio_buf_pool_destroy(el->buf_pool);
+        el->buf_pool = NULL;
+    }
+    if (el->arena) {
+        audio_arena_destroy(el->arena);
+        el->arena = NULL;
     }
     if (el->audio_thread) {
         audio_thread_cleanup(&el->audio_thread);
@@ -1088,9 +2239,31 @@ esp_err_t audio_element_run(audio_element_handle_t el)
     snprintf(task_name, 32, "el-%s", el->tag);
     audio_event_iface_discard(el->iface_event);
     xEventGroupClearBits(el->state_event, TASK_CREATED_BIT);
-    if (el->task_stack > 0) {
-        ret = audio_thread_create(&el->audio_thread, el->tag, audio_element_task, el, el->task_stack,
-                                  el->task_prio, el->stack_in_ext, el->task_core);
+    if (!audio_element_is_taskless(el) && el->scheduler) {
+        if (el->sched_task == NULL) {
+            el->sched_task = audio_scheduler_task_create(el->scheduler, audio_element_sched_step, el);
+            AUDIO_MEM_CHECK(TAG, el->sched_task, return ESP_FAIL);
+        }
+        audio_element_task_init(el);
+        audio_element_sched_hook(el, true);
+        audio_scheduler_task_start(el->sched_task);
+        ret = ESP_OK;
+    } else if (el->read_type == IO_TYPE_FUSED) {
+        /* Opened and run by the element feeding it */
+        el->task_run = true;
+        ret = ESP_OK;
+    } else if (!audio_element_is_taskless(el)) {
+        if (el->audio_thread) {
+            /* Join the task of the previous run */
+            audio_thread_cleanup(&el->audio_thread);
+        }
+        audio_thread_attr_t attr;
+        audio_thread_get_attr(&attr);
+        if (el->task_real_time && attr.policy == SCHED_OTHER) {
+            attr.policy = SCHED_FIFO;
+        }
+        ret = audio_thread_create_with_attr(&el->audio_thread, el->tag, audio_element_task, el, el->task_stack,
+                                            el->task_prio, el->stack_in_ext, el->task_core, &attr);
         if (ret == ESP_FAIL) {
             audio_element_force_set_state(el, AEL_STATE_ERROR);
             audio_element_report_status(el, AEL_STATUS_ERROR_OPEN);
@@ -1113,6 +2286,25 @@ esp_err_t audio_element_run(audio_element_handle_t el)
     return ret;
 }
 
+esp_err_t audio_element_set_scheduler(audio_element_handle_t el, audio_scheduler_handle_t sched)
+{
+    if (el->task_run) {
+        ESP_LOGE(TAG, "[%s] Set the scheduler before the element runs", el->tag);
+        return ESP_FAIL;
+    }
+    if (el->sched_task && el->scheduler != sched) {
+        audio_scheduler_task_destroy(el->sched_task);
+        el->sched_task = NULL;
+    }
+    el->scheduler = sched;
+    return ESP_OK;
+}
+
+audio_scheduler_handle_t audio_element_get_scheduler(audio_element_handle_t el)
+{
+    return el->scheduler;
+}
+
 static inline esp_err_t __audio_element_term(audio_element_handle_t el, TickType_t ticks_to_wait)
 {
     xEventGroupClearBits(el->state_event, TASK_DESTROYED_BIT);
@@ -1137,7 +2329,7 @@ esp_err_t audio_element_terminate(audio_element_handle_t el)
         ESP_LOGW(TAG, "[%s] Element has not create when AUDIO_ELEMENT_TERMINATE", el->tag);
         return ESP_OK;
     }
-    if (el->task_stack <= 0) {
+    if (audio_element_is_taskless(el)) {
         el->task_run = false;
         el->is_running = false;
         return ESP_OK;
@@ -1151,7 +2343,7 @@ esp_err_t audio_element_terminate_with_ticks(audio_element_handle_t el, TickType
         ESP_LOGW(TAG, "[%s] Element has not create when AUDIO_ELEMENT_TERMINATE, tick:%lu", el->tag, ticks_to_wait);
         return ESP_OK;
     }
-    if (el->task_stack <= 0) {
+    if (audio_element_is_taskless(el)) {
         el->task_run = false;
         el->is_running = false;
         return ESP_OK;
@@ -1171,7 +2363,7 @@ esp_err_t audio_element_pause(audio_element_handle_t el)
         return ESP_OK;
     }
     xEventGroupClearBits(el->state_event, PAUSED_BIT);
-    if (el->task_stack <= 0) {
+    if (audio_element_is_taskless(el)) {
         el->is_running = false;
         audio_element_force_set_state(el, AEL_STATE_PAUSED);
         return ESP_OK;
@@ -1180,10 +2372,13 @@ esp_err_t audio_element_pause(audio_element_handle_t el)
         ESP_LOGE(TAG, "[%s] Element send cmd error when AUDIO_ELEMENT_PAUSE", el->tag);
         return ESP_FAIL;
     }
-    EventBits_t uxBits = xEventGroupWaitBits(el->state_event, PAUSED_BIT, false, true, DEFAULT_MAX_WAIT_TIME);
+    /* An element that stops instead of pausing will never set PAUSED_BIT, stop waiting on either */
+    EventBits_t uxBits = xEventGroupWaitBits(el->state_event, PAUSED_BIT | STOPPED_BIT, false, false, DEFAULT_MAX_WAIT_TIME);
     esp_err_t ret = ESP_FAIL;
     if (uxBits & PAUSED_BIT) {
         ret = ESP_OK;
+    } else if (uxBits & STOPPED_BIT) {
+        ESP_LOGW(TAG, "[%s] Element stopped while pausing", el->tag);
     }
     return ret;
 }
@@ -1194,13 +2389,16 @@ esp_err_t audio_element_resume(audio_element_handle_t el, float wait_for_rb_thre
         ESP_LOGW(TAG, "[%s] Element has not create when AUDIO_ELEMENT_RESUME", el->tag);
         return ESP_FAIL;
     }
+    if (el->read_type == IO_TYPE_FUSED) {
+        return ESP_OK;
+    }
     if (el->state == AEL_STATE_RUNNING) {
         audio_element_report_status(el, AEL_STATUS_STATE_RUNNING);
         ESP_LOGD(TAG, "[%s] RESUME: Element is already running, state:%d, task_run:%d, is_running:%d",
                  el->tag, el->state, el->task_run, el->is_running);
         return ESP_OK;
     }
-    if (el->task_stack <= 0) {
+    if (audio_element_is_taskless(el)) {
         el->is_running = true;
         audio_element_force_set_state(el, AEL_STATE_RUNNING);
         audio_element_report_status(el, AEL_STATUS_STATE_RUNNING);
@@ -1253,7 +2451,7 @@ esp_err_t audio_element_stop(audio_element_handle_t el)
     if (el->state == AEL_STATE_RUNNING) {
         xEventGroupClearBits(el->state_event, STOPPED_BIT);
     }
-    if (el->task_stack <= 0) {
+    if (audio_element_is_taskless(el)) {
         el->is_running = false;
         audio_element_force_set_state(el, AEL_STATE_STOPPED);
         xEventGroupSetBits(el->state_event, STOPPED_BIT);
@@ -1371,9 +2569,9 @@ bool audio_element_is_stopping(audio_element_handle_t el)
 esp_err_t audio_element_update_byte_pos(audio_element_handle_t el, int pos)
 {
     if (el) {
-        mutex_lock(el->lock);
-        el->info.byte_pos += pos;
-        mutex_unlock(el->lock);
+        audio_element_info_write_begin(el);
+        AUDIO_ELEMENT_INFO_STORE(el, byte_pos, el->info.byte_pos + pos);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1382,9 +2580,9 @@ esp_err_t audio_element_update_byte_pos(audio_element_handle_t el, int pos)
 esp_err_t audio_element_set_byte_pos(audio_element_handle_t el, int pos)
 {
     if (el) {
-        mutex_lock(el->lock);
-        el->info.byte_pos = pos;
-        mutex_unlock(el->lock);
+        audio_element_info_write_begin(el);
+        AUDIO_ELEMENT_INFO_STORE(el, byte_pos, pos);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1393,9 +2591,9 @@ esp_err_t audio_element_set_byte_pos(audio_element_handle_t el, int pos)
 esp_err_t audio_element_update_total_bytes(audio_element_handle_t el, int total_bytes)
 {
     if (el) {
-        mutex_lock(el->lock);
-        el->info.total_bytes += total_bytes;
-        mutex_unlock(el->lock);
+        audio_element_info_write_begin(el);
+        AUDIO_ELEMENT_INFO_STORE(el, total_bytes, el->info.total_bytes + total_bytes);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1404,9 +2602,9 @@ esp_err_t audio_element_update_total_bytes(audio_element_handle_t el, int total_
 esp_err_t audio_element_set_total_bytes(audio_element_handle_t el, int total_bytes)
 {
     if (el) {
-        mutex_lock(el->lock);
-        el->info.total_bytes = total_bytes;
-        mutex_unlock(el->lock);
+        audio_element_info_write_begin(el);
+        AUDIO_ELEMENT_INFO_STORE(el, total_bytes, total_bytes);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1415,9 +2613,9 @@ esp_err_t audio_element_set_total_bytes(audio_element_handle_t el, int total_byt
 esp_err_t audio_element_set_bps(audio_element_handle_t el, int bit_rate)
 {
     if (el) {
-        mutex_lock(el->lock);
-        el->info.bps = bit_rate;
-        mutex_unlock(el->lock);
+        audio_element_info_write_begin(el);
+        AUDIO_ELEMENT_INFO_STORE(el, bps, bit_rate);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1426,9 +2624,9 @@ esp_err_t audio_element_set_bps(audio_element_handle_t el, int bit_rate)
 esp_err_t audio_element_set_codec_fmt(audio_element_handle_t el, int format)
 {
     if (el) {
-        mutex_lock(el->lock);
-        el->info.codec_fmt = format;
-        mutex_unlock(el->lock);
+        audio_element_info_write_begin(el);
+        AUDIO_ELEMENT_INFO_STORE(el, codec_fmt, format);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1437,11 +2635,11 @@ esp_err_t audio_element_set_codec_fmt(audio_element_handle_t el, int format)
 esp_err_t audio_element_set_music_info(audio_element_handle_t el, int sample_rates, int channels, int bits)
 {
     if (el) {
-        mutex_lock(el->lock);
-        el->info.sample_rates = sample_rates;
-        el->info.channels = channels;
-        el->info.bits = bits;
-        mutex_unlock(el->lock);
+        audio_element_info_write_begin(el);
+        AUDIO_ELEMENT_INFO_STORE(el, sample_rates, sample_rates);
+        AUDIO_ELEMENT_INFO_STORE(el, channels, channels);
+        AUDIO_ELEMENT_INFO_STORE(el, bits, bits);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1450,9 +2648,9 @@ esp_err_t audio_element_set_music_info(audio_element_handle_t el, int sample_rat
 esp_err_t audio_element_set_duration(audio_element_handle_t el, int duration)
 {
     if (el) {
-        mutex_lock(el->lock);
-        el->info.duration = duration;
-        mutex_unlock(el->lock);
+        audio_element_info_write_begin(el);
+        AUDIO_ELEMENT_INFO_STORE(el, duration, duration);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1461,9 +2659,9 @@ esp_err_t audio_element_set_duration(audio_element_handle_t el, int duration)
 esp_err_t audio_element_set_reserve_user0(audio_element_handle_t el, int user_data0)
 {
     if (el) {
-        mutex_lock(el->lock);
-        el->info.reserve_data.user_data_0 = user_data0;
-        mutex_unlock(el->lock);
+        audio_element_info_write_begin(el);
+        AUDIO_ELEMENT_INFO_STORE(el, reserve_data.user_data_0, user_data0);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1472,9 +2670,9 @@ esp_err_t audio_element_set_reserve_user0(audio_element_handle_t el, int user_da
 esp_err_t audio_element_set_reserve_user1(audio_element_handle_t el, int user_data1)
 {
     if (el) {
-        mutex_lock(el->lock);
-        el->info.reserve_data.user_data_1 = user_data1;
-        mutex_unlock(el->lock);
+        audio_element_info_write_begin(el);
+        AUDIO_ELEMENT_INFO_STORE(el, reserve_data.user_data_1, user_data1);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1483,9 +2681,9 @@ esp_err_t audio_element_set_reserve_user1(audio_element_handle_t el, int user_da
 esp_err_t audio_element_set_reserve_user2(audio_element_handle_t el, int user_data2)
 {
     if (el) {
-        mutex_lock(el->lock);
-        el->info.reserve_data.user_data_2 = user_data2;
-        mutex_unlock(el->lock);
+        audio_element_info_write_begin(el);
+        AUDIO_ELEMENT_INFO_STORE(el, reserve_data.user_data_2, user_data2);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1495,9 +2693,9 @@ esp_err_t audio_element_set_reserve_user2(audio_element_handle_t el, int user_da
 esp_err_t audio_element_set_reserve_user3(audio_element_handle_t el, int user_data3)
 {
     if (el) {
-        mutex_lock(el->lock);
-        el->info.reserve_data.user_data_3 = user_data3;
-        mutex_unlock(el->lock);
+        audio_element_info_write_begin(el);
+        AUDIO_ELEMENT_INFO_STORE(el, reserve_data.user_data_3, user_data3);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -1506,9 +2704,9 @@ esp_err_t audio_element_set_reserve_user3(audio_element_handle_t el, int user_da
 esp_err_t audio_element_set_reserve_user4(audio_element_handle_t el, int user_data4)
 {
     if (el) {
-        mutex_lock(el->lock);
-        el->info.reserve_data.user_data_4 = user_data4;
-        mutex_unlock(el->lock);
+        audio_element_info_write_begin(el);
+        AUDIO_ELEMENT_INFO_STORE(el, reserve_data.user_data_4, user_data4);
+        audio_element_info_write_end(el);
         return ESP_OK;
     }
     return ESP_FAIL;
@@ -21,16 +21,21 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  *
  */
+#include <stdatomic.h>
 #include "audio_event_iface.h"
+#include "audio_mutex.h"
 
 static const char *TAG = "AUDIO_EVT";
 
+#define SENDOUT_STACK_LISTENERS     (8)     /* Listeners `audio_event_iface_sendout` collects without an allocation */
 
+/* A subscription, on the `subscribers` list of the source and the `sources` list of the listener */
 typedef struct audio_event_iface_item {
     STAILQ_ENTRY(audio_event_iface_item)    next;
-    mqd_t                           queue;
-    int                                     queue_size;
-    int                                     mark_to_remove;
+    STAILQ_ENTRY(audio_event_iface_item)    next_source;
+    audio_event_iface_handle_t              source;
+    audio_event_iface_handle_t              listener;
+    audio_event_iface_filter_t              filter;
 } audio_event_iface_item_t;
 
 typedef STAILQ_HEAD(audio_event_iface_list, audio_event_iface_item) audio_event_iface_list_t;
@@ -41,17 +46,147 @@ typedef STAILQ_HEAD(audio_event_iface_list, audio_event_iface_item) audio_event_
 struct audio_event_iface {
     mqd_t                internal_queue;
     mqd_t                external_queue;
+    audio_mpsc_queue_handle_t   internal_inproc;
     int                        oflags;
     char                    internal_mqname[16];
     int                        internal_queue_size;
     int                        external_queue_size;
-    audio_event_iface_list_t    listening_queues;
+    audio_event_iface_list_t    subscribers;        /* Listeners `audio_event_iface_sendout` publishes to */
+    int                         subscriber_num;
+    audio_event_iface_list_t    sources;            /* Events this one listens to, linked by `next_source` */
+    pthread_mutex_t             *lock;              /* Guards `subscribers` */
+    atomic_uint                 refs;               /* The owner, and each sendout delivering to this listener */
+    audio_event_iface_drop_t    drop_policy;
+    atomic_uint                 dropped;
     void                        *context;
     on_event_iface_func         on_cmd;
     int                         wait_time;
     int                         type;
 };
 
+/*
+ * Taken before any `lock` by whoever changes a subscription. Both lists of an item change under it, so a listener
+ * and a source going away at the same time each find the other still there or already unlinked.
+ */
+static pthread_mutex_t s_subscribe_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool audio_event_iface_has_queue(audio_event_iface_handle_t evt)
+{
+    return evt->internal_inproc || evt->internal_queue;
+}
+
+static int audio_event_iface_queue_send(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg, TickType_t wait_time)
+{
+    if (evt->internal_inproc) {
+        return audio_mpsc_queue_send(evt->internal_inproc, msg, wait_time);
+    }
+    return audio_queue_send(evt->internal_queue, (char *)msg, sizeof(audio_event_iface_msg_t), wait_time);
+}
+
+/* Whatever the flags of the queue, a slow listener never stalls the source */
+static int audio_event_iface_queue_try_send(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg)
+{
+    if (evt->internal_inproc) {
+        return audio_mpsc_queue_try_send(evt->internal_inproc, msg);
+    }
+    return audio_queue_try_send(evt->internal_queue, (char *)msg, sizeof(audio_event_iface_msg_t));
+}
+
+static bool audio_event_iface_queue_try_recv(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg)
+{
+    if (evt->internal_inproc) {
+        return audio_mpsc_queue_recv_batch(evt->internal_inproc, msg, 1) == 1;
+    }
+    return audio_queue_try_recv(evt->internal_queue, (char *)msg, sizeof(audio_event_iface_msg_t)) == sizeof(audio_event_iface_msg_t);
+}
+
+static bool audio_event_iface_queue_recv(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg, TickType_t wait_time)
+{
+    if (evt->internal_inproc) {
+        return audio_mpsc_queue_recv(evt->internal_inproc, msg, wait_time) == sizeof(audio_event_iface_msg_t);
+    }
+    return evt->internal_queue
+           && audio_queue_recv(evt->internal_queue, (char *)msg, sizeof(audio_event_iface_msg_t), wait_time) == sizeof(audio_event_iface_msg_t);
+}
+
+static bool audio_event_iface_filter_match(const audio_event_iface_filter_t *filter, audio_event_iface_msg_t *msg)
+{
+    if ((filter->source && filter->source != msg->source)
+        || (filter->source_type && filter->source_type != msg->source_type)) {
+        return false;
+    }
+    if (filter->cmd_mask && (msg->cmd < 0 || msg->cmd >= 64 || !(filter->cmd_mask & AUDIO_EVENT_IFACE_BIT(msg->cmd)))) {
+        return false;
+    }
+    if (filter->status_mask && msg->cmd == AUDIO_EVENT_IFACE_STATUS_CMD) {
+        int status = (int)(intptr_t)msg->data;
+        return status >= 0 && status < 64 && (filter->status_mask & AUDIO_EVENT_IFACE_BIT(status));
+    }
+    return true;
+}
+
+/*
+ * Post to the listener queue without waiting, even on a blocking one. When it is full the listener drop policy
+ * decides which message is lost.
+ */
+static esp_err_t audio_event_iface_deliver(audio_event_iface_handle_t listener, audio_event_iface_msg_t *msg)
+{
+    if (audio_event_iface_queue_try_send(listener, msg) == 0) {
+        return ESP_OK;
+    }
+    if (listener->drop_policy == AUDIO_EVENT_IFACE_DROP_OLDEST) {
+        audio_event_iface_msg_t oldest;
+        if (audio_event_iface_queue_try_recv(listener, &oldest)
+            && audio_event_iface_queue_try_send(listener, msg) == 0) {
+            atomic_fetch_add(&listener->dropped, 1);
+            return ESP_OK;
+        }
+    }
+    atomic_fetch_add(&listener->dropped, 1);
+    return ESP_FAIL;
+}
+
+/* Drop a reference, the last one frees the interface */
+static void audio_event_iface_release(audio_event_iface_handle_t evt)
+{
+    if (atomic_fetch_sub(&evt->refs, 1) != 1) {
+        return;
+    }
+    mutex_destroy(evt->lock);
+    if (evt->internal_inproc) {
+        audio_event_iface_set_cmd_waiting_timeout(evt, 0);
+        audio_mpsc_queue_destroy(evt->internal_inproc);
+    } else if (evt->internal_queue) {
+        audio_event_iface_set_cmd_waiting_timeout(evt, 0);
+        audio_queue_delete(evt->internal_queue, evt->internal_mqname);
+    }
+    audio_free(evt);
+}
+
+/* Take the subscription off both lists and free it, with `s_subscribe_lock` held */
+static void audio_event_iface_unlink(audio_event_iface_item_t *item)
+{
+    audio_event_iface_handle_t source = item->source;
+    mutex_lock(source->lock);
+    STAILQ_REMOVE(&source->subscribers, item, audio_event_iface_item, next);
+    source->subscriber_num--;
+    mutex_unlock(source->lock);
+    STAILQ_REMOVE(&item->listener->sources, item, audio_event_iface_item, next_source);
+    audio_free(item);
+}
+
+static void audio_event_iface_queue_drain(audio_event_iface_handle_t evt)
+{
+    audio_event_iface_msg_t msg;
+    if (evt->internal_inproc) {
+        while (audio_mpsc_queue_message_available(evt->internal_inproc) > 0
+               && audio_mpsc_queue_recv(evt->internal_inproc, &msg, 0) == sizeof(audio_event_iface_msg_t));
+    } else if (evt->internal_queue) {
+        while ((audio_queue_message_available(evt->internal_queue) > 0) &&
+                    (audio_queue_recv(evt->internal_queue, (char*)&msg, sizeof(audio_event_iface_msg_t), 0) == sizeof(audio_event_iface_msg_t)));
+    }
+}
+
 audio_event_iface_handle_t audio_event_iface_init(audio_event_iface_cfg_t *config)
 {
     int ret;
@@ -64,6 +199,18 @@ audio_event_iface_handle_t audio_event_iface_init(audio_event_iface_cfg_t *confi
     evt->context = config->context;
     evt->on_cmd = config->on_cmd;
     evt->type = config->type;
+    evt->drop_policy = config->drop_policy;
+    STAILQ_INIT(&evt->subscribers);
+    STAILQ_INIT(&evt->sources);
+    atomic_init(&evt->refs, 1);
+    evt->lock = mutex_create();
+    AUDIO_MEM_CHECK(TAG, evt->lock, goto _event_iface_init_failed);
+    if (evt->internal_queue_size && config->queue_type == AUDIO_EVENT_IFACE_QUEUE_INPROC) {
+        evt->internal_inproc = audio_mpsc_queue_create(evt->internal_queue_size, sizeof(audio_event_iface_msg_t),
+                               (evt->oflags & O_NONBLOCK) != 0);
+        AUDIO_MEM_CHECK(TAG, evt->internal_inproc, goto _event_iface_init_failed);
+        return evt;
+    }
     snprintf(evt->internal_mqname, sizeof(evt->internal_mqname), "/%0lx",  (unsigned long)((uintptr_t)evt));
     if (evt->internal_queue_size) {
         evt->internal_queue = audio_queue_create(evt->internal_mqname, evt->oflags, evt->internal_queue_size, sizeof(audio_event_iface_msg_t));
@@ -79,15 +226,17 @@ audio_event_iface_handle_t audio_event_iface_init(audio_event_iface_cfg_t *confi
 
     return evt;
 _event_iface_init_failed:
+    if (evt->lock) {
+        mutex_destroy(evt->lock);
+    }
+    audio_free(evt);
     return NULL;
 }
 
 esp_err_t audio_event_iface_read(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg, TickType_t wait_time)
 {
-    if (evt->internal_queue) {
-            if (audio_queue_recv(evt->internal_queue, (char*)msg, sizeof(audio_event_iface_msg_t), wait_time) == sizeof(audio_event_iface_msg_t)) {
-                return ESP_OK;
-            }
+    if (audio_event_iface_queue_recv(evt, msg, wait_time)) {
+        return ESP_OK;
     }
     return ESP_FAIL;
 }
@@ -96,18 +245,59 @@ esp_err_t audio_event_iface_destroy(audio_event_iface_handle_t evt)
 {
     audio_event_iface_discard(evt);
 
-    if (evt->internal_queue) {
-        audio_event_iface_set_cmd_waiting_timeout(evt, 0);
-        audio_queue_delete(evt->internal_queue, evt->internal_mqname);
+    pthread_mutex_lock(&s_subscribe_lock);
+    while (!STAILQ_EMPTY(&evt->sources)) {
+        audio_event_iface_unlink(STAILQ_FIRST(&evt->sources));
     }
+    while (!STAILQ_EMPTY(&evt->subscribers)) {
+        audio_event_iface_unlink(STAILQ_FIRST(&evt->subscribers));
+    }
+    pthread_mutex_unlock(&s_subscribe_lock);
 
-    audio_free(evt);
+    /* A sendout that took this listener before it was unsubscribed frees it once it is done */
+    audio_event_iface_release(evt);
+    return ESP_OK;
+}
+
+esp_err_t audio_event_iface_subscribe(audio_event_iface_handle_t evt, audio_event_iface_handle_t listener,
+                                      const audio_event_iface_filter_t *filter)
+{
+    if (!evt || !listener || evt == listener
+        || !audio_event_iface_has_queue(listener)
+        || (0 == listener->internal_queue_size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    audio_event_iface_filter_t match_all = { 0 };
+    audio_event_iface_item_t *item;
+    pthread_mutex_lock(&s_subscribe_lock);
+    mutex_lock(evt->lock);
+    STAILQ_FOREACH(item, &evt->subscribers, next) {
+        if (item->listener == listener) {
+            break;
+        }
+    }
+    if (item == NULL) {
+        item = audio_calloc(1, sizeof(audio_event_iface_item_t));
+        AUDIO_MEM_CHECK(TAG, item, {
+            mutex_unlock(evt->lock);
+            pthread_mutex_unlock(&s_subscribe_lock);
+            return ESP_ERR_NO_MEM;
+        });
+        item->source = evt;
+        item->listener = listener;
+        STAILQ_INSERT_TAIL(&evt->subscribers, item, next);
+        evt->subscriber_num++;
+        STAILQ_INSERT_TAIL(&listener->sources, item, next_source);
+    }
+    item->filter = filter ? *filter : match_all;
+    mutex_unlock(evt->lock);
+    pthread_mutex_unlock(&s_subscribe_lock);
     return ESP_OK;
 }
 
 esp_err_t audio_event_iface_set_listener(audio_event_iface_handle_t evt, audio_event_iface_handle_t listener)
 {
-    if ((0 == listener->internal_queue)
+    if (!audio_event_iface_has_queue(listener)
         || (0 == listener->internal_queue_size)) {
         return ESP_ERR_INVALID_ARG;
     }
@@ -117,37 +307,30 @@ esp_err_t audio_event_iface_set_listener(audio_event_iface_handle_t evt, audio_e
         return ESP_FAIL;
     }
 
-    evt->external_queue = listener->internal_queue;
-
-    return ESP_OK;
+    return audio_event_iface_subscribe(evt, listener, NULL);
 }
 
 esp_err_t audio_event_iface_set_msg_listener(audio_event_iface_handle_t evt, audio_event_iface_handle_t listener)
 {
-
-    // if ((NULL == evt->internal_queue)
-    //     || (0 == evt->internal_queue_size)) {
-    //     return ESP_ERR_INVALID_ARG;
-    // }
-    // audio_event_iface_item_t *item = audio_calloc(1, sizeof(audio_event_iface_item_t));
-    // AUDIO_MEM_CHECK(TAG, item, return ESP_ERR_NO_MEM);
-    // if (audio_event_iface_discard(listener) != ESP_OK) {
-    //     AUDIO_ERROR(TAG, "Error cleanup listener");
-    //     return ESP_FAIL;
-    // }
-    // item->queue = evt->internal_queue;
-    // item->queue_size = evt->internal_queue_size;
-    // STAILQ_INSERT_TAIL(&listener->listening_queues, item, next);
-    // return audio_event_iface_update_listener(listener);
-    printf("ERROR: audio_event_iface_set_msg_listener is unimplemented");
-    return ESP_FAIL;
-
+    return audio_event_iface_subscribe(evt, listener, NULL);
 }
 
 esp_err_t audio_event_iface_remove_listener(audio_event_iface_handle_t listen, audio_event_iface_handle_t evt)
 {
-    if ((0 == evt->external_queue)
-        || (0 == evt->external_queue_size)) {
+    if (!listen || !evt || (0 == evt->external_queue_size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    audio_event_iface_item_t *item;
+    pthread_mutex_lock(&s_subscribe_lock);
+    STAILQ_FOREACH(item, &evt->subscribers, next) {
+        if (item->listener == listen) {
+            audio_event_iface_unlink(item);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_subscribe_lock);
+    if (item == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
 
@@ -155,11 +338,17 @@ esp_err_t audio_event_iface_remove_listener(audio_event_iface_handle_t listen, a
         AUDIO_ERROR(TAG, "Error cleanup listener");
         return ESP_FAIL;
     }
-
-    evt->external_queue = 0;
     return ESP_OK;
 }
 
+uint32_t audio_event_iface_get_dropped(audio_event_iface_handle_t evt)
+{
+    if (!evt) {
+        return 0;
+    }
+    return atomic_load(&evt->dropped);
+}
+
 esp_err_t audio_event_iface_set_cmd_waiting_timeout(audio_event_iface_handle_t evt, TickType_t wait_time)
 {
     evt->wait_time = wait_time;
@@ -169,7 +358,7 @@ esp_err_t audio_event_iface_set_cmd_waiting_timeout(audio_event_iface_handle_t e
 esp_err_t audio_event_iface_waiting_cmd_msg(audio_event_iface_handle_t evt)
 {
     audio_event_iface_msg_t msg;
-    if (evt->internal_queue && (audio_queue_recv(evt->internal_queue, (char*)&msg, sizeof(audio_event_iface_msg_t), evt->wait_time) == sizeof(audio_event_iface_msg_t))) {
+    if (audio_event_iface_queue_recv(evt, &msg, evt->wait_time)) {
         if (evt->on_cmd) {
             return evt->on_cmd((void *)&msg, evt->context);
         }
@@ -177,11 +366,19 @@ esp_err_t audio_event_iface_waiting_cmd_msg(audio_event_iface_handle_t evt)
     return ESP_OK;
 }
 
+bool audio_event_iface_has_cmd_msg(audio_event_iface_handle_t evt)
+{
+    if (evt->internal_inproc) {
+        return audio_mpsc_queue_message_available(evt->internal_inproc) > 0;
+    }
+    return evt->internal_queue && audio_queue_message_available(evt->internal_queue) > 0;
+}
+
 esp_err_t audio_event_iface_cmd(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg)
 {
-    if (evt->internal_queue) {
+    if (audio_event_iface_has_queue(evt)) {
         int status = 0;
-        status = audio_queue_send(evt->internal_queue, (char*)msg, sizeof(audio_event_iface_msg_t), 0);
+        status = audio_event_iface_queue_send(evt, msg, 0);
         if (status < 0) {
             printf("audio_event_iface_cmd: ERROR audio_queue_send failure=%d on msg\n",status);
             return ESP_FAIL;
@@ -192,15 +389,46 @@ esp_err_t audio_event_iface_cmd(audio_event_iface_handle_t evt, audio_event_ifac
 
 esp_err_t audio_event_iface_sendout(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg)
 {
+    esp_err_t ret = ESP_OK;
     if (evt->external_queue) {
         int status = 0;
-        status = audio_queue_send(evt->external_queue, (char*)msg, sizeof(audio_event_iface_msg_t), 0);
+        status = audio_queue_try_send(evt->external_queue, (char*)msg, sizeof(audio_event_iface_msg_t));
         if (status < 0) {
             printf("audio_event_iface_sendout: ERROR audio_queue_send failure=%d on msg\n",status);
-            return ESP_FAIL;
+            ret = ESP_FAIL;
         }
     }
-    return ESP_OK;
+    /* Take the matching listeners under the lock and deliver without it, each one held by a reference */
+    audio_event_iface_handle_t stack_listeners[SENDOUT_STACK_LISTENERS];
+    audio_event_iface_handle_t *listeners = stack_listeners;
+    audio_event_iface_item_t *item;
+    int num = 0;
+    mutex_lock(evt->lock);
+    if (evt->subscriber_num > SENDOUT_STACK_LISTENERS) {
+        listeners = audio_malloc(evt->subscriber_num * sizeof(audio_event_iface_handle_t));
+        AUDIO_MEM_CHECK(TAG, listeners, {
+            mutex_unlock(evt->lock);
+            return ESP_ERR_NO_MEM;
+        });
+    }
+    STAILQ_FOREACH(item, &evt->subscribers, next) {
+        if (audio_event_iface_filter_match(&item->filter, msg)) {
+            atomic_fetch_add(&item->listener->refs, 1);
+            listeners[num++] = item->listener;
+        }
+    }
+    mutex_unlock(evt->lock);
+    for (int i = 0; i < num; i++) {
+        if (audio_event_iface_deliver(listeners[i], msg) != ESP_OK) {
+            ESP_LOGD(TAG, "Listener %p is full, dropped cmd %d", listeners[i], msg->cmd);
+            ret = ESP_FAIL;
+        }
+        audio_event_iface_release(listeners[i]);
+    }
+    if (listeners != stack_listeners) {
+        audio_free(listeners);
+    }
+    return ret;
 }
 
 esp_err_t audio_event_iface_discard(audio_event_iface_handle_t evt)
@@ -210,9 +438,8 @@ esp_err_t audio_event_iface_discard(audio_event_iface_handle_t evt)
         while((audio_queue_message_available(evt->external_queue) > 0) &&
                     (audio_queue_recv(evt->external_queue, (char*)&msg, sizeof(audio_event_iface_msg_t), 0) == sizeof(audio_event_iface_msg_t)));
     }
-    if (evt->internal_queue && evt->internal_queue_size) {
-        while((audio_queue_message_available(evt->internal_queue) > 0) &&
-                    (audio_queue_recv(evt->internal_queue, (char*)&msg, sizeof(audio_event_iface_msg_t), 0) == sizeof(audio_event_iface_msg_t)));
+    if (evt->internal_queue_size) {
+        audio_event_iface_queue_drain(evt);
     }
     return ESP_OK;
 }
@@ -228,12 +455,49 @@ esp_err_t audio_event_iface_listen(audio_event_iface_handle_t evt, audio_event_i
     return ESP_OK;
 }
 
+int audio_event_iface_listen_batch(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msgs, int max_msgs)
+{
+    if (!evt || !msgs || max_msgs <= 0) {
+        return 0;
+    }
+    if (evt->internal_inproc) {
+        return audio_mpsc_queue_recv_batch(evt->internal_inproc, msgs, max_msgs);
+    }
+    int n = 0;
+    while (evt->internal_queue && n < max_msgs && audio_queue_message_available(evt->internal_queue) > 0
+           && audio_queue_recv(evt->internal_queue, (char *)&msgs[n], sizeof(audio_event_iface_msg_t), 0) == sizeof(audio_event_iface_msg_t)) {
+        n++;
+    }
+    return n;
+}
+
+int audio_event_iface_get_fd(audio_event_iface_handle_t evt)
+{
+    if (!evt) {
+        return -1;
+    }
+    if (evt->internal_inproc) {
+        return audio_mpsc_queue_get_fd(evt->internal_inproc);
+    }
+    return evt->internal_queue ? (int)evt->internal_queue : -1;
+}
+
 mqd_t audio_event_iface_get_queue_handle(audio_event_iface_handle_t evt)
 {
     if (!evt) {
         return 0;
     }
-    return evt->external_queue;
+    mqd_t queue = evt->external_queue;
+    mutex_lock(evt->lock);
+    if (!STAILQ_EMPTY(&evt->subscribers)) {
+        audio_event_iface_handle_t listener = STAILQ_FIRST(&evt->subscribers)->listener;
+        if (listener->internal_inproc) {
+            ESP_LOGE(TAG, "Listener %p has an in-process queue, no mqd_t, see audio_event_iface_get_fd", listener);
+        }
+        queue = listener->internal_queue;
+    }
+    mutex_unlock(evt->lock);
+    return queue;
 }
 
 mqd_t audio_event_iface_get_msg_queue_handle(audio_event_iface_handle_t evt)
@@ -241,5 +505,8 @@ mqd_t audio_event_iface_get_msg_queue_handle(audio_event_iface_handle_t evt)
     if (!evt) {
         return 0;
     }
+    if (evt->internal_inproc) {
+        ESP_LOGE(TAG, "Event %p has an in-process queue, no mqd_t, see audio_event_iface_get_fd", evt);
+    }
     return evt->internal_queue;
 }
@@ -31,7 +31,9 @@
 #include "audio_pipeline.h"
 #include "audio_event_iface.h"
 #include "audio_mem.h"
+#include "audio_arena.h"
 #include "audio_mutex.h"
+#include "audio_time.h"
 #include "ringbuf.h"
 #include "audio_error.h"
 
@@ -39,6 +41,10 @@ static const char *TAG = "AUDIO_PIPELINE";
 
 #define PIPELINE_DEBUG(x) debug_pipeline_lists(x, __LINE__, __func__)
 
+#ifndef CONFIG_AUDIO_PIPELINE_DESC_DEPTH
+# define CONFIG_AUDIO_PIPELINE_DESC_DEPTH 8
+#endif
+
 typedef struct ringbuf_item {
     STAILQ_ENTRY(ringbuf_item)  next;
     ringbuf_handle_t            rb;
@@ -59,13 +65,24 @@ typedef struct audio_element_item {
 
 typedef STAILQ_HEAD(audio_element_list, audio_element_item) audio_element_list_t;
 
+typedef struct subscriber_item {
+    STAILQ_ENTRY(subscriber_item)   next;
+    audio_event_iface_handle_t      listener;
+} subscriber_item_t;
+
+typedef STAILQ_HEAD(subscriber_list, subscriber_item) subscriber_list_t;
+
 struct audio_pipeline {
     audio_element_list_t        el_list;
     ringbuf_list_t              rb_list;
     audio_element_state_t       state;
-    pthread_mutex_t *lock;
+    pthread_mutex_t *lock;                  /* Guards el_list and rb_list against audio_pipeline_get_stats */
     bool                        linked;
     audio_event_iface_handle_t  listener;
+    subscriber_list_t           subscribers;
+    audio_scheduler_handle_t    scheduler;
+    bool                        fused;
+    audio_arena_handle_t        arena;      /* List nodes, ringbuffers and element buffers, NULL for the heap */
 };
 
 static audio_element_item_t *audio_pipeline_get_el_item_by_tag(audio_pipeline_handle_t pipeline, const char *tag)
@@ -103,33 +120,42 @@ static void audio_pipeline_register_element(audio_pipeline_handle_t pipeline, au
         ESP_LOGW(TAG, "%d, %s already exist in pipeline", __LINE__, audio_element_get_tag(el));
         return;
     }
-    audio_element_item_t *el_item = audio_calloc(1, sizeof(audio_element_item_t));
+    audio_element_item_t *el_item = audio_arena_calloc(pipeline->arena, 1, sizeof(audio_element_item_t));
     AUDIO_MEM_CHECK(TAG, el_item, return);
+    if (pipeline->arena) {
+        audio_element_set_arena(el, pipeline->arena);
+    }
     el_item->el = el;
     el_item->linked = true;
+    mutex_lock(pipeline->lock);
     STAILQ_INSERT_TAIL(&pipeline->el_list, el_item, next);
+    mutex_unlock(pipeline->lock);
 }
 
 static void audio_pipeline_unregister_element(audio_pipeline_handle_t pipeline, audio_element_handle_t el)
 {
     audio_element_item_t *el_item, *tmp;
+    mutex_lock(pipeline->lock);
     STAILQ_FOREACH_SAFE(el_item, &pipeline->el_list, next, tmp) {
         if (el_item->el == el) {
             STAILQ_REMOVE(&pipeline->el_list, el_item, audio_element_item, next);
-            audio_free(el_item);
+            audio_arena_free(el_item);
         }
     }
+    mutex_unlock(pipeline->lock);
 }
 
 static void add_rb_to_audio_pipeline(audio_pipeline_handle_t pipeline, ringbuf_handle_t rb, audio_element_handle_t host_el)
 {
-    ringbuf_item_t *rb_item = (ringbuf_item_t *)audio_calloc(1, sizeof(ringbuf_item_t));
+    ringbuf_item_t *rb_item = (ringbuf_item_t *)audio_arena_calloc(pipeline->arena, 1, sizeof(ringbuf_item_t));
     AUDIO_MEM_CHECK(TAG, rb_item, return);
     rb_item->rb = rb;
     rb_item->linked = true;
     rb_item->kept_ctx = false;
     rb_item->host_el = host_el;
+    mutex_lock(pipeline->lock);
     STAILQ_INSERT_TAIL(&pipeline->rb_list, rb_item, next);
+    mutex_unlock(pipeline->lock);
 }
 
 static void debug_pipeline_lists(audio_pipeline_handle_t pipeline, int line, const char *func)
@@ -240,6 +266,67 @@ esp_err_t audio_pipeline_remove_listener(audio_pipeline_handle_t pipeline)
     return ESP_OK;
 }
 
+esp_err_t audio_pipeline_subscribe(audio_pipeline_handle_t pipeline, audio_event_iface_handle_t listener,
+                                   const audio_event_iface_filter_t *filter)
+{
+    if (pipeline == NULL || listener == NULL) {
+        ESP_LOGE(TAG, "%s have invalid args, %p, %p", __func__, pipeline, listener);
+        return ESP_ERR_INVALID_ARG;
+    }
+    subscriber_item_t *sub;
+    STAILQ_FOREACH(sub, &pipeline->subscribers, next) {
+        if (sub->listener == listener) {
+            break;
+        }
+    }
+    if (sub == NULL) {
+        sub = audio_arena_calloc(pipeline->arena, 1, sizeof(subscriber_item_t));
+        AUDIO_MEM_CHECK(TAG, sub, return ESP_ERR_NO_MEM);
+        sub->listener = listener;
+        STAILQ_INSERT_TAIL(&pipeline->subscribers, sub, next);
+    }
+    audio_element_item_t *el_item;
+    STAILQ_FOREACH(el_item, &pipeline->el_list, next) {
+        if (el_item->linked == false) {
+            continue;
+        }
+        if (audio_element_msg_subscribe(el_item->el, listener, filter) != ESP_OK) {
+            ESP_LOGE(TAG, "Error subscribe event with: %s", (char *)audio_element_get_tag(el_item->el));
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t audio_pipeline_unsubscribe(audio_pipeline_handle_t pipeline, audio_event_iface_handle_t listener)
+{
+    subscriber_item_t *sub;
+    STAILQ_FOREACH(sub, &pipeline->subscribers, next) {
+        if (sub->listener == listener) {
+            break;
+        }
+    }
+    if (sub == NULL) {
+        ESP_LOGW(TAG, "The listener %p is not subscribed", listener);
+        return ESP_FAIL;
+    }
+    audio_element_item_t *el_item;
+    STAILQ_FOREACH(el_item, &pipeline->el_list, next) {
+        /* Elements unlinked since the subscription have no such listener, nothing to undo there */
+        audio_element_msg_remove_listener(el_item->el, listener);
+    }
+    STAILQ_REMOVE(&pipeline->subscribers, sub, subscriber_item, next);
+    audio_arena_free(sub);
+    return ESP_OK;
+}
+
+static void audio_pipeline_unsubscribe_all(audio_pipeline_handle_t pipeline)
+{
+    while (!STAILQ_EMPTY(&pipeline->subscribers)) {
+        audio_pipeline_unsubscribe(pipeline, STAILQ_FIRST(&pipeline->subscribers)->listener);
+    }
+}
+
 audio_pipeline_handle_t audio_pipeline_init(audio_pipeline_cfg_t *config)
 {
     audio_pipeline_handle_t pipeline;
@@ -252,8 +339,21 @@ audio_pipeline_handle_t audio_pipeline_init(audio_pipeline_cfg_t *config)
     AUDIO_MEM_CHECK(TAG, _success, return NULL);
     STAILQ_INIT(&pipeline->el_list);
     STAILQ_INIT(&pipeline->rb_list);
+    STAILQ_INIT(&pipeline->subscribers);
 
     pipeline->state = AEL_STATE_INIT;
+    pipeline->scheduler = config ? config->scheduler : NULL;
+    pipeline->fused = config ? config->fused : false;
+    if (config && config->arena) {
+        pipeline->arena = audio_arena_ref(config->arena);
+    } else if (config && config->arena_size > 0) {
+        pipeline->arena = audio_arena_create(config->arena_size);
+        AUDIO_MEM_CHECK(TAG, pipeline->arena, {
+            mutex_destroy(pipeline->lock);
+            audio_free(pipeline);
+            return NULL;
+        });
+    }
     return pipeline;
 }
 
@@ -261,11 +361,17 @@ esp_err_t audio_pipeline_deinit(audio_pipeline_handle_t pipeline)
 {
     audio_pipeline_terminate(pipeline);
     audio_pipeline_unlink(pipeline);
+    audio_pipeline_unsubscribe_all(pipeline);
     audio_element_item_t *el_item, *tmp;
     STAILQ_FOREACH_SAFE(el_item, &pipeline->el_list, next, tmp) {
         ESP_LOGD(TAG, "[%16s]-[%p]element instance has been deleted", audio_element_get_tag(el_item->el), el_item->el);
         audio_element_deinit(el_item->el);
-        audio_pipeline_unregister(pipeline, el_item->el);
+        audio_pipeline_unregister_element(pipeline, el_item->el);
+    }
+    if (pipeline->arena) {
+        /* Everything above went back to the arena, so its chunks are freed here in one go */
+        audio_arena_destroy(pipeline->arena);
+        pipeline->arena = NULL;
     }
     mutex_destroy(pipeline->lock);
     pipeline->lock = NULL;
@@ -279,25 +385,36 @@ esp_err_t audio_pipeline_register(audio_pipeline_handle_t pipeline, audio_elemen
     if (name) {
         audio_element_set_tag(el, name);
     }
-    audio_element_item_t *el_item = audio_calloc(1, sizeof(audio_element_item_t));
+    audio_element_item_t *el_item = audio_arena_calloc(pipeline->arena, 1, sizeof(audio_element_item_t));
 
     AUDIO_MEM_CHECK(TAG, el_item, return ESP_ERR_NO_MEM);
+    if (pipeline->arena) {
+        audio_element_set_arena(el, pipeline->arena);
+    }
     el_item->el = el;
     el_item->linked = false;
+    mutex_lock(pipeline->lock);
     STAILQ_INSERT_TAIL(&pipeline->el_list, el_item, next);
+    mutex_unlock(pipeline->lock);
     return ESP_OK;
 }
 
 esp_err_t audio_pipeline_unregister(audio_pipeline_handle_t pipeline, audio_element_handle_t el)
 {
     audio_element_item_t *el_item, *tmp;
+    mutex_lock(pipeline->lock);
     STAILQ_FOREACH_SAFE(el_item, &pipeline->el_list, next, tmp) {
         if (el_item->el == el) {
             STAILQ_REMOVE(&pipeline->el_list, el_item, audio_element_item, next);
-            audio_free(el_item);
+            mutex_unlock(pipeline->lock);
+            audio_arena_free(el_item);
+            if (pipeline->arena && audio_element_get_arena(el) == pipeline->arena) {
+                audio_element_set_arena(el, NULL);
+            }
             return ESP_OK;
         }
     }
+    mutex_unlock(pipeline->lock);
     return ESP_FAIL;
 }
 
@@ -351,6 +468,9 @@ esp_err_t audio_pipeline_run(audio_pipeline_handle_t pipeline)
                 || (AEL_STATE_STOPPED == audio_element_get_state(el_item->el))
                 || (AEL_STATE_FINISHED == audio_element_get_state(el_item->el))
                 || (AEL_STATE_ERROR == audio_element_get_state(el_item->el)))) {
+            if (pipeline->scheduler && audio_element_get_scheduler(el_item->el) != pipeline->scheduler) {
+                audio_element_set_scheduler(el_item->el, pipeline->scheduler);
+            }
             audio_element_run(el_item->el);
         }
     }
@@ -456,6 +576,31 @@ esp_err_t audio_pipeline_wait_for_stop_with_ticks(audio_pipeline_handle_t pipeli
     return ret;
 }
 
+static ringbuf_handle_t audio_pipeline_rb_create(audio_pipeline_handle_t pipeline, audio_element_handle_t el)
+{
+    int rb_size = audio_element_get_output_ringbuf_size(el);
+    if (audio_element_is_output_ringbuf_desc(el)) {
+        /* The output ringbuf size is split into buffers, two more let both ends hold one while the ring is full */
+        ringbuf_handle_t rb = NULL;
+        audio_buf_pool_handle_t pool = audio_buf_pool_create_in(pipeline->arena, rb_size / CONFIG_AUDIO_PIPELINE_DESC_DEPTH,
+                                                                CONFIG_AUDIO_PIPELINE_DESC_DEPTH + 2);
+        if (pool) {
+            rb = rb_create_desc_in(pipeline->arena, pool, CONFIG_AUDIO_PIPELINE_DESC_DEPTH);
+            audio_buf_pool_destroy(pool);
+        }
+        return rb;
+    }
+    if (audio_element_is_output_ringbuf_packet(el)) {
+        return rb_create_packet_in(pipeline->arena, rb_size, 1);
+    }
+    /* Mirrored rings let the consumer parse frames in place across the wrap, plain SPSC is the fallback */
+    ringbuf_handle_t rb = rb_create_mirrored_in(pipeline->arena, rb_size, 1);
+    if (rb == NULL) {
+        rb = rb_create_spsc_in(pipeline->arena, rb_size, 1);
+    }
+    return rb;
+}
+
 static esp_err_t _pipeline_rb_linked(audio_pipeline_handle_t pipeline, audio_element_handle_t el, bool first, bool last)
 {
     static ringbuf_handle_t rb;
@@ -467,12 +612,12 @@ static esp_err_t _pipeline_rb_linked(audio_pipeline_handle_t pipeline, audio_ele
             audio_element_set_input_ringbuf(el, rb);
         }
         bool _success = (
-                            (rb_item = audio_calloc(1, sizeof(ringbuf_item_t))) &&
-                            (rb = rb_create(audio_element_get_output_ringbuf_size(el), 1))
+                            (rb_item = audio_arena_calloc(pipeline->arena, 1, sizeof(ringbuf_item_t))) &&
+                            (rb = audio_pipeline_rb_create(pipeline, el))
                         );
 
         AUDIO_MEM_CHECK(TAG, _success, {
-            audio_free(rb_item);
+            audio_arena_free(rb_item);
             return ESP_ERR_NO_MEM;
         });
 
@@ -480,13 +625,34 @@ static esp_err_t _pipeline_rb_linked(audio_pipeline_handle_t pipeline, audio_ele
         rb_item->linked = true;
         rb_item->kept_ctx = false;
         rb_item->host_el = el;
+        mutex_lock(pipeline->lock);
         STAILQ_INSERT_TAIL(&pipeline->rb_list, rb_item, next);
+        mutex_unlock(pipeline->lock);
         audio_element_set_output_ringbuf(el, rb);
         ESP_LOGI(TAG, "link el->rb, el:%p, tag:%s, rb:%p", el, audio_element_get_tag(el) == NULL ? "NULL" : audio_element_get_tag(el), rb);
     }
     return ESP_OK;
 }
 
+/*
+ * Fused link: the element hands its output to the next one by direct call, the whole chain runs in the task of the
+ * first element and no ringbuffer is created.
+ */
+static esp_err_t _pipeline_fused_linked(audio_pipeline_handle_t pipeline, audio_element_handle_t el, bool first, bool last)
+{
+    static audio_element_handle_t prev;
+    esp_err_t ret = ESP_OK;
+    if (!first) {
+        ret = audio_element_set_fused_output(prev, el);
+    }
+    if (last && ret == ESP_OK) {
+        ret = audio_element_set_fused_output(el, NULL);
+    }
+    prev = el;
+    ESP_LOGI(TAG, "link el->el, el:%p, tag:%s", el, audio_element_get_tag(el) == NULL ? "NULL" : audio_element_get_tag(el));
+    return ret;
+}
+
 esp_err_t audio_pipeline_link(audio_pipeline_handle_t pipeline, const char *link_tag[], int link_num)
 {
     esp_err_t ret = ESP_OK;
@@ -505,7 +671,11 @@ esp_err_t audio_pipeline_link(audio_pipeline_handle_t pipeline, const char *link
         audio_element_handle_t el = item->el;
         first = (i == 0);
         last = (i == link_num - 1);
-        ret = _pipeline_rb_linked(pipeline, el, first, last);
+        if (pipeline->fused) {
+            ret = _pipeline_fused_linked(pipeline, el, first, last);
+        } else {
+            ret = _pipeline_rb_linked(pipeline, el, first, last);
+        }
         if (ret != ESP_OK) {
             return ret;
         }
@@ -523,15 +693,18 @@ esp_err_t audio_pipeline_unlink(audio_pipeline_handle_t pipeline)
         return ESP_OK;
     }
     audio_pipeline_remove_listener(pipeline);
+    audio_pipeline_unsubscribe_all(pipeline);
     STAILQ_FOREACH(el_item, &pipeline->el_list, next) {
         if (el_item->linked) {
             el_item->linked = false;
             el_item->kept_ctx = false;
+            audio_element_set_fused_output(el_item->el, NULL);
             audio_element_set_output_ringbuf(el_item->el, NULL);
             audio_element_set_input_ringbuf(el_item->el, NULL);
             ESP_LOGD(TAG, "audio_pipeline_unlink, %p, %s", el_item->el, audio_element_get_tag(el_item->el));
         }
     }
+    mutex_lock(pipeline->lock);
     STAILQ_FOREACH_SAFE(rb_item, &pipeline->rb_list, next, tmp) {
         ESP_LOGD(TAG, "audio_pipeline_unlink, RB:%p,host_el:%p", rb_item->rb, rb_item->host_el);
         STAILQ_REMOVE(&pipeline->rb_list, rb_item, ringbuf_item, next);
@@ -543,10 +716,11 @@ esp_err_t audio_pipeline_unlink(audio_pipeline_handle_t pipeline)
         rb_item->linked = false;
         rb_item->kept_ctx = false;
         rb_item->host_el = NULL;
-        audio_free(rb_item);
+        audio_arena_free(rb_item);
     }
-    ESP_LOGI(TAG, "audio_pipeline_unlinked");
     STAILQ_INIT(&pipeline->rb_list);
+    mutex_unlock(pipeline->lock);
+    ESP_LOGI(TAG, "audio_pipeline_unlinked");
     pipeline->linked = false;
     return ESP_OK;
 }
@@ -599,7 +773,11 @@ esp_err_t audio_pipeline_link_more(audio_pipeline_handle_t pipeline, audio_eleme
         first = (idx == 1);
         element_1 = va_arg(args, audio_element_handle_t);
         last = (NULL == element_1) ? true : false;
-        ret = _pipeline_rb_linked(pipeline, el, first, last);
+        if (pipeline->fused) {
+            ret = _pipeline_fused_linked(pipeline, el, first, last);
+        } else {
+            ret = _pipeline_rb_linked(pipeline, el, first, last);
+        }
         if (ret != ESP_OK) {
             return ret;
         }
@@ -625,25 +803,25 @@ esp_err_t audio_pipeline_link_insert(audio_pipeline_handle_t pipeline, bool firs
 
 esp_err_t audio_pipeline_listen_more(audio_pipeline_handle_t pipeline, audio_element_handle_t element_1, ...)
 {
+    /* Through the event interfaces, whatever the queue type of the listeners: an in-process one has no mqd_t */
+    esp_err_t ret = ESP_OK;
     va_list args;
     va_start(args, element_1);
     while (element_1) {
-        audio_element_handle_t el = element_1;
-        element_1 = va_arg(args, audio_element_handle_t);
-        mqd_t que = audio_element_get_event_queue(el);
-        audio_event_iface_msg_t dummy = {0};
-        while (1) {
-            if (audio_queue_recv(que, (char*)&dummy, sizeof(dummy),0) == 0) {
-                ESP_LOGD(TAG, "Listen_more el:%p, que :%d, OK", el, que);
-            } else {
-                ESP_LOGD(TAG, "Listen_more el:%p, que :%d, FAIL", el, que);
-                break;
-            }
+        ESP_LOGD(TAG, "Listen_more el:%p", element_1);
+        if (pipeline->listener && audio_element_msg_set_listener(element_1, pipeline->listener) != ESP_OK) {
+            ESP_LOGE(TAG, "Error register event with: %s", audio_element_get_tag(element_1));
+            ret = ESP_FAIL;
         }
+        element_1 = va_arg(args, audio_element_handle_t);
     }
     va_end(args);
+    subscriber_item_t *sub;
+    STAILQ_FOREACH(sub, &pipeline->subscribers, next) {
+        audio_event_iface_discard(sub->listener);
+    }
     PIPELINE_DEBUG(pipeline);
-    return ESP_OK;
+    return ret;
 }
 
 esp_err_t audio_pipeline_check_items_state(audio_pipeline_handle_t pipeline, audio_element_handle_t el, audio_element_status_t status)
@@ -784,6 +962,7 @@ esp_err_t audio_pipeline_breakup_elements(audio_pipeline_handle_t pipeline, audi
         return ESP_ERR_INVALID_ARG;
     }
     audio_pipeline_remove_listener(pipeline);
+    audio_pipeline_unsubscribe_all(pipeline);
     audio_element_item_t *el_item, *el_tmp;
     ringbuf_item_t *rb_item, *tmp;
     bool kept = true;
@@ -864,6 +1043,9 @@ static esp_err_t audio_pipeline_el_item_link(audio_pipeline_handle_t pipeline,
     ringbuf_item_t *cur_rb_item = NULL;
     ringbuf_item_t *rb_item, *rb_tmp;
     static ringbuf_handle_t rb;
+    if (pipeline->fused) {
+        return _pipeline_fused_linked(pipeline, el, first, last);
+    }
     // Found the kept ringbuffer if exist
     if (src_el_item->kept_ctx) {
         STAILQ_FOREACH_SAFE(rb_item, &pipeline->rb_list, next, rb_tmp) {
@@ -900,19 +1082,21 @@ static esp_err_t audio_pipeline_el_item_link(audio_pipeline_handle_t pipeline,
     if ((last == false) && (cur_rb_item == NULL)) {
         ringbuf_handle_t tmp_rb = NULL;
         bool _success = (
-                            (cur_rb_item = audio_calloc(1, sizeof(ringbuf_item_t))) &&
-                            (tmp_rb = rb_create(audio_element_get_output_ringbuf_size(el), 1))
+                            (cur_rb_item = audio_arena_calloc(pipeline->arena, 1, sizeof(ringbuf_item_t))) &&
+                            (tmp_rb = audio_pipeline_rb_create(pipeline, el))
                         );
 
         AUDIO_MEM_CHECK(TAG, _success, {
-            audio_free(cur_rb_item);
+            audio_arena_free(cur_rb_item);
             return ESP_ERR_NO_MEM;
         });
         cur_rb_item->rb = tmp_rb;
         cur_rb_item->linked = true;
         cur_rb_item->kept_ctx = false;
         cur_rb_item->host_el = el;
+        mutex_lock(pipeline->lock);
         STAILQ_INSERT_TAIL(&pipeline->rb_list, cur_rb_item, next);
+        mutex_unlock(pipeline->lock);
         ESP_LOGI(TAG, "create new rb,rb:%p",  cur_rb_item->rb);
     }
     ESP_LOGD(TAG, "%d, el:%p, tag:%s, cur_rb_item:%p, rb:%p, first:%d, last:%d\r\n", __LINE__, el,
@@ -1016,3 +1200,99 @@ esp_err_t audio_pipeline_relink_more(audio_pipeline_handle_t pipeline, audio_ele
     va_end(args);
     return ESP_OK;
 }
+
+static void audio_pipeline_stats_tag(char *dst, const char *tag)
+{
+    snprintf(dst, AUDIO_PIPELINE_STATS_TAG_LEN, "%s", tag ? tag : "");
+}
+
+audio_pipeline_stats_t *audio_pipeline_get_stats(audio_pipeline_handle_t pipeline, bool reset_fill_range)
+{
+    AUDIO_NULL_CHECK(TAG, pipeline, return NULL);
+    audio_element_item_t *el_item;
+    ringbuf_item_t *rb_item;
+    int el_num = 0, rb_num = 0;
+
+    mutex_lock(pipeline->lock);
+    STAILQ_FOREACH(el_item, &pipeline->el_list, next) {
+        el_num++;
+    }
+    STAILQ_FOREACH(rb_item, &pipeline->rb_list, next) {
+        rb_num++;
+    }
+    /* Owned by the caller, so from the heap rather than the arena */
+    audio_pipeline_stats_t *stats = audio_calloc(1, sizeof(audio_pipeline_stats_t)
+                                                 + el_num * sizeof(audio_pipeline_el_stats_t)
+                                                 + rb_num * sizeof(audio_pipeline_rb_stats_t));
+    AUDIO_MEM_CHECK(TAG, stats, {
+        mutex_unlock(pipeline->lock);
+        return NULL;
+    });
+    stats->els = (audio_pipeline_el_stats_t *)(stats + 1);
+    stats->rbs = (audio_pipeline_rb_stats_t *)(stats->els + el_num);
+    stats->time_ns = audio_time_now_ns();
+    STAILQ_FOREACH(el_item, &pipeline->el_list, next) {
+        audio_pipeline_el_stats_t *el_stats = &stats->els[stats->el_num++];
+        audio_pipeline_stats_tag(el_stats->tag, audio_element_get_tag(el_item->el));
+        el_stats->state = audio_element_get_state(el_item->el);
+        el_stats->linked = el_item->linked;
+        audio_element_get_stats(el_item->el, &el_stats->stats);
+    }
+    STAILQ_FOREACH(rb_item, &pipeline->rb_list, next) {
+        audio_pipeline_rb_stats_t *rb_stats = &stats->rbs[stats->rb_num++];
+        STAILQ_FOREACH(el_item, &pipeline->el_list, next) {
+            if (audio_element_get_output_ringbuf(el_item->el) == rb_item->rb) {
+                audio_pipeline_stats_tag(rb_stats->writer, audio_element_get_tag(el_item->el));
+            }
+            if (audio_element_get_input_ringbuf(el_item->el) == rb_item->rb) {
+                audio_pipeline_stats_tag(rb_stats->reader, audio_element_get_tag(el_item->el));
+            }
+        }
+        rb_get_stats(rb_item->rb, &rb_stats->stats);
+        if (reset_fill_range) {
+            rb_reset_fill_range(rb_item->rb);
+        }
+    }
+    mutex_unlock(pipeline->lock);
+    return stats;
+}
+
+void audio_pipeline_free_stats(audio_pipeline_stats_t *stats)
+{
+    audio_free(stats);
+}
+
+esp_err_t audio_pipeline_get_media_time(audio_pipeline_handle_t pipeline, int64_t *media_time_us, int64_t *latency_us)
+{
+    AUDIO_NULL_CHECK(TAG, pipeline, return ESP_ERR_INVALID_ARG);
+    AUDIO_NULL_CHECK(TAG, media_time_us, return ESP_ERR_INVALID_ARG);
+    audio_element_item_t *el_item;
+    audio_element_presentation_t pres;
+    audio_element_state_t state = AEL_STATE_NONE;
+    bool found = false;
+
+    mutex_lock(pipeline->lock);
+    /* Normally only the sink reports, with a split output the freshest report wins */
+    STAILQ_FOREACH(el_item, &pipeline->el_list, next) {
+        audio_element_presentation_t cur;
+        if (el_item->linked && audio_element_get_presentation(el_item->el, &cur) == ESP_OK
+            && (!found || cur.time_ns > pres.time_ns)) {
+            pres = cur;
+            state = audio_element_get_state(el_item->el);
+            found = true;
+        }
+    }
+    mutex_unlock(pipeline->lock);
+    if (!found) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *media_time_us = pres.pts;
+    if (state == AEL_STATE_RUNNING) {
+        /* Reports come once per buffer written, the clock runs on in between */
+        *media_time_us += (audio_time_now_ns() - pres.time_ns) / 1000;
+    }
+    if (latency_us) {
+        *latency_us = pres.origin_ns ? (pres.time_ns - pres.origin_ns) / 1000 : -1;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,440 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "esp_log.h"
+#include "audio_mem.h"
+#include "audio_error.h"
+#include "audio_thread.h"
+#include "audio_pipeline_exporter.h"
+
+static const char *TAG = "AUDIO_EXPORTER";
+
+#define EXPORTER_BUF_SIZE       (4 * 1024)  /* Initial text buffer, grown to fit the pipeline */
+#define EXPORTER_REQUEST_MS     (100)       /* Time a client gets to send its request line */
+
+struct audio_pipeline_exporter {
+    audio_pipeline_handle_t         pipeline;
+    audio_pipeline_export_type_t    type;
+    char                            *path;
+    int                             period_ms;
+    int                             listen_fd;
+    int                             stop_fd[2];     /* The task polls the read end, stop writes to the other */
+    char                            *buf;
+    int                             buf_size;
+    audio_thread_t                  thread;
+};
+
+typedef struct {
+    char    *buf;
+    int     size;
+    int     len;
+} exporter_text_t;
+
+/* One uint64_t counter of a snapshot, rows of the same name are samples of one metric family */
+typedef struct {
+    const char  *name;
+    const char  *type;
+    const char  *help;
+    const char  *label;     /* Extra label of the sample, NULL for none */
+    size_t      offset;
+    double      scale;
+} exporter_metric_t;
+
+#define EL_COUNTER(name, help, label, field, scale) \
+    { name, "counter", help, label, offsetof(audio_element_stats_t, field), scale }
+#define RB_COUNTER(name, help, label, field, scale) \
+    { name, "counter", help, label, offsetof(rb_stats_t, field), scale }
+
+static const exporter_metric_t s_el_metrics[] = {
+    EL_COUNTER("audio_element_process_calls_total", "Calls of the process callback.", NULL, process_calls, 1),
+    EL_COUNTER("audio_element_in_bytes_total", "Bytes read by the element.", NULL, bytes_in, 1),
+    EL_COUNTER("audio_element_out_bytes_total", "Bytes written by the element.", NULL, bytes_out, 1),
+    EL_COUNTER("audio_element_process_seconds_total", "Time spent in the process callback.",
+               "clock=\"wall\"", process_wall_ns, 1e-9),
+    EL_COUNTER("audio_element_process_seconds_total", NULL, "clock=\"cpu\"", process_cpu_ns, 1e-9),
+    EL_COUNTER("audio_element_wait_seconds_total", "Time spent in the input and output functions.",
+               "direction=\"input\"", input_wait_ns, 1e-9),
+    EL_COUNTER("audio_element_wait_seconds_total", NULL, "direction=\"output\"", output_wait_ns, 1e-9),
+};
+
+static const exporter_metric_t s_rb_metrics[] = {
+    RB_COUNTER("audio_ringbuf_written_bytes_total", "Bytes written to the ringbuffer.", NULL, bytes_written, 1),
+    RB_COUNTER("audio_ringbuf_read_bytes_total", "Bytes read from the ringbuffer.", NULL, bytes_read, 1),
+    RB_COUNTER("audio_ringbuf_waits_total", "Times a side blocked on the ringbuffer.",
+               "side=\"reader\"", reader_waits, 1),
+    RB_COUNTER("audio_ringbuf_waits_total", NULL, "side=\"writer\"", writer_waits, 1),
+    RB_COUNTER("audio_ringbuf_wakeups_total", "Waits ended by the other side rather than by the timeout.",
+               "side=\"reader\"", reader_wakeups, 1),
+    RB_COUNTER("audio_ringbuf_wakeups_total", NULL, "side=\"writer\"", writer_wakeups, 1),
+    RB_COUNTER("audio_ringbuf_wait_seconds_total", "Time a side spent blocked on the ringbuffer.",
+               "side=\"reader\"", reader_wait_ns, 1e-9),
+    RB_COUNTER("audio_ringbuf_wait_seconds_total", NULL, "side=\"writer\"", writer_wait_ns, 1e-9),
+};
+
+static const double s_quantiles[] = { 0.5, 0.9, 0.99 };
+
+static void __attribute__((format(printf, 2, 3))) exporter_printf(exporter_text_t *text, const char *fmt, ...)
+{
+    int room = text->len < text->size ? text->size - text->len : 0;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(room ? text->buf + text->len : NULL, room, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        text->len += n;
+    }
+}
+
+/* Label values escape backslash, double quote and line feed */
+static const char *exporter_escape(char *dst, int size, const char *src)
+{
+    int n = 0;
+    for (; *src && n < size - 2; src++) {
+        if (*src == '\\' || *src == '"' || *src == '\n') {
+            dst[n++] = '\\';
+        }
+        dst[n++] = *src == '\n' ? 'n' : *src;
+    }
+    dst[n] = '\0';
+    return dst;
+}
+
+static void exporter_family(exporter_text_t *text, const char *name, const char *type, const char *help)
+{
+    exporter_printf(text, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/* Sample of each element, or of each ringbuffer, for every row of a metric table */
+static void exporter_counters(exporter_text_t *text, const exporter_metric_t *metrics, int metric_num,
+                              const audio_pipeline_stats_t *stats, bool elements)
+{
+    char label[2][2 * AUDIO_PIPELINE_STATS_TAG_LEN];
+    for (int m = 0; m < metric_num; m++) {
+        const exporter_metric_t *metric = &metrics[m];
+        if (metric->help) {
+            exporter_family(text, metric->name, metric->type, metric->help);
+        }
+        int num = elements ? stats->el_num : stats->rb_num;
+        for (int i = 0; i < num; i++) {
+            const char *base;
+            if (elements) {
+                base = (const char *)&stats->els[i].stats;
+                exporter_printf(text, "%s{element=\"%s\"", metric->name,
+                                exporter_escape(label[0], sizeof(label[0]), stats->els[i].tag));
+            } else {
+                base = (const char *)&stats->rbs[i].stats;
+                exporter_printf(text, "%s{writer=\"%s\",reader=\"%s\"", metric->name,
+                                exporter_escape(label[0], sizeof(label[0]), stats->rbs[i].writer),
+                                exporter_escape(label[1], sizeof(label[1]), stats->rbs[i].reader));
+            }
+            uint64_t value = *(const uint64_t *)(base + metric->offset);
+            if (metric->scale == 1) {
+                exporter_printf(text, "%s%s} %llu\n", metric->label ? "," : "", metric->label ? metric->label : "",
+                                (unsigned long long)value);
+            } else {
+                exporter_printf(text, "%s%s} %.9f\n", metric->label ? "," : "", metric->label ? metric->label : "",
+                                value * metric->scale);
+            }
+        }
+    }
+}
+
+/* Gauge of each ringbuffer from one uint32_t field of rb_stats_t */
+static void exporter_rb_gauge(exporter_text_t *text, const audio_pipeline_stats_t *stats, const char *name,
+                              const char *help, size_t offset)
+{
+    char label[2][2 * AUDIO_PIPELINE_STATS_TAG_LEN];
+    exporter_family(text, name, "gauge", help);
+    for (int i = 0; i < stats->rb_num; i++) {
+        exporter_printf(text, "%s{writer=\"%s\",reader=\"%s\"} %u\n", name,
+                        exporter_escape(label[0], sizeof(label[0]), stats->rbs[i].writer),
+                        exporter_escape(label[1], sizeof(label[1]), stats->rbs[i].reader),
+                        *(const uint32_t *)((const char *)&stats->rbs[i].stats + offset));
+    }
+}
+
+int audio_pipeline_stats_to_prometheus(const audio_pipeline_stats_t *stats, char *buf, int size)
+{
+    exporter_text_t text = { .buf = buf, .size = buf ? size : 0, .len = 0 };
+    char label[2 * AUDIO_PIPELINE_STATS_TAG_LEN];
+    if (stats == NULL) {
+        return ESP_FAIL;
+    }
+    if (text.size > 0) {
+        text.buf[0] = '\0';
+    }
+
+    exporter_family(&text, "audio_element_state", "gauge", "State of the element, see audio_element_state_t.");
+    for (int i = 0; i < stats->el_num; i++) {
+        exporter_printf(&text, "audio_element_state{element=\"%s\"} %d\n",
+                        exporter_escape(label, sizeof(label), stats->els[i].tag), stats->els[i].state);
+    }
+    exporter_counters(&text, s_el_metrics, sizeof(s_el_metrics) / sizeof(s_el_metrics[0]), stats, true);
+    exporter_family(&text, "audio_element_process_latency_seconds", "summary", "Wall time per process call.");
+    for (int i = 0; i < stats->el_num; i++) {
+        const audio_element_stats_t *el_stats = &stats->els[i].stats;
+        exporter_escape(label, sizeof(label), stats->els[i].tag);
+        for (int q = 0; q < sizeof(s_quantiles) / sizeof(s_quantiles[0]); q++) {
+            exporter_printf(&text, "audio_element_process_latency_seconds{element=\"%s\",quantile=\"%g\"} %.6f\n",
+                            label, s_quantiles[q],
+                            audio_element_hist_percentile(&el_stats->process_wall, s_quantiles[q] * 100) * 1e-6);
+        }
+        exporter_printf(&text, "audio_element_process_latency_seconds_sum{element=\"%s\"} %.9f\n",
+                        label, el_stats->process_wall_ns * 1e-9);
+        exporter_printf(&text, "audio_element_process_latency_seconds_count{element=\"%s\"} %llu\n",
+                        label, (unsigned long long)el_stats->process_calls);
+    }
+
+    exporter_rb_gauge(&text, stats, "audio_ringbuf_size_bytes", "Size of the ringbuffer.",
+                      offsetof(rb_stats_t, size));
+    exporter_rb_gauge(&text, stats, "audio_ringbuf_filled_bytes", "Filled bytes of the ringbuffer.",
+                      offsetof(rb_stats_t, filled));
+    exporter_rb_gauge(&text, stats, "audio_ringbuf_fill_min_bytes", "Lowest fill level since the previous snapshot.",
+                      offsetof(rb_stats_t, fill_min));
+    exporter_rb_gauge(&text, stats, "audio_ringbuf_fill_max_bytes", "Highest fill level since the previous snapshot.",
+                      offsetof(rb_stats_t, fill_max));
+    exporter_counters(&text, s_rb_metrics, sizeof(s_rb_metrics) / sizeof(s_rb_metrics[0]), stats, false);
+    return text.len;
+}
+
+/* Text of a new snapshot in exporter->buf, its length or ESP_FAIL */
+static int exporter_render(audio_pipeline_exporter_handle_t exporter)
+{
+    audio_pipeline_stats_t *stats = audio_pipeline_get_stats(exporter->pipeline, true);
+    if (stats == NULL) {
+        return ESP_FAIL;
+    }
+    int len = audio_pipeline_stats_to_prometheus(stats, exporter->buf, exporter->buf_size);
+    if (len >= exporter->buf_size) {
+        char *buf = audio_realloc(exporter->buf, len + 1);
+        if (buf == NULL) {
+            ESP_LOGE(TAG, "No memory for %d bytes of text", len + 1);
+            audio_pipeline_free_stats(stats);
+            return ESP_FAIL;
+        }
+        exporter->buf = buf;
+        exporter->buf_size = len + 1;
+        len = audio_pipeline_stats_to_prometheus(stats, exporter->buf, exporter->buf_size);
+    }
+    audio_pipeline_free_stats(stats);
+    return len;
+}
+
+static int exporter_write_all(int fd, const char *data, int len, bool sock)
+{
+    while (len > 0) {
+        /* A client that went away must not raise SIGPIPE in the application */
+        int n = sock ? send(fd, data, len, MSG_NOSIGNAL) : write(fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return ESP_FAIL;
+        }
+        data += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+static void exporter_write_file(audio_pipeline_exporter_handle_t exporter)
+{
+    char tmp[strlen(exporter->path) + sizeof(".tmp")];
+    int len = exporter_render(exporter);
+    if (len < 0) {
+        return;
+    }
+    snprintf(tmp, sizeof(tmp), "%s.tmp", exporter->path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "Open %s failed, errno:%d", tmp, errno);
+        return;
+    }
+    int ret = exporter_write_all(fd, exporter->buf, len, false);
+    close(fd);
+    if (ret != ESP_OK || rename(tmp, exporter->path) != 0) {
+        ESP_LOGE(TAG, "Write %s failed, errno:%d", exporter->path, errno);
+        unlink(tmp);
+    }
+}
+
+static void exporter_serve_client(audio_pipeline_exporter_handle_t exporter, int fd)
+{
+    static const char http_head[] = "HTTP/1.0 200 OK\r\n"
+                                    "Content-Type: text/plain; version=0.0.4\r\n"
+                                    "Connection: close\r\n\r\n";
+    char request[64];
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    bool http = false;
+
+    /* A HTTP client sends its request first, a bare client such as `nc -U` may send nothing */
+    if (poll(&pfd, 1, EXPORTER_REQUEST_MS) > 0) {
+        int n = recv(fd, request, sizeof(request) - 1, MSG_DONTWAIT);
+        http = (n >= 4 && memcmp(request, "GET ", 4) == 0);
+    }
+    int len = exporter_render(exporter);
+    if (len < 0) {
+        return;
+    }
+    if (http && exporter_write_all(fd, http_head, sizeof(http_head) - 1, true) != ESP_OK) {
+        return;
+    }
+    exporter_write_all(fd, exporter->buf, len, true);
+}
+
+static void *exporter_task(void *pv)
+{
+    audio_pipeline_exporter_handle_t exporter = (audio_pipeline_exporter_handle_t)pv;
+    struct pollfd pfd[2] = {
+        { .fd = exporter->stop_fd[0], .events = POLLIN },
+        { .fd = exporter->listen_fd, .events = POLLIN },
+    };
+    bool sock = (exporter->type == AUDIO_PIPELINE_EXPORT_UNIX_SOCKET);
+
+    while (1) {
+        if (!sock) {
+            exporter_write_file(exporter);
+        }
+        int ret = poll(pfd, sock ? 2 : 1, sock ? -1 : exporter->period_ms);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "Poll failed, errno:%d", errno);
+            break;
+        }
+        if (pfd[0].revents) {
+            break;
+        }
+        if (sock && (pfd[1].revents & POLLIN)) {
+            int fd = accept4(exporter->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (fd >= 0) {
+                exporter_serve_client(exporter, fd);
+                close(fd);
+            }
+        }
+    }
+    return NULL;
+}
+
+static int exporter_listen(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        ESP_LOGE(TAG, "Socket path too long: %s", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    /* A socket left behind by a previous run would make bind fail */
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0) {
+        ESP_LOGE(TAG, "Listen on %s failed, errno:%d", path, errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+audio_pipeline_exporter_handle_t audio_pipeline_exporter_start(audio_pipeline_handle_t pipeline,
+                                                               const audio_pipeline_exporter_cfg_t *config)
+{
+    if (pipeline == NULL || config == NULL || config->path == NULL
+        || (config->type == AUDIO_PIPELINE_EXPORT_FILE && config->period_ms <= 0)) {
+        ESP_LOGE(TAG, "Invalid exporter configuration");
+        return NULL;
+    }
+    audio_pipeline_exporter_handle_t exporter = audio_calloc(1, sizeof(struct audio_pipeline_exporter));
+    AUDIO_MEM_CHECK(TAG, exporter, return NULL);
+    exporter->pipeline = pipeline;
+    exporter->type = config->type;
+    exporter->period_ms = config->period_ms;
+    exporter->listen_fd = -1;
+    exporter->stop_fd[0] = exporter->stop_fd[1] = -1;
+    exporter->buf_size = EXPORTER_BUF_SIZE;
+    exporter->path = audio_strdup(config->path);
+    exporter->buf = audio_malloc(exporter->buf_size);
+    AUDIO_MEM_CHECK(TAG, exporter->path && exporter->buf, goto _exporter_failed);
+    if (pipe2(exporter->stop_fd, O_CLOEXEC) != 0) {
+        ESP_LOGE(TAG, "Create pipe failed, errno:%d", errno);
+        goto _exporter_failed;
+    }
+    if (exporter->type == AUDIO_PIPELINE_EXPORT_UNIX_SOCKET) {
+        exporter->listen_fd = exporter_listen(exporter->path);
+        if (exporter->listen_fd < 0) {
+            goto _exporter_failed;
+        }
+    }
+    if (audio_thread_create(&exporter->thread, "exporter", exporter_task, exporter, config->task_stack,
+                            config->task_prio, false, 0) != ESP_OK) {
+        ESP_LOGE(TAG, "Error create exporter task");
+        goto _exporter_failed;
+    }
+    ESP_LOGI(TAG, "Exporting to %s", exporter->path);
+    return exporter;
+_exporter_failed:
+    exporter->thread = 0;
+    audio_pipeline_exporter_stop(exporter);
+    return NULL;
+}
+
+esp_err_t audio_pipeline_exporter_stop(audio_pipeline_exporter_handle_t exporter)
+{
+    if (exporter == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (exporter->thread) {
+        while (write(exporter->stop_fd[1], "", 1) < 0 && errno == EINTR) {
+        }
+        audio_thread_cleanup(&exporter->thread);
+    }
+    if (exporter->listen_fd >= 0) {
+        close(exporter->listen_fd);
+        unlink(exporter->path);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (exporter->stop_fd[i] >= 0) {
+            close(exporter->stop_fd[i]);
+        }
+    }
+    audio_free(exporter->buf);
+    audio_free(exporter->path);
+    audio_free(exporter);
+    return ESP_OK;
+}
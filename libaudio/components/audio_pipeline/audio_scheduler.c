@@ -0,0 +1,393 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdatomic.h>
+#include <limits.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "audio_mem.h"
+#include "audio_mutex.h"
+#include "audio_error.h"
+#include "audio_futex.h"
+#include "audio_thread.h"
+#include "audio_time.h"
+#include "audio_scheduler.h"
+
+static const char *TAG = "AUDIO_SCHED";
+
+#define AUDIO_SCHED_QUEUE_SIZE      (16)
+
+typedef enum {
+    TASK_EXITED = 0,    /* Not started, or the last step returned AUDIO_SCHED_EXIT */
+    TASK_IDLE,          /* Waiting for audio_scheduler_task_wake */
+    TASK_QUEUED,        /* Sitting in a worker queue */
+    TASK_RUNNING,       /* A worker is in the step function */
+    TASK_NOTIFIED,      /* Woken up while running, the step is called once more */
+} task_state_t;
+
+struct audio_scheduler_task {
+    audio_scheduler_handle_t    sched;
+    audio_scheduler_step_func   step;
+    void                        *ctx;
+    atomic_uint                 state;
+};
+
+/*
+ * Per worker double ended queue. The owner pushes and pops at the bottom, so the task it just woke up runs
+ * next while its data is still hot. Thieves and tasks that used up their slice go through the top.
+ */
+typedef struct audio_worker {
+    audio_scheduler_handle_t    sched;
+    audio_thread_t              thread;
+    bool                        started;
+    pthread_mutex_t             *lock;
+    audio_scheduler_task_t      *queue;
+    uint32_t                    queue_size;     /* Power of two */
+    uint32_t                    top;            /* Free running indices, bottom - top tasks are queued */
+    uint32_t                    bottom;
+    uint32_t                    seed;           /* Picks the first victim to steal from */
+} audio_worker_t;
+
+struct audio_scheduler {
+    audio_worker_t              *workers;
+    int                         workers_num;
+    int64_t                     slice_ns;
+    atomic_uint                 pending;        /* Tasks queued on any worker */
+    atomic_uint                 sleepers;       /* Workers parked on sleep_seq */
+    atomic_uint                 sleep_seq;      /* Futex word idle workers sleep on */
+    atomic_uint                 exit_waiters;   /* Threads parked on exit_seq */
+    atomic_uint                 exit_seq;       /* Futex word for tasks to reach TASK_EXITED, outlives them */
+    atomic_uint                 next_worker;    /* Round robin for wakeups from outside the pool */
+    atomic_bool                 stop;
+};
+
+static __thread audio_worker_t *s_worker;
+
+/* With w->lock held */
+static bool audio_worker_grow(audio_worker_t *w)
+{
+    uint32_t size = w->queue_size * 2;
+    audio_scheduler_task_t *queue = audio_calloc(size, sizeof(audio_scheduler_task_t));
+    AUDIO_MEM_CHECK(TAG, queue, return false);
+    for (uint32_t i = w->top; i != w->bottom; i++) {
+        queue[i & (size - 1)] = w->queue[i & (w->queue_size - 1)];
+    }
+    audio_free(w->queue);
+    w->queue = queue;
+    w->queue_size = size;
+    return true;
+}
+
+static bool audio_worker_push(audio_worker_t *w, audio_scheduler_task_t task, bool top)
+{
+    mutex_lock(w->lock);
+    if (w->bottom - w->top == w->queue_size && !audio_worker_grow(w)) {
+        mutex_unlock(w->lock);
+        return false;
+    }
+    if (top) {
+        w->queue[--w->top & (w->queue_size - 1)] = task;
+    } else {
+        w->queue[w->bottom++ & (w->queue_size - 1)] = task;
+    }
+    mutex_unlock(w->lock);
+    return true;
+}
+
+static audio_scheduler_task_t audio_worker_pop(audio_worker_t *w, bool top)
+{
+    audio_scheduler_task_t task = NULL;
+    if (top) {
+        /* Stealing, never wait for a busy victim */
+        if (pthread_mutex_trylock(w->lock) != 0) {
+            return NULL;
+        }
+    } else {
+        mutex_lock(w->lock);
+    }
+    if (w->bottom != w->top) {
+        task = top ? w->queue[w->top++ & (w->queue_size - 1)] : w->queue[--w->bottom & (w->queue_size - 1)];
+    }
+    mutex_unlock(w->lock);
+    return task;
+}
+
+static audio_scheduler_task_t audio_worker_steal(audio_worker_t *w)
+{
+    audio_scheduler_handle_t sched = w->sched;
+    /* xorshift, spreads the thieves over the victims */
+    w->seed ^= w->seed << 13;
+    w->seed ^= w->seed >> 17;
+    w->seed ^= w->seed << 5;
+    for (int i = 0; i < sched->workers_num; i++) {
+        audio_worker_t *victim = &sched->workers[(w->seed + i) % sched->workers_num];
+        if (victim == w) {
+            continue;
+        }
+        audio_scheduler_task_t task = audio_worker_pop(victim, true);
+        if (task) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Queue a task whose state was just moved to TASK_QUEUED. A worker queues on itself, everyone else picks
+ * the workers in turn. `yield` puts the task behind everything that is queued already.
+ */
+static void audio_sched_enqueue(audio_scheduler_handle_t sched, audio_scheduler_task_t task, bool yield)
+{
+    audio_worker_t *w = s_worker;
+    if (w == NULL || w->sched != sched) {
+        w = &sched->workers[atomic_fetch_add(&sched->next_worker, 1) % sched->workers_num];
+    }
+    /* Counted before it is visible, so that a worker going to sleep cannot miss it */
+    atomic_fetch_add(&sched->pending, 1);
+    while (!audio_worker_push(w, task, yield)) {
+        sched_yield();
+    }
+    if (atomic_load(&sched->sleepers)) {
+        atomic_fetch_add(&sched->sleep_seq, 1);
+        audio_futex_wake((volatile uint32_t *)&sched->sleep_seq, 1);
+    }
+}
+
+static void audio_worker_run(audio_worker_t *w, audio_scheduler_task_t task)
+{
+    audio_scheduler_handle_t sched = w->sched;
+    int64_t slice_end = audio_time_now_ns() + sched->slice_ns;
+
+    atomic_store(&task->state, TASK_RUNNING);
+    while (1) {
+        audio_scheduler_ret_t ret = task->step(task->ctx);
+        if (ret == AUDIO_SCHED_EXIT) {
+            /* Last access to the task, it may be freed or restarted right after */
+            atomic_store(&task->state, TASK_EXITED);
+            /* Pairs with audio_scheduler_task_wait_exit: either it sees the state, or we see it waiting */
+            if (atomic_load(&sched->exit_waiters)) {
+                atomic_fetch_add(&sched->exit_seq, 1);
+                audio_futex_wake((volatile uint32_t *)&sched->exit_seq, INT_MAX);
+            }
+            return;
+        }
+        if (ret == AUDIO_SCHED_IDLE) {
+            unsigned int state = TASK_RUNNING;
+            if (atomic_compare_exchange_strong(&task->state, &state, TASK_IDLE)) {
+                return;
+            }
+            /* Woken up during the step, look again */
+        }
+        if (audio_time_now_ns() >= slice_end) {
+            atomic_store(&task->state, TASK_QUEUED);
+            audio_sched_enqueue(sched, task, true);
+            return;
+        }
+        atomic_store(&task->state, TASK_RUNNING);
+    }
+}
+
+static void *audio_worker_task(void *pv)
+{
+    audio_worker_t *w = (audio_worker_t *)pv;
+    audio_scheduler_handle_t sched = w->sched;
+
+    s_worker = w;
+    while (!atomic_load(&sched->stop)) {
+        audio_scheduler_task_t task = audio_worker_pop(w, false);
+        if (task == NULL) {
+            task = audio_worker_steal(w);
+        }
+        if (task) {
+            atomic_fetch_sub(&sched->pending, 1);
+            audio_worker_run(w, task);
+            continue;
+        }
+        /* Pairs with audio_sched_enqueue: either it sees us sleeping, or we see its task pending */
+        uint32_t seq = atomic_load(&sched->sleep_seq);
+        atomic_fetch_add(&sched->sleepers, 1);
+        if (atomic_load(&sched->pending) == 0 && !atomic_load(&sched->stop)) {
+            audio_futex_wait((volatile uint32_t *)&sched->sleep_seq, seq, NULL);
+        } else if (!atomic_load(&sched->stop)) {
+            /*
+             * Pending but not found: its push is not done yet and will wake us, or it sits behind a victim
+             * lock that was busy. Look again after a slice at the latest.
+             */
+            struct timespec ts;
+            audio_futex_wait((volatile uint32_t *)&sched->sleep_seq, seq,
+                             audio_time_deadline_ns(&ts, CLOCK_MONOTONIC, sched->slice_ns));
+        }
+        atomic_fetch_sub(&sched->sleepers, 1);
+    }
+    s_worker = NULL;
+    return NULL;
+}
+
+audio_scheduler_handle_t audio_scheduler_create(const audio_scheduler_cfg_t *config)
+{
+    audio_scheduler_handle_t sched = audio_calloc(1, sizeof(struct audio_scheduler));
+    AUDIO_MEM_CHECK(TAG, sched, return NULL);
+
+    int workers = config->workers;
+    if (workers <= 0) {
+        workers = sysconf(_SC_NPROCESSORS_ONLN);
+        if (workers <= 0) {
+            workers = 1;
+        }
+    }
+    sched->slice_ns = (int64_t)(config->slice_us > 0 ? config->slice_us : DEFAULT_SCHEDULER_SLICE_US) * 1000;
+    sched->workers = audio_calloc(workers, sizeof(audio_worker_t));
+    AUDIO_MEM_CHECK(TAG, sched->workers, goto _sched_init_failed);
+    sched->workers_num = workers;
+    for (int i = 0; i < workers; i++) {
+        audio_worker_t *w = &sched->workers[i];
+        w->sched = sched;
+        w->seed = 2463534242u + i;
+        w->queue_size = AUDIO_SCHED_QUEUE_SIZE;
+        w->queue = audio_calloc(w->queue_size, sizeof(audio_scheduler_task_t));
+        w->lock = mutex_create();
+        AUDIO_MEM_CHECK(TAG, w->queue && w->lock, goto _sched_init_failed);
+    }
+    for (int i = 0; i < workers; i++) {
+        audio_worker_t *w = &sched->workers[i];
+        if (audio_thread_create(&w->thread, "sched", audio_worker_task, w, config->task_stack, config->task_prio,
+                                false, i) != ESP_OK) {
+            ESP_LOGE(TAG, "Error create worker %d", i);
+            goto _sched_init_failed;
+        }
+        w->started = true;
+    }
+    ESP_LOGI(TAG, "Scheduler created, %d workers", workers);
+    return sched;
+_sched_init_failed:
+    audio_scheduler_destroy(sched);
+    return NULL;
+}
+
+esp_err_t audio_scheduler_destroy(audio_scheduler_handle_t sched)
+{
+    if (sched == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    atomic_store(&sched->stop, true);
+    atomic_fetch_add(&sched->sleep_seq, 1);
+    audio_futex_wake((volatile uint32_t *)&sched->sleep_seq, INT_MAX);
+    for (int i = 0; i < sched->workers_num; i++) {
+        if (sched->workers[i].started) {
+            audio_thread_cleanup(&sched->workers[i].thread);
+        }
+    }
+    if (atomic_load(&sched->pending)) {
+        ESP_LOGW(TAG, "Destroyed with %u tasks queued", atomic_load(&sched->pending));
+    }
+    for (int i = 0; i < sched->workers_num; i++) {
+        audio_free(sched->workers[i].queue);
+        if (sched->workers[i].lock) {
+            mutex_destroy(sched->workers[i].lock);
+        }
+    }
+    audio_free(sched->workers);
+    audio_free(sched);
+    return ESP_OK;
+}
+
+int audio_scheduler_get_workers(audio_scheduler_handle_t sched)
+{
+    return sched ? sched->workers_num : 0;
+}
+
+audio_scheduler_task_t audio_scheduler_task_create(audio_scheduler_handle_t sched, audio_scheduler_step_func step,
+                                                   void *ctx)
+{
+    if (sched == NULL || step == NULL) {
+        return NULL;
+    }
+    audio_scheduler_task_t task = audio_calloc(1, sizeof(struct audio_scheduler_task));
+    AUDIO_MEM_CHECK(TAG, task, return NULL);
+    task->sched = sched;
+    task->step = step;
+    task->ctx = ctx;
+    atomic_init(&task->state, TASK_EXITED);
+    return task;
+}
+
+/* A worker stores TASK_EXITED right after the last step returned, it cannot be long */
+static void audio_scheduler_task_wait_exit(audio_scheduler_task_t task)
+{
+    audio_scheduler_handle_t sched = task->sched;
+    while (atomic_load(&task->state) != TASK_EXITED) {
+        uint32_t seq = atomic_load(&sched->exit_seq);
+        atomic_fetch_add(&sched->exit_waiters, 1);
+        if (atomic_load(&task->state) != TASK_EXITED) {
+            audio_futex_wait((volatile uint32_t *)&sched->exit_seq, seq, NULL);
+        }
+        atomic_fetch_sub(&sched->exit_waiters, 1);
+    }
+}
+
+esp_err_t audio_scheduler_task_destroy(audio_scheduler_task_t task)
+{
+    if (task == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    audio_scheduler_task_wait_exit(task);
+    audio_free(task);
+    return ESP_OK;
+}
+
+esp_err_t audio_scheduler_task_start(audio_scheduler_task_t task)
+{
+    if (task == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    audio_scheduler_task_wait_exit(task);
+    atomic_store(&task->state, TASK_QUEUED);
+    audio_sched_enqueue(task->sched, task, false);
+    return ESP_OK;
+}
+
+esp_err_t audio_scheduler_task_wake(audio_scheduler_task_t task)
+{
+    if (task == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    unsigned int state = atomic_load(&task->state);
+    while (1) {
+        if (state == TASK_IDLE) {
+            if (atomic_compare_exchange_weak(&task->state, &state, TASK_QUEUED)) {
+                audio_sched_enqueue(task->sched, task, false);
+                return ESP_OK;
+            }
+        } else if (state == TASK_RUNNING) {
+            if (atomic_compare_exchange_weak(&task->state, &state, TASK_NOTIFIED)) {
+                return ESP_OK;
+            }
+        } else {
+            /* Queued or notified already, or exited */
+            return ESP_OK;
+        }
+    }
+}
@@ -0,0 +1,211 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _AUDIO_BUF_H_
+#define _AUDIO_BUF_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "portmacro.h"
+#include "audio_type_def.h"
+#include "audio_arena.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUDIO_BUF_FLAG_FORMAT_CHANGE    (1 << 0)    /*!< Stream format changes from this buffer on */
+#define AUDIO_BUF_FLAG_DISCONTINUITY    (1 << 1)    /*!< Buffer does not follow the previous one, e.g. after a seek */
+#define AUDIO_BUF_FLAG_USER_SHIFT       (16)        /*!< Bits from here up are free for the elements */
+
+typedef struct audio_buf_pool *audio_buf_pool_handle_t;
+
+/**
+ * @brief      Called when a buffer goes back to its pool, from the thread that dropped the last reference, with the
+ *             waiter list of the pool locked: it must not block, release a buffer of the pool or change its waiters
+ */
+typedef void (*audio_buf_pool_notify_func)(audio_buf_pool_handle_t pool, void *ctx);
+
+/**
+ * @brief      A callback on the waiter list of a pool, see `audio_buf_pool_add_waiter`. Owned by the caller, e.g.
+ *             embedded in the descriptor Ringbuffer it wakes up, so adding one allocates nothing.
+ */
+typedef struct audio_buf_pool_waiter {
+    audio_buf_pool_notify_func      notify;     /*!< The callback */
+    void                            *ctx;       /*!< The callback context */
+    struct audio_buf_pool_waiter    *next;      /*!< Used by the pool while the waiter is on its list */
+} audio_buf_pool_waiter_t;
+
+/**
+ * @brief      Format of the data held by a buffer
+ */
+typedef struct {
+    int                 sample_rates;   /*!< Sample rates in Hz, 0 if unknown */
+    int                 channels;       /*!< Number of audio channel, 0 if unknown */
+    int                 bits;           /*!< Bit wide, 0 if unknown */
+    esp_codec_type_t    codec_fmt;      /*!< Codec of the data, ESP_CODEC_TYPE_RAW for PCM */
+} audio_buf_format_t;
+
+/**
+ * @brief      A reference counted buffer of a pool. Elements pass it to each other by pointer,
+ *             the memory goes back to the pool when the last reference is dropped.
+ */
+typedef struct {
+    char                *data;          /*!< Start of the buffer memory */
+    int                 size;           /*!< Capacity of `data` in bytes */
+    int                 offset;         /*!< Offset of the payload in `data` */
+    int                 len;            /*!< Length of the payload */
+    audio_buf_format_t  fmt;            /*!< Format of the payload */
+    int64_t             timestamp;      /*!< Timestamp of the first byte of the payload in microseconds, 0 if unknown */
+    uint32_t            flags;          /*!< AUDIO_BUF_FLAG_* */
+} audio_buf_t;
+
+/**
+ * @brief      Create a pool of `n_bufs` buffers of `buf_size` bytes each, all allocated up front
+ *
+ * @param[in]  buf_size     Size of each buffer
+ * @param[in]  n_bufs       Number of buffers
+ *
+ * @return     audio_buf_pool_handle_t, NULL on failure
+ */
+audio_buf_pool_handle_t audio_buf_pool_create(int buf_size, int n_bufs);
+
+/**
+ * @brief      Same as `audio_buf_pool_create`, with the pool and its buffers allocated from `arena`
+ *
+ * @param[in]  arena        The arena to allocate from, NULL for the heap
+ * @param[in]  buf_size     Size of each buffer
+ * @param[in]  n_bufs       Number of buffers
+ *
+ * @return     audio_buf_pool_handle_t, NULL on failure
+ */
+audio_buf_pool_handle_t audio_buf_pool_create_in(audio_arena_handle_t arena, int buf_size, int n_bufs);
+
+/**
+ * @brief      Drop the reference taken by `audio_buf_pool_create` or `audio_buf_pool_ref`.
+ *             The memory is freed once the last reference is dropped and every buffer is back in the pool,
+ *             so buffers still in flight stay valid.
+ *
+ * @param[in]  pool     The pool handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t audio_buf_pool_destroy(audio_buf_pool_handle_t pool);
+
+/**
+ * @brief      Take one more reference on the pool, released with `audio_buf_pool_destroy`
+ *
+ * @param[in]  pool     The pool handle
+ *
+ * @return     The pool handle
+ */
+audio_buf_pool_handle_t audio_buf_pool_ref(audio_buf_pool_handle_t pool);
+
+/**
+ * @brief      Add a waiter called every time a buffer goes back to the pool. Every descriptor Ringbuffer fed by the
+ *             pool adds its own, so rings sharing a pool each get their wake-ups.
+ *
+ * @param[in]  pool     The pool handle
+ * @param[in]  waiter   The waiter, with `notify` and `ctx` set; it must stay valid until it is removed
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t audio_buf_pool_add_waiter(audio_buf_pool_handle_t pool, audio_buf_pool_waiter_t *waiter);
+
+/**
+ * @brief      Remove a waiter of `audio_buf_pool_add_waiter`. Once this returns its callback is not running and will
+ *             not be called again, so its context can be freed.
+ *
+ * @param[in]  pool     The pool handle
+ * @param[in]  waiter   The waiter
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG  `waiter` is not on the list of the pool
+ */
+esp_err_t audio_buf_pool_remove_waiter(audio_buf_pool_handle_t pool, audio_buf_pool_waiter_t *waiter);
+
+/**
+ * @brief      Get the number of buffers in the pool that are not in use
+ *
+ * @param[in]  pool     The pool handle
+ *
+ * @return     Number of free buffers
+ */
+int audio_buf_pool_get_free(audio_buf_pool_handle_t pool);
+
+/**
+ * @brief      Get the size of the buffers of the pool
+ *
+ * @param[in]  pool     The pool handle
+ *
+ * @return     Buffer size in bytes, ESP_ERR_INVALID_ARG if `pool` is NULL
+ */
+int audio_buf_pool_get_buf_size(audio_buf_pool_handle_t pool);
+
+/**
+ * @brief      Take a free buffer from the pool, wait `ticks_to_wait` ticks until one is released if none is free.
+ *             The buffer is returned with one reference, an empty payload and no format, timestamp or flags.
+ *
+ * @param[in]  pool             The pool handle
+ * @param[in]  ticks_to_wait    The ticks to wait, 0 to try once
+ *
+ * @return     The buffer, NULL if none was released in time
+ */
+audio_buf_t *audio_buf_alloc(audio_buf_pool_handle_t pool, TickType_t ticks_to_wait);
+
+/**
+ * @brief      Take one more reference on a buffer, e.g. to hand the same data to two consumers
+ *
+ * @param[in]  buf      The buffer
+ *
+ * @return     The buffer
+ */
+audio_buf_t *audio_buf_ref(audio_buf_t *buf);
+
+/**
+ * @brief      Drop one reference on a buffer, the last one gives it back to its pool
+ *
+ * @param[in]  buf      The buffer, NULL is ignored
+ */
+void audio_buf_unref(audio_buf_t *buf);
+
+/**
+ * @brief      Get the number of references held on a buffer
+ *
+ * @param[in]  buf      The buffer
+ *
+ * @return     The reference count
+ */
+int audio_buf_get_refs(audio_buf_t *buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _AUDIO_BUF_H_ */
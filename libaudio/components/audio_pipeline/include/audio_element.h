@@ -29,6 +29,7 @@
 #include "audio_event_iface.h"
 #include "ringbuf.h"
 #include "audio_common.h"
+#include "audio_scheduler.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -73,6 +74,7 @@ typedef enum {
     AEL_MSG_CMD_REPORT_MUSIC_INFO   = 9,
     AEL_MSG_CMD_REPORT_CODEC_FMT    = 10,
     AEL_MSG_CMD_REPORT_POSITION     = 11,
+    AEL_MSG_CMD_REPORT_STATS        = 12,
 } audio_element_msg_cmd_t;
 
 /**
@@ -140,6 +142,45 @@ typedef struct {
     .codec_fmt = ESP_CODEC_TYPE_UNKNOW    \
 }
 
+#define AEL_STATS_HIST_SUB_BITS     (3)                             /*!< Buckets per power of two of a histogram, in bits */
+#define AEL_STATS_HIST_BUCKETS      (24 << AEL_STATS_HIST_SUB_BITS) /*!< Buckets of a histogram, 0 us up to 2^26 us */
+
+/**
+ * @brief Histogram of durations in microseconds. Log-linear like an HDR histogram: one bucket per
+ *        microsecond below 8 us, then 8 buckets per power of two, so a bucket is within 12.5% of its values.
+ *        Longer durations land in the last bucket.
+ */
+typedef struct {
+    uint32_t    count[AEL_STATS_HIST_BUCKETS];  /*!< Number of durations per bucket */
+    uint32_t    max_us;                         /*!< Longest duration */
+} audio_element_hist_t;
+
+/**
+ * @brief Audio Element counters, kept since the Element was initialized. Diff two snapshots for a rate.
+ */
+typedef struct {
+    uint64_t    process_calls;                  /*!< Calls of the process callback */
+    uint64_t    bytes_in;                       /*!< Bytes read through the input functions */
+    uint64_t    bytes_out;                      /*!< Bytes written through the output functions */
+    uint64_t    process_wall_ns;                /*!< Wall time in the process callback, with the input and output waits */
+    uint64_t    process_cpu_ns;                 /*!< CPU time of the calling thread in the process callback,
+                                                     estimated from one call in CONFIG_AUDIO_ELEMENT_STATS_CPU_PERIOD */
+    uint64_t    input_wait_ns;                  /*!< Wall time in the input functions, mostly waiting for data */
+    uint64_t    output_wait_ns;                 /*!< Wall time in the output functions, mostly waiting for room.
+                                                     A fused output includes the time of the Elements it feeds */
+    audio_element_hist_t process_wall;          /*!< Wall time per process call */
+    audio_element_hist_t process_cpu;           /*!< CPU time of the sampled process calls */
+} audio_element_stats_t;
+
+/**
+ * @brief What an output Element presents now, see `audio_element_set_presentation`
+ */
+typedef struct {
+    int64_t     pts;                            /*!< Media time being presented in microseconds */
+    int64_t     origin_ns;                      /*!< CLOCK_MONOTONIC time the source produced it, 0 if unknown */
+    int64_t     time_ns;                        /*!< CLOCK_MONOTONIC time of the report */
+} audio_element_presentation_t;
+
 typedef esp_err_t (*el_io_func)(audio_element_handle_t self);
 typedef audio_element_err_t (*process_func)(audio_element_handle_t self, char *el_buffer, int el_buf_len);
 typedef audio_element_err_t (*stream_func)(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait,
@@ -170,8 +211,12 @@ typedef struct {
     void                *data;            /*!< User context */
     const char          *tag;             /*!< Element tag */
     bool                stack_in_ext;     /*!< Try to allocate stack in external memory */
+    bool                task_real_time;   /*!< Element task runs as SCHED_FIFO, even when audio_thread_set_attr left
+                                               the other threads as SCHED_OTHER */
     int                 multi_in_rb_num;  /*!< The number of multiple input ringbuffer */
     int                 multi_out_rb_num; /*!< The number of multiple output ringbuffer */
+    bool                out_rb_packet;    /*!< Output ringbuffer created by the pipeline keeps every write as one record */
+    bool                out_rb_desc;      /*!< Output ringbuffer created by the pipeline passes pooled buffers by pointer */
 } audio_element_cfg_t;
 
 #define DEFAULT_ELEMENT_RINGBUF_SIZE    (8*1024)
@@ -268,6 +313,8 @@ esp_err_t audio_element_setinfo(audio_element_handle_t el, audio_element_info_t
 
 /**
  * @brief      Get audio element infomation.
+ *             It takes no lock and never waits for the element thread, prefer
+ *             `audio_element_get_byte_pos` when only the position is needed.
  *
  * @param[in]  el    The audio element handle
  * @param      info  The information pointer
@@ -313,6 +360,33 @@ char *audio_element_get_uri(audio_element_handle_t el);
  */
 esp_err_t audio_element_run(audio_element_handle_t el);
 
+/**
+ * @brief      Run the element as a task of a shared worker pool instead of a thread of its own.
+ *             The task only gets a worker while it has a command to handle, or while it is running and
+ *             its input ringbuf holds `buffer_len` bytes (or is done) and half of its output ringbuf is free.
+ *             It then calls `process` repeatedly, for at most the scheduler slice before other elements run.
+ *             Reads of more than `buffer_len` bytes, or writes of more than half the output ringbuf,
+ *             can still block a worker for a while. Elements without a task (task_stack <= 0) ignore this.
+ *             Must be called before `audio_element_run`.
+ *
+ * @param[in]  el     The audio element handle
+ * @param[in]  sched  The scheduler, NULL to go back to one thread per element
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t audio_element_set_scheduler(audio_element_handle_t el, audio_scheduler_handle_t sched);
+
+/**
+ * @brief      Get the scheduler the element runs on
+ *
+ * @param[in]  el     The audio element handle
+ *
+ * @return     The scheduler handle, NULL if the element has a thread of its own
+ */
+audio_scheduler_handle_t audio_element_get_scheduler(audio_element_handle_t el);
+
 /**
  * @brief      Terminate Audio Element.
  *             With this function, audio_element will exit the task function.
@@ -435,6 +509,22 @@ esp_err_t audio_element_msg_set_listener(audio_element_handle_t el, audio_event_
  */
 esp_err_t audio_element_set_event_callback(audio_element_handle_t el, event_cb_func cb_func, void *ctx);
 
+/**
+ * @brief      Add one more `listener` to audio element `el`, receiving only the events that pass `filter`.
+ *             Unlike `audio_element_msg_set_listener` the pending messages of `listener` are kept.
+ *
+ * @param      el           The audio element handle
+ * @param      listener     The event will be listen to
+ * @param      filter       The subscription filter, NULL for all events
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_ERR_NO_MEM
+ */
+esp_err_t audio_element_msg_subscribe(audio_element_handle_t el, audio_event_iface_handle_t listener,
+                                     const audio_event_iface_filter_t *filter);
+
 /**
  * @brief      Remove listener out of el.
  *             No new events will be sent to the listener.
@@ -490,6 +580,34 @@ esp_err_t audio_element_set_output_ringbuf(audio_element_handle_t el, ringbuf_ha
  */
 ringbuf_handle_t audio_element_get_output_ringbuf(audio_element_handle_t el);
 
+/**
+ * @brief      Fuse the output of an element to the input of the next one. The next element gets no task and no input
+ *             ringbuffer: whatever `el` outputs is handed to its `process` by direct call, in the thread of `el`.
+ *             `next` may itself be fused to a further element, so a whole chain runs in one thread.
+ *             It is opened and closed along with `el`, and finishes once `el` is done and its input is drained.
+ *
+ * @note       Both elements must be stopped. `audio_element_input_peek` hands out the buffer of `el` itself, without
+ *             a copy. An element that peeks and consumes nothing, waiting for more, is called again on the next push
+ *             with the rest of this one copied in front of it.
+ *
+ * @param[in]  el    The audio element handle
+ * @param[in]  next  The element to fuse to, NULL to break the fused link of `el`
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t audio_element_set_fused_output(audio_element_handle_t el, audio_element_handle_t next);
+
+/**
+ * @brief      Get the element fused to the output of an element.
+ *
+ * @param[in]  el    The audio element handle
+ *
+ * @return     The fused element, NULL if the output of `el` is not fused
+ */
+audio_element_handle_t audio_element_get_fused_output(audio_element_handle_t el);
+
 /**
  * @brief      Get current Element state.
  *
@@ -582,11 +700,127 @@ esp_err_t audio_element_report_codec_fmt(audio_element_handle_t el);
  */
 esp_err_t audio_element_report_pos(audio_element_handle_t el);
 
+/**
+ * @brief      Element will sendout event `AEL_MSG_CMD_REPORT_STATS` with a snapshot of its counters, see
+ *             `audio_element_get_stats`. The snapshot is overwritten by the next report.
+ *
+ * @param[in]  el    The audio element handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ *     - ESP_ERR_NO_MEM
+ *     - ESP_ERR_NOT_SUPPORTED when the counters are compiled out
+ */
+esp_err_t audio_element_report_stats(audio_element_handle_t el);
+
+/**
+ * @brief      Send `AEL_MSG_CMD_REPORT_STATS` from the Element task every `period_ms`, checked after each process call
+ *
+ * @param[in]  el           The audio element handle
+ * @param[in]  period_ms    The period, 0 (the default) for no periodic report
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t audio_element_set_stats_report_period(audio_element_handle_t el, int period_ms);
+
+/**
+ * @brief      Get a consistent snapshot of the Element counters: process calls, bytes in and out, the wall and CPU
+ *             time of the process calls with their histograms, and the time spent in the input and output functions.
+ *             The counters cost two CLOCK_MONOTONIC reads, served without a syscall, per process, input or output
+ *             call, and are on unless CONFIG_AUDIO_ELEMENT_STATS is 0. The thread CPU time takes a syscall to read, so
+ *             only one process call in CONFIG_AUDIO_ELEMENT_STATS_CPU_PERIOD (16 by default, 0 for none) is timed on it.
+ *
+ * @param[in]  el       The audio element handle
+ * @param[out] stats    The snapshot
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ *     - ESP_ERR_NOT_SUPPORTED when the counters are compiled out
+ */
+esp_err_t audio_element_get_stats(audio_element_handle_t el, audio_element_stats_t *stats);
+
+/**
+ * @brief      Get a percentile of a histogram of `audio_element_stats_t`
+ *
+ * @param[in]  hist         The histogram
+ * @param[in]  percentile   The percentile, 0 to 100
+ *
+ * @return     The upper bound in microseconds of the bucket holding the percentile, at most the longest duration.
+ *             0 for an empty histogram.
+ */
+uint32_t audio_element_hist_percentile(const audio_element_hist_t *hist, double percentile);
+
+/**
+ * @brief      Stamp the next bytes the Element outputs, see `rb_set_timestamp`
+ *
+ *             Sources stamp each chunk they read with the time they got it, and with the media time when they know
+ *             it. Elements that change the timing, like decoders, stamp their output themselves. Any other Element
+ *             passes the stamp of its input on to its output, moved by the bytes it was into the input if the
+ *             Element information describes PCM, so that stamp is only as exact as the input chunks line up with
+ *             the output ones. Once an Element called this it no longer passes input stamps on.
+ *
+ * @param[in]  el           The audio element handle
+ * @param[in]  pts          Media time in microseconds, RB_PTS_NONE if unknown
+ * @param[in]  origin_ns    CLOCK_MONOTONIC time the source produced the data, 0 if unknown
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ *     - ESP_ERR_NOT_SUPPORTED, the output is a callback
+ */
+esp_err_t audio_element_set_output_timestamp(audio_element_handle_t el, int64_t pts, int64_t origin_ns);
+
+/**
+ * @brief      Get the stamp of the data the last input call returned, see `rb_get_timestamp`
+ *
+ *             A fused input gets the stamp of the buffer pushed to it, `offset` is then always 0.
+ *
+ * @param[in]  el    The audio element handle
+ * @param[out] ts    The stamp
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ *     - ESP_ERR_NOT_FOUND, nothing stamped the input
+ */
+esp_err_t audio_element_get_input_timestamp(audio_element_handle_t el, rb_timestamp_t *ts);
+
+/**
+ * @brief      Report the media time an output Element presents now, e.g. the one leaving the DAC.
+ *             `audio_pipeline_get_media_time` reads it from the last Element of the pipeline.
+ *
+ * @param[in]  el           The audio element handle
+ * @param[in]  pts          Media time in microseconds
+ * @param[in]  origin_ns    CLOCK_MONOTONIC time the source produced the data presented, 0 if unknown
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t audio_element_set_presentation(audio_element_handle_t el, int64_t pts, int64_t origin_ns);
+
+/**
+ * @brief      Get the last report of `audio_element_set_presentation`
+ *
+ * @param[in]  el    The audio element handle
+ * @param[out] pres  The report
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ *     - ESP_ERR_NOT_FOUND, nothing reported since the Element was opened
+ */
+esp_err_t audio_element_get_presentation(audio_element_handle_t el, audio_element_presentation_t *pres);
+
 /**
  * @brief      Set input read timeout (default is `portMAX_DELAY`).
  *
  * @param[in]  el       The audio element handle
- * @param[in]  timeout  The timeout
+ * @param[in]  timeout  The timeout in ticks of one second, use `pdMS_TO_TICKS` for a timeout in milliseconds
  *
  * @return
  *     - ESP_OK
@@ -598,7 +832,7 @@ esp_err_t audio_element_set_input_timeout(audio_element_handle_t el, TickType_t
  * @brief      Set output read timeout (default is `portMAX_DELAY`).
  *
  * @param[in]  el       The audio element handle
- * @param[in]  timeout  The timeout
+ * @param[in]  timeout  The timeout in ticks of one second, use `pdMS_TO_TICKS` for a timeout in milliseconds
  *
  * @return
  *     - ESP_OK
@@ -680,6 +914,132 @@ audio_element_err_t audio_element_input(audio_element_handle_t el, char *buffer,
  */
 audio_element_err_t audio_element_output(audio_element_handle_t el, char *buffer, int write_size);
 
+/**
+ * @brief      Get one record of Element input data with its metadata.
+ *             Only available when the input is a packet mode ringbuffer, see `rb_create_packet`.
+ *
+ * @param[in]  el            The audio element handle
+ * @param      buffer        The buffer pointer
+ * @param[in]  wanted_size   The buffer size, a record larger than that is an input error
+ * @param[out] info          The record metadata, can be NULL
+ *
+ * @return
+ *        - > 0 length of the record
+ *        - <=0 audio_element_err_t
+ */
+audio_element_err_t audio_element_input_packet(audio_element_handle_t el, char *buffer, int wanted_size, rb_packet_info_t *info);
+
+/**
+ * @brief      Send out Element output data as one record with its metadata.
+ *             On any output other than a packet mode ringbuffer the metadata is dropped and this behaves like
+ *             `audio_element_output`.
+ *
+ * @param[in]  el          The audio element handle
+ * @param      buffer      The buffer pointer
+ * @param[in]  write_size  The write size
+ * @param[in]  info        The record metadata, can be NULL
+ *
+ * @return
+ *        - > 0 number of bytes written
+ *        - <=0 audio_element_err_t
+ */
+audio_element_err_t audio_element_output_packet(audio_element_handle_t el, char *buffer, int write_size, const rb_packet_info_t *info);
+
+/**
+ * @brief      Get Element input data in place, without copying it out of the input ringbuffer.
+ *             Only available when the input is a ringbuffer. The returned span is contiguous and may be shorter than
+ *             `wanted_size`; it must be released with `audio_element_input_consume` once parsed.
+ *
+ * @param[in]  el            The audio element handle
+ * @param[out] buffer        Set to the start of the input data
+ * @param[in]  wanted_size   The maximum size wanted
+ *
+ * @return
+ *        - > 0 number of bytes available at `*buffer`
+ *        - <=0 audio_element_err_t
+ */
+audio_element_err_t audio_element_input_peek(audio_element_handle_t el, char **buffer, int wanted_size);
+
+/**
+ * @brief      Release `len` bytes of input data returned by `audio_element_input_peek`
+ *
+ * @param[in]  el    The audio element handle
+ * @param[in]  len   Number of bytes consumed
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t audio_element_input_consume(audio_element_handle_t el, int len);
+
+/**
+ * @brief      Get space in the output ringbuffer so Element can produce data in place.
+ *             Only available when the output is a ringbuffer. The returned span is contiguous and may be shorter than
+ *             `wanted_size`; the produced bytes are sent out by `audio_element_output_commit`.
+ *
+ * @param[in]  el            The audio element handle
+ * @param[out] buffer        Set to the start of the output space
+ * @param[in]  wanted_size   The maximum size wanted
+ *
+ * @return
+ *        - > 0 number of bytes writable at `*buffer`
+ *        - <=0 audio_element_err_t
+ */
+audio_element_err_t audio_element_output_acquire(audio_element_handle_t el, char **buffer, int wanted_size);
+
+/**
+ * @brief      Send out `len` bytes produced into the space returned by `audio_element_output_acquire`
+ *
+ * @param[in]  el    The audio element handle
+ * @param[in]  len   Number of bytes produced
+ *
+ * @return
+ *        - > 0 number of bytes written
+ *        - <=0 audio_element_err_t
+ */
+audio_element_err_t audio_element_output_commit(audio_element_handle_t el, int len);
+
+/**
+ * @brief      Get an empty buffer to produce output into. When the output is a descriptor ringbuffer the buffer comes
+ *             from its pool and goes downstream without a copy, otherwise from a small pool of the Element.
+ *
+ * @param[in]  el    The audio element handle
+ * @param[out] buf   Set to the buffer, send it with `audio_element_output_buf` or drop it with `audio_buf_unref`
+ *
+ * @return
+ *        - > 0 size of the buffer
+ *        - <=0 audio_element_err_t
+ */
+audio_element_err_t audio_element_alloc_buf(audio_element_handle_t el, audio_buf_t **buf);
+
+/**
+ * @brief      Get the next input buffer. A descriptor input ringbuffer hands its buffers over as they are,
+ *             any other input is read into a buffer from `audio_element_alloc_buf`, with the timestamp and flags
+ *             of packet mode ringbuffers and the format from the Element info.
+ *
+ * @param[in]  el    The audio element handle
+ * @param[out] buf   Set to the buffer, the caller owns the reference
+ *
+ * @return
+ *        - > 0 length of the payload
+ *        - <=0 audio_element_err_t
+ */
+audio_element_err_t audio_element_input_buf(audio_element_handle_t el, audio_buf_t **buf);
+
+/**
+ * @brief      Send a buffer out. A descriptor output ringbuffer queues the buffer itself, any other output gets a
+ *             copy of the payload, packet mode ringbuffers with the timestamp and flags.
+ *             The reference is always taken over, even on failure.
+ *
+ * @param[in]  el    The audio element handle
+ * @param[in]  buf   The buffer
+ *
+ * @return
+ *        - > 0 number of bytes written
+ *        - <=0 audio_element_err_t
+ */
+audio_element_err_t audio_element_output_buf(audio_element_handle_t el, audio_buf_t *buf);
+
 /**
  * @brief     This API allows the application to set a read callback for the first audio_element in the pipeline for
  *            allowing the pipeline to interface with other systems. The callback is invoked every time the audio
@@ -739,10 +1099,11 @@ stream_func audio_element_get_read_cb(audio_element_handle_t el);
 /**
  * @brief      Get External queue of Emitter.
  *             We can read any event that has been send out of Element from this `mqd_t`.
+ *             A listener on the in-process queue, the default, has none: use `audio_event_iface_get_fd` on it.
  *
  * @param[in]  el    The audio element handle
  *
- * @return     mqd_t
+ * @return     mqd_t, 0 with an error log if the listener uses the in-process queue
  */
 mqd_t audio_element_get_event_queue(audio_element_handle_t el);
 
@@ -791,6 +1152,73 @@ int audio_element_get_output_ringbuf_size(audio_element_handle_t el);
  */
 esp_err_t audio_element_set_output_ringbuf_size(audio_element_handle_t el, int rb_size);
 
+/**
+ * @brief      Set whether the output ringbuffer created by the pipeline for this Element is a packet mode ringbuffer,
+ *             see `rb_create_packet`. Takes effect on the next `audio_pipeline_link`.
+ *
+ * @param[in]  el       The audio element handle
+ * @param[in]  packet   true to keep every output write as one record
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t audio_element_set_output_ringbuf_packet(audio_element_handle_t el, bool packet);
+
+/**
+ * @brief      Get whether the pipeline creates a packet mode output ringbuffer for this Element
+ *
+ * @param[in]  el    The audio element handle
+ *
+ * @return     true if the output keeps write boundaries
+ */
+bool audio_element_is_output_ringbuf_packet(audio_element_handle_t el);
+
+/**
+ * @brief      Make the pipeline create a descriptor output ringbuffer for this Element, passing pooled buffers by
+ *             pointer, see `rb_create_desc`. Takes effect on the next `audio_pipeline_link`.
+ *
+ * @param[in]  el       The audio element handle
+ * @param[in]  desc     true to pass buffers by pointer
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t audio_element_set_output_ringbuf_desc(audio_element_handle_t el, bool desc);
+
+/**
+ * @brief      Get whether the pipeline creates a descriptor output ringbuffer for this Element
+ *
+ * @param[in]  el    The audio element handle
+ *
+ * @return     true if the output passes buffers by pointer
+ */
+bool audio_element_is_output_ringbuf_desc(audio_element_handle_t el);
+
+/**
+ * @brief      Draw the Element buffer, the report data and the private buffer pool from `arena` instead of the
+ *             heap. `audio_pipeline_register` sets the arena of the pipeline. The Element holds a reference on
+ *             the arena until another one is set or the Element is deinitialized.
+ *
+ * @param[in]  el       The audio element handle
+ * @param[in]  arena    The arena, NULL for the heap
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t audio_element_set_arena(audio_element_handle_t el, audio_arena_handle_t arena);
+
+/**
+ * @brief      Get the arena set with `audio_element_set_arena`
+ *
+ * @param[in]  el       The audio element handle
+ *
+ * @return     The arena, NULL for the heap
+ */
+audio_arena_handle_t audio_element_get_arena(audio_element_handle_t el);
+
 /**
  * @brief      Call this function to read data from multi input ringbuffer by given index.
  *
@@ -809,6 +1237,10 @@ esp_err_t audio_element_multi_input(audio_element_handle_t el, char *buffer, int
 /**
  * @brief      Call this function write data by multi output ringbuffer.
  *
+ *             The data is copied into every multi output ringbuffer. To feed several consumers from a single
+ *             copy, use a ringbuffer created by `rb_create_broadcast` as the output ringbuffer of the element and
+ *             give each consumer one of its readers (`rb_broadcast_get_reader`) as input ringbuffer.
+ *
  * @param[in]  el            The audio element handle
  * @param      buffer        The buffer pointer
  * @param[in]  wanted_size   The wanted size
@@ -929,6 +1361,24 @@ bool audio_element_is_stopping(audio_element_handle_t el);
  */
 esp_err_t audio_element_update_byte_pos(audio_element_handle_t el, int pos);
 
+/**
+ * @brief      Get the byte position of element information without copying the whole information
+ *
+ * @param[in]  el    The audio element handle
+ *
+ * @return     The byte_pos
+ */
+int64_t audio_element_get_byte_pos(audio_element_handle_t el);
+
+/**
+ * @brief      Get the total bytes of element information without copying the whole information
+ *
+ * @param[in]  el    The audio element handle
+ *
+ * @return     The total_bytes
+ */
+int64_t audio_element_get_total_bytes(audio_element_handle_t el);
+
 /**
  * @brief      Set the byte position of element information
  *
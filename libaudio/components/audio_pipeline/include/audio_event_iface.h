@@ -31,6 +31,7 @@
 #include "audio_error.h"
 #include "audio_mem.h"
 #include "audio_queue.h"
+#include "audio_mpsc_queue.h"
 #include "portmacro.h"
 #include "esp_err.h"
 #ifdef __cplusplus
@@ -53,12 +54,45 @@ typedef esp_err_t (*on_event_iface_func)(audio_event_iface_msg_t *, void *);
 
 typedef struct audio_event_iface *audio_event_iface_handle_t;
 
+/**
+ * Backend of the event interface internal queue
+ */
+typedef enum {
+    AUDIO_EVENT_IFACE_QUEUE_INPROC = 0,             /*!< In-process lock-free queue, no syscall unless a side sleeps */
+    AUDIO_EVENT_IFACE_QUEUE_MQUEUE,                 /*!< POSIX message queue, visible through `audio_event_iface_get_msg_queue_handle` */
+} audio_event_iface_queue_t;
+
+/**
+ * What a listener loses when its queue is full
+ */
+typedef enum {
+    AUDIO_EVENT_IFACE_DROP_NEWEST = 0,              /*!< The message being sent is dropped and the send fails */
+    AUDIO_EVENT_IFACE_DROP_OLDEST,                  /*!< The oldest queued message makes room for the new one */
+} audio_event_iface_drop_t;
+
+#define AUDIO_EVENT_IFACE_BIT(x)        (1ULL << (x))
+
+/* Command carrying an `AEL_STATUS_*` code in `data`, same value as AEL_MSG_CMD_REPORT_STATUS */
+#define AUDIO_EVENT_IFACE_STATUS_CMD    (8)
+
+/**
+ * Subscription filter, a zero field matches everything
+ */
+typedef struct {
+    void                *source;                    /*!< Only events from this source */
+    int                 source_type;                /*!< Only events with this source type */
+    uint64_t            cmd_mask;                   /*!< AUDIO_EVENT_IFACE_BIT() of the commands to pass, commands >= 64 never pass */
+    uint64_t            status_mask;                /*!< AUDIO_EVENT_IFACE_BIT() of the `AEL_STATUS_*` codes to pass in status reports */
+} audio_event_iface_filter_t;
+
 /**
  * Event interface configurations
  */
 typedef struct {
     mqd_t         external_queue;
     int                 oflags;
+    audio_event_iface_queue_t queue_type;           /*!< Backend of the internal queue, mqueue only when another process needs the mqd_t */
+    audio_event_iface_drop_t drop_policy;           /*!< What is lost when this interface listens and its queue is full */
     int                 internal_queue_size;        /*!< It's optional, Queue size for event `internal_queue` */
     int                 external_queue_size;        /*!< It's optional, Queue size for event `external_queue` */
     on_event_iface_func on_cmd;                     /*!< Function callback for listener when any event arrived */
@@ -74,6 +108,8 @@ typedef struct {
 #define AUDIO_EVENT_IFACE_DEFAULT_CFG() {                   \
     .external_queue = 0,  \
     .oflags =  O_RDWR | O_CREAT | O_NONBLOCK,\
+    .queue_type = AUDIO_EVENT_IFACE_QUEUE_INPROC,           \
+    .drop_policy = AUDIO_EVENT_IFACE_DROP_NEWEST,           \
     .internal_queue_size = DEFAULT_AUDIO_EVENT_IFACE_SIZE,  \
     .external_queue_size = DEFAULT_AUDIO_EVENT_IFACE_SIZE,  \
     .on_cmd = NULL,                                         \
@@ -94,7 +130,8 @@ typedef struct {
 audio_event_iface_handle_t audio_event_iface_init(audio_event_iface_cfg_t *config);
 
 /**
- * @brief      Cleanup event, it doesn't free evt pointer
+ * @brief      Cleanup event: unsubscribe it from the events it listens to, drop its own listeners and free it.
+ *             A sendout already delivering to it keeps it until that delivery is done.
  *
  * @param      evt   The event
  *
@@ -105,7 +142,8 @@ audio_event_iface_handle_t audio_event_iface_init(audio_event_iface_cfg_t *confi
 esp_err_t audio_event_iface_destroy(audio_event_iface_handle_t evt);
 
 /**
- * @brief      Add audio event `evt` to the listener, then we can listen `evt` event from `listen`
+ * @brief      Add audio event `evt` to the listener, then we can listen `evt` event from `listen`.
+ *             Pending messages of the listener are discarded, other listeners of `evt` are kept.
  *
  * @param      listener     The event can listen another event
  * @param      evt          The event to be added to
@@ -116,6 +154,31 @@ esp_err_t audio_event_iface_destroy(audio_event_iface_handle_t evt);
  */
 esp_err_t audio_event_iface_set_listener(audio_event_iface_handle_t evt, audio_event_iface_handle_t listener);
 
+/**
+ * @brief      Subscribe `listener` to the events `evt` sends out, an emitter can have any number of listeners.
+ *             Only the events passing `filter` are posted to the listener queue, subscribing again replaces the filter.
+ *
+ * @param      evt          The event emitter
+ * @param      listener     The event listener, it must have an internal queue
+ * @param      filter       The filter, NULL to receive everything
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_ERR_NO_MEM
+ */
+esp_err_t audio_event_iface_subscribe(audio_event_iface_handle_t evt, audio_event_iface_handle_t listener,
+                                      const audio_event_iface_filter_t *filter);
+
+/**
+ * @brief      Get the number of messages the listener lost to its drop policy
+ *
+ * @param      evt          The event listener
+ *
+ * @return     The number of dropped messages
+ */
+uint32_t audio_event_iface_get_dropped(audio_event_iface_handle_t evt);
+
 /**
  * @brief      Remove audio event `evt` from the listener
  *
@@ -151,6 +214,16 @@ esp_err_t audio_event_iface_set_cmd_waiting_timeout(audio_event_iface_handle_t e
  */
 esp_err_t audio_event_iface_waiting_cmd_msg(audio_event_iface_handle_t evt);
 
+/**
+ * @brief      Check whether the internal queue holds a message, `audio_event_iface_waiting_cmd_msg` does not
+ *             block then
+ *
+ * @param      evt        The event
+ *
+ * @return     true if a message is pending
+ */
+bool audio_event_iface_has_cmd_msg(audio_event_iface_handle_t evt);
+
 /**
  * @brief      Trigger an event for internal queue with a message
  *
@@ -176,14 +249,17 @@ esp_err_t audio_event_iface_cmd(audio_event_iface_handle_t evt, audio_event_ifac
 esp_err_t audio_event_iface_cmd_from_isr(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg);
 
 /**
- * @brief      Trigger and event out with a message
+ * @brief      Trigger and event out with a message.
+ *             Delivered to the external queue and the listeners without blocking, whatever the flags of their queues:
+ *             the drop policy of a full listener decides which message is lost.
  *
  * @param      evt   The event
  * @param      msg   The message
  *
  * @return
  *     - ESP_OK
- *     - ESP_FAIL
+ *     - ESP_FAIL            A queue was full and a message was dropped
+ *     - ESP_ERR_NO_MEM
  */
 esp_err_t audio_event_iface_sendout(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg);
 
@@ -211,12 +287,37 @@ esp_err_t audio_event_iface_discard(audio_event_iface_handle_t evt);
  */
 esp_err_t audio_event_iface_listen(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msg, TickType_t wait_time);
 
+/**
+ * @brief      Receive the pending events without blocking
+ *
+ * @param[in]  evt       The event interface
+ * @param[out] msgs      Array of `max_msgs` events to fill in
+ * @param[in]  max_msgs  The maximum number of events to receive
+ *
+ * @return     The number of events received, 0 if none is pending
+ */
+int audio_event_iface_listen_batch(audio_event_iface_handle_t evt, audio_event_iface_msg_t *msgs, int max_msgs);
+
+/**
+ * @brief      Get a file descriptor to poll/epoll for pending events of the listener `evt`.
+ *             It is the eventfd of the in-process queue or the mqd_t of the mqueue. The eventfd is only re-armed once
+ *             `audio_event_iface_listen_batch` or `audio_event_iface_listen` finds the queue empty, so drain it on every
+ *             wake-up. The descriptor belongs to `evt` and is closed by `audio_event_iface_destroy`.
+ *
+ * @param[in]  evt   The event interface
+ *
+ * @return
+ *     - >=0  The file descriptor, readable while events are pending
+ *     - -1   `evt` has no internal queue or the descriptor can not be created
+ */
+int audio_event_iface_get_fd(audio_event_iface_handle_t evt);
+
 /**
  * @brief      Get External queue handle of Emmitter
  *
  * @param[in]  evt   The external queue
  *
- * @return     External mqd_t
+ * @return     External mqd_t, 0 with an error log if the listener uses the in-process queue, which has no mqd_t
  */
 mqd_t audio_event_iface_get_queue_handle(audio_event_iface_handle_t evt);
 
@@ -238,19 +339,20 @@ esp_err_t audio_event_iface_read(audio_event_iface_handle_t evt, audio_event_ifa
  *
  * @param[in]  evt   The Internal queue
  *
- * @return     Internal mqd_t
+ * @return     Internal mqd_t, 0 with an error log for the in-process queue, which has no mqd_t
  */
 mqd_t audio_event_iface_get_msg_queue_handle(audio_event_iface_handle_t evt);
 
 /**
- * @brief      Add audio internal event `evt` to the listener, then we can listen `evt` event from `listen`
+ * @brief      Add audio internal event `evt` to the listener, then we can listen `evt` event from `listen`.
+ *             Same as `audio_event_iface_subscribe` without a filter, the listener keeps its pending messages.
  *
  * @param      listener     The event can listen another event
  * @param      evt          The event to be added to
  *
  * @return
  *     - ESP_OK
- *     - ESP_FAIL
+ *     - ESP_ERR_INVALID_ARG
  */
 esp_err_t audio_event_iface_set_msg_listener(audio_event_iface_handle_t evt, audio_event_iface_handle_t listener);
 #ifdef __cplusplus
@@ -43,14 +43,56 @@ typedef struct audio_pipeline *audio_pipeline_handle_t;
  */
 typedef struct audio_pipeline_cfg {
     int rb_size;        /*!< Audio Pipeline ringbuffer size */
+    audio_scheduler_handle_t scheduler; /*!< Run the elements on this worker pool, NULL for one thread per element */
+    bool fused;         /*!< Link the elements by direct call in the task of the first one, no ringbuffer in between */
+    int arena_size;     /*!< Chunk size of the arena the pipeline draws its ringbuffers, list nodes and element buffers
+                             from, released in one go by `audio_pipeline_deinit`. 0 to allocate from the heap */
+    audio_arena_handle_t arena; /*!< Share this arena instead of creating one, the pipeline takes a reference */
 } audio_pipeline_cfg_t;
 
 #define DEFAULT_PIPELINE_RINGBUF_SIZE    (8*1024)
+#define DEFAULT_PIPELINE_ARENA_SIZE      (16*1024)
 
 #define DEFAULT_AUDIO_PIPELINE_CONFIG() {\
     .rb_size            = DEFAULT_PIPELINE_RINGBUF_SIZE,\
+    .scheduler          = NULL,\
+    .fused              = false,\
+    .arena_size         = DEFAULT_PIPELINE_ARENA_SIZE,\
+    .arena              = NULL,\
 }
 
+#define AUDIO_PIPELINE_STATS_TAG_LEN     (32)
+
+/**
+ * @brief Snapshot of one element of a pipeline, see `audio_pipeline_get_stats`
+ */
+typedef struct {
+    char                    tag[AUDIO_PIPELINE_STATS_TAG_LEN];  /*!< Tag of the element, truncated */
+    audio_element_state_t   state;      /*!< State of the element */
+    bool                    linked;     /*!< Part of the current link */
+    audio_element_stats_t   stats;      /*!< Counters of the element, all 0 when compiled out */
+} audio_pipeline_el_stats_t;
+
+/**
+ * @brief Snapshot of one ringbuffer of a pipeline, see `audio_pipeline_get_stats`
+ */
+typedef struct {
+    char                    writer[AUDIO_PIPELINE_STATS_TAG_LEN];   /*!< Tag of the element writing to it, "" if none */
+    char                    reader[AUDIO_PIPELINE_STATS_TAG_LEN];   /*!< Tag of the element reading from it, "" if none */
+    rb_stats_t              stats;      /*!< Counters of the ringbuffer, all 0 when compiled out */
+} audio_pipeline_rb_stats_t;
+
+/**
+ * @brief Snapshot of a whole pipeline, one allocation freed with `audio_pipeline_free_stats`
+ */
+typedef struct {
+    int64_t                     time_ns;    /*!< CLOCK_MONOTONIC time the snapshot was taken at */
+    int                         el_num;     /*!< Number of entries of `els` */
+    audio_pipeline_el_stats_t   *els;       /*!< Registered elements, in registration order */
+    int                         rb_num;     /*!< Number of entries of `rbs` */
+    audio_pipeline_rb_stats_t   *rbs;       /*!< Ringbuffers of the link, in link order */
+} audio_pipeline_stats_t;
+
 /**
  * @brief      Initialize audio_pipeline_handle_t object
  *             audio_pipeline is responsible for controlling the audio data stream and connecting the audio elements with the ringbuffer
@@ -85,6 +127,8 @@ esp_err_t audio_pipeline_deinit(audio_pipeline_handle_t pipeline);
  * @note       Because of stop pipeline or pause pipeline depend much on register order.
  *             Please register element strictly in the following order: input element first, process middle, output element last.
  *
+ * @note       When the pipeline has an arena, the element draws its buffers from it, see `audio_element_set_arena`.
+ *
  * @param[in]  pipeline The Audio Pipeline Handle
  * @param[in]  el       The Audio Element Handle
  * @param[in]  name     The name identifier of the audio_element in this audio_pipeline
@@ -96,7 +140,8 @@ esp_err_t audio_pipeline_deinit(audio_pipeline_handle_t pipeline);
 esp_err_t audio_pipeline_register(audio_pipeline_handle_t pipeline, audio_element_handle_t el, const char *name);
 
 /**
- * @brief      Unregister the audio_element in audio_pipeline, remove it from the list
+ * @brief      Unregister the audio_element in audio_pipeline, remove it from the list.
+ *             An element using the arena of the pipeline goes back to the heap.
  *
  * @param[in]  pipeline The Audio Pipeline Handle
  * @param[in]  el       The Audio Element Handle
@@ -287,6 +332,33 @@ esp_err_t audio_pipeline_remove_listener(audio_pipeline_handle_t pipeline);
  */
 esp_err_t audio_pipeline_set_listener(audio_pipeline_handle_t pipeline, audio_event_iface_handle_t evt);
 
+/**
+ * @brief      Subscribe one more `listener` to the linked elements of this audio_pipeline, receiving only the events
+ *             that pass `filter`. The subscription ends with `audio_pipeline_unsubscribe` or when the pipeline unlinks.
+ *
+ * @param[in]  pipeline     The Audio Pipeline Handle
+ * @param[in]  listener     The Event Handle
+ * @param[in]  filter       The subscription filter, NULL for all events
+ *
+ * @return
+ *     - ESP_OK on success
+ *     - ESP_FAIL when any errors
+ */
+esp_err_t audio_pipeline_subscribe(audio_pipeline_handle_t pipeline, audio_event_iface_handle_t listener,
+                                   const audio_event_iface_filter_t *filter);
+
+/**
+ * @brief      Remove a listener added by `audio_pipeline_subscribe`
+ *
+ * @param[in]  pipeline     The Audio Pipeline Handle
+ * @param[in]  listener     The Event Handle
+ *
+ * @return
+ *     - ESP_OK on success
+ *     - ESP_FAIL when the listener is not subscribed
+ */
+esp_err_t audio_pipeline_unsubscribe(audio_pipeline_handle_t pipeline, audio_event_iface_handle_t listener);
+
 /**
  * @brief      Get the event iface using by this pipeline
  *
@@ -353,6 +425,8 @@ esp_err_t audio_pipeline_link_more(audio_pipeline_handle_t pipeline, audio_eleme
 
 /**
  * @brief      Subscribe a NULL-terminated list of element's events to audio_pipeline.
+ *             The elements send out to the listener of `audio_pipeline_set_listener`, and the events pending on it and
+ *             on the listeners of `audio_pipeline_subscribe` are dropped.
  *
  * @param[in]  pipeline     The audio pipeline handle
  * @param[in]  element_1    The element event to subscribe to the audio_pipeline.
@@ -484,6 +558,49 @@ esp_err_t audio_pipeline_relink_more(audio_pipeline_handle_t pipeline, audio_ele
  */
 esp_err_t audio_pipeline_change_state(audio_pipeline_handle_t pipeline, audio_element_state_t new_state);
 
+/**
+ * @brief      Take a snapshot of the elements and ringbuffers of the pipeline: state, bytes through, time spent
+ *             processing and waiting of every element, fill level, fill range, bytes through, waits and wakeups
+ *             of every ringbuffer. Throughput is the difference of the byte counters of two snapshots over the
+ *             difference of their `time_ns`.
+ *
+ *             Safe to call from any thread while the pipeline runs, linking and unlinking wait for it.
+ *
+ * @param[in]  pipeline             The Audio Pipeline Handle
+ * @param[in]  reset_fill_range     Restart the fill range of every ringbuffer after the snapshot, so that the next
+ *                                  one reports the range since this one, see `rb_reset_fill_range`
+ *
+ * @return     The snapshot, NULL when out of memory
+ */
+audio_pipeline_stats_t *audio_pipeline_get_stats(audio_pipeline_handle_t pipeline, bool reset_fill_range);
+
+/**
+ * @brief      Free a snapshot returned by `audio_pipeline_get_stats`
+ *
+ * @param[in]  stats    The snapshot, may be NULL
+ */
+void audio_pipeline_free_stats(audio_pipeline_stats_t *stats);
+
+/**
+ * @brief      Get the media time the pipeline presents now and how long ago the source produced it.
+ *
+ *             Both come from the linked element that last reported its presentation, normally the sink, see
+ *             `audio_element_set_presentation`, and from the timestamps the elements pass along the ringbuffers,
+ *             see `audio_element_set_output_timestamp`. While that element runs, the media time moves on with the
+ *             clock between its reports.
+ *
+ * @param[in]  pipeline         The Audio Pipeline Handle
+ * @param[out] media_time_us    Media time in microseconds
+ * @param[out] latency_us       From the source producing the data to its presentation, -1 if the source did not
+ *                              say when it produced it, may be NULL
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_ERR_NOT_FOUND, no element reported its presentation
+ */
+esp_err_t audio_pipeline_get_media_time(audio_pipeline_handle_t pipeline, int64_t *media_time_us, int64_t *latency_us);
+
 
 #ifdef __cplusplus
 }
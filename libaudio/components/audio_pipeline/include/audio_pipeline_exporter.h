@@ -0,0 +1,113 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _AUDIO_PIPELINE_EXPORTER_H_
+#define _AUDIO_PIPELINE_EXPORTER_H_
+
+#include "audio_pipeline.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct audio_pipeline_exporter *audio_pipeline_exporter_handle_t;
+
+/**
+ * @brief Where the exporter serves the snapshots
+ */
+typedef enum {
+    AUDIO_PIPELINE_EXPORT_FILE = 0,     /*!< Rewrite a file every period, e.g. for the node_exporter textfile collector */
+    AUDIO_PIPELINE_EXPORT_UNIX_SOCKET,  /*!< Take a snapshot for every connection to a UNIX stream socket */
+} audio_pipeline_export_type_t;
+
+/**
+ * @brief Exporter configurations
+ */
+typedef struct {
+    audio_pipeline_export_type_t    type;       /*!< File or UNIX socket */
+    const char                      *path;      /*!< Path of the file or of the socket, replaced if it exists */
+    int                             period_ms;  /*!< File rewrite period, unused for a socket */
+    int                             task_stack; /*!< Exporter task stack */
+    int                             task_prio;  /*!< Exporter task priority */
+} audio_pipeline_exporter_cfg_t;
+
+#define DEFAULT_EXPORTER_PERIOD_MS      (1000)
+#define DEFAULT_EXPORTER_STACK_SIZE     (4*1024)
+#define DEFAULT_EXPORTER_TASK_PRIO      (1)
+
+#define AUDIO_PIPELINE_EXPORTER_DEFAULT_CFG() {             \
+    .type               = AUDIO_PIPELINE_EXPORT_FILE,       \
+    .path               = NULL,                             \
+    .period_ms          = DEFAULT_EXPORTER_PERIOD_MS,       \
+    .task_stack         = DEFAULT_EXPORTER_STACK_SIZE,      \
+    .task_prio          = DEFAULT_EXPORTER_TASK_PRIO,       \
+}
+
+/**
+ * @brief      Format a snapshot in the Prometheus text exposition format
+ *
+ *             Elements are labelled by tag, ringbuffers by the tags of their writer and reader. Counters count up
+ *             since the element or ringbuffer was created, so that rate() gives the throughput. The process time
+ *             per call is a summary with the 0.5, 0.9 and 0.99 quantiles.
+ *
+ * @param[in]  stats    The snapshot, see `audio_pipeline_get_stats`
+ * @param[out] buf      The output, NUL terminated, may be NULL if `size` is 0
+ * @param[in]  size     Size of `buf`
+ *
+ * @return     Length of the whole text without the NUL, like snprintf. The text was cut if it is `size` or more.
+ */
+int audio_pipeline_stats_to_prometheus(const audio_pipeline_stats_t *stats, char *buf, int size);
+
+/**
+ * @brief      Start a task that serves snapshots of the pipeline in the Prometheus text format
+ *
+ *             A file is written to `path`.tmp first and then renamed, a reader never sees it half written.
+ *             A socket answers `curl --unix-socket path http://localhost/metrics` with a HTTP response and any
+ *             other client with the bare text, then closes the connection. Every snapshot restarts the fill range
+ *             of the ringbuffers, so the range reported is the one since the previous snapshot.
+ *
+ * @param[in]  pipeline  The Audio Pipeline Handle, it must outlive the exporter
+ * @param[in]  config    The configuration - audio_pipeline_exporter_cfg_t
+ *
+ * @return     The exporter handle, NULL on failure
+ */
+audio_pipeline_exporter_handle_t audio_pipeline_exporter_start(audio_pipeline_handle_t pipeline,
+                                                               const audio_pipeline_exporter_cfg_t *config);
+
+/**
+ * @brief      Stop the exporter task and remove the socket. Call it before `audio_pipeline_deinit`.
+ *
+ * @param[in]  exporter  The exporter handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t audio_pipeline_exporter_stop(audio_pipeline_exporter_handle_t exporter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _AUDIO_PIPELINE_EXPORTER_H_ */
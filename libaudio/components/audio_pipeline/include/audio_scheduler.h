@@ -0,0 +1,158 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _AUDIO_SCHEDULER_H_
+#define _AUDIO_SCHEDULER_H_
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct audio_scheduler *audio_scheduler_handle_t;
+typedef struct audio_scheduler_task *audio_scheduler_task_t;
+
+/**
+ * @brief Result of one step of a scheduler task
+ */
+typedef enum {
+    AUDIO_SCHED_IDLE = 0,   /*!< Nothing to do, the task sleeps until audio_scheduler_task_wake */
+    AUDIO_SCHED_READY,      /*!< More work is pending, the step is called again */
+    AUDIO_SCHED_EXIT,       /*!< The task is done, it can be started again with audio_scheduler_task_start */
+} audio_scheduler_ret_t;
+
+typedef audio_scheduler_ret_t (*audio_scheduler_step_func)(void *ctx);
+
+/**
+ * @brief Scheduler configurations
+ */
+typedef struct {
+    int     workers;        /*!< Number of worker threads, 0 for one per online CPU */
+    int     slice_us;       /*!< Time a ready task keeps its worker before it goes back to the queue */
+    int     task_stack;     /*!< Worker task stack */
+    int     task_prio;      /*!< Worker task priority */
+} audio_scheduler_cfg_t;
+
+#define DEFAULT_SCHEDULER_SLICE_US      (2000)
+#define DEFAULT_SCHEDULER_STACK_SIZE    (4*1024)
+#define DEFAULT_SCHEDULER_TASK_PRIO     (5)
+
+#define AUDIO_SCHEDULER_DEFAULT_CFG() {                 \
+    .workers            = 0,                            \
+    .slice_us           = DEFAULT_SCHEDULER_SLICE_US,   \
+    .task_stack         = DEFAULT_SCHEDULER_STACK_SIZE, \
+    .task_prio          = DEFAULT_SCHEDULER_TASK_PRIO,  \
+}
+
+/**
+ * @brief      Create a pool of worker threads that run scheduler tasks
+ *
+ *             Every worker owns a queue of runnable tasks. A worker runs its own queue newest first and steals
+ *             the oldest task of another worker once its own queue is empty. Idle workers sleep.
+ *
+ * @param[in]  config  The configuration - audio_scheduler_cfg_t
+ *
+ * @return     The scheduler handle, NULL on failure
+ */
+audio_scheduler_handle_t audio_scheduler_create(const audio_scheduler_cfg_t *config);
+
+/**
+ * @brief      Stop and join the workers, then free the scheduler
+ *
+ *             Every task should have exited before, queued tasks are not run any more.
+ *
+ * @param[in]  sched   The scheduler handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t audio_scheduler_destroy(audio_scheduler_handle_t sched);
+
+/**
+ * @brief      Create a task, it does not run until audio_scheduler_task_start
+ *
+ *             `step` must not block for long: it does a bounded amount of work and returns. While it returns
+ *             AUDIO_SCHED_READY it is called again, for at most `slice_us` before other tasks get the worker.
+ *
+ * @param[in]  sched   The scheduler handle
+ * @param[in]  step    The step function
+ * @param[in]  ctx     The context passed to `step`
+ *
+ * @return     The task handle, NULL on failure
+ */
+audio_scheduler_task_t audio_scheduler_task_create(audio_scheduler_handle_t sched, audio_scheduler_step_func step,
+                                                   void *ctx);
+
+/**
+ * @brief      Free a task, waits for the worker if it is returning from its last step
+ *
+ * @param[in]  task    The task handle, it must have exited or never been started
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t audio_scheduler_task_destroy(audio_scheduler_task_t task);
+
+/**
+ * @brief      Queue a task that is not running, waits for the worker if it is returning from its last step
+ *
+ * @param[in]  task    The task handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t audio_scheduler_task_start(audio_scheduler_task_t task);
+
+/**
+ * @brief      Make an idle task runnable, safe to call from any thread
+ *
+ *             Waking a task that is queued does nothing, waking a task that is running has its step called once
+ *             more, so a wakeup is never lost. Exited tasks are left alone.
+ *
+ * @param[in]  task    The task handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t audio_scheduler_task_wake(audio_scheduler_task_t task);
+
+/**
+ * @brief      Number of workers of the scheduler
+ *
+ * @param[in]  sched   The scheduler handle
+ *
+ * @return     The number of worker threads
+ */
+int audio_scheduler_get_workers(audio_scheduler_handle_t sched);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _AUDIO_SCHEDULER_H_ */
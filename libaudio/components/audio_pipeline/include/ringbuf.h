@@ -34,6 +34,8 @@
 #include "audio_error.h"
 #include "portmacro.h"
 #include "audio_queue.h"
+#include "audio_buf.h"
+#include "audio_arena.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -44,8 +46,66 @@ extern "C" {
 #define RB_ABORT        (-3)
 #define RB_TIMEOUT      (-4)
 
+#define RB_PACKET_FLAG_FORMAT_CHANGE    (1 << 0)    /*!< Stream format (rate, channels, bits, codec) changes from this packet on */
+#define RB_PACKET_FLAG_DISCONTINUITY    (1 << 1)    /*!< Packet does not follow the previous one, e.g. after a seek */
+#define RB_PACKET_FLAG_USER_SHIFT       (16)        /*!< Bits from here up are free for the elements */
+
 typedef struct ringbuf *ringbuf_handle_t;
 
+/**
+ * @brief      Callback set with `rb_set_reader_notify` or `rb_set_writer_notify`, called from the thread that
+ *             changed the Ringbuffer, it must not block
+ */
+typedef void (*rb_notify_func)(ringbuf_handle_t rb, void *ctx);
+
+/**
+ * @brief      Metadata carried with every record of a packet mode Ringbuffer
+ */
+typedef struct {
+    uint32_t    flags;          /*!< RB_PACKET_FLAG_* */
+    int64_t     timestamp;      /*!< Timestamp of the packet in microseconds, 0 if unknown */
+    uint32_t    len;            /*!< Length of the record, set by `rb_read_packet` even if it does not fit */
+} rb_packet_info_t;
+
+/**
+ * @brief      What the writer of a broadcast Ringbuffer does when a reader falls a whole Ringbuffer behind
+ */
+typedef enum {
+    RB_BROADCAST_BLOCK = 0,         /*!< The writer waits for the slowest reader */
+    RB_BROADCAST_DROP_OLDEST,       /*!< The writer drops the oldest data of the lagging reader and carries on */
+} rb_broadcast_policy_t;
+
+/**
+ * @brief      Ringbuffer counters, see `rb_get_stats`. Bytes, waits and wakeups count up since the Ringbuffer was
+ *             created, `rb_reset` leaves them alone. A wait is one time a side blocked, it ends on a wakeup from
+ *             the other side or on the timeout.
+ */
+typedef struct {
+    uint32_t    size;           /*!< Size of the Ringbuffer in bytes */
+    uint32_t    filled;         /*!< Filled bytes now */
+    uint32_t    fill_min;       /*!< Lowest fill level since created or since `rb_reset_fill_range` */
+    uint32_t    fill_max;       /*!< Highest fill level since created or since `rb_reset_fill_range` */
+    uint64_t    bytes_written;  /*!< Bytes through the writer side */
+    uint64_t    bytes_read;     /*!< Bytes through the reader side */
+    uint64_t    reader_waits;   /*!< Times the reader blocked on an empty Ringbuffer */
+    uint64_t    reader_wakeups; /*!< Reader waits ended by the writer */
+    uint64_t    reader_wait_ns; /*!< Time the reader spent blocked */
+    uint64_t    writer_waits;   /*!< Times the writer blocked on a full Ringbuffer */
+    uint64_t    writer_wakeups; /*!< Writer waits ended by the reader */
+    uint64_t    writer_wait_ns; /*!< Time the writer spent blocked */
+} rb_stats_t;
+
+#define RB_PTS_NONE     (INT64_MIN)     /*!< Media time of a timestamp that only carries an origin */
+
+/**
+ * @brief      Timestamp of a byte stream, see `rb_set_timestamp`
+ */
+typedef struct {
+    int64_t     pts;            /*!< Media time of the stamped byte in microseconds, RB_PTS_NONE if unknown */
+    int64_t     origin_ns;      /*!< CLOCK_MONOTONIC time the source produced the stamped byte, 0 if unknown */
+    int64_t     offset;         /*!< Bytes from the stamped byte to the byte asked about, set by `rb_get_timestamp` */
+} rb_timestamp_t;
+
 /**
  * @brief      Create ringbuffer with total size = block_size * n_blocks
  *
@@ -56,6 +116,166 @@ typedef struct ringbuf *ringbuf_handle_t;
  */
 ringbuf_handle_t rb_create(int block_size, int n_blocks);
 
+/**
+ * @brief      Same as `rb_create`, with the Ringbuffer allocated from `arena`
+ *
+ * @param[in]  arena        The arena to allocate from, NULL for the heap
+ * @param[in]  block_size   Size of each block
+ * @param[in]  n_blocks     Number of blocks
+ *
+ * @return     ringbuf_handle_t
+ */
+ringbuf_handle_t rb_create_in(audio_arena_handle_t arena, int block_size, int n_blocks);
+
+/**
+ * @brief      Create a lock-free single producer / single consumer ringbuffer with total size = block_size * n_blocks
+ *
+ *             The returned handle is used with the same rb_* API and keeps the same RB_DONE/RB_ABORT/RB_TIMEOUT
+ *             semantics, but `rb_read` and `rb_write` take no lock and only issue a futex wakeup when the other
+ *             side is actually blocked. Exactly one thread may call `rb_read` and exactly one thread may call
+ *             `rb_write` at any time; `rb_reset` must only be called while neither side is active.
+ *
+ * @param[in]  block_size   Size of each block
+ * @param[in]  n_blocks     Number of blocks
+ *
+ * @return     ringbuf_handle_t
+ */
+ringbuf_handle_t rb_create_spsc(int block_size, int n_blocks);
+
+/**
+ * @brief      Same as `rb_create_spsc`, with the Ringbuffer allocated from `arena`
+ *
+ * @param[in]  arena        The arena to allocate from, NULL for the heap
+ * @param[in]  block_size   Size of each block
+ * @param[in]  n_blocks     Number of blocks
+ *
+ * @return     ringbuf_handle_t
+ */
+ringbuf_handle_t rb_create_spsc_in(audio_arena_handle_t arena, int block_size, int n_blocks);
+
+/**
+ * @brief      Create a single producer / single consumer ringbuffer whose memory is mapped twice back to back
+ *
+ *             The same pages are mapped at p and p + size, so every span handed out by `rb_peek_read` and
+ *             `rb_acquire_write` is contiguous up to the full Ringbuffer size and frames can be parsed in place
+ *             across the wrap. The total size is rounded up to a multiple of the page size.
+ *             Same threading rules as `rb_create_spsc`.
+ *
+ * @param[in]  block_size   Size of each block
+ * @param[in]  n_blocks     Number of blocks
+ *
+ * @return     ringbuf_handle_t, NULL if the memory could not be mapped
+ */
+ringbuf_handle_t rb_create_mirrored(int block_size, int n_blocks);
+
+/**
+ * @brief      Same as `rb_create_mirrored`, with the Ringbuffer allocated from `arena`, the mapped data
+ *             pages are not part of the arena
+ *
+ * @param[in]  arena        The arena to allocate from, NULL for the heap
+ * @param[in]  block_size   Size of each block
+ * @param[in]  n_blocks     Number of blocks
+ *
+ * @return     ringbuf_handle_t
+ */
+ringbuf_handle_t rb_create_mirrored_in(audio_arena_handle_t arena, int block_size, int n_blocks);
+
+/**
+ * @brief      Create a single producer / single consumer ringbuffer that keeps write boundaries
+ *
+ *             Every `rb_write`/`rb_write_packet` stores one record made of a small header (length, flags,
+ *             timestamp) and the data, and every `rb_read`/`rb_read_packet` returns exactly one whole record.
+ *             Reads are never rounded down to a multiple of 4. `rb_bytes_filled` includes the record headers,
+ *             and the zero-copy span API is not available. Same threading rules as `rb_create_spsc`.
+ *
+ * @param[in]  block_size   Size of each block
+ * @param[in]  n_blocks     Number of blocks
+ *
+ * @return     ringbuf_handle_t
+ */
+ringbuf_handle_t rb_create_packet(int block_size, int n_blocks);
+
+/**
+ * @brief      Same as `rb_create_packet`, with the Ringbuffer allocated from `arena`
+ *
+ * @param[in]  arena        The arena to allocate from, NULL for the heap
+ * @param[in]  block_size   Size of each block
+ * @param[in]  n_blocks     Number of blocks
+ *
+ * @return     ringbuf_handle_t
+ */
+ringbuf_handle_t rb_create_packet_in(audio_arena_handle_t arena, int block_size, int n_blocks);
+
+/**
+ * @brief      Create a ringbuffer with one writer and `n_readers` independent readers sharing one copy of the data
+ *
+ *             The returned handle is the writer side, used with `rb_write` like any other Ringbuffer, for example
+ *             as the output ringbuffer of an element. Each reader gets its own handle from
+ *             `rb_broadcast_get_reader`, to be used with `rb_read` as the input ringbuffer of one consumer.
+ *             Every reader sees every byte; with RB_BROADCAST_BLOCK the writer is throttled by the slowest reader.
+ *             `rb_abort` on a reader handle detaches that reader until it is reset, `rb_reset` on a reader handle
+ *             skips it to the write position, `rb_done_write`/`rb_abort`/`rb_reset` on the writer handle apply to
+ *             all readers. The total size is rounded up to a power of 2. The zero-copy span API is not available.
+ *
+ * @param[in]  block_size   Size of each block
+ * @param[in]  n_blocks     Number of blocks
+ * @param[in]  n_readers    Number of readers
+ * @param[in]  policy       What to do with a reader that lags a whole Ringbuffer behind
+ *
+ * @return     ringbuf_handle_t of the writer side
+ */
+ringbuf_handle_t rb_create_broadcast(int block_size, int n_blocks, int n_readers, rb_broadcast_policy_t policy);
+
+/**
+ * @brief      Create a single producer / single consumer ringbuffer that passes pooled buffers by pointer
+ *
+ *             `rb_write_buf` queues an `audio_buf_t` and `rb_read_buf` hands the same buffer to the reader, so the
+ *             data is never copied. Elements that still use bytes are served by a shim: `rb_write` copies into
+ *             buffers taken from `pool`, `rb_read` copies out of the queued buffers, `rb_peek_read` hands out the
+ *             rest of the current buffer and `rb_acquire_write` a whole free buffer of the pool.
+ *             `rb_bytes_filled` counts the payload bytes queued and `rb_get_size` is `depth` buffers of the pool.
+ *             The Ringbuffer takes a reference on `pool` and sets its notify callback. Same threading rules as
+ *             `rb_create_spsc`.
+ *
+ * @param[in]  pool     The pool the byte shim allocates from
+ * @param[in]  depth    Number of buffers that can be queued, rounded up to a power of 2
+ *
+ * @return     ringbuf_handle_t
+ */
+ringbuf_handle_t rb_create_desc(audio_buf_pool_handle_t pool, int depth);
+
+/**
+ * @brief      Same as `rb_create_desc`, with the Ringbuffer allocated from `arena`, the buffers come from `pool`
+ *
+ * @param[in]  arena    The arena to allocate from, NULL for the heap
+ * @param[in]  pool     The pool the byte shim allocates from
+ * @param[in]  depth    Number of buffers that can be queued, rounded up to a power of 2
+ *
+ * @return     ringbuf_handle_t
+ */
+ringbuf_handle_t rb_create_desc_in(audio_arena_handle_t arena, audio_buf_pool_handle_t pool, int depth);
+
+/**
+ * @brief      Get the handle of one reader of a broadcast Ringbuffer
+ *
+ *             Reader handles belong to the writer handle, `rb_destroy` on a reader handle does nothing.
+ *
+ * @param[in]  rb       The writer handle returned by `rb_create_broadcast`
+ * @param[in]  index    Index of the reader, starts from `0`
+ *
+ * @return     ringbuf_handle_t, NULL if `rb` is not a broadcast Ringbuffer or `index` is out of range
+ */
+ringbuf_handle_t rb_broadcast_get_reader(ringbuf_handle_t rb, int index);
+
+/**
+ * @brief      Get the number of bytes a reader of a broadcast Ringbuffer lost to RB_BROADCAST_DROP_OLDEST
+ *
+ * @param[in]  rb    The reader handle
+ *
+ * @return     Dropped bytes since the last `rb_reset`, ESP_FAIL if `rb` is not a broadcast reader
+ */
+int rb_broadcast_get_dropped(ringbuf_handle_t rb);
+
 /**
  * @brief      Cleanup and free all memory created by ringbuf_handle_t
  *
@@ -143,6 +363,141 @@ int rb_read(ringbuf_handle_t rb, char *buf, int len, TickType_t ticks_to_wait);
  */
 int rb_write(ringbuf_handle_t rb, char *buf, int len, TickType_t ticks_to_wait);
 
+/**
+ * @brief      Read one record from a packet mode Ringbuffer, wait `ticks_to_wait` ticks until a record is available
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param      buf            The buffer to copy the record data to, NULL to drop the record whatever its length
+ * @param[in]  buf_len        The buffer length. A record that does not fit is left in the Ringbuffer and RB_FAIL
+ *                            returned, read it again with a buffer of `info->len` bytes or drop it.
+ * @param[out] info           The record metadata, can be NULL
+ * @param[in]  ticks_to_wait  The ticks to wait
+ *
+ * @return
+ *     - > 0 length of the record
+ *     - RB_DONE, RB_ABORT, RB_TIMEOUT or RB_FAIL
+ */
+int rb_read_packet(ringbuf_handle_t rb, char *buf, int buf_len, rb_packet_info_t *info, TickType_t ticks_to_wait);
+
+/**
+ * @brief      Write `buf` as one record to a packet mode Ringbuffer, wait `ticks_to_wait` ticks until the whole
+ *             record fits
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param      buf            The record data
+ * @param[in]  len            The record length
+ * @param[in]  info           The record metadata, NULL for none
+ * @param[in]  ticks_to_wait  The ticks to wait
+ *
+ * @return
+ *     - > 0 length of the record
+ *     - RB_DONE, RB_ABORT, RB_TIMEOUT or RB_FAIL
+ */
+int rb_write_packet(ringbuf_handle_t rb, const char *buf, int len, const rb_packet_info_t *info, TickType_t ticks_to_wait);
+
+/**
+ * @brief      Take a free buffer from the pool of a descriptor Ringbuffer, wait `ticks_to_wait` ticks until one is
+ *             released. Unlike `audio_buf_alloc`, the wait ends when the Ringbuffer is aborted or done.
+ *             The buffer is filled in place and queued with `rb_write_buf`, or dropped with `audio_buf_unref`.
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param[out] buf            Set to the buffer
+ * @param[in]  ticks_to_wait  The ticks to wait
+ *
+ * @return
+ *     - > 0 size of the buffer
+ *     - RB_DONE, RB_ABORT, RB_TIMEOUT or RB_FAIL
+ */
+int rb_alloc_buf(ringbuf_handle_t rb, audio_buf_t **buf, TickType_t ticks_to_wait);
+
+/**
+ * @brief      Queue a buffer on a descriptor Ringbuffer, wait `ticks_to_wait` ticks until there is room for it.
+ *             The reference held by the caller is handed over to the Ringbuffer on success only.
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param[in]  buf            The buffer, with a payload of at least one byte
+ * @param[in]  ticks_to_wait  The ticks to wait
+ *
+ * @return
+ *     - > 0 length of the payload
+ *     - RB_DONE, RB_ABORT, RB_TIMEOUT or RB_FAIL
+ */
+int rb_write_buf(ringbuf_handle_t rb, audio_buf_t *buf, TickType_t ticks_to_wait);
+
+/**
+ * @brief      Take the next buffer from a descriptor Ringbuffer, wait `ticks_to_wait` ticks until one is queued.
+ *             The caller gets the reference and drops it with `audio_buf_unref`.
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param[out] buf            Set to the buffer
+ * @param[in]  ticks_to_wait  The ticks to wait
+ *
+ * @return
+ *     - > 0 length of the payload
+ *     - RB_DONE, RB_ABORT, RB_TIMEOUT or RB_FAIL
+ */
+int rb_read_buf(ringbuf_handle_t rb, audio_buf_t **buf, TickType_t ticks_to_wait);
+
+/**
+ * @brief      Get a pointer to the data at the read position without copying it out of the Ringbuffer.
+ *             Waits `ticks_to_wait` ticks until `len` bytes (at most the Ringbuffer size) are filled, and hands out
+ *             whatever is filled if the wait ends by timeout, abort or done. The returned span is contiguous, so
+ *             it may be shorter than the bytes filled when the data wraps around the end of the Ringbuffer,
+ *             unless the Ringbuffer is mirrored. The data stays in the Ringbuffer until released by `rb_consume`.
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param[out] buf            Set to the start of the readable span
+ * @param[in]  len            The maximum length wanted
+ * @param[in]  ticks_to_wait  The ticks to wait
+ *
+ * @return
+ *     - > 0 number of contiguous bytes readable at `*buf`
+ *     - RB_DONE, RB_ABORT, RB_TIMEOUT or RB_FAIL
+ */
+int rb_peek_read(ringbuf_handle_t rb, char **buf, int len, TickType_t ticks_to_wait);
+
+/**
+ * @brief      Release `len` bytes previously returned by `rb_peek_read` to the writer
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ * @param[in]  len   Number of bytes consumed, no more than the last peeked span
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t rb_consume(ringbuf_handle_t rb, int len);
+
+/**
+ * @brief      Get a pointer to free space at the write position so the data can be produced in place.
+ *             Waits `ticks_to_wait` ticks until `len` bytes (at most the Ringbuffer size) are free, and hands out
+ *             whatever is free if the wait ends by timeout or abort. The returned span is contiguous, so it may be
+ *             shorter than the space available when it wraps around the end of the Ringbuffer, unless the
+ *             Ringbuffer is mirrored. Nothing is visible to the reader until `rb_commit_write` is called.
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param[out] buf            Set to the start of the writable span
+ * @param[in]  len            The maximum length wanted
+ * @param[in]  ticks_to_wait  The ticks to wait
+ *
+ * @return
+ *     - > 0 number of contiguous bytes writable at `*buf`
+ *     - RB_DONE, RB_ABORT, RB_TIMEOUT or RB_FAIL
+ */
+int rb_acquire_write(ringbuf_handle_t rb, char **buf, int len, TickType_t ticks_to_wait);
+
+/**
+ * @brief      Publish `len` bytes written into the span returned by `rb_acquire_write`
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ * @param[in]  len   Number of bytes produced, no more than the last acquired span
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ */
+esp_err_t rb_commit_write(ringbuf_handle_t rb, int len);
+
 /**
  * @brief      Set status of writing to ringbuffer is done
  *
@@ -165,6 +520,191 @@ esp_err_t rb_done_write(ringbuf_handle_t rb);
  */
 esp_err_t rb_unblock_reader(ringbuf_handle_t rb);
 
+/**
+ * @brief      Set the watermarks that batch the wakeups between the reader and the writer
+ *
+ *             A blocked reader is only woken up, and only reads, once the filled bytes reach the size it still
+ *             wants or `high_watermark`, whichever is smaller, or the writer is done or aborted. A blocked writer
+ *             is only woken up, and only writes, once the free space reaches the size it still has to write or
+ *             `low_watermark`, whichever is smaller. 0 keeps the default of waking up for any progress.
+ *             Both can not add up to more than the Ringbuffer size, otherwise both sides could wait for each
+ *             other. Packet mode Ringbuffers always wait for whole records. Set before the Ringbuffer is used.
+ *
+ * @param[in]  rb               The Ringbuffer handle
+ * @param[in]  low_watermark    Free space a blocked writer waits for
+ * @param[in]  high_watermark   Filled bytes a blocked reader waits for
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t rb_set_watermark(ringbuf_handle_t rb, int low_watermark, int high_watermark);
+
+/**
+ * @brief      Check whether the writer has called `rb_done_write`
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ *
+ * @return     true if writing is done
+ */
+bool rb_is_done_write(ringbuf_handle_t rb);
+
+/**
+ * @brief      Check whether the Ringbuffer was created by `rb_create_mirrored`
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ *
+ * @return     true if every span of the Ringbuffer is contiguous
+ */
+bool rb_is_mirrored(ringbuf_handle_t rb);
+
+/**
+ * @brief      Check whether the Ringbuffer was created by `rb_create_packet`
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ *
+ * @return     true if the Ringbuffer keeps write boundaries
+ */
+bool rb_is_packet(ringbuf_handle_t rb);
+
+/**
+ * @brief      Check whether the Ringbuffer was created by `rb_create_desc`
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ *
+ * @return     true if the Ringbuffer passes buffers by pointer
+ */
+bool rb_is_desc(ringbuf_handle_t rb);
+
+/**
+ * @brief      Get the pool the byte shim of a descriptor Ringbuffer allocates from
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ *
+ * @return     The pool, NULL if `rb` is not a descriptor Ringbuffer
+ */
+audio_buf_pool_handle_t rb_desc_get_pool(ringbuf_handle_t rb);
+
+/**
+ * @brief      Set a callback for the reader side, for readers that do not block in `rb_read`
+ *
+ *             It is called after every write or commit, `rb_done_write`, `rb_abort` and `rb_unblock_reader`.
+ *             It is called often, check `rb_read_ready` before doing anything costly.
+ *             For broadcast Ringbuffers, set it on each reader handle.
+ *
+ * @param[in]  rb      The Ringbuffer handle
+ * @param[in]  notify  The callback, NULL to remove it
+ * @param[in]  ctx     The context passed to the callback
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t rb_set_reader_notify(ringbuf_handle_t rb, rb_notify_func notify, void *ctx);
+
+/**
+ * @brief      Set a callback for the writer side, for writers that do not block in `rb_write`
+ *
+ *             It is called after every read or consume, `rb_done_write`, `rb_abort` and `rb_reset`.
+ *             For broadcast Ringbuffers, set it on the writer handle, reads on every reader handle call it.
+ *
+ * @param[in]  rb      The Ringbuffer handle
+ * @param[in]  notify  The callback, NULL to remove it
+ * @param[in]  ctx     The context passed to the callback
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t rb_set_writer_notify(ringbuf_handle_t rb, rb_notify_func notify, void *ctx);
+
+/**
+ * @brief      Check whether a read of `len` bytes would return without waiting
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ * @param[in]  len   The read size, capped at the Ringbuffer size. Packet mode Ringbuffers only need a record,
+ *                   descriptor Ringbuffers a buffer.
+ *
+ * @return     true if the data is there, or the Ringbuffer is done, aborted or the reader unblocked
+ */
+bool rb_read_ready(ringbuf_handle_t rb, int len);
+
+/**
+ * @brief      Check whether a write of `len` bytes would return without waiting
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ * @param[in]  len   The write size, capped at the Ringbuffer size. Packet mode Ringbuffers also need room for
+ *                   the record header. Descriptor Ringbuffers need a free slot and a free buffer in the pool.
+ *
+ * @return     true if the space is there, or the Ringbuffer is done or aborted
+ */
+bool rb_write_ready(ringbuf_handle_t rb, int len);
+
+/**
+ * @brief      Get the fill level and the traffic counters of the Ringbuffer
+ *
+ *             The fill range tells how close the Ringbuffer came to running dry (`fill_min`) or full (`fill_max`),
+ *             which is what sizing it is about. Reset the range after each sample to watch it as a trend.
+ *             For broadcast Ringbuffers, the writer handle counts the writer side and each reader handle its own
+ *             reader side. The counters are on unless CONFIG_RINGBUF_STATS is 0.
+ *
+ * @param[in]  rb       The Ringbuffer handle
+ * @param[out] stats    The counters
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_ERR_NOT_SUPPORTED when the counters are compiled out
+ */
+esp_err_t rb_get_stats(ringbuf_handle_t rb, rb_stats_t *stats);
+
+/**
+ * @brief      Restart the fill range of `rb_get_stats` from the current fill level
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_ERR_NOT_SUPPORTED when the counters are compiled out
+ */
+esp_err_t rb_reset_fill_range(ringbuf_handle_t rb);
+
+/**
+ * @brief      Stamp the next byte written with a media time and the time the source produced it
+ *
+ *             The stamp holds for every byte up to the next stamp, a reader asks for it with `rb_get_timestamp`.
+ *             Sources stamp each chunk before writing it, and elements that change the timing, like decoders,
+ *             stamp their output again. Only the most recent stamps are kept for a reader that falls behind,
+ *             so a lagging reader gets the stamp of an earlier byte with a larger offset. Only the writer may call
+ *             it. Packet mode records also carry a timestamp of their own, see `rb_packet_info_t`.
+ *
+ * @param[in]  rb           The Ringbuffer handle, the writer handle of a broadcast Ringbuffer
+ * @param[in]  pts          Media time in microseconds, RB_PTS_NONE to only pass the origin on
+ * @param[in]  origin_ns    CLOCK_MONOTONIC time the source produced the byte, 0 if unknown
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t rb_set_timestamp(ringbuf_handle_t rb, int64_t pts, int64_t origin_ns);
+
+/**
+ * @brief      Get the stamp of the first byte returned by the last read, peek or consume of this reader
+ *
+ *             `offset` is the distance from the stamped byte, so a PCM reader can work out the media time of the
+ *             first byte as `pts` plus the duration of `offset` bytes. Only the reader may call it.
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ * @param[out] ts    The stamp
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_ERR_NOT_FOUND, the writer did not stamp the stream up to that byte
+ */
+esp_err_t rb_get_timestamp(ringbuf_handle_t rb, rb_timestamp_t *ts);
+
 
 #ifdef __cplusplus
 }
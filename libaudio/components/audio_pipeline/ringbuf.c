@@ -22,34 +22,159 @@
  *
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "ringbuf.h"
 #include "audio_mutex.h"
+#include "audio_futex.h"
+#include "audio_sem.h"
+#include "audio_time.h"
+#include "audio_trace.h"
+#include "audio_usdt.h"
+#include "audio_arena.h"
 
 
 static const char *TAG = "RINGBUF";
 
+#define RB_CACHE_LINE_SIZE  (64)
+
+#ifndef CONFIG_RINGBUF_STATS
+#define CONFIG_RINGBUF_STATS    1   /* 0 compiles the counters of rb_get_stats out */
+#endif
+
+#define RB_TIMESTAMP_MARKS  (16)    /* Stamps kept for a lagging reader, see rb_set_timestamp */
+
+/* A stamp of rb_set_timestamp. The writer reuses the slot while readers look, so it is read like a seqlock. */
+typedef struct {
+    atomic_uint seq;            /**< Odd while the writer updates the slot */
+    atomic_ullong pos;          /**< Stream position of the stamped byte */
+    atomic_llong pts;
+    atomic_llong origin_ns;
+} rb_ts_mark_t;
+
 struct ringbuf {
     char *p_o;                   /**< Original pointer */
     char *volatile p_r;          /**< Read pointer */
     char *volatile p_w;          /**< Write pointer */
-    volatile uint32_t fill_cnt;  /**< Number of filled slots */
+    atomic_uint fill_cnt;        /**< Number of filled slots, changed with `lock` held, read without it too */
     uint32_t size;               /**< Buffer size */
-    sem_t *can_read;
-    sem_t *can_write;
+    audio_sem_handle_t can_read;
+    audio_sem_handle_t can_write;
     pthread_mutex_t *lock;
-    bool abort_read;
-    bool abort_write;
-    bool is_done_write;         /**< To signal that we are done writing */
-    bool unblock_reader_flag;   /**< To unblock instantly from rb_read */
+    atomic_bool abort_read;
+    atomic_bool abort_write;
+    atomic_bool is_done_write;         /**< To signal that we are done writing */
+    atomic_bool unblock_reader_flag;   /**< To unblock instantly from rb_read */
+    bool spsc;                  /**< Lock-free single producer / single consumer mode */
+    bool mirrored;              /**< Buffer is mapped twice back to back, see rb_create_mirrored */
+    bool packet;                /**< Every write is kept as one record, see rb_create_packet */
+    bool drop_oldest;           /**< Broadcast writer drops lagging readers, see rb_create_broadcast */
+    bool desc;                  /**< Buffers are passed by pointer, see rb_create_desc */
+    audio_buf_pool_handle_t desc_pool;  /**< Pool the byte shim of a descriptor ring allocates from */
+    audio_buf_pool_waiter_t desc_waiter;  /**< Wakes the byte shim writer when a buffer goes back to `desc_pool` */
+    audio_buf_t **desc_slots;   /**< Queued buffers, indexed by rd_idx / wr_idx & desc_mask */
+    uint32_t desc_mask;
+    audio_buf_t *desc_rd_cur;   /**< Buffer the byte shim reader is part way through */
+    int desc_rd_off;            /**< Bytes of desc_rd_cur already read */
+    audio_buf_t *desc_wr_cur;   /**< Buffer handed out by rb_acquire_write, not committed yet */
+    atomic_int desc_bytes;      /**< Payload bytes queued, including the unread part of desc_rd_cur */
+    struct ringbuf *bcast_owner;     /**< Writer handle of a broadcast reader handle */
+    struct ringbuf **bcast_readers;  /**< Reader handles of a broadcast writer handle */
+    int bcast_readers_num;
+    uint32_t low_watermark;     /**< Free space a blocked writer waits for, 0 = any, see rb_set_watermark */
+    uint32_t high_watermark;    /**< Filled bytes a blocked reader waits for, 0 = any, see rb_set_watermark */
+    _Atomic(rb_notify_func) rd_notify;  /**< Reader side callback, see rb_set_reader_notify */
+    void *rd_notify_ctx;
+    _Atomic(rb_notify_func) wr_notify;  /**< Writer side callback, see rb_set_writer_notify */
+    void *wr_notify_ctx;
+    /*
+     * SPSC state. Indices run over [0, 2 * size) so that a full ring can be told apart from an empty one.
+     * The reader and writer sides are kept at least a cache line apart to avoid false sharing.
+     */
+    char pad0[RB_CACHE_LINE_SIZE];
+    atomic_uint rd_idx;         /**< Read index, owned by the consumer */
+    atomic_uint rd_parked;      /**< Consumer is sleeping on rd_seq */
+    atomic_uint rd_seq;         /**< Futex word the consumer sleeps on */
+    atomic_uint rd_need;        /**< Filled bytes the blocked consumer waits for, 0 = not blocked on a locked ring */
+    atomic_uint dropped;        /**< Bytes a broadcast reader lost to RB_BROADCAST_DROP_OLDEST */
+    atomic_uint fill_min;       /**< Lowest fill level left by a read, see rb_get_stats */
+    atomic_ullong rd_bytes;     /**< Reader side counters of rb_get_stats */
+    atomic_ullong rd_waits;
+    atomic_ullong rd_wakeups;
+    atomic_ullong rd_wait_ns;
+    uint64_t rd_pos;            /**< Stream position of the reader, payload bytes written since the last reset */
+    uint64_t rd_last;           /**< Stream position of the first byte of the last read, see rb_get_timestamp */
+    uint64_t rd_mark_pos;       /**< Last stamp found by the reader, kept for when it falls behind the marks */
+    rb_timestamp_t rd_mark;
+    bool rd_mark_valid;
+    char pad1[RB_CACHE_LINE_SIZE];
+    atomic_uint wr_idx;         /**< Write index, owned by the producer */
+    atomic_uint wr_parked;      /**< Producer is sleeping on wr_seq */
+    atomic_uint wr_seq;         /**< Futex word the producer sleeps on */
+    atomic_uint wr_need;        /**< Free space the blocked producer waits for, 0 = not blocked on a locked ring */
+    atomic_uint fill_max;       /**< Highest fill level left by a write, see rb_get_stats */
+    atomic_ullong wr_bytes;     /**< Writer side counters of rb_get_stats */
+    atomic_ullong wr_waits;
+    atomic_ullong wr_wakeups;
+    atomic_ullong wr_wait_ns;
+    atomic_ullong wr_pos;       /**< Stream position of the writer */
+    atomic_uint ts_head;        /**< Stamps set so far, the newest is ts_marks[(ts_head - 1) % RB_TIMESTAMP_MARKS] */
+    rb_ts_mark_t ts_marks[RB_TIMESTAMP_MARKS];
+    char pad2[RB_CACHE_LINE_SIZE];
 };
 
+/* Record header in front of every packet of a packet mode ring */
+typedef struct {
+    uint32_t len;
+    uint32_t flags;
+    int64_t timestamp;
+} rb_packet_hdr_t;
+
+typedef uint32_t (*rb_probe_t)(ringbuf_handle_t rb);
+
 static esp_err_t rb_abort_read(ringbuf_handle_t rb);
 static esp_err_t rb_abort_write(ringbuf_handle_t rb);
+static void rb_desc_drain(ringbuf_handle_t rb);
 
-ringbuf_handle_t rb_create(int block_size, int n_blocks)
+static inline bool rb_is_broadcast(ringbuf_handle_t rb)
+{
+    return rb->bcast_owner || rb->bcast_readers;
+}
+
+/* The reader may make progress: data arrived, or the ring is done, aborted or unblocked */
+static void rb_notify_reader(ringbuf_handle_t rb)
+{
+    if (rb->bcast_readers) {
+        for (int i = 0; i < rb->bcast_readers_num; i++) {
+            rb_notify_reader(rb->bcast_readers[i]);
+        }
+        return;
+    }
+    rb_notify_func notify = atomic_load_explicit(&rb->rd_notify, memory_order_acquire);
+    if (notify) {
+        notify(rb, rb->rd_notify_ctx);
+    }
+}
+
+/* The writer may make progress: space was freed, or the ring is done or aborted */
+static void rb_notify_writer(ringbuf_handle_t rb)
+{
+    if (rb->bcast_owner) {
+        rb = rb->bcast_owner;
+    }
+    rb_notify_func notify = atomic_load_explicit(&rb->wr_notify, memory_order_acquire);
+    if (notify) {
+        notify(rb, rb->wr_notify_ctx);
+    }
+}
+
+ringbuf_handle_t rb_create_in(audio_arena_handle_t arena, int block_size, int n_blocks)
 {
     if (block_size < 2) {
         ESP_LOGE(TAG, "Invalid size");
@@ -59,22 +184,21 @@ ringbuf_handle_t rb_create(int block_size, int n_blocks)
     ringbuf_handle_t rb;
     char *buf = NULL;
 
-    rb = audio_malloc(sizeof(struct ringbuf));
-    rb->can_read = audio_malloc(sizeof(sem_t));
-    rb->can_write = audio_malloc(sizeof(sem_t));
+    rb = audio_arena_calloc(arena, 1, sizeof(struct ringbuf));
+    AUDIO_MEM_CHECK(TAG, rb, return NULL);
 
+    /* Binary: a post only says the level changed, the peer re-checks it under the lock */
     bool _success =
-        (   (rb && rb->can_read && rb->can_write)                       &&
-            (buf            = audio_calloc(n_blocks, block_size))      &&
-            (sem_init(rb->can_read, 0, 0) == 0)                             &&
+        (   (buf            = audio_arena_calloc(arena, n_blocks, block_size)) &&
+            (rb->can_read   = audio_sem_create(0, 1))                   &&
             (rb->lock = mutex_create())                                               &&
-            (sem_init(rb->can_write, 0, 0) == 0)
+            (rb->can_write  = audio_sem_create(0, 1))
         );
 
     AUDIO_MEM_CHECK(TAG, _success, goto _rb_init_failed);
 
     rb->p_o = rb->p_r = rb->p_w = buf;
-    rb->fill_cnt = 0;
+    atomic_init(&rb->fill_cnt, 0);
     rb->size = block_size * n_blocks;
     rb->is_done_write = false;
     rb->unblock_reader_flag = false;
@@ -86,23 +210,242 @@ _rb_init_failed:
     return NULL;
 }
 
+ringbuf_handle_t rb_create(int block_size, int n_blocks)
+{
+    return rb_create_in(NULL, block_size, n_blocks);
+}
+
+/*
+ * Map one memfd twice back to back, so that p_o[i] and p_o[i + size] are the same byte.
+ */
+static char *rb_mirror_map(uint32_t size)
+{
+    char *addr = NULL;
+    int fd = memfd_create("ringbuf", MFD_CLOEXEC);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "memfd_create failed, errno:%d", errno);
+        return NULL;
+    }
+    if (ftruncate(fd, size) != 0) {
+        goto _mirror_failed;
+    }
+    /* Reserve 2 * size of address space first, then overlay both halves with the same pages */
+    addr = mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        addr = NULL;
+        goto _mirror_failed;
+    }
+    if (mmap(addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+        || mmap(addr + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(addr, 2 * size);
+        addr = NULL;
+        goto _mirror_failed;
+    }
+    close(fd);
+    return addr;
+_mirror_failed:
+    ESP_LOGE(TAG, "Mirror mapping of %u bytes failed, errno:%d", size, errno);
+    close(fd);
+    return NULL;
+}
+
+static ringbuf_handle_t rb_create_lockfree(audio_arena_handle_t arena, int block_size, int n_blocks, bool mirrored)
+{
+    if (block_size < 2) {
+        ESP_LOGE(TAG, "Invalid size");
+        return NULL;
+    }
+
+    ringbuf_handle_t rb = audio_arena_calloc(arena, 1, sizeof(struct ringbuf));
+    AUDIO_MEM_CHECK(TAG, rb, return NULL);
+    rb->size = block_size * n_blocks;
+    if (mirrored) {
+        /* Both views must start on a page boundary, round the size up to whole pages */
+        uint32_t page_size = sysconf(_SC_PAGESIZE);
+        rb->size = (rb->size + page_size - 1) / page_size * page_size;
+        rb->p_o = rb_mirror_map(rb->size);
+        rb->mirrored = (rb->p_o != NULL);
+    } else {
+        rb->p_o = audio_arena_calloc(arena, n_blocks, block_size);
+    }
+    AUDIO_MEM_CHECK(TAG, rb->p_o, goto _rb_init_failed);
+
+    rb->p_r = rb->p_w = rb->p_o;
+    rb->spsc = true;
+    atomic_init(&rb->rd_idx, 0);
+    atomic_init(&rb->wr_idx, 0);
+    atomic_init(&rb->rd_parked, 0);
+    atomic_init(&rb->wr_parked, 0);
+    atomic_init(&rb->rd_seq, 0);
+    atomic_init(&rb->wr_seq, 0);
+    return rb;
+_rb_init_failed:
+    rb_destroy(rb);
+    return NULL;
+}
+
+ringbuf_handle_t rb_create_spsc(int block_size, int n_blocks)
+{
+    return rb_create_lockfree(NULL, block_size, n_blocks, false);
+}
+
+ringbuf_handle_t rb_create_spsc_in(audio_arena_handle_t arena, int block_size, int n_blocks)
+{
+    return rb_create_lockfree(arena, block_size, n_blocks, false);
+}
+
+ringbuf_handle_t rb_create_mirrored(int block_size, int n_blocks)
+{
+    return rb_create_lockfree(NULL, block_size, n_blocks, true);
+}
+
+ringbuf_handle_t rb_create_mirrored_in(audio_arena_handle_t arena, int block_size, int n_blocks)
+{
+    return rb_create_lockfree(arena, block_size, n_blocks, true);
+}
+
+ringbuf_handle_t rb_create_packet_in(audio_arena_handle_t arena, int block_size, int n_blocks)
+{
+    ringbuf_handle_t rb = rb_create_lockfree(arena, block_size, n_blocks, false);
+    if (rb) {
+        rb->packet = true;
+    }
+    return rb;
+}
+
+ringbuf_handle_t rb_create_packet(int block_size, int n_blocks)
+{
+    return rb_create_packet_in(NULL, block_size, n_blocks);
+}
+
+ringbuf_handle_t rb_create_broadcast(int block_size, int n_blocks, int n_readers, rb_broadcast_policy_t policy)
+{
+    if (block_size < 2 || n_blocks < 1 || n_readers < 1) {
+        ESP_LOGE(TAG, "Invalid size");
+        return NULL;
+    }
+
+    ringbuf_handle_t rb = audio_arena_calloc(NULL, 1, sizeof(struct ringbuf));
+    AUDIO_MEM_CHECK(TAG, rb, return NULL);
+    /* Cursors are free running 32 bit counters, a power of 2 size keeps the offset a mask across their wrap */
+    rb->size = 1;
+    while (rb->size < block_size * n_blocks) {
+        rb->size <<= 1;
+    }
+    rb->p_o = audio_arena_calloc(NULL, 1, rb->size);
+    AUDIO_MEM_CHECK(TAG, rb->p_o, goto _rb_init_failed);
+    rb->p_r = rb->p_w = rb->p_o;
+    rb->drop_oldest = (policy == RB_BROADCAST_DROP_OLDEST);
+    rb->bcast_readers = audio_arena_calloc(NULL, n_readers, sizeof(ringbuf_handle_t));
+    AUDIO_MEM_CHECK(TAG, rb->bcast_readers, goto _rb_init_failed);
+    rb->bcast_readers_num = n_readers;
+    /* One allocation per reader keeps the cursors of different readers on different cache lines */
+    for (int i = 0; i < n_readers; i++) {
+        ringbuf_handle_t reader = audio_arena_calloc(NULL, 1, sizeof(struct ringbuf));
+        AUDIO_MEM_CHECK(TAG, reader, goto _rb_init_failed);
+        reader->bcast_owner = rb;
+        reader->p_o = reader->p_r = reader->p_w = rb->p_o;
+        reader->size = rb->size;
+        rb->bcast_readers[i] = reader;
+    }
+    return rb;
+_rb_init_failed:
+    rb_destroy(rb);
+    return NULL;
+}
+
+static void rb_desc_pool_notify(audio_buf_pool_handle_t pool, void *ctx);
+
+ringbuf_handle_t rb_create_desc_in(audio_arena_handle_t arena, audio_buf_pool_handle_t pool, int depth)
+{
+    if (pool == NULL || depth < 1) {
+        ESP_LOGE(TAG, "Invalid size");
+        return NULL;
+    }
+
+    ringbuf_handle_t rb = audio_arena_calloc(arena, 1, sizeof(struct ringbuf));
+    AUDIO_MEM_CHECK(TAG, rb, return NULL);
+    /* Indices count buffers and run free, a power of 2 depth keeps the slot a mask across their wrap */
+    uint32_t slots = 1;
+    while (slots < depth) {
+        slots <<= 1;
+    }
+    rb->desc_slots = audio_arena_calloc(arena, slots, sizeof(audio_buf_t *));
+    AUDIO_MEM_CHECK(TAG, rb->desc_slots, goto _rb_init_failed);
+    rb->desc_mask = slots - 1;
+    rb->size = slots * audio_buf_pool_get_buf_size(pool);
+    /* Shares the SPSC wakeup machinery: rd_seq / wr_seq, done, abort and unblock */
+    rb->spsc = true;
+    rb->desc = true;
+    rb->desc_pool = audio_buf_pool_ref(pool);
+    rb->desc_waiter.notify = rb_desc_pool_notify;
+    rb->desc_waiter.ctx = rb;
+    audio_buf_pool_add_waiter(pool, &rb->desc_waiter);
+    return rb;
+_rb_init_failed:
+    rb_destroy(rb);
+    return NULL;
+}
+
+ringbuf_handle_t rb_create_desc(audio_buf_pool_handle_t pool, int depth)
+{
+    return rb_create_desc_in(NULL, pool, depth);
+}
+
+ringbuf_handle_t rb_broadcast_get_reader(ringbuf_handle_t rb, int index)
+{
+    if (rb == NULL || rb->bcast_readers == NULL || index < 0 || index >= rb->bcast_readers_num) {
+        ESP_LOGE(TAG, "Invalid broadcast reader %d", index);
+        return NULL;
+    }
+    return rb->bcast_readers[index];
+}
+
+int rb_broadcast_get_dropped(ringbuf_handle_t rb)
+{
+    if (rb == NULL || rb->bcast_owner == NULL) {
+        return ESP_FAIL;
+    }
+    return atomic_load_explicit(&rb->dropped, memory_order_relaxed);
+}
+
 esp_err_t rb_destroy(ringbuf_handle_t rb)
 {
     if (rb == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
-    if (rb->p_o) {
-        audio_free(rb->p_o);
+    if (rb->bcast_owner) {
+        /* Freed together with the writer handle */
+        return ESP_OK;
+    }
+    if (rb->bcast_readers) {
+        for (int i = 0; i < rb->bcast_readers_num; i++) {
+            audio_arena_free(rb->bcast_readers[i]);
+        }
+        audio_arena_free(rb->bcast_readers);
+        rb->bcast_readers = NULL;
+    }
+    if (rb->desc) {
+        audio_buf_pool_remove_waiter(rb->desc_pool, &rb->desc_waiter);
+        rb_desc_drain(rb);
+        audio_buf_pool_destroy(rb->desc_pool);
+        rb->desc_pool = NULL;
+    }
+    audio_arena_free(rb->desc_slots);
+    rb->desc_slots = NULL;
+    if (rb->p_o && rb->mirrored) {
+        munmap(rb->p_o, 2 * rb->size);
+        rb->p_o = NULL;
+    } else if (rb->p_o) {
+        audio_arena_free(rb->p_o);
         rb->p_o = NULL;
     }
     if (rb->can_read) {
-        sem_destroy(rb->can_read);
-        audio_free(rb->can_read);
+        audio_sem_destroy(rb->can_read);
         rb->can_read = NULL;
     }
     if (rb->can_write) {
-        sem_destroy(rb->can_write);
-        audio_free(rb->can_write);
+        audio_sem_destroy(rb->can_write);
         rb->can_write = NULL;
     }
     if (rb->lock) {
@@ -110,70 +453,1095 @@ esp_err_t rb_destroy(ringbuf_handle_t rb)
         rb->lock = NULL;
     }
 
-    audio_free(rb);
+    audio_arena_free(rb);
     rb = NULL;
     return ESP_OK;
 }
 
-esp_err_t rb_reset(ringbuf_handle_t rb)
+esp_err_t rb_reset(ringbuf_handle_t rb)
+{
+    if (rb == NULL) {
+        return ESP_FAIL;
+    }
+    rb->p_r = rb->p_w = rb->p_o;
+    atomic_store_explicit(&rb->fill_cnt, 0, memory_order_relaxed);
+    if (rb->desc) {
+        rb_desc_drain(rb);
+    }
+    if (rb->spsc) {
+        atomic_store(&rb->rd_idx, 0);
+        atomic_store(&rb->wr_idx, 0);
+    }
+    if (rb->bcast_readers) {
+        atomic_store(&rb->wr_idx, 0);
+        for (int i = 0; i < rb->bcast_readers_num; i++) {
+            rb_reset(rb->bcast_readers[i]);
+        }
+    }
+    if (rb->bcast_owner) {
+        atomic_store(&rb->rd_idx, atomic_load(&rb->bcast_owner->wr_idx));
+        atomic_store(&rb->dropped, 0);
+    }
+    rb->rd_pos = rb->rd_last = 0;
+    rb->rd_mark_valid = false;
+    atomic_store(&rb->wr_pos, 0);
+    atomic_store(&rb->ts_head, 0);
+    atomic_store(&rb->rd_need, 0);
+    atomic_store(&rb->wr_need, 0);
+    rb->is_done_write = false;
+
+    rb->unblock_reader_flag = false;
+    rb->abort_read = false;
+    rb->abort_write = false;
+    rb_notify_writer(rb);
+    return ESP_OK;
+}
+
+static inline uint32_t rb_spsc_filled(ringbuf_handle_t rb, uint32_t rd, uint32_t wr)
+{
+    return wr >= rd ? wr - rd : 2 * rb->size - rd + wr;
+}
+
+static inline uint32_t rb_spsc_advance(ringbuf_handle_t rb, uint32_t idx, uint32_t len)
+{
+    idx += len;
+    return idx >= 2 * rb->size ? idx - 2 * rb->size : idx;
+}
+
+static inline char *rb_spsc_ptr(ringbuf_handle_t rb, uint32_t idx)
+{
+    return rb->p_o + (idx >= rb->size ? idx - rb->size : idx);
+}
+
+static void rb_spsc_copy_out(ringbuf_handle_t rb, uint32_t idx, char *dst, int len)
+{
+    char *src = rb_spsc_ptr(rb, idx);
+    if (!rb->mirrored && (src + len) > (rb->p_o + rb->size)) {
+        int len1 = rb->p_o + rb->size - src;
+        memcpy(dst, src, len1);
+        memcpy(dst + len1, rb->p_o, len - len1);
+    } else {
+        memcpy(dst, src, len);
+    }
+}
+
+static void rb_spsc_copy_in(ringbuf_handle_t rb, uint32_t idx, const char *src, int len)
+{
+    char *dst = rb_spsc_ptr(rb, idx);
+    if (!rb->mirrored && (dst + len) > (rb->p_o + rb->size)) {
+        int len1 = rb->p_o + rb->size - dst;
+        memcpy(dst, src, len1);
+        memcpy(rb->p_o, src + len1, len - len1);
+    } else {
+        memcpy(dst, src, len);
+    }
+}
+
+/*
+ * Fill level seen by the slowest attached reader of a broadcast writer handle, this is what throttles the writer.
+ */
+static uint32_t rb_bcast_filled(ringbuf_handle_t rb, uint32_t wr)
+{
+    uint32_t filled = 0;
+    for (int i = 0; i < rb->bcast_readers_num; i++) {
+        ringbuf_handle_t reader = rb->bcast_readers[i];
+        if (reader->abort_read) {
+            /* An aborted reader no longer holds the writer back */
+            continue;
+        }
+        uint32_t fill = wr - atomic_load_explicit(&reader->rd_idx, memory_order_acquire);
+        if (fill > filled) {
+            filled = fill;
+        }
+    }
+    return filled;
+}
+
+/* With rb->lock held, the only writer. A plain load and store, no locked read-modify-write */
+static inline void rb_fill_cnt_add(ringbuf_handle_t rb, int len)
+{
+    atomic_store_explicit(&rb->fill_cnt, atomic_load_explicit(&rb->fill_cnt, memory_order_relaxed) + len,
+                          memory_order_relaxed);
+}
+
+static uint32_t rb_fill_cnt(ringbuf_handle_t rb)
+{
+    if (rb->desc) {
+        return atomic_load_explicit(&rb->desc_bytes, memory_order_relaxed);
+    }
+    if (rb->bcast_owner) {
+        return atomic_load_explicit(&rb->bcast_owner->wr_idx, memory_order_acquire)
+               - atomic_load_explicit(&rb->rd_idx, memory_order_acquire);
+    }
+    if (rb->bcast_readers) {
+        return rb_bcast_filled(rb, atomic_load_explicit(&rb->wr_idx, memory_order_relaxed));
+    }
+    if (rb->spsc) {
+        return rb_spsc_filled(rb, atomic_load_explicit(&rb->rd_idx, memory_order_acquire),
+                              atomic_load_explicit(&rb->wr_idx, memory_order_acquire));
+    }
+    return atomic_load_explicit(&rb->fill_cnt, memory_order_relaxed);
+}
+
+int rb_bytes_available(ringbuf_handle_t rb)
+{
+    return (rb->size - rb_fill_cnt(rb));
+}
+
+int rb_bytes_filled(ringbuf_handle_t rb)
+{
+    if (rb) {
+        return rb_fill_cnt(rb);
+    }
+    return ESP_FAIL;
+}
+
+/*
+ * Counters of rb_get_stats. Bytes and fill levels are counted once per call by the public read and write
+ * functions, the waits only on the slow path where a side blocks, so the fast path costs an atomic add or two.
+ */
+#if CONFIG_RINGBUF_STATS
+
+static inline int64_t rb_stats_now(void)
+{
+    return audio_time_now_ns();
+}
+
+/* The exporter may reset the range concurrently, so the bound only moves by compare and swap */
+static inline void rb_stats_bound(atomic_uint *bound, uint32_t fill, bool lower)
+{
+    uint32_t cur = atomic_load_explicit(bound, memory_order_relaxed);
+    while ((lower ? fill < cur : fill > cur)
+           && !atomic_compare_exchange_weak_explicit(bound, &cur, fill, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static void rb_stats_read(ringbuf_handle_t rb, int len)
+{
+    if (len > 0) {
+        atomic_fetch_add_explicit(&rb->rd_bytes, len, memory_order_relaxed);
+        rb_stats_bound(&rb->fill_min, rb_fill_cnt(rb), true);
+    }
+}
+
+static void rb_stats_write(ringbuf_handle_t rb, int len)
+{
+    if (len > 0) {
+        atomic_fetch_add_explicit(&rb->wr_bytes, len, memory_order_relaxed);
+        rb_stats_bound(&rb->fill_max, rb_fill_cnt(rb), false);
+    }
+}
+
+/* A wait that started at `start`, `woken` if it ended on a wakeup from the peer rather than the timeout */
+static void rb_stats_wait(ringbuf_handle_t rb, bool reader, int64_t start, bool woken)
+{
+    atomic_fetch_add_explicit(reader ? &rb->rd_wait_ns : &rb->wr_wait_ns, rb_stats_now() - start,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(reader ? &rb->rd_waits : &rb->wr_waits, 1, memory_order_relaxed);
+    if (woken) {
+        atomic_fetch_add_explicit(reader ? &rb->rd_wakeups : &rb->wr_wakeups, 1, memory_order_relaxed);
+    }
+}
+
+#else
+
+static inline int64_t rb_stats_now(void)
+{
+    return 0;
+}
+
+static inline void rb_stats_read(ringbuf_handle_t rb, int len)
+{
+}
+
+static inline void rb_stats_write(ringbuf_handle_t rb, int len)
+{
+}
+
+static inline void rb_stats_wait(ringbuf_handle_t rb, bool reader, int64_t start, bool woken)
+{
+}
+
+#endif /* CONFIG_RINGBUF_STATS */
+
+/* Stream position of the next byte the reader gets */
+static uint64_t rb_reader_pos(ringbuf_handle_t rb)
+{
+    if (rb->bcast_owner) {
+        /* The writer moves a lagging reader ahead, so the position follows the cursor rather than a count */
+        uint64_t wr_pos = atomic_load_explicit(&rb->bcast_owner->wr_pos, memory_order_acquire);
+        uint32_t rd = atomic_load_explicit(&rb->rd_idx, memory_order_relaxed);
+        return wr_pos - (int32_t)((uint32_t)wr_pos - rd);
+    }
+    return rb->rd_pos;
+}
+
+static void rb_account_read(ringbuf_handle_t rb, int len)
+{
+    if (len > 0) {
+        rb->rd_pos = rb->bcast_owner ? rb_reader_pos(rb) : rb->rd_pos + len;
+        rb->rd_last = rb->rd_pos - len;
+    }
+    rb_stats_read(rb, len);
+}
+
+static void rb_account_write(ringbuf_handle_t rb, int len)
+{
+    if (len > 0) {
+        atomic_fetch_add_explicit(&rb->wr_pos, len, memory_order_release);
+    }
+    rb_stats_write(rb, len);
+}
+
+static void rb_sem_release(audio_sem_handle_t handle)
+{
+    audio_sem_give(handle);
+}
+
+/* A blocked read or write on the trace timeline, with the fill level it woke up to */
+static inline void rb_trace_wait(ringbuf_handle_t rb, bool reader, int64_t trace_start)
+{
+    if (trace_start) {
+        audio_trace_span("ringbuf", reader ? "rb_read_wait" : "rb_write_wait", NULL, (uintptr_t)rb,
+                         rb_fill_cnt(rb), trace_start);
+    }
+}
+
+static inline void rb_usdt_block(ringbuf_handle_t rb, bool reader)
+{
+    if (reader) {
+        AUDIO_USDT1(rb_read_block, rb);
+    } else {
+        AUDIO_USDT1(rb_write_block, rb);
+    }
+}
+
+static inline void rb_usdt_unblock(ringbuf_handle_t rb, bool reader, int ret)
+{
+    if (reader) {
+        AUDIO_USDT2(rb_read_unblock, rb, ret);
+    } else {
+        AUDIO_USDT2(rb_write_unblock, rb, ret);
+    }
+}
+
+/* Locked rings: wait for the peer to post the semaphore of this side */
+static int rb_sem_block(ringbuf_handle_t rb, bool reader, TickType_t timeout)
+{
+    if (timeout == 0) {
+        return audio_sem_take(reader ? rb->can_read : rb->can_write, 0);
+    }
+    int64_t start = rb_stats_now();
+    int64_t trace_start = audio_trace_begin();
+    rb_usdt_block(rb, reader);
+    int ret = audio_sem_take(reader ? rb->can_read : rb->can_write, timeout);
+    rb_usdt_unblock(rb, reader, ret);
+    rb_stats_wait(rb, reader, start, ret == 0);
+    rb_trace_wait(rb, reader, trace_start);
+    return ret;
+}
+
+/*
+ * Wake the peer only if it has announced it is parked and `level` (data for a reader, space for a writer)
+ * reaches what it waits for. Pairs with the seq_cst store of `parked` followed by the re-check in
+ * rb_futex_block: either the peer sees our index update, or we see it parked.
+ */
+static void rb_spsc_wake(atomic_uint *parked, atomic_uint *need, atomic_uint *seq, uint32_t level)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(parked, memory_order_acquire)
+        && level >= atomic_load_explicit(need, memory_order_relaxed)) {
+        atomic_fetch_add(seq, 1);
+        audio_futex_wake((volatile uint32_t *)seq, 1);
+    }
+}
+
+/* Unconditional wakeup used by the rare state changes (done, abort, unblock) */
+static void rb_spsc_kick(atomic_uint *seq)
+{
+    atomic_fetch_add(seq, 1);
+    audio_futex_wake((volatile uint32_t *)seq, 1);
+}
+
+static uint32_t rb_probe_rd(ringbuf_handle_t rb)
+{
+    return atomic_load(&rb->rd_idx);
+}
+
+static uint32_t rb_probe_wr(ringbuf_handle_t rb)
+{
+    return atomic_load(&rb->wr_idx);
+}
+
+static uint32_t rb_probe_bcast_wr(ringbuf_handle_t rb)
+{
+    return atomic_load(&rb->bcast_owner->wr_idx);
+}
+
+static uint32_t rb_probe_bcast_space(ringbuf_handle_t rb)
+{
+    return rb->size - rb_bcast_filled(rb, atomic_load_explicit(&rb->wr_idx, memory_order_relaxed));
+}
+
+/*
+ * Park until `probe` returns something other than `seen`, a flag is raised, or the timeout expires.
+ * The peer only wakes us up once `need` bytes of data (reader) or space (writer) are there.
+ */
+static int rb_futex_block(ringbuf_handle_t rb, bool reader, rb_probe_t probe, uint32_t seen, uint32_t need,
+                          TickType_t timeout)
+{
+    atomic_uint *parked = reader ? &rb->rd_parked : &rb->wr_parked;
+    atomic_uint *seq = reader ? &rb->rd_seq : &rb->wr_seq;
+    struct timespec ts;
+    int ret = 0;
+
+    if (timeout == 0) {
+        return ETIMEDOUT;
+    }
+    uint32_t cur_seq = atomic_load(seq);
+    atomic_store_explicit(reader ? &rb->rd_need : &rb->wr_need, need, memory_order_relaxed);
+    atomic_store(parked, 1);
+    bool raised = rb->is_done_write || (reader ? (rb->abort_read || rb->unblock_reader_flag) : rb->abort_write);
+    if (probe(rb) == seen && !raised) {
+        int64_t start = rb_stats_now();
+        int64_t trace_start = audio_trace_begin();
+        rb_usdt_block(rb, reader);
+        ret = audio_futex_wait((volatile uint32_t *)seq, cur_seq, audio_futex_deadline(&ts, timeout));
+        rb_usdt_unblock(rb, reader, ret);
+        rb_stats_wait(rb, reader, start, ret == 0);
+        rb_trace_wait(rb, reader, trace_start);
+    }
+    atomic_store_explicit(parked, 0, memory_order_relaxed);
+    return ret;
+}
+
+static int rb_spsc_block(ringbuf_handle_t rb, bool reader, uint32_t seen, uint32_t need, TickType_t timeout)
+{
+    return rb_futex_block(rb, reader, reader ? rb_probe_wr : rb_probe_rd, seen, need, timeout);
+}
+
+/* Data a blocked reader that still wants `want` bytes waits for */
+static inline uint32_t rb_rd_need(ringbuf_handle_t rb, uint32_t want)
+{
+    /* Without a watermark, wake up for a word, reads are rounded down to a multiple of 4 anyway */
+    uint32_t need = rb->high_watermark ? rb->high_watermark : 4;
+    return want < need ? want : need;
+}
+
+/* Space a blocked writer that still has `want` bytes to write waits for */
+static inline uint32_t rb_wr_need(ringbuf_handle_t rb, uint32_t want)
+{
+    uint32_t need = rb->low_watermark ? rb->low_watermark : 1;
+    return want < need ? want : need;
+}
+
+/*
+ * Locked rings, with rb->lock held: whether the blocked reader (or writer) can make progress now.
+ * The need is cleared so that a single post is issued per wait.
+ */
+static bool rb_locked_peer_ready(ringbuf_handle_t rb, bool reader)
+{
+    atomic_uint *need = reader ? &rb->rd_need : &rb->wr_need;
+    uint32_t fill = atomic_load_explicit(&rb->fill_cnt, memory_order_relaxed);
+    uint32_t level = reader ? fill : rb->size - fill;
+    uint32_t n = atomic_load_explicit(need, memory_order_relaxed);
+
+    if (n && level >= n) {
+        atomic_store_explicit(need, 0, memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+static int rb_spsc_read(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wait)
+{
+    int read_size = 0;
+    int total_read_size = 0;
+    int ret_val = 0;
+
+    while (buf_len) {
+        uint32_t rd = atomic_load_explicit(&rb->rd_idx, memory_order_relaxed);
+        uint32_t wr = atomic_load_explicit(&rb->wr_idx, memory_order_acquire);
+        uint32_t fill_cnt = rb_spsc_filled(rb, rd, wr);
+
+        if (fill_cnt < buf_len) {
+            /* Same multiple of 4 workaround as the locked ring, see rb_read */
+            read_size = fill_cnt & 0xfffffffc;
+            if ((read_size == 0) && rb->is_done_write) {
+                read_size = fill_cnt;
+            }
+            /* Below the high watermark, keep waiting for more rather than reading a small piece */
+            if (fill_cnt < rb->high_watermark && !rb->is_done_write) {
+                read_size = 0;
+            }
+        } else {
+            read_size = buf_len;
+        }
+
+        if (read_size == 0) {
+            if (rb->is_done_write) {
+                ret_val = RB_DONE;
+                break;
+            }
+            if (rb->abort_read) {
+                ret_val = RB_ABORT;
+                break;
+            }
+            if (rb->unblock_reader_flag) {
+                ret_val = RB_TIMEOUT;
+                break;
+            }
+            if (rb_spsc_block(rb, true, wr, rb_rd_need(rb, buf_len), ticks_to_wait) != 0) {
+                ret_val = RB_TIMEOUT;
+                break;
+            }
+            continue;
+        }
+
+        if (buf) {
+            rb_spsc_copy_out(rb, rd, buf, read_size);
+        }
+        atomic_store_explicit(&rb->rd_idx, rb_spsc_advance(rb, rd, read_size), memory_order_release);
+        rb_spsc_wake(&rb->wr_parked, &rb->wr_need, &rb->wr_seq, rb->size - fill_cnt + read_size);
+
+        buf_len -= read_size;
+        total_read_size += read_size;
+        if (buf) {
+            buf += read_size;
+        }
+    }
+    if (ret_val == RB_ABORT) {
+        total_read_size = ret_val;
+    }
+    rb->unblock_reader_flag = false;
+    return total_read_size > 0 ? total_read_size : ret_val;
+}
+
+static int rb_spsc_write(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wait)
+{
+    int write_size;
+    int total_write_size = 0;
+    int ret_val = 0;
+
+    while (buf_len) {
+        uint32_t wr = atomic_load_explicit(&rb->wr_idx, memory_order_relaxed);
+        uint32_t rd = atomic_load_explicit(&rb->rd_idx, memory_order_acquire);
+        uint32_t fill_cnt = rb_spsc_filled(rb, rd, wr);
+        write_size = rb->size - fill_cnt;
+        if (buf_len <= write_size) {
+            write_size = buf_len;
+        } else if (write_size < rb->low_watermark) {
+            /* Below the low watermark, keep waiting for more space rather than writing a small piece */
+            write_size = 0;
+        }
+
+        if (write_size == 0) {
+            if (rb->is_done_write) {
+                ret_val = RB_DONE;
+                break;
+            }
+            if (rb->abort_write) {
+                ret_val = RB_ABORT;
+                break;
+            }
+            if (rb_spsc_block(rb, false, rd, rb_wr_need(rb, buf_len), ticks_to_wait) != 0) {
+                ret_val = RB_TIMEOUT;
+                break;
+            }
+            continue;
+        }
+
+        rb_spsc_copy_in(rb, wr, buf, write_size);
+        atomic_store_explicit(&rb->wr_idx, rb_spsc_advance(rb, wr, write_size), memory_order_release);
+        rb_spsc_wake(&rb->rd_parked, &rb->rd_need, &rb->rd_seq, fill_cnt + write_size);
+
+        buf_len -= write_size;
+        total_write_size += write_size;
+        buf += write_size;
+    }
+    if (ret_val == RB_ABORT) {
+        total_write_size = ret_val;
+    }
+    return total_write_size > 0 ? total_write_size : ret_val;
+}
+
+/*
+ * Same as rb_spsc_wake for the writer of a broadcast ring, the free space is only computed when it is parked.
+ */
+static void rb_bcast_wake_writer(ringbuf_handle_t rb)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&rb->wr_parked, memory_order_acquire)
+        && rb_probe_bcast_space(rb) >= atomic_load_explicit(&rb->wr_need, memory_order_relaxed)) {
+        atomic_fetch_add(&rb->wr_seq, 1);
+        audio_futex_wake((volatile uint32_t *)&rb->wr_seq, 1);
+    }
+}
+
+static int rb_bcast_read(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wait)
+{
+    ringbuf_handle_t owner = rb->bcast_owner;
+    int read_size = 0;
+    int total_read_size = 0;
+    int ret_val = 0;
+
+    while (buf_len) {
+        uint32_t rd = atomic_load_explicit(&rb->rd_idx, memory_order_acquire);
+        uint32_t wr = atomic_load_explicit(&owner->wr_idx, memory_order_acquire);
+        uint32_t fill_cnt = wr - rd;
+
+        if (fill_cnt > rb->size) {
+            /* Either detached and overrun by the writer, or skipped ahead by drop-oldest between the two loads */
+            if (rb->abort_read) {
+                ret_val = RB_ABORT;
+                break;
+            }
+            continue;
+        }
+        if (fill_cnt < buf_len) {
+            read_size = fill_cnt & 0xfffffffc;
+            if ((read_size == 0) && rb->is_done_write) {
+                read_size = fill_cnt;
+            }
+            if (fill_cnt < rb->high_watermark && !rb->is_done_write) {
+                read_size = 0;
+            }
+        } else {
+            read_size = buf_len;
+        }
+
+        if (read_size == 0) {
+            if (rb->is_done_write) {
+                ret_val = RB_DONE;
+                break;
+            }
+            if (rb->abort_read) {
+                ret_val = RB_ABORT;
+                break;
+            }
+            if (rb->unblock_reader_flag) {
+                ret_val = RB_TIMEOUT;
+                break;
+            }
+            if (rb_futex_block(rb, true, rb_probe_bcast_wr, wr, rb_rd_need(rb, buf_len), ticks_to_wait) != 0) {
+                ret_val = RB_TIMEOUT;
+                break;
+            }
+            continue;
+        }
+
+        if (buf) {
+            rb_spsc_copy_out(owner, rd & (rb->size - 1), buf, read_size);
+        }
+        if (owner->drop_oldest) {
+            /* The writer moves the cursor of a lagging reader before overwriting, if it did, copy again */
+            if (!atomic_compare_exchange_strong(&rb->rd_idx, &rd, rd + read_size)) {
+                continue;
+            }
+        } else {
+            atomic_store_explicit(&rb->rd_idx, rd + read_size, memory_order_release);
+        }
+        rb_bcast_wake_writer(owner);
+
+        buf_len -= read_size;
+        total_read_size += read_size;
+        if (buf) {
+            buf += read_size;
+        }
+    }
+    if (ret_val == RB_ABORT) {
+        total_read_size = ret_val;
+    }
+    rb->unblock_reader_flag = false;
+    return total_read_size > 0 ? total_read_size : ret_val;
+}
+
+/*
+ * Move every attached reader that would be overrun by a write of `len` bytes at `wr` far enough ahead.
+ */
+static void rb_bcast_drop(ringbuf_handle_t rb, uint32_t wr, uint32_t len)
+{
+    for (int i = 0; i < rb->bcast_readers_num; i++) {
+        ringbuf_handle_t reader = rb->bcast_readers[i];
+        if (reader->abort_read) {
+            continue;
+        }
+        uint32_t rd = atomic_load_explicit(&reader->rd_idx, memory_order_acquire);
+        while (wr - rd > rb->size - len) {
+            uint32_t to = wr + len - rb->size;
+            if (atomic_compare_exchange_weak(&reader->rd_idx, &rd, to)) {
+                atomic_fetch_add_explicit(&reader->dropped, to - rd, memory_order_relaxed);
+                break;
+            }
+        }
+    }
+}
+
+static int rb_bcast_write(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wait)
+{
+    int write_size;
+    int total_write_size = 0;
+    int ret_val = 0;
+
+    while (buf_len) {
+        uint32_t wr = atomic_load_explicit(&rb->wr_idx, memory_order_relaxed);
+        if (rb->drop_oldest) {
+            rb_bcast_drop(rb, wr, buf_len < rb->size ? buf_len : rb->size);
+        }
+        uint32_t space = rb->size - rb_bcast_filled(rb, wr);
+        write_size = buf_len <= space ? buf_len : (space < rb->low_watermark ? 0 : space);
+
+        if (write_size == 0) {
+            if (rb->is_done_write) {
+                ret_val = RB_DONE;
+                break;
+            }
+            if (rb->abort_write) {
+                ret_val = RB_ABORT;
+                break;
+            }
+            if (rb_futex_block(rb, false, rb_probe_bcast_space, space, rb_wr_need(rb, buf_len), ticks_to_wait) != 0) {
+                ret_val = RB_TIMEOUT;
+                break;
+            }
+            continue;
+        }
+
+        rb_spsc_copy_in(rb, wr & (rb->size - 1), buf, write_size);
+        atomic_store_explicit(&rb->wr_idx, wr + write_size, memory_order_release);
+        for (int i = 0; i < rb->bcast_readers_num; i++) {
+            ringbuf_handle_t reader = rb->bcast_readers[i];
+            rb_spsc_wake(&reader->rd_parked, &reader->rd_need, &reader->rd_seq,
+                         wr + write_size - atomic_load_explicit(&reader->rd_idx, memory_order_relaxed));
+        }
+
+        buf_len -= write_size;
+        total_write_size += write_size;
+        buf += write_size;
+    }
+    if (ret_val == RB_ABORT) {
+        total_write_size = ret_val;
+    }
+    return total_write_size > 0 ? total_write_size : ret_val;
+}
+
+int rb_read_packet(ringbuf_handle_t rb, char *buf, int buf_len, rb_packet_info_t *info, TickType_t ticks_to_wait)
+{
+    rb_packet_hdr_t hdr;
+    int ret_val;
+
+    if (rb == NULL || !rb->packet) {
+        return RB_FAIL;
+    }
+    while (1) {
+        uint32_t rd = atomic_load_explicit(&rb->rd_idx, memory_order_relaxed);
+        uint32_t wr = atomic_load_explicit(&rb->wr_idx, memory_order_acquire);
+
+        /* Header and payload are published together, a visible header means the whole record is there */
+        if (rb_spsc_filled(rb, rd, wr) >= sizeof(hdr)) {
+            rb_spsc_copy_out(rb, rd, (char *)&hdr, sizeof(hdr));
+            if (info) {
+                info->len = hdr.len;
+            }
+            /* The record stays, the caller learns its length from info and reads again or drops it */
+            if (buf && hdr.len > buf_len) {
+                ESP_LOGD(TAG, "Packet of %u bytes does not fit in %d bytes", hdr.len, buf_len);
+                ret_val = RB_FAIL;
+                break;
+            }
+            if (buf) {
+                rb_spsc_copy_out(rb, rb_spsc_advance(rb, rd, sizeof(hdr)), buf, hdr.len);
+            }
+            atomic_store_explicit(&rb->rd_idx, rb_spsc_advance(rb, rd, sizeof(hdr) + hdr.len), memory_order_release);
+            rb_spsc_wake(&rb->wr_parked, &rb->wr_need, &rb->wr_seq,
+                         rb->size - rb_spsc_filled(rb, rd, wr) + sizeof(hdr) + hdr.len);
+            if (info) {
+                info->flags = hdr.flags;
+                info->timestamp = hdr.timestamp;
+            }
+            rb->unblock_reader_flag = false;
+            rb_notify_writer(rb);
+            rb_account_read(rb, hdr.len);
+            return hdr.len;
+        }
+        if (rb->is_done_write) {
+            ret_val = RB_DONE;
+            break;
+        }
+        if (rb->abort_read) {
+            ret_val = RB_ABORT;
+            break;
+        }
+        if (rb->unblock_reader_flag) {
+            ret_val = RB_TIMEOUT;
+            break;
+        }
+        if (rb_spsc_block(rb, true, wr, sizeof(hdr), ticks_to_wait) != 0) {
+            ret_val = RB_TIMEOUT;
+            break;
+        }
+    }
+    rb->unblock_reader_flag = false;
+    return ret_val;
+}
+
+int rb_write_packet(ringbuf_handle_t rb, const char *buf, int len, const rb_packet_info_t *info, TickType_t ticks_to_wait)
+{
+    rb_packet_hdr_t hdr = {
+        .len = len,
+        .flags = info ? info->flags : 0,
+        .timestamp = info ? info->timestamp : 0,
+    };
+
+    if (rb == NULL || !rb->packet || buf == NULL || len <= 0) {
+        return RB_FAIL;
+    }
+    if (sizeof(hdr) + len > rb->size) {
+        ESP_LOGE(TAG, "Packet of %d bytes does not fit in ringbuf of %u bytes", len, rb->size);
+        return RB_FAIL;
+    }
+    while (1) {
+        uint32_t wr = atomic_load_explicit(&rb->wr_idx, memory_order_relaxed);
+        uint32_t rd = atomic_load_explicit(&rb->rd_idx, memory_order_acquire);
+
+        if (rb->size - rb_spsc_filled(rb, rd, wr) >= sizeof(hdr) + len) {
+            rb_spsc_copy_in(rb, wr, (const char *)&hdr, sizeof(hdr));
+            rb_spsc_copy_in(rb, rb_spsc_advance(rb, wr, sizeof(hdr)), buf, len);
+            atomic_store_explicit(&rb->wr_idx, rb_spsc_advance(rb, wr, sizeof(hdr) + len), memory_order_release);
+            rb_spsc_wake(&rb->rd_parked, &rb->rd_need, &rb->rd_seq, rb_spsc_filled(rb, rd, wr) + sizeof(hdr) + len);
+            rb_notify_reader(rb);
+            rb_account_write(rb, len);
+            return len;
+        }
+        if (rb->is_done_write) {
+            return RB_DONE;
+        }
+        if (rb->abort_write) {
+            return RB_ABORT;
+        }
+        if (rb_spsc_block(rb, false, rd, sizeof(hdr) + len, ticks_to_wait) != 0) {
+            return RB_TIMEOUT;
+        }
+    }
+}
+
+/*
+ * Descriptor rings. rd_idx and wr_idx count buffers, the reader and the writer hand each other pointers through
+ * desc_slots with the same release / acquire pairing and parking as the SPSC byte rings.
+ */
+static inline uint32_t rb_desc_queued(ringbuf_handle_t rb)
+{
+    return atomic_load_explicit(&rb->wr_idx, memory_order_acquire)
+           - atomic_load_explicit(&rb->rd_idx, memory_order_acquire);
+}
+
+static uint32_t rb_probe_desc_free(ringbuf_handle_t rb)
+{
+    return audio_buf_pool_get_free(rb->desc_pool);
+}
+
+/* A buffer went back to the pool, the byte shim writer may be parked waiting for one */
+static void rb_desc_pool_notify(audio_buf_pool_handle_t pool, void *ctx)
+{
+    ringbuf_handle_t rb = (ringbuf_handle_t)ctx;
+    rb_spsc_wake(&rb->wr_parked, &rb->wr_need, &rb->wr_seq, UINT32_MAX);
+    rb_notify_writer(rb);
+}
+
+/* Drop every buffer held by the ring, neither side may be active */
+static void rb_desc_drain(ringbuf_handle_t rb)
+{
+    uint32_t rd = atomic_load(&rb->rd_idx);
+    uint32_t wr = atomic_load(&rb->wr_idx);
+    while (rd != wr) {
+        audio_buf_unref(rb->desc_slots[rd++ & rb->desc_mask]);
+    }
+    atomic_store(&rb->rd_idx, wr);
+    audio_buf_unref(rb->desc_rd_cur);
+    rb->desc_rd_cur = NULL;
+    rb->desc_rd_off = 0;
+    audio_buf_unref(rb->desc_wr_cur);
+    rb->desc_wr_cur = NULL;
+    atomic_store(&rb->desc_bytes, 0);
+}
+
+static int rb_desc_pop(ringbuf_handle_t rb, audio_buf_t **buf, TickType_t ticks_to_wait)
+{
+    while (1) {
+        uint32_t rd = atomic_load_explicit(&rb->rd_idx, memory_order_relaxed);
+        uint32_t wr = atomic_load_explicit(&rb->wr_idx, memory_order_acquire);
+
+        if (rd != wr) {
+            *buf = rb->desc_slots[rd & rb->desc_mask];
+            atomic_store_explicit(&rb->rd_idx, rd + 1, memory_order_release);
+            rb_spsc_wake(&rb->wr_parked, &rb->wr_need, &rb->wr_seq, rb->desc_mask + 2 - (wr - rd));
+            rb_notify_writer(rb);
+            return (*buf)->len;
+        }
+        if (rb->is_done_write) {
+            return RB_DONE;
+        }
+        if (rb->abort_read) {
+            return RB_ABORT;
+        }
+        if (rb->unblock_reader_flag) {
+            return RB_TIMEOUT;
+        }
+        if (rb_spsc_block(rb, true, wr, 1, ticks_to_wait) != 0) {
+            return RB_TIMEOUT;
+        }
+    }
+}
+
+/* Wait until a slot is free, so that the next push does not block */
+static int rb_desc_wait_slot(ringbuf_handle_t rb, TickType_t ticks_to_wait)
+{
+    while (1) {
+        uint32_t wr = atomic_load_explicit(&rb->wr_idx, memory_order_relaxed);
+        uint32_t rd = atomic_load_explicit(&rb->rd_idx, memory_order_acquire);
+
+        if (rb->is_done_write) {
+            return RB_DONE;
+        }
+        if (rb->abort_write) {
+            return RB_ABORT;
+        }
+        if (wr - rd <= rb->desc_mask) {
+            return RB_OK;
+        }
+        if (rb_spsc_block(rb, false, rd, 1, ticks_to_wait) != 0) {
+            return RB_TIMEOUT;
+        }
+    }
+}
+
+static int rb_desc_push(ringbuf_handle_t rb, audio_buf_t *buf, TickType_t ticks_to_wait)
+{
+    int ret = rb_desc_wait_slot(rb, ticks_to_wait);
+    if (ret != RB_OK) {
+        return ret;
+    }
+    uint32_t wr = atomic_load_explicit(&rb->wr_idx, memory_order_relaxed);
+    uint32_t rd = atomic_load_explicit(&rb->rd_idx, memory_order_acquire);
+    rb->desc_slots[wr & rb->desc_mask] = buf;
+    /* Counted before it is published, so the reader never takes the count below zero */
+    atomic_fetch_add_explicit(&rb->desc_bytes, buf->len, memory_order_relaxed);
+    atomic_store_explicit(&rb->wr_idx, wr + 1, memory_order_release);
+    rb_spsc_wake(&rb->rd_parked, &rb->rd_need, &rb->rd_seq, wr + 1 - rd);
+    rb_notify_reader(rb);
+    return buf->len;
+}
+
+/* Take a free buffer of the pool for the byte shim writer */
+static int rb_desc_alloc(ringbuf_handle_t rb, audio_buf_t **buf, TickType_t ticks_to_wait)
+{
+    while (1) {
+        if (rb->is_done_write) {
+            return RB_DONE;
+        }
+        if (rb->abort_write) {
+            return RB_ABORT;
+        }
+        *buf = audio_buf_alloc(rb->desc_pool, 0);
+        if (*buf) {
+            return (*buf)->size;
+        }
+        if (rb_futex_block(rb, false, rb_probe_desc_free, 0, 1, ticks_to_wait) != 0) {
+            return RB_TIMEOUT;
+        }
+    }
+}
+
+/* Byte shim reader: release `len` bytes of the current buffer */
+static void rb_desc_advance(ringbuf_handle_t rb, int len)
+{
+    audio_buf_t *cur = rb->desc_rd_cur;
+    rb->desc_rd_off += len;
+    atomic_fetch_sub_explicit(&rb->desc_bytes, len, memory_order_relaxed);
+    if (rb->desc_rd_off == cur->len) {
+        rb->desc_rd_cur = NULL;
+        rb->desc_rd_off = 0;
+        audio_buf_unref(cur);
+    }
+}
+
+static int rb_desc_read(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wait)
+{
+    int total_read_size = 0;
+    int ret_val = 0;
+
+    while (buf_len > 0) {
+        if (rb->desc_rd_cur == NULL) {
+            ret_val = rb_desc_pop(rb, &rb->desc_rd_cur, ticks_to_wait);
+            if (ret_val < 0) {
+                break;
+            }
+        }
+        audio_buf_t *cur = rb->desc_rd_cur;
+        int read_size = cur->len - rb->desc_rd_off;
+        if (read_size > buf_len) {
+            read_size = buf_len;
+        }
+        if (buf) {
+            memcpy(buf, cur->data + cur->offset + rb->desc_rd_off, read_size);
+            buf += read_size;
+        }
+        rb_desc_advance(rb, read_size);
+        buf_len -= read_size;
+        total_read_size += read_size;
+    }
+    if (ret_val == RB_ABORT) {
+        total_read_size = ret_val;
+    }
+    rb->unblock_reader_flag = false;
+    return total_read_size > 0 ? total_read_size : ret_val;
+}
+
+static int rb_desc_write(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wait)
+{
+    int total_write_size = 0;
+    int ret_val = 0;
+
+    while (buf_len > 0) {
+        audio_buf_t *desc = NULL;
+        ret_val = rb_desc_alloc(rb, &desc, ticks_to_wait);
+        if (ret_val < 0) {
+            break;
+        }
+        int write_size = buf_len < desc->size ? buf_len : desc->size;
+        memcpy(desc->data, buf, write_size);
+        desc->len = write_size;
+        ret_val = rb_desc_push(rb, desc, ticks_to_wait);
+        if (ret_val < 0) {
+            audio_buf_unref(desc);
+            break;
+        }
+        buf_len -= write_size;
+        total_write_size += write_size;
+        buf += write_size;
+    }
+    if (ret_val == RB_ABORT) {
+        total_write_size = ret_val;
+    }
+    return total_write_size > 0 ? total_write_size : ret_val;
+}
+
+static int rb_desc_peek(ringbuf_handle_t rb, char **buf, int len, TickType_t ticks_to_wait)
+{
+    if (rb->desc_rd_cur == NULL) {
+        int ret = rb_desc_pop(rb, &rb->desc_rd_cur, ticks_to_wait);
+        rb->unblock_reader_flag = false;
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    audio_buf_t *cur = rb->desc_rd_cur;
+    int avail = cur->len - rb->desc_rd_off;
+    *buf = cur->data + cur->offset + rb->desc_rd_off;
+    return len < avail ? len : avail;
+}
+
+static esp_err_t rb_desc_consume(ringbuf_handle_t rb, int len)
+{
+    audio_buf_t *cur = rb->desc_rd_cur;
+    if (len == 0) {
+        return ESP_OK;
+    }
+    if (len < 0 || cur == NULL || len > cur->len - rb->desc_rd_off) {
+        return ESP_FAIL;
+    }
+    rb_desc_advance(rb, len);
+    return ESP_OK;
+}
+
+static int rb_desc_acquire(ringbuf_handle_t rb, char **buf, int len, TickType_t ticks_to_wait)
+{
+    /* Both a slot and a buffer, so that the commit never waits */
+    int ret = rb_desc_wait_slot(rb, ticks_to_wait);
+    if (ret == RB_OK && rb->desc_wr_cur == NULL) {
+        ret = rb_desc_alloc(rb, &rb->desc_wr_cur, ticks_to_wait);
+    }
+    if (ret < 0) {
+        return ret;
+    }
+    *buf = rb->desc_wr_cur->data;
+    return len < rb->desc_wr_cur->size ? len : rb->desc_wr_cur->size;
+}
+
+static esp_err_t rb_desc_commit(ringbuf_handle_t rb, int len)
 {
-    if (rb == NULL) {
+    audio_buf_t *cur = rb->desc_wr_cur;
+    if (len == 0) {
+        /* Nothing produced, the buffer is kept for the next acquire */
+        return ESP_OK;
+    }
+    if (len < 0 || cur == NULL || len > cur->size) {
+        return ESP_FAIL;
+    }
+    cur->len = len;
+    rb->desc_wr_cur = NULL;
+    if (rb_desc_push(rb, cur, 0) < 0) {
+        audio_buf_unref(cur);
         return ESP_FAIL;
     }
-    rb->p_r = rb->p_w = rb->p_o;
-    rb->fill_cnt = 0;
-    rb->is_done_write = false;
-
-    rb->unblock_reader_flag = false;
-    rb->abort_read = false;
-    rb->abort_write = false;
     return ESP_OK;
 }
 
-int rb_bytes_available(ringbuf_handle_t rb)
+int rb_read_buf(ringbuf_handle_t rb, audio_buf_t **buf, TickType_t ticks_to_wait)
 {
-    return (rb->size - rb->fill_cnt);
+    int ret;
+    if (rb == NULL || !rb->desc || buf == NULL) {
+        return RB_FAIL;
+    }
+    if (rb->desc_rd_cur) {
+        /* Rest of a buffer the byte shim has started on */
+        *buf = rb->desc_rd_cur;
+        (*buf)->offset += rb->desc_rd_off;
+        (*buf)->len -= rb->desc_rd_off;
+        rb->desc_rd_cur = NULL;
+        rb->desc_rd_off = 0;
+        ret = (*buf)->len;
+    } else {
+        ret = rb_desc_pop(rb, buf, ticks_to_wait);
+    }
+    if (ret > 0) {
+        atomic_fetch_sub_explicit(&rb->desc_bytes, ret, memory_order_relaxed);
+        rb_account_read(rb, ret);
+    }
+    rb->unblock_reader_flag = false;
+    return ret;
 }
 
-int rb_bytes_filled(ringbuf_handle_t rb)
+int rb_alloc_buf(ringbuf_handle_t rb, audio_buf_t **buf, TickType_t ticks_to_wait)
 {
-    if (rb) {
-        return rb->fill_cnt;
+    if (rb == NULL || !rb->desc || buf == NULL) {
+        return RB_FAIL;
     }
-    return ESP_FAIL;
+    return rb_desc_alloc(rb, buf, ticks_to_wait);
 }
 
-static void rb_sem_release(sem_t *handle )
+int rb_write_buf(ringbuf_handle_t rb, audio_buf_t *buf, TickType_t ticks_to_wait)
 {
-    sem_post(handle);
-}
-
-static int rb_sem_block(sem_t *handle, TickType_t timeout) {
-    struct timespec ts;
-    int status;
-
-    if (timeout != 0) {
-        status = clock_gettime(CLOCK_REALTIME, &ts);
-        if (status < 0)
-        {
-          int errcode = errno;
-          fprintf(stderr, "rb_sem_block: clock_gettime() failed: %d\n", errcode);
-          abort();
-        }
-        ts.tv_sec += timeout;
+    if (rb == NULL || !rb->desc || buf == NULL || buf->len <= 0) {
+        return RB_FAIL;
     }
-
-    return sem_timedwait(handle, &ts);
+    int ret = rb_desc_push(rb, buf, ticks_to_wait);
+    rb_account_write(rb, ret);
+    return ret;
 }
 
-int rb_read(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wait)
+static int rb_read_bytes(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wait)
 {
     int read_size = 0;
     int total_read_size = 0;
     int ret_val = 0;
+    bool wake_writer = false;
 
-    if (rb == NULL) {
-        return RB_FAIL;
+    if (rb_is_broadcast(rb)) {
+        return rb->bcast_owner ? rb_bcast_read(rb, buf, buf_len, ticks_to_wait) : RB_FAIL;
+    }
+    if (rb->spsc) {
+        return rb_spsc_read(rb, buf, buf_len, ticks_to_wait);
     }
 
     while (buf_len) {
@@ -183,8 +1551,9 @@ int rb_read(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wai
             goto read_err;
         }
 
-        if (rb->fill_cnt < buf_len) {
-            read_size = rb->fill_cnt;
+        uint32_t fill_cnt = atomic_load_explicit(&rb->fill_cnt, memory_order_relaxed);
+        if (fill_cnt < buf_len) {
+            read_size = fill_cnt;
             /**
              * When non-multiple of 4(word size) bytes are written to I2S, there is noise.
              * Below is the kind of workaround to read only in multiple of 4. Avoids noise when rb is read in small chunks.
@@ -192,7 +1561,10 @@ int rb_read(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wai
              */
             read_size = read_size & 0xfffffffc;
             if ((read_size == 0) && rb->is_done_write) {
-                read_size = rb->fill_cnt;
+                read_size = fill_cnt;
+            }
+            if (fill_cnt < rb->high_watermark && !rb->is_done_write) {
+                read_size = 0;
             }
         } else {
             read_size = buf_len;
@@ -218,10 +1590,14 @@ int rb_read(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wai
                 goto read_err;
             }
 
+            atomic_store_explicit(&rb->rd_need, rb_rd_need(rb, buf_len), memory_order_relaxed);
             mutex_unlock(rb->lock);
-            rb_sem_release(rb->can_write);
+            if (wake_writer) {
+                wake_writer = false;
+                rb_sem_release(rb->can_write);
+            }
             //wait till some data available to read
-            if (rb_sem_block(rb->can_read, ticks_to_wait) != 0) {
+            if (rb_sem_block(rb, true, ticks_to_wait) != 0) {
                 ret_val = RB_TIMEOUT;
                 goto read_err;
             }
@@ -244,16 +1620,17 @@ int rb_read(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wai
         }
 
         buf_len -= read_size;
-        rb->fill_cnt -= read_size;
+        rb_fill_cnt_add(rb, -read_size);
         total_read_size += read_size;
         buf += read_size;
+        wake_writer |= rb_locked_peer_ready(rb, false);
         mutex_unlock(rb->lock);
         if (buf_len == 0) {
             break;
         }
     }
 read_err:
-    if (total_read_size > 0) {
+    if (wake_writer) {
         rb_sem_release(rb->can_write);
     }
     if ((ret_val == RB_FAIL) ||
@@ -264,14 +1641,42 @@ read_err:
     return total_read_size > 0 ? total_read_size : ret_val;
 }
 
-int rb_write(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wait)
+int rb_read(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wait)
+{
+    int ret;
+    if (rb == NULL) {
+        return RB_FAIL;
+    }
+    AUDIO_USDT3(rb_read_entry, rb, buf_len, ticks_to_wait);
+    if (rb->packet) {
+        ret = rb_read_packet(rb, buf, buf_len, NULL, ticks_to_wait);
+    } else {
+        if (rb->desc) {
+            ret = rb_desc_read(rb, buf, buf_len, ticks_to_wait);
+        } else {
+            ret = rb_read_bytes(rb, buf, buf_len, ticks_to_wait);
+            if (ret > 0) {
+                rb_notify_writer(rb);
+            }
+        }
+        rb_account_read(rb, ret);
+    }
+    AUDIO_USDT2(rb_read_return, rb, ret);
+    return ret;
+}
+
+static int rb_write_bytes(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wait)
 {
     int write_size;
     int total_write_size = 0;
     int ret_val = 0;
+    bool wake_reader = false;
 
-    if (rb == NULL || buf == NULL) {
-        return RB_FAIL;
+    if (rb_is_broadcast(rb)) {
+        return rb->bcast_readers ? rb_bcast_write(rb, buf, buf_len, ticks_to_wait) : RB_FAIL;
+    }
+    if (rb->spsc) {
+        return rb_spsc_write(rb, buf, buf_len, ticks_to_wait);
     }
 
     while (buf_len) {
@@ -282,8 +1687,10 @@ int rb_write(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wa
         }
         write_size = rb_bytes_available(rb);
 
-        if (buf_len < write_size) {
+        if (buf_len <= write_size) {
             write_size = buf_len;
+        } else if (write_size < rb->low_watermark) {
+            write_size = 0;
         }
 
         if (write_size == 0) {
@@ -299,10 +1706,14 @@ int rb_write(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wa
                 goto write_err;
             }
 
+            atomic_store_explicit(&rb->wr_need, rb_wr_need(rb, buf_len), memory_order_relaxed);
             mutex_unlock(rb->lock);
-            rb_sem_release(rb->can_read);
+            if (wake_reader) {
+                wake_reader = false;
+                rb_sem_release(rb->can_read);
+            }
             //wait till we have some empty space to write
-            if (rb_sem_block(rb->can_write, ticks_to_wait) != 0) {
+            if (rb_sem_block(rb, false, ticks_to_wait) != 0) {
                 ret_val = RB_TIMEOUT;
                 goto write_err;
             }
@@ -321,16 +1732,17 @@ int rb_write(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wa
         }
 
         buf_len -= write_size;
-        rb->fill_cnt += write_size;
+        rb_fill_cnt_add(rb, write_size);
         total_write_size += write_size;
         buf += write_size;
+        wake_reader |= rb_locked_peer_ready(rb, true);
         mutex_unlock(rb->lock);
         if (buf_len == 0) {
             break;
         }
     }
 write_err:
-    if (total_write_size > 0) {
+    if (wake_reader) {
         rb_sem_release(rb->can_read);
     }
     if ((ret_val == RB_FAIL) ||
@@ -340,12 +1752,262 @@ write_err:
     return total_write_size > 0 ? total_write_size : ret_val;
 }
 
+int rb_write(ringbuf_handle_t rb, char *buf, int buf_len, TickType_t ticks_to_wait)
+{
+    int ret;
+    if (rb == NULL || buf == NULL) {
+        return RB_FAIL;
+    }
+    AUDIO_USDT3(rb_write_entry, rb, buf_len, ticks_to_wait);
+    if (rb->packet) {
+        ret = rb_write_packet(rb, buf, buf_len, NULL, ticks_to_wait);
+    } else {
+        if (rb->desc) {
+            ret = rb_desc_write(rb, buf, buf_len, ticks_to_wait);
+        } else {
+            ret = rb_write_bytes(rb, buf, buf_len, ticks_to_wait);
+            if (ret > 0) {
+                rb_notify_reader(rb);
+            }
+        }
+        rb_account_write(rb, ret);
+    }
+    AUDIO_USDT2(rb_write_return, rb, ret);
+    return ret;
+}
+
+/*
+ * Contiguous span that can be read (reader) or written (writer) at the current position, `total` returns
+ * all bytes readable or writable including the part behind the wrap. Locked rings must hold rb->lock.
+ * For SPSC rings, `seen` returns the peer index the span was computed from.
+ */
+static int rb_contiguous(ringbuf_handle_t rb, bool reader, char **ptr, uint32_t *seen, int *total)
+{
+    uint32_t avail;
+    char *pos;
+
+    if (rb->spsc) {
+        uint32_t rd = atomic_load_explicit(&rb->rd_idx, reader ? memory_order_relaxed : memory_order_acquire);
+        uint32_t wr = atomic_load_explicit(&rb->wr_idx, reader ? memory_order_acquire : memory_order_relaxed);
+        avail = rb_spsc_filled(rb, rd, wr);
+        if (!reader) {
+            avail = rb->size - avail;
+        }
+        pos = rb_spsc_ptr(rb, reader ? rd : wr);
+        *seen = reader ? wr : rd;
+    } else {
+        uint32_t fill = atomic_load_explicit(&rb->fill_cnt, memory_order_relaxed);
+        avail = reader ? fill : rb->size - fill;
+        pos = reader ? rb->p_r : rb->p_w;
+    }
+    *total = avail;
+    if (!rb->mirrored && pos + avail > rb->p_o + rb->size) {
+        avail = rb->p_o + rb->size - pos;
+    }
+    *ptr = pos;
+    return avail;
+}
+
+/*
+ * Wait until `len` bytes of data (reader) or space (writer) are available, shared by rb_peek_read and
+ * rb_acquire_write. Whatever is available is handed out when the wait ends early.
+ */
+static int rb_span_wait(ringbuf_handle_t rb, bool reader, char **buf, int len, TickType_t ticks_to_wait)
+{
+    uint32_t seen = 0;
+    bool timed_out = false;
+    int ret_val;
+    int total;
+
+    if (rb == NULL || buf == NULL || len <= 0 || rb->packet || rb_is_broadcast(rb)) {
+        return RB_FAIL;
+    }
+    if (len > rb->size) {
+        len = rb->size;
+    }
+    while (1) {
+        if (!rb->spsc && mutex_lock(rb->lock) != 0) {
+            ret_val = RB_TIMEOUT;
+            break;
+        }
+        int avail = rb_contiguous(rb, reader, buf, &seen, &total);
+        if (rb->is_done_write) {
+            ret_val = RB_DONE;
+        } else if (reader ? rb->abort_read : rb->abort_write) {
+            ret_val = RB_ABORT;
+        } else if (timed_out || (reader && rb->unblock_reader_flag)) {
+            ret_val = RB_TIMEOUT;
+        } else {
+            ret_val = RB_OK;
+        }
+        if (total >= len || (total > 0 && ret_val != RB_OK)) {
+            if (!rb->spsc) {
+                mutex_unlock(rb->lock);
+            }
+            if (reader) {
+                rb->unblock_reader_flag = false;
+            }
+            return avail < len ? avail : len;
+        }
+        if (rb->spsc) {
+            if (ret_val == RB_OK && rb_spsc_block(rb, reader, seen, len, ticks_to_wait) != 0) {
+                timed_out = true;
+            }
+        } else {
+            atomic_store_explicit(reader ? &rb->rd_need : &rb->wr_need, len, memory_order_relaxed);
+            mutex_unlock(rb->lock);
+            if (ret_val == RB_OK) {
+                if (rb_sem_block(rb, reader, ticks_to_wait) != 0) {
+                    timed_out = true;
+                }
+            }
+        }
+        if (ret_val != RB_OK) {
+            break;
+        }
+    }
+    *buf = NULL;
+    if (reader) {
+        rb->unblock_reader_flag = false;
+    }
+    return ret_val;
+}
+
+/*
+ * Hand `len` bytes from one side to the other after a peek/acquire.
+ */
+static esp_err_t rb_span_advance(ringbuf_handle_t rb, bool reader, int len)
+{
+    char *pos;
+    uint32_t seen;
+    int total;
+
+    if (rb == NULL || len < 0 || rb->packet || rb_is_broadcast(rb)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (len == 0) {
+        return ESP_OK;
+    }
+    if (!rb->spsc && mutex_lock(rb->lock) != 0) {
+        return ESP_FAIL;
+    }
+    if (rb_contiguous(rb, reader, &pos, &seen, &total) < len) {
+        ESP_LOGE(TAG, "%s %d bytes, more than the span available", reader ? "consume" : "commit", len);
+        if (!rb->spsc) {
+            mutex_unlock(rb->lock);
+        }
+        return ESP_FAIL;
+    }
+    if (rb->spsc) {
+        atomic_uint *idx = reader ? &rb->rd_idx : &rb->wr_idx;
+        atomic_store_explicit(idx, rb_spsc_advance(rb, atomic_load_explicit(idx, memory_order_relaxed), len),
+                              memory_order_release);
+        /* The peer sees everything but the part of the span that is left over */
+        if (reader) {
+            rb_spsc_wake(&rb->wr_parked, &rb->wr_need, &rb->wr_seq, rb->size - total + len);
+            rb_notify_writer(rb);
+        } else {
+            rb_spsc_wake(&rb->rd_parked, &rb->rd_need, &rb->rd_seq, rb->size - total + len);
+            rb_notify_reader(rb);
+        }
+        return ESP_OK;
+    }
+    pos += len;
+    if (pos >= rb->p_o + rb->size) {
+        pos -= rb->size;
+    }
+    if (reader) {
+        rb->p_r = pos;
+        rb_fill_cnt_add(rb, -len);
+    } else {
+        rb->p_w = pos;
+        rb_fill_cnt_add(rb, len);
+    }
+    bool wake = rb_locked_peer_ready(rb, !reader);
+    mutex_unlock(rb->lock);
+    if (wake) {
+        rb_sem_release(reader ? rb->can_write : rb->can_read);
+    }
+    if (reader) {
+        rb_notify_writer(rb);
+    } else {
+        rb_notify_reader(rb);
+    }
+    return ESP_OK;
+}
+
+int rb_peek_read(ringbuf_handle_t rb, char **buf, int len, TickType_t ticks_to_wait)
+{
+    int ret;
+    if (rb && rb->desc && buf && len > 0) {
+        ret = rb_desc_peek(rb, buf, len, ticks_to_wait);
+    } else {
+        ret = rb_span_wait(rb, true, buf, len, ticks_to_wait);
+    }
+    if (ret > 0) {
+        rb->rd_last = rb_reader_pos(rb);
+    }
+    return ret;
+}
+
+esp_err_t rb_consume(ringbuf_handle_t rb, int len)
+{
+    esp_err_t ret;
+    if (rb && rb->desc) {
+        ret = rb_desc_consume(rb, len);
+    } else {
+        ret = rb_span_advance(rb, true, len);
+    }
+    if (ret == ESP_OK) {
+        rb_account_read(rb, len);
+    }
+    return ret;
+}
+
+int rb_acquire_write(ringbuf_handle_t rb, char **buf, int len, TickType_t ticks_to_wait)
+{
+    if (rb && rb->desc && buf && len > 0) {
+        return rb_desc_acquire(rb, buf, len, ticks_to_wait);
+    }
+    return rb_span_wait(rb, false, buf, len, ticks_to_wait);
+}
+
+esp_err_t rb_commit_write(ringbuf_handle_t rb, int len)
+{
+    esp_err_t ret;
+    if (rb && rb->desc) {
+        ret = rb_desc_commit(rb, len);
+    } else {
+        ret = rb_span_advance(rb, false, len);
+    }
+    if (ret == ESP_OK) {
+        rb_account_write(rb, len);
+    }
+    return ret;
+}
+
 static esp_err_t rb_abort_read(ringbuf_handle_t rb)
 {
     if (rb == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
     rb->abort_read = true;
+    if (rb->bcast_readers) {
+        for (int i = 0; i < rb->bcast_readers_num; i++) {
+            rb_abort_read(rb->bcast_readers[i]);
+        }
+        return ESP_OK;
+    }
+    if (rb->bcast_owner) {
+        /* The writer may be waiting for this reader only */
+        rb_spsc_kick(&rb->rd_seq);
+        rb_spsc_kick(&rb->bcast_owner->wr_seq);
+        return ESP_OK;
+    }
+    if (rb->spsc) {
+        rb_spsc_kick(&rb->rd_seq);
+        return ESP_OK;
+    }
     rb_sem_release(rb->can_read);
     return ESP_OK;
 }
@@ -356,6 +2018,10 @@ static esp_err_t rb_abort_write(ringbuf_handle_t rb)
         return ESP_ERR_INVALID_ARG;
     }
     rb->abort_write = true;
+    if (rb->spsc || rb_is_broadcast(rb)) {
+        rb_spsc_kick(&rb->wr_seq);
+        return ESP_OK;
+    }
     rb_sem_release(rb->can_write);
     return ESP_OK;
 }
@@ -367,6 +2033,8 @@ esp_err_t rb_abort(ringbuf_handle_t rb)
     }
     esp_err_t err = rb_abort_read(rb);
     err |= rb_abort_write(rb);
+    rb_notify_reader(rb);
+    rb_notify_writer(rb);
     return err;
 }
 
@@ -375,7 +2043,7 @@ bool rb_is_full(ringbuf_handle_t rb)
     if (rb == NULL) {
         return false;
     }
-    return (rb->size == rb->fill_cnt);
+    return (rb->size == rb_fill_cnt(rb));
 }
 
 esp_err_t rb_done_write(ringbuf_handle_t rb)
@@ -384,7 +2052,20 @@ esp_err_t rb_done_write(ringbuf_handle_t rb)
         return ESP_ERR_INVALID_ARG;
     }
     rb->is_done_write = true;
-    rb_sem_release(rb->can_read);
+    if (rb->bcast_readers) {
+        for (int i = 0; i < rb->bcast_readers_num; i++) {
+            rb->bcast_readers[i]->is_done_write = true;
+            rb_spsc_kick(&rb->bcast_readers[i]->rd_seq);
+        }
+    }
+    if (rb->spsc || rb_is_broadcast(rb)) {
+        rb_spsc_kick(&rb->rd_seq);
+        rb_spsc_kick(&rb->wr_seq);
+    } else {
+        rb_sem_release(rb->can_read);
+    }
+    rb_notify_reader(rb);
+    rb_notify_writer(rb);
     return ESP_OK;
 }
 
@@ -394,10 +2075,53 @@ esp_err_t rb_unblock_reader(ringbuf_handle_t rb)
         return ESP_ERR_INVALID_ARG;
     }
     rb->unblock_reader_flag = true;
-    rb_sem_release(rb->can_read);
+    if (rb->bcast_readers) {
+        for (int i = 0; i < rb->bcast_readers_num; i++) {
+            rb_unblock_reader(rb->bcast_readers[i]);
+        }
+        return ESP_OK;
+    }
+    if (rb->spsc || rb->bcast_owner) {
+        rb_spsc_kick(&rb->rd_seq);
+    } else {
+        rb_sem_release(rb->can_read);
+    }
+    rb_notify_reader(rb);
     return ESP_OK;
 }
 
+bool rb_is_mirrored(ringbuf_handle_t rb)
+{
+    if (rb == NULL) {
+        return false;
+    }
+    return rb->mirrored;
+}
+
+bool rb_is_packet(ringbuf_handle_t rb)
+{
+    if (rb == NULL) {
+        return false;
+    }
+    return rb->packet;
+}
+
+bool rb_is_desc(ringbuf_handle_t rb)
+{
+    if (rb == NULL) {
+        return false;
+    }
+    return rb->desc;
+}
+
+audio_buf_pool_handle_t rb_desc_get_pool(ringbuf_handle_t rb)
+{
+    if (rb == NULL) {
+        return NULL;
+    }
+    return rb->desc_pool;
+}
+
 bool rb_is_done_write(ringbuf_handle_t rb)
 {
     if (rb == NULL) {
@@ -413,3 +2137,183 @@ int rb_get_size(ringbuf_handle_t rb)
     }
     return rb->size;
 }
+
+esp_err_t rb_set_watermark(ringbuf_handle_t rb, int low_watermark, int high_watermark)
+{
+    if (rb == NULL || low_watermark < 0 || high_watermark < 0 || low_watermark + high_watermark > rb->size) {
+        ESP_LOGE(TAG, "Invalid watermarks %d/%d", low_watermark, high_watermark);
+        return ESP_ERR_INVALID_ARG;
+    }
+    rb->low_watermark = low_watermark;
+    rb->high_watermark = high_watermark;
+    if (rb->bcast_readers) {
+        for (int i = 0; i < rb->bcast_readers_num; i++) {
+            rb->bcast_readers[i]->high_watermark = high_watermark;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t rb_set_reader_notify(ringbuf_handle_t rb, rb_notify_func notify, void *ctx)
+{
+    if (rb == NULL || rb->bcast_readers) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    /* The context is published by the release store of the callback */
+    atomic_store_explicit(&rb->rd_notify, NULL, memory_order_relaxed);
+    rb->rd_notify_ctx = ctx;
+    atomic_store_explicit(&rb->rd_notify, notify, memory_order_release);
+    return ESP_OK;
+}
+
+esp_err_t rb_set_writer_notify(ringbuf_handle_t rb, rb_notify_func notify, void *ctx)
+{
+    if (rb == NULL || rb->bcast_owner) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    atomic_store_explicit(&rb->wr_notify, NULL, memory_order_relaxed);
+    rb->wr_notify_ctx = ctx;
+    atomic_store_explicit(&rb->wr_notify, notify, memory_order_release);
+    return ESP_OK;
+}
+
+bool rb_read_ready(ringbuf_handle_t rb, int len)
+{
+    if (rb == NULL) {
+        return false;
+    }
+    if (rb->is_done_write || rb->abort_read || rb->unblock_reader_flag) {
+        return true;
+    }
+    if (rb->desc) {
+        return rb->desc_rd_cur || rb_desc_queued(rb) > 0;
+    }
+    if (rb->packet) {
+        /* Records are published whole */
+        return rb_fill_cnt(rb) > 0;
+    }
+    uint32_t need = len > 0 ? len : 1;
+    return rb_fill_cnt(rb) >= (need < rb->size ? need : rb->size);
+}
+
+bool rb_write_ready(ringbuf_handle_t rb, int len)
+{
+    if (rb == NULL) {
+        return false;
+    }
+    if (rb->is_done_write || rb->abort_write) {
+        return true;
+    }
+    if (rb->desc) {
+        return rb_desc_queued(rb) <= rb->desc_mask
+               && (rb->desc_wr_cur || audio_buf_pool_get_free(rb->desc_pool) > 0);
+    }
+    uint32_t need = len > 0 ? len : 1;
+    if (rb->packet) {
+        need += sizeof(rb_packet_hdr_t);
+    }
+    return rb->size - rb_fill_cnt(rb) >= (need < rb->size ? need : rb->size);
+}
+
+#if CONFIG_RINGBUF_STATS
+esp_err_t rb_get_stats(ringbuf_handle_t rb, rb_stats_t *stats)
+{
+    if (rb == NULL || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t filled = rb_fill_cnt(rb);
+    uint32_t fill_min = atomic_load_explicit(&rb->fill_min, memory_order_relaxed);
+    uint32_t fill_max = atomic_load_explicit(&rb->fill_max, memory_order_relaxed);
+    stats->size = rb->size;
+    stats->filled = filled;
+    /* Either bound may lag a read or write in flight, the range always holds the level it is reported with */
+    stats->fill_min = fill_min < filled ? fill_min : filled;
+    stats->fill_max = fill_max > filled ? fill_max : filled;
+    stats->bytes_read = atomic_load_explicit(&rb->rd_bytes, memory_order_relaxed);
+    stats->bytes_written = atomic_load_explicit(&rb->wr_bytes, memory_order_relaxed);
+    stats->reader_waits = atomic_load_explicit(&rb->rd_waits, memory_order_relaxed);
+    stats->reader_wakeups = atomic_load_explicit(&rb->rd_wakeups, memory_order_relaxed);
+    stats->reader_wait_ns = atomic_load_explicit(&rb->rd_wait_ns, memory_order_relaxed);
+    stats->writer_waits = atomic_load_explicit(&rb->wr_waits, memory_order_relaxed);
+    stats->writer_wakeups = atomic_load_explicit(&rb->wr_wakeups, memory_order_relaxed);
+    stats->writer_wait_ns = atomic_load_explicit(&rb->wr_wait_ns, memory_order_relaxed);
+    return ESP_OK;
+}
+
+esp_err_t rb_reset_fill_range(ringbuf_handle_t rb)
+{
+    if (rb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t filled = rb_fill_cnt(rb);
+    atomic_store_explicit(&rb->fill_min, filled, memory_order_relaxed);
+    atomic_store_explicit(&rb->fill_max, filled, memory_order_relaxed);
+    return ESP_OK;
+}
+#else
+esp_err_t rb_get_stats(ringbuf_handle_t rb, rb_stats_t *stats)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t rb_reset_fill_range(ringbuf_handle_t rb)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif /* CONFIG_RINGBUF_STATS */
+
+esp_err_t rb_set_timestamp(ringbuf_handle_t rb, int64_t pts, int64_t origin_ns)
+{
+    if (rb == NULL || rb->bcast_owner) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t head = atomic_load_explicit(&rb->ts_head, memory_order_relaxed);
+    rb_ts_mark_t *mark = &rb->ts_marks[head % RB_TIMESTAMP_MARKS];
+    uint32_t seq = atomic_load_explicit(&mark->seq, memory_order_relaxed);
+    atomic_store_explicit(&mark->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&mark->pos, atomic_load_explicit(&rb->wr_pos, memory_order_relaxed), memory_order_relaxed);
+    atomic_store_explicit(&mark->pts, pts, memory_order_relaxed);
+    atomic_store_explicit(&mark->origin_ns, origin_ns, memory_order_relaxed);
+    atomic_store_explicit(&mark->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&rb->ts_head, head + 1, memory_order_release);
+    return ESP_OK;
+}
+
+esp_err_t rb_get_timestamp(ringbuf_handle_t rb, rb_timestamp_t *ts)
+{
+    if (rb == NULL || ts == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ringbuf_handle_t writer = rb->bcast_owner ? rb->bcast_owner : rb;
+    uint32_t head = atomic_load_explicit(&writer->ts_head, memory_order_acquire);
+    uint32_t n = head < RB_TIMESTAMP_MARKS ? head : RB_TIMESTAMP_MARKS;
+    /* Stamps are in stream order, the newest one at or before the byte is the one that holds */
+    for (uint32_t i = 1; i <= n; i++) {
+        rb_ts_mark_t *mark = &writer->ts_marks[(head - i) % RB_TIMESTAMP_MARKS];
+        uint32_t seq = atomic_load_explicit(&mark->seq, memory_order_acquire);
+        uint64_t pos = atomic_load_explicit(&mark->pos, memory_order_relaxed);
+        int64_t pts = atomic_load_explicit(&mark->pts, memory_order_relaxed);
+        int64_t origin_ns = atomic_load_explicit(&mark->origin_ns, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if ((seq & 1) || seq != atomic_load_explicit(&mark->seq, memory_order_relaxed)) {
+            /* Reused for a newer stamp, older slots are no better */
+            break;
+        }
+        if (pos <= rb->rd_last) {
+            if (!rb->rd_mark_valid || pos >= rb->rd_mark_pos) {
+                rb->rd_mark_pos = pos;
+                rb->rd_mark.pts = pts;
+                rb->rd_mark.origin_ns = origin_ns;
+                rb->rd_mark_valid = true;
+            }
+            break;
+        }
+    }
+    if (!rb->rd_mark_valid || rb->rd_mark_pos > rb->rd_last) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *ts = rb->rd_mark;
+    ts->offset = rb->rd_last - rb->rd_mark_pos;
+    return ESP_OK;
+}
@@ -0,0 +1,286 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_log.h"
+#include "audio_mem.h"
+#include "audio_error.h"
+#include "audio_mutex.h"
+#include "audio_arena.h"
+
+static const char *TAG = "AUDIO_ARENA";
+
+#define ARENA_MIN_SHIFT     (4)                                 /* Smallest class is 16 bytes */
+#define ARENA_CLASSES       (31 - ARENA_MIN_SHIFT)
+#define ARENA_ALIGN(x)      (((x) + 15) & ~(size_t)15)
+
+/* Placed right in front of every block, 16 bytes so that the block stays aligned */
+typedef struct {
+    audio_arena_handle_t        arena;          /* NULL for a block from the heap */
+    uint32_t                    cls;
+    uint32_t                    reserved;
+} audio_arena_block_t;
+
+typedef struct audio_arena_chunk {
+    struct audio_arena_chunk    *next;
+    size_t                      size;           /* Bytes after the chunk header */
+    size_t                      used;
+} audio_arena_chunk_t;
+
+#define ARENA_BLOCK_HDR     ARENA_ALIGN(sizeof(audio_arena_block_t))
+#define ARENA_CHUNK_HDR     ARENA_ALIGN(sizeof(audio_arena_chunk_t))
+
+struct audio_arena {
+    pthread_mutex_t             *lock;
+    size_t                      chunk_size;
+    audio_arena_chunk_t         *chunks;        /* Bump allocation happens in the first one */
+    void                        *free_list[ARENA_CLASSES];  /* Freed blocks, linked through their first word */
+    int                         refs;           /* Handle references plus blocks in use */
+    size_t                      reserved;
+    size_t                      used;
+};
+
+static inline void *arena_block_data(audio_arena_block_t *hdr)
+{
+    return (char *)hdr + ARENA_BLOCK_HDR;
+}
+
+static inline audio_arena_block_t *arena_block_hdr(void *ptr)
+{
+    return (audio_arena_block_t *)((char *)ptr - ARENA_BLOCK_HDR);
+}
+
+static inline size_t arena_class_size(int cls)
+{
+    return (size_t)1 << (cls + ARENA_MIN_SHIFT);
+}
+
+static int arena_size_class(size_t size)
+{
+    int cls = 0;
+    while (cls < ARENA_CLASSES && arena_class_size(cls) < size) {
+        cls++;
+    }
+    return cls;
+}
+
+static void arena_release(audio_arena_handle_t arena)
+{
+    audio_arena_chunk_t *chunk = arena->chunks;
+    while (chunk) {
+        audio_arena_chunk_t *next = chunk->next;
+        audio_free(chunk);
+        chunk = next;
+    }
+    if (arena->lock) {
+        mutex_destroy(arena->lock);
+    }
+    ESP_LOGD(TAG, "Released %p, %zu bytes", arena, arena->reserved);
+    audio_free(arena);
+}
+
+static void arena_unref_locked(audio_arena_handle_t arena)
+{
+    bool last = (--arena->refs == 0);
+    mutex_unlock(arena->lock);
+    if (last) {
+        arena_release(arena);
+    }
+}
+
+/* Hand the unused tail of the bump chunk to the free lists before it is left behind */
+static void arena_retire_tail(audio_arena_handle_t arena, audio_arena_chunk_t *chunk)
+{
+    for (int cls = ARENA_CLASSES - 1; cls >= 0; cls--) {
+        size_t bytes = ARENA_BLOCK_HDR + arena_class_size(cls);
+        while (chunk->size - chunk->used >= bytes) {
+            audio_arena_block_t *hdr = (audio_arena_block_t *)((char *)chunk + ARENA_CHUNK_HDR + chunk->used);
+            chunk->used += bytes;
+            hdr->arena = arena;
+            hdr->cls = cls;
+            *(void **)arena_block_data(hdr) = arena->free_list[cls];
+            arena->free_list[cls] = arena_block_data(hdr);
+        }
+    }
+}
+
+static audio_arena_block_t *arena_carve(audio_arena_handle_t arena, size_t bytes)
+{
+    audio_arena_chunk_t *chunk = arena->chunks;
+    if (chunk == NULL || chunk->size - chunk->used < bytes) {
+        size_t size = bytes > arena->chunk_size ? bytes : arena->chunk_size;
+        audio_arena_chunk_t *fresh = audio_malloc(ARENA_CHUNK_HDR + size);
+        if (fresh == NULL) {
+            return NULL;
+        }
+        fresh->size = size;
+        fresh->used = 0;
+        arena->reserved += ARENA_CHUNK_HDR + size;
+        if (chunk && size > arena->chunk_size) {
+            /* An oversized block fills its own chunk, keep bumping in the current one */
+            fresh->next = chunk->next;
+            chunk->next = fresh;
+        } else {
+            if (chunk) {
+                arena_retire_tail(arena, chunk);
+            }
+            fresh->next = chunk;
+            arena->chunks = fresh;
+        }
+        chunk = fresh;
+    }
+    audio_arena_block_t *hdr = (audio_arena_block_t *)((char *)chunk + ARENA_CHUNK_HDR + chunk->used);
+    chunk->used += bytes;
+    return hdr;
+}
+
+audio_arena_handle_t audio_arena_create(int chunk_size)
+{
+    if (chunk_size <= 0) {
+        ESP_LOGE(TAG, "Invalid chunk size %d", chunk_size);
+        return NULL;
+    }
+    audio_arena_handle_t arena = audio_calloc(1, sizeof(struct audio_arena));
+    AUDIO_MEM_CHECK(TAG, arena, return NULL);
+    arena->lock = mutex_create();
+    AUDIO_MEM_CHECK(TAG, arena->lock, {
+        audio_free(arena);
+        return NULL;
+    });
+    arena->chunk_size = ARENA_ALIGN((size_t)chunk_size);
+    arena->refs = 1;
+    return arena;
+}
+
+esp_err_t audio_arena_destroy(audio_arena_handle_t arena)
+{
+    if (arena == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    mutex_lock(arena->lock);
+    arena_unref_locked(arena);
+    return ESP_OK;
+}
+
+audio_arena_handle_t audio_arena_ref(audio_arena_handle_t arena)
+{
+    if (arena) {
+        mutex_lock(arena->lock);
+        arena->refs++;
+        mutex_unlock(arena->lock);
+    }
+    return arena;
+}
+
+void *audio_arena_malloc(audio_arena_handle_t arena, size_t size)
+{
+    audio_arena_block_t *hdr;
+    if (arena == NULL) {
+        hdr = audio_malloc(ARENA_BLOCK_HDR + size);
+        AUDIO_MEM_CHECK(TAG, hdr, return NULL);
+        hdr->arena = NULL;
+        return arena_block_data(hdr);
+    }
+    int cls = arena_size_class(size);
+    if (cls >= ARENA_CLASSES) {
+        ESP_LOGE(TAG, "Block of %zu bytes is too large", size);
+        return NULL;
+    }
+    mutex_lock(arena->lock);
+    void *ptr = arena->free_list[cls];
+    if (ptr) {
+        arena->free_list[cls] = *(void **)ptr;
+    } else {
+        hdr = arena_carve(arena, ARENA_BLOCK_HDR + arena_class_size(cls));
+        if (hdr) {
+            hdr->arena = arena;
+            hdr->cls = cls;
+            ptr = arena_block_data(hdr);
+        }
+    }
+    if (ptr) {
+        /* A block in use keeps the arena alive */
+        arena->refs++;
+        arena->used += arena_class_size(cls);
+    }
+    mutex_unlock(arena->lock);
+    AUDIO_MEM_CHECK(TAG, ptr, return NULL);
+    return ptr;
+}
+
+void *audio_arena_calloc(audio_arena_handle_t arena, size_t nmemb, size_t size)
+{
+    if (size && nmemb > SIZE_MAX / size) {
+        return NULL;
+    }
+    void *ptr = audio_arena_malloc(arena, nmemb * size);
+    if (ptr) {
+        memset(ptr, 0, nmemb * size);
+    }
+    return ptr;
+}
+
+void audio_arena_free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    audio_arena_block_t *hdr = arena_block_hdr(ptr);
+    audio_arena_handle_t arena = hdr->arena;
+    if (arena == NULL) {
+        audio_free(hdr);
+        return;
+    }
+    int cls = hdr->cls;
+    mutex_lock(arena->lock);
+    *(void **)ptr = arena->free_list[cls];
+    arena->free_list[cls] = ptr;
+    arena->used -= arena_class_size(cls);
+    arena_unref_locked(arena);
+}
+
+int audio_arena_get_reserved(audio_arena_handle_t arena)
+{
+    if (arena == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    mutex_lock(arena->lock);
+    int reserved = arena->reserved;
+    mutex_unlock(arena->lock);
+    return reserved;
+}
+
+int audio_arena_get_used(audio_arena_handle_t arena)
+{
+    if (arena == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    mutex_lock(arena->lock);
+    int used = arena->used;
+    mutex_unlock(arena->lock);
+    return used;
+}
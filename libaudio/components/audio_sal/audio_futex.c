@@ -0,0 +1,56 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) CO., LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "audio_futex.h"
+#include "audio_time.h"
+
+int audio_futex_wait(volatile uint32_t *uaddr, uint32_t expected, const struct timespec *abs_timeout)
+{
+    /* FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC deadline, so EINTR can simply retry */
+    while (syscall(SYS_futex, uaddr, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, expected,
+                   abs_timeout, NULL, FUTEX_BITSET_MATCH_ANY) != 0) {
+        if (errno == ETIMEDOUT) {
+            return ETIMEDOUT;
+        }
+        if (errno != EINTR) {
+            break;
+        }
+    }
+    return 0;
+}
+
+int audio_futex_wake(volatile uint32_t *uaddr, int nr_wake)
+{
+    long ret = syscall(SYS_futex, uaddr, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, nr_wake, NULL, NULL, 0);
+    return ret < 0 ? 0 : (int)ret;
+}
+
+struct timespec *audio_futex_deadline(struct timespec *ts, TickType_t ticks)
+{
+    return audio_time_deadline(ts, CLOCK_MONOTONIC, ticks);
+}
@@ -22,64 +22,244 @@
  *
  */
 
+#define _GNU_SOURCE
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <malloc.h>
+#include <execinfo.h>
 #include "string.h"
 #include "sdkconfig.h"
 #include "esp_log.h"
 #include "audio_mem.h"
+#include "audio_time.h"
 
 #undef CONFIG_SPIRAM_BOOT_INIT
-#define ENABLE_AUDIO_MEM_TRACE
 
+#ifndef CONFIG_AUDIO_MEM_ACCOUNTING
+# define CONFIG_AUDIO_MEM_ACCOUNTING 1
+#endif
+
+#ifndef CONFIG_AUDIO_MEM_SITES
+# define CONFIG_AUDIO_MEM_SITES 256         /* Power of 2, call sites past this are counted under "other" */
+#endif
+
+#ifndef CONFIG_AUDIO_MEM_SAMPLES
+# define CONFIG_AUDIO_MEM_SAMPLES 64
+#endif
+
+#ifndef CONFIG_AUDIO_MEM_SHOW_SITES
+# define CONFIG_AUDIO_MEM_SHOW_SITES 8
+#endif
+
+#define AUDIO_MEM_BT_DEPTH      (8)
+#define AUDIO_MEM_NO_SAMPLE     (0xffff)
+#define AUDIO_MEM_CHECK_SALT    (0x5a3c96e1u)
+
+#if CONFIG_AUDIO_MEM_ACCOUNTING
+
+/*
+ * Every block is allocated 8 bytes larger and the last 8 usable bytes hold a trailer naming the call site. A block
+ * whose trailer does not check out was not allocated here (malloc'd by a library and released with audio_free), it is
+ * freed without being counted. Nothing is placed in front of the block, so mixing with malloc/free stays harmless.
+ */
+typedef struct {
+    uint32_t    check;
+    uint16_t    site;
+    uint16_t    sample;
+} audio_mem_trailer_t;
+
+typedef struct {
+    _Atomic(uintptr_t)  addr;           /* Return address of the caller, 0 while the slot is free */
+    atomic_long         live;
+    atomic_long         peak;
+    atomic_llong        allocs;
+    atomic_llong        frees;
+    long long           shown_allocs;   /* Allocation count at the last audio_mem_print, for the rate */
+} audio_mem_site_t;
+
+typedef struct {
+    _Atomic(void *)     ptr;            /* NULL while the slot is free */
+    size_t              size;
+    int                 depth;
+    void                *frames[AUDIO_MEM_BT_DEPTH];
+} audio_mem_sample_t;
+
+static audio_mem_site_t     s_sites[CONFIG_AUDIO_MEM_SITES];    /* Slot 0 is the total, the last one "other" */
+static audio_mem_sample_t   s_samples[CONFIG_AUDIO_MEM_SAMPLES];
+static atomic_int           s_sample_rate;
+static atomic_uint          s_sample_tick;
+static int64_t              s_shown_time;
+
+#define AUDIO_MEM_TOTAL         (&s_sites[0])
+#define AUDIO_MEM_OTHER         (CONFIG_AUDIO_MEM_SITES - 1)
+
+static inline uint32_t audio_mem_check(const void *ptr, uint16_t site, uint16_t sample)
+{
+    uint32_t h = (uint32_t)((uintptr_t)ptr >> 4) ^ (uint32_t)((uint64_t)(uintptr_t)ptr >> 32);
+    return (h * 0x9e3779b1u) ^ AUDIO_MEM_CHECK_SALT ^ ((uint32_t)site << 16) ^ sample;
+}
+
+static uint16_t audio_mem_site_index(const void *caller)
+{
+    uintptr_t addr = (uintptr_t)caller;
+    uint32_t idx = (uint32_t)((addr >> 2) * 0x9e3779b1u) % (AUDIO_MEM_OTHER - 1) + 1;
+    for (int probe = 0; probe < AUDIO_MEM_OTHER - 1; probe++) {
+        audio_mem_site_t *site = &s_sites[idx];
+        uintptr_t cur = atomic_load_explicit(&site->addr, memory_order_acquire);
+        if (cur == addr) {
+            return idx;
+        }
+        if (cur == 0) {
+            uintptr_t expected = 0;
+            if (atomic_compare_exchange_strong_explicit(&site->addr, &expected, addr,
+                                                        memory_order_acq_rel, memory_order_acquire)
+                || expected == addr) {
+                return idx;
+            }
+        }
+        idx = idx + 1 < AUDIO_MEM_OTHER ? idx + 1 : 1;
+    }
+    return AUDIO_MEM_OTHER;
+}
+
+static inline void audio_mem_site_add(audio_mem_site_t *site, long bytes)
+{
+    long live = atomic_fetch_add_explicit(&site->live, bytes, memory_order_relaxed) + bytes;
+    long peak = atomic_load_explicit(&site->peak, memory_order_relaxed);
+    while (live > peak
+           && !atomic_compare_exchange_weak_explicit(&site->peak, &peak, live, memory_order_relaxed, memory_order_relaxed)) {
+    }
+    atomic_fetch_add_explicit(&site->allocs, 1, memory_order_relaxed);
+}
+
+static inline void audio_mem_site_sub(audio_mem_site_t *site, long bytes)
+{
+    atomic_fetch_sub_explicit(&site->live, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&site->frees, 1, memory_order_relaxed);
+}
+
+static uint16_t audio_mem_sample(void *ptr, size_t size)
+{
+    int rate = atomic_load_explicit(&s_sample_rate, memory_order_relaxed);
+    if (rate <= 0 || atomic_fetch_add_explicit(&s_sample_tick, 1, memory_order_relaxed) % rate) {
+        return AUDIO_MEM_NO_SAMPLE;
+    }
+    for (int i = 0; i < CONFIG_AUDIO_MEM_SAMPLES; i++) {
+        void *expected = NULL;
+        audio_mem_sample_t *sample = &s_samples[i];
+        if (atomic_load_explicit(&sample->ptr, memory_order_relaxed) == NULL
+            && atomic_compare_exchange_strong_explicit(&sample->ptr, &expected, (void *)1,
+                                                       memory_order_acquire, memory_order_relaxed)) {
+            /* Claimed with a placeholder, published once the backtrace is in */
+            sample->size = size;
+            sample->depth = backtrace(sample->frames, AUDIO_MEM_BT_DEPTH);
+            atomic_store_explicit(&sample->ptr, ptr, memory_order_release);
+            return i;
+        }
+    }
+    return AUDIO_MEM_NO_SAMPLE;
+}
+
+/* Account a block handed out for `caller`, `ptr` was allocated 8 bytes larger than asked */
+static void *audio_mem_track(void *ptr, const void *caller)
+{
+    if (ptr == NULL) {
+        return NULL;
+    }
+    size_t usable = malloc_usable_size(ptr);
+    audio_mem_trailer_t trailer;
+    trailer.site = audio_mem_site_index(caller);
+    trailer.sample = audio_mem_sample(ptr, usable - sizeof(trailer));
+    trailer.check = audio_mem_check(ptr, trailer.site, trailer.sample);
+    memcpy((char *)ptr + usable - sizeof(trailer), &trailer, sizeof(trailer));
+    audio_mem_site_add(AUDIO_MEM_TOTAL, usable);
+    audio_mem_site_add(&s_sites[trailer.site], usable);
+    return ptr;
+}
+
+/* Undo audio_mem_track, false for a block that was not allocated here */
+static bool audio_mem_untrack(void *ptr)
+{
+    size_t usable = malloc_usable_size(ptr);
+    audio_mem_trailer_t trailer;
+    if (usable < sizeof(trailer)) {
+        return false;
+    }
+    memcpy(&trailer, (char *)ptr + usable - sizeof(trailer), sizeof(trailer));
+    if (trailer.check != audio_mem_check(ptr, trailer.site, trailer.sample) || trailer.site >= CONFIG_AUDIO_MEM_SITES) {
+        return false;
+    }
+    /* A stale trailer must not match again once the memory is reused */
+    memset((char *)ptr + usable - sizeof(trailer), 0, sizeof(trailer));
+    if (trailer.sample < CONFIG_AUDIO_MEM_SAMPLES) {
+        void *expected = ptr;
+        atomic_compare_exchange_strong_explicit(&s_samples[trailer.sample].ptr, &expected, NULL,
+                                                memory_order_release, memory_order_relaxed);
+    }
+    audio_mem_site_sub(AUDIO_MEM_TOTAL, usable);
+    audio_mem_site_sub(&s_sites[trailer.site], usable);
+    return true;
+}
+
+#define AUDIO_MEM_EXTRA         sizeof(audio_mem_trailer_t)
+#define AUDIO_MEM_TRACK(p)      audio_mem_track(p, __builtin_return_address(0))
+#define AUDIO_MEM_UNTRACK(p)    audio_mem_untrack(p)
+
+#else
+
+#define AUDIO_MEM_EXTRA         0
+#define AUDIO_MEM_TRACK(p)      (p)
+#define AUDIO_MEM_UNTRACK(p)    (true)
+
+#endif /* CONFIG_AUDIO_MEM_ACCOUNTING */
 
 void *audio_malloc(size_t size)
 {
-    void *data =  NULL;
-    data = malloc(size);
-#ifdef ENABLE_AUDIO_MEM_TRACE
-    ESP_LOGI("AUDIO_MEM", "malloc:%p, size:%d, called:0x%08x", data, size, (intptr_t)__builtin_return_address(0) - 2);
-#endif
-    return data;
+    return AUDIO_MEM_TRACK(malloc(size + AUDIO_MEM_EXTRA));
 }
 
 void audio_free(void *ptr)
 {
+    if (ptr) {
+        (void)AUDIO_MEM_UNTRACK(ptr);
+    }
     free(ptr);
-#ifdef ENABLE_AUDIO_MEM_TRACE
-    ESP_LOGI("AUIDO_MEM", "free:%p, called:0x%08x", ptr, (intptr_t)__builtin_return_address(0) - 2);
-#endif
 }
 
 void *audio_calloc(size_t nmemb, size_t size)
 {
-    void *data =  NULL;
-    data = calloc(nmemb, size);
-#ifdef ENABLE_AUDIO_MEM_TRACE
-    ESP_LOGI("AUIDO_MEM", "calloc:%p, size:%d, called:0x%08x", data, size, (intptr_t)__builtin_return_address(0) - 2);
-#endif
-    return data;
+    if (size && nmemb > (SIZE_MAX - AUDIO_MEM_EXTRA) / size) {
+        return NULL;
+    }
+    return AUDIO_MEM_TRACK(calloc(1, nmemb * size + AUDIO_MEM_EXTRA));
 }
 
 void *audio_realloc(void *ptr, size_t size)
 {
-    void *p = NULL;
-    p = realloc(ptr, size);
-#ifdef ENABLE_AUDIO_MEM_TRACE
-    ESP_LOGI("AUDIO_MEM", "realloc,new:%p, ptr:%p size:%d, called:0x%08x", p, ptr, size, (intptr_t)__builtin_return_address(0) - 2);
-#endif
-    return p;
+    if (ptr == NULL) {
+        return AUDIO_MEM_TRACK(malloc(size + AUDIO_MEM_EXTRA));
+    }
+    /* Taken off the books first, on failure the old block is still valid and goes back on them */
+    bool tracked = AUDIO_MEM_UNTRACK(ptr);
+    void *p = realloc(ptr, size + AUDIO_MEM_EXTRA);
+    if (p == NULL) {
+        if (tracked) {
+            (void)AUDIO_MEM_TRACK(ptr);
+        }
+        return NULL;
+    }
+    return AUDIO_MEM_TRACK(p);
 }
 
 char *audio_strdup(const char *str)
 {
-    char *copy = malloc(strlen(str) + 1);
+    size_t len = strlen(str) + 1;
+    char *copy = malloc(len + AUDIO_MEM_EXTRA);
     if (copy) {
-        strcpy(copy, str);
+        memcpy(copy, str, len);
     }
-#ifdef ENABLE_AUDIO_MEM_TRACE
-    ESP_LOGI("AUDIO_MEM", "strdup:%p, size:%d, called:0x%08x", copy, strlen(copy), (intptr_t)__builtin_return_address(0) - 2);
-#endif
-    return copy;
+    return AUDIO_MEM_TRACK(copy);
 }
 
 void *audio_calloc_inner(size_t n, size_t size)
@@ -87,15 +267,127 @@ void *audio_calloc_inner(size_t n, size_t size)
     void *data =  NULL;
     ESP_LOGE("AUIDO_MEM","ESWIN_PROTING_TODO: %s is not implemented","audio_calloc_inner");
     // data = heap_caps_calloc(n, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-#ifdef ENABLE_AUDIO_MEM_TRACE
-    ESP_LOGI("AUIDO_MEM", "calloc_inner:%p, size:%d, called:0x%08x", data, size, (intptr_t)__builtin_return_address(0) - 2);
-#endif
     return data;
 }
 
+#if CONFIG_AUDIO_MEM_ACCOUNTING
+static void audio_mem_load(audio_mem_site_t *site, audio_mem_stats_t *stats)
+{
+    uintptr_t addr = atomic_load_explicit(&site->addr, memory_order_acquire);
+    stats->site = (const void *)addr;
+    stats->live_bytes = atomic_load_explicit(&site->live, memory_order_relaxed);
+    stats->peak_bytes = atomic_load_explicit(&site->peak, memory_order_relaxed);
+    stats->allocs = atomic_load_explicit(&site->allocs, memory_order_relaxed);
+    stats->frees = atomic_load_explicit(&site->frees, memory_order_relaxed);
+}
+#endif
+
+esp_err_t audio_mem_get_stats(audio_mem_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(stats, 0, sizeof(*stats));
+#if CONFIG_AUDIO_MEM_ACCOUNTING
+    audio_mem_load(AUDIO_MEM_TOTAL, stats);
+    stats->site = NULL;
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+int audio_mem_get_site_stats(audio_mem_stats_t *sites, int max_sites)
+{
+    int n = 0;
+    if (sites == NULL || max_sites <= 0) {
+        return 0;
+    }
+#if CONFIG_AUDIO_MEM_ACCOUNTING
+    for (int i = 1; i < CONFIG_AUDIO_MEM_SITES; i++) {
+        audio_mem_stats_t cur;
+        audio_mem_load(&s_sites[i], &cur);
+        if (cur.allocs == 0) {
+            continue;
+        }
+        if (i == AUDIO_MEM_OTHER) {
+            cur.site = NULL;
+        }
+        /* Keep the `max_sites` largest by live bytes, in descending order */
+        int pos = n < max_sites ? n++ : max_sites;
+        while (pos > 0 && sites[pos - 1].live_bytes < cur.live_bytes) {
+            if (pos < max_sites) {
+                sites[pos] = sites[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < max_sites) {
+            sites[pos] = cur;
+        }
+    }
+#endif
+    return n;
+}
+
+void audio_mem_set_sample_rate(int rate)
+{
+#if CONFIG_AUDIO_MEM_ACCOUNTING
+    atomic_store_explicit(&s_sample_rate, rate > 0 ? rate : 0, memory_order_relaxed);
+#endif
+}
+
+int audio_mem_dump_samples(const char *tag)
+{
+    int n = 0;
+#if CONFIG_AUDIO_MEM_ACCOUNTING
+    for (int i = 0; i < CONFIG_AUDIO_MEM_SAMPLES; i++) {
+        audio_mem_sample_t *sample = &s_samples[i];
+        void *ptr = atomic_load_explicit(&sample->ptr, memory_order_acquire);
+        if (ptr == NULL || ptr == (void *)1) {
+            continue;
+        }
+        n++;
+        ESP_LOGI(tag, "Live sample %p, %zu bytes", ptr, sample->size);
+        char **symbols = backtrace_symbols(sample->frames, sample->depth);
+        for (int f = 0; symbols && f < sample->depth; f++) {
+            ESP_LOGI(tag, "    #%d %s", f, symbols[f]);
+        }
+        free(symbols);
+    }
+#endif
+    return n;
+}
+
 void audio_mem_print(const char *tag, int line, const char *func)
 {
-    ESP_LOGI(tag, "Func:%s, Line:%d, ESWIN_PROTING_TODO :'MEM Total :%d Bytes' is not implemented\r\n", func, line, 0);
+#if CONFIG_AUDIO_MEM_ACCOUNTING
+    audio_mem_stats_t total;
+    audio_mem_stats_t sites[CONFIG_AUDIO_MEM_SHOW_SITES];
+    audio_mem_get_stats(&total);
+    int n = audio_mem_get_site_stats(sites, CONFIG_AUDIO_MEM_SHOW_SITES);
+    int64_t now = audio_time_now_ns();
+    int64_t elapsed = s_shown_time ? now - s_shown_time : 0;
+    s_shown_time = now;
+    ESP_LOGI(tag, "Func:%s, Line:%d, MEM Total:%ld Bytes, peak:%ld, allocs:%lld, frees:%lld",
+             func, line, total.live_bytes, total.peak_bytes, total.allocs, total.frees);
+    for (int i = 0; i < n; i++) {
+        /* Rate since the previous print, the slot is found again from the address */
+        long long rate = 0;
+        if (sites[i].site) {
+            uint16_t idx = audio_mem_site_index(sites[i].site);
+            if (elapsed > 0) {
+                rate = (sites[i].allocs - s_sites[idx].shown_allocs) * 1000000000LL / elapsed;
+            }
+            s_sites[idx].shown_allocs = sites[i].allocs;
+        }
+        char **symbol = sites[i].site ? backtrace_symbols((void *const *)&sites[i].site, 1) : NULL;
+        ESP_LOGI(tag, "    %ld Bytes, peak:%ld, allocs:%lld (%lld/s), frees:%lld, %s", sites[i].live_bytes,
+                 sites[i].peak_bytes, sites[i].allocs, rate, sites[i].frees, symbol ? symbol[0] : "other");
+        free(symbol);
+    }
+#else
+    ESP_LOGI(tag, "Func:%s, Line:%d, MEM accounting is disabled", func, line);
+#endif
 }
 
 #if defined (CONFIG_SPIRAM_BOOT_INIT)
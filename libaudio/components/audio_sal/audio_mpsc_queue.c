@@ -0,0 +1,311 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "audio_mem.h"
+#include "audio_error.h"
+#include "audio_futex.h"
+#include "audio_time.h"
+#include "audio_mpsc_queue.h"
+#include "esp_log.h"
+
+static const char *TAG = "AUDIO_MPSC_QUEUE";
+
+/*
+ * Bounded ring of slots with a sequence number each (D. Vyukov). A slot is free for the send at position `pos`
+ * once its sequence reads `pos`, and holds the item for the receive at `pos` once it reads `pos + 1`. Senders claim
+ * positions with a CAS on `head`; receives take `tail` the same way, so a discard from another thread stays safe.
+ * The ring is a power of 2 for the index mask, `len` keeps the capacity the caller asked for.
+ */
+typedef struct {
+    _Atomic uint32_t            seq;
+} audio_mpsc_slot_t;
+
+struct audio_mpsc_queue {
+    _Atomic uint32_t            head;           /* Next position to send to */
+    _Atomic uint32_t            tail;           /* Next position to receive from */
+    _Atomic uint32_t            sent;           /* Futex word, bumped on every send */
+    _Atomic uint32_t            received;       /* Futex word, bumped on every receive */
+    _Atomic uint32_t            recv_waiters;
+    _Atomic uint32_t            send_waiters;
+    uint32_t                    len;
+    uint32_t                    mask;
+    uint32_t                    item_size;
+    uint32_t                    slot_size;
+    bool                        nonblock;
+    char                        *slots;
+    _Atomic int                 fd;             /* eventfd for poll(), -1 until asked for */
+    _Atomic uint32_t            fd_armed;       /* The consumer found the queue empty, next send signals the fd */
+    pthread_mutex_t             fd_lock;
+};
+
+static inline audio_mpsc_slot_t *audio_mpsc_slot(audio_mpsc_queue_handle_t q, uint32_t pos)
+{
+    return (audio_mpsc_slot_t *)(q->slots + (size_t)(pos & q->mask) * q->slot_size);
+}
+
+audio_mpsc_queue_handle_t audio_mpsc_queue_create(uint32_t queue_len, uint32_t item_size, bool nonblock)
+{
+    if (queue_len == 0 || queue_len > (1u << 30) || item_size == 0) {
+        return NULL;
+    }
+    uint32_t size = 1;
+    while (size < queue_len) {
+        size <<= 1;
+    }
+    audio_mpsc_queue_handle_t q = audio_calloc(1, sizeof(struct audio_mpsc_queue));
+    AUDIO_MEM_CHECK(TAG, q, return NULL);
+    q->len = queue_len;
+    q->mask = size - 1;
+    q->item_size = item_size;
+    q->slot_size = (sizeof(audio_mpsc_slot_t) + item_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    q->nonblock = nonblock;
+    atomic_init(&q->fd, -1);
+    pthread_mutex_init(&q->fd_lock, NULL);
+    q->slots = audio_calloc(size, q->slot_size);
+    AUDIO_MEM_CHECK(TAG, q->slots, {
+        audio_free(q);
+        return NULL;
+    });
+    for (uint32_t i = 0; i < size; i++) {
+        atomic_init(&audio_mpsc_slot(q, i)->seq, i);
+    }
+    return q;
+}
+
+void audio_mpsc_queue_destroy(audio_mpsc_queue_handle_t q)
+{
+    if (q) {
+        if (atomic_load(&q->fd) >= 0) {
+            close(atomic_load(&q->fd));
+        }
+        pthread_mutex_destroy(&q->fd_lock);
+        audio_free(q->slots);
+        audio_free(q);
+    }
+}
+
+static bool audio_mpsc_try_send(audio_mpsc_queue_handle_t q, const void *item)
+{
+    uint32_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    for (;;) {
+        audio_mpsc_slot_t *slot = audio_mpsc_slot(q, pos);
+        int32_t diff = (int32_t)(atomic_load_explicit(&slot->seq, memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (pos - atomic_load_explicit(&q->tail, memory_order_acquire) >= q->len) {
+                return false;
+            }
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                memcpy(slot + 1, item, q->item_size);
+                atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+}
+
+static bool audio_mpsc_try_recv(audio_mpsc_queue_handle_t q, void *item)
+{
+    uint32_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    for (;;) {
+        audio_mpsc_slot_t *slot = audio_mpsc_slot(q, pos);
+        int32_t diff = (int32_t)(atomic_load_explicit(&slot->seq, memory_order_acquire) - (pos + 1));
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                memcpy(item, slot + 1, q->item_size);
+                atomic_store_explicit(&slot->seq, pos + q->mask + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+}
+
+/*
+ * Retry the send or receive until it succeeds or the deadline passes. The futex word is read before the retry, so
+ * a wake-up that lands between the failed try and the wait makes the wait return at once.
+ */
+static int audio_mpsc_wait(audio_mpsc_queue_handle_t q, bool send, void *item, TickType_t wait_time)
+{
+    _Atomic uint32_t *word = send ? &q->received : &q->sent;
+    _Atomic uint32_t *waiters = send ? &q->send_waiters : &q->recv_waiters;
+    struct timespec ts;
+    const struct timespec *deadline = audio_time_deadline(&ts, CLOCK_MONOTONIC, wait_time ? wait_time : portMAX_DELAY);
+    for (;;) {
+        uint32_t seq = atomic_load(word);
+        atomic_fetch_add(waiters, 1);
+        bool done = send ? audio_mpsc_try_send(q, item) : audio_mpsc_try_recv(q, item);
+        if (!done && audio_time_left_ns(deadline) != 0) {
+            audio_futex_wait((volatile uint32_t *)word, seq, deadline);
+            done = send ? audio_mpsc_try_send(q, item) : audio_mpsc_try_recv(q, item);
+        }
+        atomic_fetch_sub(waiters, 1);
+        if (done) {
+            return 0;
+        }
+        if (audio_time_left_ns(deadline) == 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+    }
+}
+
+static void audio_mpsc_queue_signal(audio_mpsc_queue_handle_t q)
+{
+    atomic_fetch_add(&q->sent, 1);
+    if (atomic_load(&q->recv_waiters)) {
+        audio_futex_wake((volatile uint32_t *)&q->sent, 1);
+    }
+    if (atomic_load(&q->fd_armed) && atomic_exchange(&q->fd_armed, 0)) {
+        uint64_t one = 1;
+        if (write(atomic_load(&q->fd), &one, sizeof(one)) < 0) {
+            ESP_LOGW(TAG, "Signal eventfd failed, errno=%d", errno);
+        }
+    }
+}
+
+int audio_mpsc_queue_send(audio_mpsc_queue_handle_t q, const void *item, TickType_t wait_time)
+{
+    if (!audio_mpsc_try_send(q, item)) {
+        if (wait_time == 0 && q->nonblock) {
+            errno = EAGAIN;
+            return -1;
+        }
+        if (audio_mpsc_wait(q, true, (void *)item, wait_time) != 0) {
+            return -1;
+        }
+    }
+    audio_mpsc_queue_signal(q);
+    return 0;
+}
+
+int audio_mpsc_queue_try_send(audio_mpsc_queue_handle_t q, const void *item)
+{
+    if (!audio_mpsc_try_send(q, item)) {
+        errno = EAGAIN;
+        return -1;
+    }
+    audio_mpsc_queue_signal(q);
+    return 0;
+}
+
+/*
+ * Clear the eventfd and re-arm it once the queue reads empty. A send racing with this either sees the flag set and
+ * signals, or lands before it and is caught by the retry the caller makes after arming.
+ */
+static bool audio_mpsc_queue_rearm(audio_mpsc_queue_handle_t q)
+{
+    int fd = atomic_load(&q->fd);
+    if (fd < 0) {
+        return false;
+    }
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        ESP_LOGW(TAG, "Clear eventfd failed, errno=%d", errno);
+    }
+    atomic_store(&q->fd_armed, 1);
+    return true;
+}
+
+int audio_mpsc_queue_recv(audio_mpsc_queue_handle_t q, void *item, TickType_t wait_time)
+{
+    if (!audio_mpsc_try_recv(q, item) && !(audio_mpsc_queue_rearm(q) && audio_mpsc_try_recv(q, item))) {
+        if (wait_time == 0 && q->nonblock) {
+            errno = EAGAIN;
+            return -1;
+        }
+        if (audio_mpsc_wait(q, false, item, wait_time) != 0) {
+            return -1;
+        }
+    }
+    atomic_fetch_add(&q->received, 1);
+    if (atomic_load(&q->send_waiters)) {
+        audio_futex_wake((volatile uint32_t *)&q->received, INT_MAX);
+    }
+    return q->item_size;
+}
+
+int audio_mpsc_queue_recv_batch(audio_mpsc_queue_handle_t q, void *items, int max_items)
+{
+    int n = 0;
+    while (n < max_items && audio_mpsc_try_recv(q, (char *)items + (size_t)n * q->item_size)) {
+        n++;
+    }
+    if (n < max_items && audio_mpsc_queue_rearm(q)) {
+        while (n < max_items && audio_mpsc_try_recv(q, (char *)items + (size_t)n * q->item_size)) {
+            n++;
+        }
+    }
+    if (n) {
+        atomic_fetch_add(&q->received, n);
+        if (atomic_load(&q->send_waiters)) {
+            audio_futex_wake((volatile uint32_t *)&q->received, INT_MAX);
+        }
+    }
+    return n;
+}
+
+int audio_mpsc_queue_get_fd(audio_mpsc_queue_handle_t q)
+{
+    pthread_mutex_lock(&q->fd_lock);
+    if (atomic_load(&q->fd) < 0) {
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) {
+            ESP_LOGE(TAG, "Create eventfd failed, errno=%d", errno);
+        } else {
+            /* Readable at once if messages were queued before anybody polled */
+            uint64_t one = 1;
+            if (audio_mpsc_queue_message_available(q) > 0 && write(fd, &one, sizeof(one)) < 0) {
+                ESP_LOGW(TAG, "Signal eventfd failed, errno=%d", errno);
+            }
+            atomic_store(&q->fd, fd);
+            atomic_store(&q->fd_armed, 1);
+        }
+    }
+    pthread_mutex_unlock(&q->fd_lock);
+    return atomic_load(&q->fd);
+}
+
+int audio_mpsc_queue_message_available(audio_mpsc_queue_handle_t q)
+{
+    uint32_t tail = atomic_load(&q->tail);
+    uint32_t head = atomic_load(&q->head);
+    int32_t n = (int32_t)(head - tail);
+    return n < 0 ? 0 : n;
+}
@@ -22,6 +22,7 @@
  *
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -34,15 +35,50 @@
 #include "audio_idf_version.h"
 #include "esp_log.h"
 #include "audio_mem.h"
+#include "audio_time.h"
 
-pthread_mutex_t *mutex_create(void)
+#ifndef CONFIG_AUDIO_MUTEX_PRIO_INHERIT
+# define CONFIG_AUDIO_MUTEX_PRIO_INHERIT 0
+#endif
+
+/*
+ * glibc mutexes already take and release an uncontended lock with one atomic operation. The adaptive type also
+ * spins a bounded number of times before sleeping in the kernel, which suits the short critical sections here.
+ */
+static pthread_mutex_t *mutex_create_with_protocol(int protocol)
 {
-    pthread_mutex_t *mutex = NULL;
-    mutex = (pthread_mutex_t *)audio_malloc(sizeof(pthread_mutex_t));
-    pthread_mutex_init(mutex, NULL);
+    pthread_mutexattr_t attr;
+    pthread_mutex_t *mutex = (pthread_mutex_t *)audio_malloc(sizeof(pthread_mutex_t));
+    if (mutex == NULL) {
+        return NULL;
+    }
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, protocol == PTHREAD_PRIO_INHERIT ? PTHREAD_MUTEX_NORMAL : PTHREAD_MUTEX_ADAPTIVE_NP);
+    pthread_mutexattr_setprotocol(&attr, protocol);
+    int ret = pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (ret != 0) {
+        ESP_LOGE("AUDIO_MUTEX", "pthread_mutex_init failed, ret=%d", ret);
+        audio_free(mutex);
+        return NULL;
+    }
     return mutex;
 }
 
+pthread_mutex_t *mutex_create(void)
+{
+#if CONFIG_AUDIO_MUTEX_PRIO_INHERIT
+    return mutex_create_with_protocol(PTHREAD_PRIO_INHERIT);
+#else
+    return mutex_create_with_protocol(PTHREAD_PRIO_NONE);
+#endif
+}
+
+pthread_mutex_t *mutex_create_prio_inherit(void)
+{
+    return mutex_create_with_protocol(PTHREAD_PRIO_INHERIT);
+}
+
 int mutex_destroy(pthread_mutex_t *mutex)
 {
         pthread_mutex_destroy(mutex);
@@ -51,19 +87,27 @@ int mutex_destroy(pthread_mutex_t *mutex)
 }
 
 int mutex_lock(pthread_mutex_t *mutex)
+{
+    return mutex_lock_timeout(mutex, portMAX_DELAY);
+}
+
+int mutex_lock_timeout(pthread_mutex_t *mutex, TickType_t ticks)
 {
     struct timespec ts;
-    int status;
-    status = clock_gettime(CLOCK_REALTIME, &ts);
-    if (status < 0)
-    {
-        int errcode = errno;
-        fprintf(stderr, "rb_block: clock_gettime() failed: %d\n", errcode);
-        abort();
-    }
-    ts.tv_sec += portMAX_DELAY;
 
-    return pthread_mutex_timedlock(mutex, &ts);
+    if (ticks == 0) {
+        return pthread_mutex_trylock(mutex);
+    }
+    if (audio_time_deadline(&ts, CLOCK_MONOTONIC, ticks) == NULL) {
+        return pthread_mutex_lock(mutex);
+    }
+    int ret = pthread_mutex_clocklock(mutex, CLOCK_MONOTONIC, &ts);
+    if (ret == EINVAL) {
+        /* Older glibc only times out priority inheritance mutexes on CLOCK_REALTIME */
+        audio_time_deadline(&ts, CLOCK_REALTIME, ticks);
+        ret = pthread_mutex_timedlock(mutex, &ts);
+    }
+    return ret;
 }
 
 int mutex_unlock(pthread_mutex_t *mutex)
@@ -22,7 +22,10 @@
  *
  */
 
+#define _GNU_SOURCE
 #include "audio_queue.h"
+#include "audio_time.h"
+#include <poll.h>
 #include <time.h>
 
 #  define CONFIG_AUDIO_MSG_PRIO  1
@@ -63,46 +66,73 @@ int audio_queue_delete(mqd_t queue, const char *mq_name)
     return ret;
 }
 
+/* A deadline in the past, makes mq_timed* try once without blocking whatever the queue flags are */
+static const struct timespec audio_queue_expired = { 0, 0 };
+
+/*
+ * mq_timed* only take CLOCK_REALTIME deadlines and return at once on O_NONBLOCK queues, so the waiting is done
+ * by polling the queue descriptor against a CLOCK_MONOTONIC deadline.
+ */
+static void audio_queue_wait(mqd_t queue, short events, const struct timespec *deadline)
+{
+    struct pollfd pfd = {
+        .fd = (int)queue,
+        .events = events,
+    };
+    struct timespec left;
+    int64_t left_ns = audio_time_left_ns(deadline);
+
+    left.tv_sec = left_ns / 1000000000LL;
+    left.tv_nsec = left_ns % 1000000000LL;
+    ppoll(&pfd, 1, deadline ? &left : NULL, NULL);
+}
+
 int audio_queue_send(mqd_t queue, char *item, size_t msglen, TickType_t wait_time)
 {
-    int ret = 0;
     struct timespec ts;
-    if(wait_time != 0) {
-        int status = clock_gettime(CLOCK_REALTIME, &ts);
-        if (status != 0)
-        {
-            printf("clock_gettime: ERROR clock_gettime failed\n");
-            return -1;
+    int ret = 0;
+
+    if (wait_time == 0) {
+        return mq_send((mqd_t)queue, item, msglen, CONFIG_AUDIO_MSG_PRIO);
+    }
+    const struct timespec *deadline = audio_time_deadline(&ts, CLOCK_MONOTONIC, wait_time);
+    while ((ret = mq_timedsend((mqd_t)queue, item, msglen, CONFIG_AUDIO_MSG_PRIO, &audio_queue_expired)) != 0) {
+        if ((errno != ETIMEDOUT && errno != EAGAIN) || audio_time_left_ns(deadline) == 0) {
+            break;
         }
-        ts.tv_sec += wait_time;
-        ret = mq_timedsend((mqd_t)queue, item, msglen, CONFIG_AUDIO_MSG_PRIO, &ts);
-    } else {
-        ret = mq_send((mqd_t)queue, item, msglen, CONFIG_AUDIO_MSG_PRIO);
+        audio_queue_wait(queue, POLLOUT, deadline);
     }
-
     return ret;
 }
 
+int audio_queue_try_send(mqd_t queue, char *item, size_t msglen)
+{
+    return mq_timedsend((mqd_t)queue, item, msglen, CONFIG_AUDIO_MSG_PRIO, &audio_queue_expired);
+}
+
 int audio_queue_recv(mqd_t queue, char *item, size_t msglen, TickType_t wait_time)
 {
-    int ret = 0;
     struct timespec ts;
-    if(wait_time != 0) {
-        int status = clock_gettime(CLOCK_REALTIME, &ts);
-        if (status != 0)
-        {
-            printf("clock_gettime: ERROR clock_gettime failed\n");
-            return -1;
+    int ret = 0;
+
+    if (wait_time == 0) {
+        return mq_receive((mqd_t)queue, item, msglen, 0);
+    }
+    const struct timespec *deadline = audio_time_deadline(&ts, CLOCK_MONOTONIC, wait_time);
+    while ((ret = mq_timedreceive((mqd_t)queue, item, msglen, 0, &audio_queue_expired)) < 0) {
+        if ((errno != ETIMEDOUT && errno != EAGAIN) || audio_time_left_ns(deadline) == 0) {
+            break;
         }
-        ts.tv_sec += wait_time;
-        ret = mq_timedreceive((mqd_t)queue, item, msglen, 0, &ts);
-    } else {
-        ret = mq_receive((mqd_t)queue, item, msglen, 0);
+        audio_queue_wait(queue, POLLIN, deadline);
     }
-
     return ret;
 }
 
+int audio_queue_try_recv(mqd_t queue, char *item, size_t msglen)
+{
+    return mq_timedreceive((mqd_t)queue, item, msglen, 0, &audio_queue_expired);
+}
+
 int audio_queue_message_available(const mqd_t queue)
 {
     struct mq_attr mq_stat;
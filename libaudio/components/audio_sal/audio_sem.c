@@ -0,0 +1,102 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <errno.h>
+#include <stdatomic.h>
+#include "audio_mem.h"
+#include "audio_error.h"
+#include "audio_futex.h"
+#include "audio_time.h"
+#include "audio_sem.h"
+#include "esp_log.h"
+
+static const char *TAG = "AUDIO_SEM";
+
+struct audio_sem {
+    _Atomic uint32_t            count;          /* Futex word */
+    _Atomic uint32_t            waiters;
+    uint32_t                    max;
+};
+
+audio_sem_handle_t audio_sem_create(uint32_t initial, uint32_t max)
+{
+    if (max == 0 || initial > max) {
+        return NULL;
+    }
+    audio_sem_handle_t sem = audio_calloc(1, sizeof(struct audio_sem));
+    AUDIO_MEM_CHECK(TAG, sem, return NULL);
+    atomic_init(&sem->count, initial);
+    sem->max = max;
+    return sem;
+}
+
+void audio_sem_destroy(audio_sem_handle_t sem)
+{
+    audio_free(sem);
+}
+
+int audio_sem_take(audio_sem_handle_t sem, TickType_t ticks)
+{
+    struct timespec ts;
+    const struct timespec *deadline = NULL;
+    uint32_t count = atomic_load(&sem->count);
+    for (;;) {
+        while (count > 0) {
+            if (atomic_compare_exchange_weak(&sem->count, &count, count - 1)) {
+                return 0;
+            }
+        }
+        if (ticks == 0) {
+            return EBUSY;
+        }
+        if (deadline == NULL && ticks != portMAX_DELAY) {
+            deadline = audio_time_deadline(&ts, CLOCK_MONOTONIC, ticks);
+        } else if (deadline && audio_time_left_ns(deadline) == 0) {
+            return ETIMEDOUT;
+        }
+        atomic_fetch_add(&sem->waiters, 1);
+        audio_futex_wait((volatile uint32_t *)&sem->count, 0, deadline);
+        atomic_fetch_sub(&sem->waiters, 1);
+        count = atomic_load(&sem->count);
+    }
+}
+
+int audio_sem_give(audio_sem_handle_t sem)
+{
+    uint32_t count = atomic_load(&sem->count);
+    do {
+        if (count >= sem->max) {
+            return EOVERFLOW;
+        }
+    } while (!atomic_compare_exchange_weak(&sem->count, &count, count + 1));
+    if (atomic_load(&sem->waiters) != 0) {
+        audio_futex_wake((volatile uint32_t *)&sem->count, 1);
+    }
+    return 0;
+}
+
+uint32_t audio_sem_get_count(audio_sem_handle_t sem)
+{
+    return atomic_load(&sem->count);
+}
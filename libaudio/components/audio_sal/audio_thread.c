@@ -22,34 +22,195 @@
  *
  */
 
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "esp_log.h"
 #include "audio_mem.h"
 #include "audio_error.h"
 #include "audio_thread.h"
 
+#ifndef CONFIG_AUDIO_THREAD_STACK_MIN
+#  define CONFIG_AUDIO_THREAD_STACK_MIN  (64 * 1024)
+#endif
+
+static const char *TAG = "AUDIO_THREAD";
+
+static audio_thread_attr_t s_thread_attr = AUDIO_THREAD_DEFAULT_ATTR();
+static pthread_mutex_t s_thread_attr_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_bool s_rt_denied;
+static atomic_bool s_mlock_denied;
+
+typedef struct {
+    void            *(*main_func)(void *);
+    void            *arg;
+    bool            mlock_stack;
+    char            name[16];
+} audio_thread_start_t;
+
+esp_err_t audio_thread_set_attr(const audio_thread_attr_t *attr)
+{
+    if (attr == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (attr->policy != SCHED_OTHER && attr->policy != SCHED_FIFO && attr->policy != SCHED_RR) {
+        ESP_LOGE(TAG, "Unsupported scheduling policy %d", attr->policy);
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_thread_attr_lock);
+    s_thread_attr = *attr;
+    pthread_mutex_unlock(&s_thread_attr_lock);
+    atomic_store(&s_rt_denied, false);
+    atomic_store(&s_mlock_denied, false);
+    return ESP_OK;
+}
+
+esp_err_t audio_thread_get_attr(audio_thread_attr_t *attr)
+{
+    if (attr == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_thread_attr_lock);
+    *attr = s_thread_attr;
+    pthread_mutex_unlock(&s_thread_attr_lock);
+    return ESP_OK;
+}
+
+static void *audio_thread_start(void *pv)
+{
+    audio_thread_start_t start = *(audio_thread_start_t *)pv;
+    audio_free(pv);
+    pthread_setname_np(pthread_self(), start.name);
+    if (start.mlock_stack) {
+        pthread_attr_t attr;
+        void *stack_addr = NULL;
+        size_t stack_size = 0;
+        if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+            pthread_attr_getstack(&attr, &stack_addr, &stack_size);
+            pthread_attr_destroy(&attr);
+        }
+        if (stack_addr && mlock(stack_addr, stack_size) != 0 && !atomic_exchange(&s_mlock_denied, true)) {
+            ESP_LOGW(TAG, "[%s] Can not lock the stack in RAM, %s", start.name, strerror(errno));
+        }
+    }
+    return start.main_func(start.arg);
+}
+
+/*
+ * Task priorities keep their FreeRTOS order: prio 0 is the lowest real-time priority of the policy.
+ */
+static int audio_thread_rt_prio(int policy, int prio)
+{
+    int min = sched_get_priority_min(policy);
+    int max = sched_get_priority_max(policy);
+    prio += min;
+    return prio < min ? min : (prio > max ? max : prio);
+}
+
+static void audio_thread_set_cpus(pthread_attr_t *attr, const audio_thread_attr_t *cfg, int core_id)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    uint64_t mask = cfg->cpu_mask;
+    if (cfg->pin_core && core_id >= 0 && core_id < cpus && core_id < 64
+        && (mask == 0 || (mask & (1ULL << core_id)))) {
+        mask = 1ULL << core_id;
+    }
+    if (mask == 0) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < 64 && i < cpus; i++) {
+        if (mask & (1ULL << i)) {
+            CPU_SET(i, &set);
+        }
+    }
+    if (CPU_COUNT(&set) > 0) {
+        pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+    }
+}
+
 esp_err_t audio_thread_create(audio_thread_t *p_handle, const char *name, void*(*main_func)(void*) , void *arg,
                               uint32_t stack, int prio, bool stack_in_ext, int core_id)
 {
+    return audio_thread_create_with_attr(p_handle, name, main_func, arg, stack, prio, stack_in_ext, core_id, NULL);
+}
+
+esp_err_t audio_thread_create_with_attr(audio_thread_t *p_handle, const char *name, void*(*main_func)(void*),
+                                        void *arg, uint32_t stack, int prio, bool stack_in_ext, int core_id,
+                                        const audio_thread_attr_t *attr_cfg)
+{
+    audio_thread_attr_t cfg;
+    if (attr_cfg == NULL) {
+        audio_thread_get_attr(&cfg);
+    } else if (attr_cfg->policy != SCHED_OTHER && attr_cfg->policy != SCHED_FIFO && attr_cfg->policy != SCHED_RR) {
+        ESP_LOGE(TAG, "Unsupported scheduling policy %d", attr_cfg->policy);
+        return ESP_FAIL;
+    } else {
+        cfg = *attr_cfg;
+    }
+    audio_thread_start_t *start = audio_calloc(1, sizeof(audio_thread_start_t));
+    AUDIO_MEM_CHECK(TAG, start, return ESP_FAIL);
+    start->main_func = main_func;
+    start->arg = arg;
+    start->mlock_stack = cfg.mlock_stack;
+    snprintf(start->name, sizeof(start->name), "%s", name ? name : "audio");
+
+    /* FreeRTOS stack sizes are tight for glibc, they are raised to CONFIG_AUDIO_THREAD_STACK_MIN */
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t stack_size = stack > CONFIG_AUDIO_THREAD_STACK_MIN ? stack : CONFIG_AUDIO_THREAD_STACK_MIN;
+    stack_size = stack_size < PTHREAD_STACK_MIN ? PTHREAD_STACK_MIN : stack_size;
+    stack_size = (stack_size + page - 1) / page * page;
+
     pthread_attr_t attr;
-    int res = pthread_attr_init(&attr);
-    assert(res == 0);
-    res = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    assert(res == 0);
-    // res = pthread_attr_setstacksize(&attr, stack);
-    // assert(res == 0);
-    res = pthread_create(p_handle, &attr, main_func, arg);
-    assert(res == 0);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    pthread_attr_setstacksize(&attr, stack_size);
+    audio_thread_set_cpus(&attr, &cfg, core_id);
+    bool rt = cfg.policy != SCHED_OTHER && !atomic_load(&s_rt_denied);
+    if (rt) {
+        struct sched_param param = { .sched_priority = audio_thread_rt_prio(cfg.policy, prio) };
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, cfg.policy);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+    int res = pthread_create(p_handle, &attr, audio_thread_start, start);
+    if (res == EPERM && rt) {
+        if (!atomic_exchange(&s_rt_denied, true)) {
+            ESP_LOGW(TAG, "No permission for real-time scheduling, the audio threads run as SCHED_OTHER");
+        }
+        pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+        res = pthread_create(p_handle, &attr, audio_thread_start, start);
+    }
+    pthread_attr_destroy(&attr);
+    if (res != 0) {
+        ESP_LOGE(TAG, "[%s] Error create thread, %s", start->name, strerror(res));
+        audio_free(start);
+        return ESP_FAIL;
+    }
     return ESP_OK;
 }
 
 esp_err_t audio_thread_cleanup(audio_thread_t *p_handle)
 {
+    if (*p_handle == 0) {
+        return ESP_FAIL;
+    }
+    pthread_join(*p_handle, NULL);
+    *p_handle = 0;
     return ESP_OK;
 }
 
 esp_err_t audio_thread_delete_task(audio_thread_t *p_handle)
 {
+    if (p_handle == NULL || pthread_equal(*p_handle, pthread_self())) {
+        pthread_exit(NULL);
+    }
     int res = pthread_cancel(*p_handle);
-    assert(res == 0);
-    return ESP_OK; /* Control never reach here if this is self delete */
+    return res == 0 ? ESP_OK : ESP_FAIL; /* Control never reach here if this is self delete */
 }
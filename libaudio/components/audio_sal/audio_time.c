@@ -0,0 +1,75 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "audio_time.h"
+
+#define AUDIO_TIME_NS_PER_SEC   (1000000000LL)
+#define AUDIO_TIME_NS_PER_MS    (1000000LL)
+
+int64_t audio_time_ticks_to_ns(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY) {
+        return AUDIO_TIME_FOREVER;
+    }
+    if (ticks & portTICK_MS_FLAG) {
+        return (int64_t)(ticks & ~portTICK_MS_FLAG) * AUDIO_TIME_NS_PER_MS;
+    }
+    return (int64_t)ticks * AUDIO_TIME_NS_PER_SEC;
+}
+
+int64_t audio_time_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * AUDIO_TIME_NS_PER_SEC + ts.tv_nsec;
+}
+
+struct timespec *audio_time_deadline_ns(struct timespec *ts, clockid_t clock, int64_t timeout_ns)
+{
+    if (timeout_ns < 0) {
+        return NULL;
+    }
+    clock_gettime(clock, ts);
+    ts->tv_sec += timeout_ns / AUDIO_TIME_NS_PER_SEC;
+    ts->tv_nsec += timeout_ns % AUDIO_TIME_NS_PER_SEC;
+    if (ts->tv_nsec >= AUDIO_TIME_NS_PER_SEC) {
+        ts->tv_sec++;
+        ts->tv_nsec -= AUDIO_TIME_NS_PER_SEC;
+    }
+    return ts;
+}
+
+struct timespec *audio_time_deadline(struct timespec *ts, clockid_t clock, TickType_t ticks)
+{
+    return audio_time_deadline_ns(ts, clock, audio_time_ticks_to_ns(ticks));
+}
+
+int64_t audio_time_left_ns(const struct timespec *deadline)
+{
+    if (deadline == NULL) {
+        return AUDIO_TIME_FOREVER;
+    }
+    int64_t left = (int64_t)deadline->tv_sec * AUDIO_TIME_NS_PER_SEC + deadline->tv_nsec - audio_time_now_ns();
+    return left > 0 ? left : 0;
+}
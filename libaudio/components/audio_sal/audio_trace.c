@@ -0,0 +1,331 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Every thread that records gets a buffer of events of its own, with that thread as the only writer. Events are
+ * appended and never overwritten, so a reader that loads `head` with acquire can walk the events below it while the
+ * owner keeps appending. A full buffer drops the event and counts it.
+ *
+ * A trace is a generation number. The owner clears its buffer the first time it records into a new generation, and
+ * only buffers of the current generation are saved. Buffers are kept for the life of the process: a thread that
+ * exits releases its buffer, and a new thread takes it over once a later trace has started.
+ */
+
+#define _GNU_SOURCE
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "audio_mem.h"
+#include "audio_trace.h"
+#include "esp_log.h"
+
+#if CONFIG_AUDIO_TRACE
+
+static const char *TAG = "AUDIO_TRACE";
+
+#define AUDIO_TRACE_INSTANT     (-1)            /* `dur` of an instant event */
+
+typedef struct {
+    int64_t                     ts;
+    int64_t                     dur;
+    const char                  *cat;
+    const char                  *name;
+    uint64_t                    id;
+    int64_t                     arg;
+    char                        obj[AUDIO_TRACE_OBJ_LEN];
+} audio_trace_event_t;
+
+typedef struct audio_trace_buf {
+    struct audio_trace_buf      *next;          /* Never unlinked */
+    atomic_int                  owned;          /* A live thread records into this buffer */
+    atomic_uint                 gen;            /* The trace the events belong to, written by the owner */
+    atomic_uint                 head;           /* Written by the owner */
+    atomic_uint                 dropped;        /* Written by the owner */
+    int                         tid;
+    char                        thread[16];
+    audio_trace_event_t         events[CONFIG_AUDIO_TRACE_EVENTS];
+} audio_trace_buf_t;
+
+int g_audio_trace_on;
+
+static _Atomic(audio_trace_buf_t *) s_bufs;
+static __thread audio_trace_buf_t *s_buf;
+static pthread_key_t s_buf_key;
+static pthread_once_t s_buf_key_once = PTHREAD_ONCE_INIT;
+static atomic_uint s_gen;
+static atomic_uint s_lost;                      /* Events of threads that could not get a buffer */
+static int64_t s_start_ns;
+
+static void audio_trace_release_buf(void *arg)
+{
+    audio_trace_buf_t *buf = (audio_trace_buf_t *)arg;
+    atomic_store_explicit(&buf->owned, 0, memory_order_release);
+}
+
+static void audio_trace_make_key(void)
+{
+    pthread_key_create(&s_buf_key, audio_trace_release_buf);
+}
+
+static audio_trace_buf_t *audio_trace_buf(void)
+{
+    if (s_buf) {
+        return s_buf;
+    }
+    uint32_t gen = atomic_load_explicit(&s_gen, memory_order_relaxed);
+    audio_trace_buf_t *buf;
+    for (buf = atomic_load_explicit(&s_bufs, memory_order_acquire); buf; buf = buf->next) {
+        int expected = 0;
+        // The events of an exited thread stay until a later trace starts
+        if (atomic_load_explicit(&buf->owned, memory_order_relaxed) == 0
+            && atomic_load_explicit(&buf->gen, memory_order_relaxed) != gen
+            && atomic_compare_exchange_strong_explicit(&buf->owned, &expected, 1,
+                                                       memory_order_acquire, memory_order_relaxed)) {
+            break;
+        }
+    }
+    if (buf == NULL) {
+        buf = audio_calloc(1, sizeof(audio_trace_buf_t));
+        if (buf == NULL) {
+            return NULL;
+        }
+        atomic_init(&buf->owned, 1);
+        buf->next = atomic_load_explicit(&s_bufs, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&s_bufs, &buf->next, buf,
+                                                      memory_order_release, memory_order_relaxed)) {
+        }
+    }
+    // Published to a reader by the release store of `gen` in audio_trace_claim
+    buf->tid = syscall(SYS_gettid);
+    if (pthread_getname_np(pthread_self(), buf->thread, sizeof(buf->thread)) != 0) {
+        buf->thread[0] = '\0';
+    }
+    pthread_once(&s_buf_key_once, audio_trace_make_key);
+    pthread_setspecific(s_buf_key, buf);
+    s_buf = buf;
+    return buf;
+}
+
+static audio_trace_event_t *audio_trace_claim(audio_trace_buf_t **buf_out)
+{
+    audio_trace_buf_t *buf = audio_trace_buf();
+    if (buf == NULL) {
+        atomic_fetch_add_explicit(&s_lost, 1, memory_order_relaxed);
+        return NULL;
+    }
+    uint32_t gen = atomic_load_explicit(&s_gen, memory_order_relaxed);
+    if (atomic_load_explicit(&buf->gen, memory_order_relaxed) != gen) {
+        atomic_store_explicit(&buf->head, 0, memory_order_relaxed);
+        atomic_store_explicit(&buf->dropped, 0, memory_order_relaxed);
+        atomic_store_explicit(&buf->gen, gen, memory_order_release);
+    }
+    uint32_t head = atomic_load_explicit(&buf->head, memory_order_relaxed);
+    if (head >= CONFIG_AUDIO_TRACE_EVENTS) {
+        atomic_store_explicit(&buf->dropped, atomic_load_explicit(&buf->dropped, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+        return NULL;
+    }
+    *buf_out = buf;
+    return &buf->events[head];
+}
+
+static void audio_trace_record(const char *cat, const char *name, const char *obj, uint64_t id, int64_t arg,
+                               int64_t ts, int64_t dur)
+{
+    audio_trace_buf_t *buf;
+    audio_trace_event_t *ev = audio_trace_claim(&buf);
+    if (ev == NULL) {
+        return;
+    }
+    ev->ts = ts;
+    ev->dur = dur;
+    ev->cat = cat;
+    ev->name = name;
+    ev->id = id;
+    ev->arg = arg;
+    if (obj) {
+        strncpy(ev->obj, obj, sizeof(ev->obj) - 1);
+        ev->obj[sizeof(ev->obj) - 1] = '\0';
+    } else {
+        ev->obj[0] = '\0';
+    }
+    atomic_store_explicit(&buf->head, atomic_load_explicit(&buf->head, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+void audio_trace_span(const char *cat, const char *name, const char *obj, uint64_t id, int64_t arg, int64_t start_ns)
+{
+    if (start_ns == 0) {
+        return;
+    }
+    audio_trace_record(cat, name, obj, id, arg, start_ns, audio_time_now_ns() - start_ns);
+}
+
+void audio_trace_instant(const char *cat, const char *name, const char *obj, uint64_t id, int64_t arg)
+{
+    if (!audio_trace_enabled()) {
+        return;
+    }
+    audio_trace_record(cat, name, obj, id, arg, audio_time_now_ns(), AUDIO_TRACE_INSTANT);
+}
+
+esp_err_t audio_trace_start(void)
+{
+    __atomic_store_n(&g_audio_trace_on, 0, __ATOMIC_RELAXED);
+    s_start_ns = audio_time_now_ns();
+    atomic_store_explicit(&s_lost, 0, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_gen, 1, memory_order_relaxed);
+    __atomic_store_n(&g_audio_trace_on, 1, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+esp_err_t audio_trace_stop(void)
+{
+    __atomic_store_n(&g_audio_trace_on, 0, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+static void audio_trace_put_string(FILE *fp, const char *str)
+{
+    fputc('"', fp);
+    for (; *str; str++) {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\') {
+            fputc('\\', fp);
+            fputc(c, fp);
+        } else if (c < 0x20) {
+            fprintf(fp, "\\u%04x", c);
+        } else {
+            fputc(c, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+static void audio_trace_put_event(FILE *fp, int pid, int tid, const audio_trace_event_t *ev)
+{
+    fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f",
+            ev->name, ev->cat, pid, tid, (ev->ts - s_start_ns) / 1000.0);
+    if (ev->dur == AUDIO_TRACE_INSTANT) {
+        fputs(",\"ph\":\"i\",\"s\":\"t\"", fp);
+    } else {
+        fprintf(fp, ",\"ph\":\"X\",\"dur\":%.3f", ev->dur / 1000.0);
+    }
+    fputs(",\"args\":{", fp);
+    if (ev->obj[0]) {
+        fputs("\"obj\":", fp);
+        audio_trace_put_string(fp, ev->obj);
+        fputc(',', fp);
+    }
+    if (ev->id) {
+        fprintf(fp, "\"id\":\"0x%llx\",", (unsigned long long)ev->id);
+    }
+    fprintf(fp, "\"value\":%lld}}", (long long)ev->arg);
+}
+
+esp_err_t audio_trace_save(const char *path)
+{
+    if (path == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s", path);
+        return ESP_FAIL;
+    }
+    int pid = getpid();
+    uint32_t gen = atomic_load_explicit(&s_gen, memory_order_relaxed);
+    int events = 0;
+    fprintf(fp, "{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"audio\"}}",
+            pid);
+    for (audio_trace_buf_t *buf = atomic_load_explicit(&s_bufs, memory_order_acquire); buf; buf = buf->next) {
+        if (atomic_load_explicit(&buf->gen, memory_order_acquire) != gen) {
+            continue;
+        }
+        uint32_t head = atomic_load_explicit(&buf->head, memory_order_acquire);
+        fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                pid, buf->tid);
+        audio_trace_put_string(fp, buf->thread[0] ? buf->thread : "thread");
+        fputs("}}", fp);
+        for (uint32_t i = 0; i < head; i++) {
+            audio_trace_put_event(fp, pid, buf->tid, &buf->events[i]);
+        }
+        events += head;
+    }
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":\"%u\"}}\n", audio_trace_get_dropped());
+    bool failed = ferror(fp);
+    if (fclose(fp) != 0 || failed) {
+        ESP_LOGE(TAG, "Failed to write %s", path);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Saved %d events to %s", events, path);
+    return ESP_OK;
+}
+
+uint32_t audio_trace_get_dropped(void)
+{
+    uint32_t gen = atomic_load_explicit(&s_gen, memory_order_relaxed);
+    uint32_t dropped = atomic_load_explicit(&s_lost, memory_order_relaxed);
+    for (audio_trace_buf_t *buf = atomic_load_explicit(&s_bufs, memory_order_acquire); buf; buf = buf->next) {
+        if (atomic_load_explicit(&buf->gen, memory_order_acquire) == gen) {
+            dropped += atomic_load_explicit(&buf->dropped, memory_order_relaxed);
+        }
+    }
+    return dropped;
+}
+
+#else
+
+void audio_trace_span(const char *cat, const char *name, const char *obj, uint64_t id, int64_t arg, int64_t start_ns)
+{
+}
+
+void audio_trace_instant(const char *cat, const char *name, const char *obj, uint64_t id, int64_t arg)
+{
+}
+
+esp_err_t audio_trace_start(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t audio_trace_stop(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t audio_trace_save(const char *path)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+uint32_t audio_trace_get_dropped(void)
+{
+    return 0;
+}
+
+#endif /* CONFIG_AUDIO_TRACE */
@@ -32,20 +32,27 @@
  */
 
 /* Standard includes. */
+#include <assert.h>
+#include <limits.h>
+#include <stdatomic.h>
 #include <stdlib.h>
-#include <pthread.h>
 #include "esp_err.h"
 #include "event_groups.h"
 #include "audio_mem.h"
+#include "audio_futex.h"
 #include "esp_log.h"
+#include "audio_time.h"
 
 static const char *TAG = "EVENTGROUPS";
 
+/*
+ * All the bits live in one futex word. Setting bits wakes every waiter only when somebody sleeps, each waiter
+ * re-tests its own any/all condition, so any combination of bits can be waited for.
+ */
 typedef struct EventGroupDef_t
 {
-    EventBits_t uxEventBits;
-    pthread_cond_t  eventGroupCond[8];
-    pthread_mutex_t eventGroupMux;
+    _Atomic uint32_t uxEventBits;
+    _Atomic uint32_t uxWaiters;
 } EventGroup_t;
 
 static BaseType_t prvTestWaitCondition( const EventBits_t uxCurrentEventBits,
@@ -84,29 +91,12 @@ static BaseType_t prvTestWaitCondition(const EventBits_t uxCurrentEventBits,
 EventGroupHandle_t xEventGroupCreate(void)
 {
     EventGroup_t *pxEventBits;
-    int status = 0;
     pxEventBits = (EventGroup_t *) audio_malloc(sizeof(EventGroup_t)); /*lint !e9087 !e9079 see comment above. */
 
     if(pxEventBits != NULL)
     {
-        pxEventBits->uxEventBits = 0;
-
-          /* Initialize the mutex */
-        status = pthread_mutex_init(&pxEventBits->eventGroupMux, NULL);
-        if (status != 0)
-        {
-            ESP_LOGE(TAG, "xEventGroupCreate : pthread_mutex_init failed, status=%d", status);
-        }
-
-        /* Initialize the condition variable */
-        for (size_t i = 0; i < 8; i++)
-        {
-            status = pthread_cond_init(&pxEventBits->eventGroupCond[i], NULL);
-            if (status != 0)
-            {
-                ESP_LOGE(TAG, "ERROR xEventGroupCreate : pthread_cond_init failed status=%d", status);
-            }
-        }
+        atomic_init(&pxEventBits->uxEventBits, 0);
+        atomic_init(&pxEventBits->uxWaiters, 0);
     }
     else
     {
@@ -123,75 +113,35 @@ EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup,
                                  TickType_t xTicksToWait)
 {
     EventGroup_t * pxEventBits = xEventGroup;
-    EventBits_t uxReturn;
-    BaseType_t xWaitConditionMet;
-    int status = 0;
+    struct timespec ts;
+    const struct timespec *deadline = NULL;
 
     assert(xEventGroup);
     assert(uxBitsToWaitFor != 0);
 
-    if((uxBitsToWaitFor & (uxBitsToWaitFor - 1)) != 0) {
-        ESP_LOGE(TAG, "ERROR xEventGroupWaitBits :Wait For  Muti Bits Is Not Implement!");
-        abort();
-        return ESP_FAIL;
+    if (xTicksToWait != 0) {
+        deadline = audio_time_deadline(&ts, CLOCK_MONOTONIC, xTicksToWait);
     }
-
-    pthread_mutex_lock(&xEventGroup->eventGroupMux);
-    {
-        const EventBits_t uxCurrentEventBits = pxEventBits->uxEventBits;
-
-        /* Check to see if the wait condition is already met or not. */
-        xWaitConditionMet = prvTestWaitCondition(uxCurrentEventBits, uxBitsToWaitFor, xWaitForAllBits);
-
-        if(xWaitConditionMet != pdFALSE)
-        {
-            /* The wait condition has already been met so there is no need to
-             * block. */
-            uxReturn = uxCurrentEventBits;
-            xTicksToWait = (TickType_t) 0;
-            /* Clear the wait bits if requested to do so. */
-            if(xClearOnExit != pdFALSE)
-            {
-                pxEventBits->uxEventBits &= ~uxBitsToWaitFor;
+    for (;;) {
+        EventBits_t uxCurrentEventBits = atomic_load(&pxEventBits->uxEventBits);
+
+        if (prvTestWaitCondition(uxCurrentEventBits, uxBitsToWaitFor, xWaitForAllBits) != pdFALSE) {
+            /* Clear the wait bits if requested to do so, unless they changed under us. */
+            if (xClearOnExit != pdFALSE
+                && !atomic_compare_exchange_weak(&pxEventBits->uxEventBits, &uxCurrentEventBits,
+                                                 uxCurrentEventBits & ~uxBitsToWaitFor)) {
+                continue;
             }
+            return uxCurrentEventBits;
         }
-        else
-        {
-            struct timespec ts;
-            clock_gettime(CLOCK_REALTIME, &ts);
-            ts.tv_sec   += xTicksToWait;
-
-            for (int i = 0; i < 8; i++) {
-                if ((uxBitsToWaitFor & (1<<i)) != 0)
-                {
-                    if((pxEventBits->uxEventBits & (1<<i)) != 0)
-                    {
-                        ESP_LOGW(TAG, "xEventGroupWaitBits : the Waiting Bit  has been set");
-                    }
-                    status = pthread_cond_timedwait(&pxEventBits->eventGroupCond[i], &pxEventBits->eventGroupMux, &ts);
-                    if (status != 0)
-                    {
-                        ESP_LOGE(TAG, "pthread_cond_clockwait failed, status=%d", status);
-                    }
-                    break;
-                }
-            }
-
-            if ((pxEventBits->uxEventBits & uxBitsToWaitFor) == 0)
-            {
-                ESP_LOGE(TAG, "xEventGroupWaitBits :the Waiting Bit  has been set");
-            }
-
-            uxReturn = pxEventBits->uxEventBits;
-            /* Clear the wait bits if requested to do so. */
-            if(xClearOnExit != pdFALSE)
-            {
-                pxEventBits->uxEventBits &= ~uxBitsToWaitFor;
-            }
+        if (xTicksToWait == 0 || audio_time_left_ns(deadline) == 0) {
+            /* Timed out, return the current bits like FreeRTOS does. */
+            return uxCurrentEventBits;
         }
+        atomic_fetch_add(&pxEventBits->uxWaiters, 1);
+        audio_futex_wait((volatile uint32_t *)&pxEventBits->uxEventBits, uxCurrentEventBits, deadline);
+        atomic_fetch_sub(&pxEventBits->uxWaiters, 1);
     }
-    pthread_mutex_unlock(&xEventGroup->eventGroupMux);
-    return uxReturn;
 }
 /*-----------------------------------------------------------*/
 
@@ -199,22 +149,11 @@ EventBits_t xEventGroupClearBits(EventGroupHandle_t xEventGroup,
                                   const EventBits_t uxBitsToClear)
 {
     EventGroup_t * pxEventBits = xEventGroup;
-    EventBits_t uxReturn;
 
-    /* Check the user is not attempting to clear the bits used by the kernel
-     * itself. */
     assert(xEventGroup);
-    pthread_mutex_lock(&xEventGroup->eventGroupMux);
-    {
-        /* The value returned is the event group value prior to the bits being
-         * cleared. */
-        uxReturn = pxEventBits->uxEventBits;
-
-        /* Clear the bits. */
-        pxEventBits->uxEventBits &= ~uxBitsToClear;
-    }
-    pthread_mutex_unlock(&xEventGroup->eventGroupMux);
-    return uxReturn;
+    /* The value returned is the event group value prior to the bits being
+     * cleared. */
+    return atomic_fetch_and(&pxEventBits->uxEventBits, ~uxBitsToClear);
 }
 
 EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup,
@@ -225,16 +164,11 @@ EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup,
     assert(xEventGroup);
     assert(uxBitsToSet != 0);
 
-    pthread_mutex_lock(&pxEventBits->eventGroupMux);
-    /* set the bits. */
-    pxEventBits->uxEventBits |= uxBitsToSet;
-    for(int i=0; i<8; i++){
-        if((uxBitsToSet & (1<<i)) != (EventBits_t)0)
-        pthread_cond_signal(&pxEventBits->eventGroupCond[i]);
+    EventBits_t uxReturn = atomic_fetch_or(&pxEventBits->uxEventBits, uxBitsToSet) | uxBitsToSet;
+    if (atomic_load(&pxEventBits->uxWaiters) != 0) {
+        audio_futex_wake((volatile uint32_t *)&pxEventBits->uxEventBits, INT_MAX);
     }
-
-    pthread_mutex_unlock(&pxEventBits->eventGroupMux);
-    return pxEventBits->uxEventBits;
+    return uxReturn;
 }
 /*-----------------------------------------------------------*/
 
@@ -244,19 +178,5 @@ void vEventGroupDelete(EventGroupHandle_t xEventGroup)
         ESP_LOGE(TAG, "ERROR : xEventGroup is already NULL");
         return ;
     }
-    EventGroup_t * pxEventBits = xEventGroup;
-    int status;
-    pthread_mutex_lock(&pxEventBits->eventGroupMux);
-    {
-        for(int i=0; i<8; i++) {
-           status = pthread_cond_destroy(&pxEventBits->eventGroupCond[i]);
-            if (status != 0)
-            {
-                ESP_LOGE(TAG, "ERROR : pthread_cond_destroy eventGroupCond[%d] failed, status=%d\n", i, status);
-            }
-        }
-    }
-    pthread_mutex_unlock(&pxEventBits->eventGroupMux);
-    pthread_mutex_destroy(&pxEventBits->eventGroupMux);
-    audio_free(pxEventBits);
+    audio_free(xEventGroup);
 }
@@ -0,0 +1,123 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __AUDIO_ARENA_H__
+#define __AUDIO_ARENA_H__
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Arena for objects that come and go with a pipeline. Memory is taken from the heap in large chunks, carved into
+ * power of 2 size classes, and a freed block is kept on the free list of its class for the next allocation of the
+ * same size. Nothing goes back to the heap before the arena is released, which happens in one go when the last
+ * handle reference and the last block are gone.
+ *
+ * Every block remembers where it came from, so `audio_arena_free` needs no arena and also takes blocks allocated
+ * with a NULL arena, which come straight from the heap.
+ */
+typedef struct audio_arena *audio_arena_handle_t;
+
+/**
+ * @brief      Create an arena
+ *
+ * @param[in]  chunk_size   Bytes taken from the heap at a time, larger blocks get a chunk of their own
+ *
+ * @return     audio_arena_handle_t, NULL on failure
+ */
+audio_arena_handle_t audio_arena_create(int chunk_size);
+
+/**
+ * @brief      Drop the reference of the caller. The chunks are freed once no handle reference and no block is left.
+ *
+ * @param[in]  arena    The arena handle
+ *
+ * @return     ESP_OK or ESP_ERR_INVALID_ARG
+ */
+esp_err_t audio_arena_destroy(audio_arena_handle_t arena);
+
+/**
+ * @brief      Take one more reference, dropped again with `audio_arena_destroy`
+ *
+ * @param[in]  arena    The arena handle, may be NULL
+ *
+ * @return     The arena handle
+ */
+audio_arena_handle_t audio_arena_ref(audio_arena_handle_t arena);
+
+/**
+ * @brief      Allocate `size` bytes, the block keeps the arena alive until it is freed
+ *
+ * @param[in]  arena    The arena handle, NULL to allocate from the heap
+ * @param[in]  size     Size in bytes
+ *
+ * @return     Pointer aligned to 16 bytes, NULL on failure
+ */
+void *audio_arena_malloc(audio_arena_handle_t arena, size_t size);
+
+/**
+ * @brief      Same as `audio_arena_malloc` for `nmemb * size` bytes, zero filled
+ *
+ * @param[in]  arena    The arena handle, NULL to allocate from the heap
+ * @param[in]  nmemb    Number of members
+ * @param[in]  size     Size of each member
+ *
+ * @return     Pointer aligned to 16 bytes, NULL on failure
+ */
+void *audio_arena_calloc(audio_arena_handle_t arena, size_t nmemb, size_t size);
+
+/**
+ * @brief      Free a block of `audio_arena_malloc` or `audio_arena_calloc`, from any arena or the heap
+ *
+ * @param[in]  ptr      The block, may be NULL
+ */
+void audio_arena_free(void *ptr);
+
+/**
+ * @brief      Get the bytes the arena has taken from the heap
+ *
+ * @param[in]  arena    The arena handle
+ *
+ * @return     Bytes reserved, ESP_ERR_INVALID_ARG if arena is NULL
+ */
+int audio_arena_get_reserved(audio_arena_handle_t arena);
+
+/**
+ * @brief      Get the bytes held by the blocks in use, rounded up to their size class
+ *
+ * @param[in]  arena    The arena handle
+ *
+ * @return     Bytes in use, ESP_ERR_INVALID_ARG if arena is NULL
+ */
+int audio_arena_get_used(audio_arena_handle_t arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __AUDIO_FUTEX_H__
+#define __AUDIO_FUTEX_H__
+
+#include <stdint.h>
+#include <time.h>
+#include "portmacro.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief       Block while the 32-bit word at `uaddr` still holds `expected`
+ *
+ * @param       uaddr           The futex word, shared by the waiter and the waker
+ * @param       expected        The value the caller observed before deciding to sleep
+ * @param       abs_timeout     Absolute CLOCK_MONOTONIC deadline, NULL to wait forever
+ *
+ * @return      - 0:            Woken up, or the word no longer holds `expected`
+ *              - ETIMEDOUT:    The deadline expired
+ */
+int audio_futex_wait(volatile uint32_t *uaddr, uint32_t expected, const struct timespec *abs_timeout);
+
+/**
+ * @brief       Wake up threads blocked in `audio_futex_wait` on `uaddr`
+ *
+ * @param       uaddr           The futex word
+ * @param       nr_wake         Maximum number of waiters to wake up
+ *
+ * @return      - Number of waiters woken up
+ */
+int audio_futex_wake(volatile uint32_t *uaddr, int nr_wake);
+
+/**
+ * @brief       Convert `ticks` to an absolute CLOCK_MONOTONIC deadline
+ *
+ * @param       ts              The deadline to fill in
+ * @param       ticks           The ticks to wait
+ *
+ * @return      - ts:           The deadline
+ *              - NULL:         `ticks` is portMAX_DELAY, wait forever
+ */
+struct timespec *audio_futex_deadline(struct timespec *ts, TickType_t ticks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef __AUDIO_FUTEX_H__ */
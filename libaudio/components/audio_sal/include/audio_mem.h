@@ -26,6 +26,7 @@
 #define _AUDIO_MEM_H_
 
 #include <esp_types.h>
+#include "esp_err.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -77,7 +78,65 @@ void *audio_calloc(size_t nmemb, size_t size);
 void *audio_calloc_inner(size_t nmemb, size_t size);
 
 /**
- * @brief   Print heap memory status
+ * @brief   Allocation counters of one call site, or of all of them
+ *
+ *          Bytes are counted as handed out by the allocator, so they can be a little above the sizes asked for.
+ */
+typedef struct {
+    const void  *site;          /*!< Return address of the caller of audio_malloc & co, NULL for the total and for the
+                                     sites past CONFIG_AUDIO_MEM_SITES */
+    long        live_bytes;     /*!< Bytes allocated and not freed yet */
+    long        peak_bytes;     /*!< Highest `live_bytes` seen */
+    long long   allocs;         /*!< Number of allocations */
+    long long   frees;          /*!< Number of frees */
+} audio_mem_stats_t;
+
+/**
+ * @brief   Get the counters of all allocations made through audio_malloc, audio_calloc, audio_realloc and audio_strdup
+ *
+ *          The counters are updated without a lock on every call, CONFIG_AUDIO_MEM_ACCOUNTING=0 compiles them out.
+ *          A block released with audio_free that was not allocated by these functions is freed and not counted.
+ *
+ * @param[out] stats   The totals
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ *     - ESP_ERR_NOT_SUPPORTED when the accounting is compiled out
+ */
+esp_err_t audio_mem_get_stats(audio_mem_stats_t *stats);
+
+/**
+ * @brief   Get the counters of the call sites holding the most memory
+ *
+ * @param[out] sites        Filled with the sites in descending order of live bytes
+ * @param[in]  max_sites    Capacity of `sites`
+ *
+ * @return
+ *     - Number of entries filled
+ */
+int audio_mem_get_site_stats(audio_mem_stats_t *sites, int max_sites);
+
+/**
+ * @brief   Record the backtrace of one allocation in `rate`, kept until the block is freed
+ *
+ * @param[in]  rate     Sample one allocation in `rate`, 0 to stop sampling
+ */
+void audio_mem_set_sample_rate(int rate);
+
+/**
+ * @brief   Log the sampled allocations that are still live, with their backtraces
+ *
+ * @param[in]  tag      Tag of log
+ *
+ * @return
+ *     - Number of live samples
+ */
+int audio_mem_dump_samples(const char *tag);
+
+/**
+ * @brief   Print heap memory status: the totals, then the call sites holding the most memory with their allocation
+ *          rate since the previous print
  *
  * @param[in]  tag    tag of log
  * @param[in]  line   line of log
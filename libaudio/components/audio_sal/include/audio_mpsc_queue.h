@@ -0,0 +1,131 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __AUDIO_MPSC_QUEUE_H__
+#define __AUDIO_MPSC_QUEUE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "portmacro.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * In-process bounded message queue: any number of threads may send, a lock-free slot ring carries fixed-size
+ * items, and a futex wakes the blocked side. No syscall is made unless the other side sleeps.
+ */
+typedef struct audio_mpsc_queue *audio_mpsc_queue_handle_t;
+
+/**
+ * @brief       Allocate a queue instance with given item size and length
+ *
+ * @param       queue_len       The maximum number of items that the queue can contain
+ * @param       item_size       The number of bytes each item in the queue will require
+ * @param       nonblock        Same as O_NONBLOCK on an mqueue: a wait_time of 0 tries once instead of blocking
+ *
+ * @return      - Others:       Queue handle is returned
+ *              - NULL:         Failed to create queue handle
+ */
+audio_mpsc_queue_handle_t audio_mpsc_queue_create(uint32_t queue_len, uint32_t item_size, bool nonblock);
+
+/**
+ * @brief       Delete the queue, nobody may be blocked on it
+ *
+ * @param       queue           The queue handle
+ */
+void audio_mpsc_queue_destroy(audio_mpsc_queue_handle_t queue);
+
+/**
+ * @brief       Post an item on given queue
+ *
+ * @param       queue           The queue handle
+ * @param       item            A pointer to the `item_size` bytes to copy into the queue
+ * @param       wait_time       The maximum time to block waiting for space, same units as `audio_queue_send`
+ *
+ * @return      - 0:            The item was successfully posted
+ *              - -1:           Queue full, errno is EAGAIN or ETIMEDOUT
+ */
+int audio_mpsc_queue_send(audio_mpsc_queue_handle_t queue, const void *item, TickType_t wait_time);
+
+/**
+ * @brief       Post an item if there is room, without blocking even on a blocking queue
+ *
+ * @param       queue           The queue handle
+ * @param       item            A pointer to the `item_size` bytes to copy into the queue
+ *
+ * @return      - 0:            The item was successfully posted
+ *              - -1:           Queue full, errno is EAGAIN
+ */
+int audio_mpsc_queue_try_send(audio_mpsc_queue_handle_t queue, const void *item);
+
+/**
+ * @brief       Receive an item from a queue
+ *
+ * @param       queue           The queue handle
+ * @param       item            A pointer to `item_size` bytes to copy the item to
+ * @param       wait_time       The maximum time to block waiting for an item, same units as `audio_queue_send`
+ *
+ * @return      - item_size:    An item was successfully received from the queue
+ *              - -1:           Queue empty, errno is EAGAIN or ETIMEDOUT
+ */
+int audio_mpsc_queue_recv(audio_mpsc_queue_handle_t queue, void *item, TickType_t wait_time);
+
+/**
+ * @brief       Receive up to `max_items` items without blocking
+ *
+ * @param       queue           The queue handle
+ * @param       items           A buffer of `max_items * item_size` bytes
+ * @param       max_items       The maximum number of items to receive
+ *
+ * @return      The number of items received, 0 if the queue is empty
+ */
+int audio_mpsc_queue_recv_batch(audio_mpsc_queue_handle_t queue, void *items, int max_items);
+
+/**
+ * @brief       Get an eventfd that polls readable when items are pending, created on the first call and closed with
+ *              the queue. It is only re-armed once a receive finds the queue empty, so drain the queue on every wake-up.
+ *
+ * @param       queue           The queue handle
+ *
+ * @return      - >=0:          The file descriptor
+ *              - -1:           Failed to create the eventfd
+ */
+int audio_mpsc_queue_get_fd(audio_mpsc_queue_handle_t queue);
+
+/**
+ * @brief       Return the number of messages stored in a queue
+ *
+ * @param       queue           The queue handle
+ *
+ * @return      The number of messages available in the queue
+ */
+int audio_mpsc_queue_message_available(audio_mpsc_queue_handle_t queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef __AUDIO_MPSC_QUEUE_H__ */
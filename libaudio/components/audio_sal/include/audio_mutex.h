@@ -25,6 +25,8 @@
 #ifndef __AUDIO_MUTEX_H__
 #define __AUDIO_MUTEX_H__
 
+#include <pthread.h>
+#include "portmacro.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +39,16 @@ extern "C" {
  *              - NULL:         Failed to create mutex
  */
 pthread_mutex_t *mutex_create(void);
+
+/**
+ * @brief       Create a mutex with priority inheritance, a low priority owner is boosted while a real-time thread
+ *              waits for it. `mutex_create` does the same for every mutex when CONFIG_AUDIO_MUTEX_PRIO_INHERIT is set.
+ *
+ * @return      - Others:      A mutex handle is returned
+ *              - NULL:         Failed to create mutex
+ */
+pthread_mutex_t *mutex_create_prio_inherit(void);
+
 /**
  * @brief       Delete the mutex instance
  *
@@ -55,6 +67,15 @@ int mutex_destroy(pthread_mutex_t *mutex);
  */
 int mutex_lock(pthread_mutex_t *mutex);
 
+/**
+ * @brief       Lock the mutex, giving up after `ticks` (CLOCK_MONOTONIC, see pdMS_TO_TICKS for milliseconds)
+ *
+ * @return      - 0:            Locked
+ *              - ETIMEDOUT:    Not locked within `ticks`
+ *              - EBUSY:        `ticks` is 0 and the mutex is held
+ */
+int mutex_lock_timeout(pthread_mutex_t *mutex, TickType_t ticks);
+
 /**
  * @brief       Release the mutex
  *
@@ -64,27 +64,48 @@ int audio_queue_delete(mqd_t queue, const char *mq_name);
  *
  * @param       queue            A pointer to queue handle
  * @param       item             A pointer to the item that is to be placed on the queue
- * @param       block_time_ms    The maximum amount of millisecond the task should block waiting for space
- *                               to become available on the queue, should it already be full
+ * @param       wait_time        The maximum time to block waiting for space, in ticks (seconds, or milliseconds
+ *                               with pdMS_TO_TICKS) on CLOCK_MONOTONIC; 0 tries once according to the queue flags
  *
  * @return      - 0:             The item was successfully posted
  *              - Otherwise:     Queue full error
  */
 int audio_queue_send(mqd_t queue, char *item, size_t msglen, TickType_t wait_time);
 
+/**
+ * @brief       Post an item if there is room, without blocking even on a queue opened without O_NONBLOCK
+ *
+ * @param       queue            A pointer to queue handle
+ * @param       item             A pointer to the item that is to be placed on the queue
+ *
+ * @return      - 0:             The item was successfully posted
+ *              - Otherwise:     Queue full error
+ */
+int audio_queue_try_send(mqd_t queue, char *item, size_t msglen);
+
 /**
  * @brief       Receive an item from a queue.
  *
  * @param       queue            A pointer to queue handle
  * @param       item             A pointer to the item that is to be placed on the queue
- * @param       block_time_ms    The maximum amount of millisecond the task should block waiting for space
- *                               to become available on the queue, should it already be full
+ * @param       wait_time        The maximum time to block waiting for an item, same units as `audio_queue_send`
  *
  * @return      - 0:             An item was successfully received from the queue
  *              - Otherwise:     Failed to received queue
  */
 int audio_queue_recv(mqd_t queue, char *item, size_t msglen, TickType_t wait_time);
 
+/**
+ * @brief       Receive an item if there is one, without blocking even on a queue opened without O_NONBLOCK
+ *
+ * @param       queue            A pointer to queue handle
+ * @param       item             A pointer to the item that is to be placed on the queue
+ *
+ * @return      - msglen:        An item was successfully received from the queue
+ *              - -1:            Queue empty
+ */
+int audio_queue_try_recv(mqd_t queue, char *item, size_t msglen);
+
 /**
  * @brief       Return the number of messages stored in a queue.
  *
@@ -0,0 +1,93 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __AUDIO_SEM_H__
+#define __AUDIO_SEM_H__
+
+#include <stdint.h>
+#include "portmacro.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Counting semaphore on a futex word, give and take are one atomic operation unless a taker has to sleep
+ */
+typedef struct audio_sem *audio_sem_handle_t;
+
+/**
+ * @brief       Create a counting semaphore
+ *
+ * @param       initial         The initial count
+ * @param       max             The maximum count, 1 for a binary semaphore
+ *
+ * @return      - Others:       A semaphore handle is returned
+ *              - NULL:         Failed to create the semaphore
+ */
+audio_sem_handle_t audio_sem_create(uint32_t initial, uint32_t max);
+
+/**
+ * @brief       Delete the semaphore, nobody may be blocked on it
+ *
+ * @param       sem             The semaphore handle
+ */
+void audio_sem_destroy(audio_sem_handle_t sem);
+
+/**
+ * @brief       Take the semaphore, giving up after `ticks` (CLOCK_MONOTONIC, see pdMS_TO_TICKS for milliseconds)
+ *
+ * @param       sem             The semaphore handle
+ * @param       ticks           The ticks to wait, portMAX_DELAY to wait forever
+ *
+ * @return      - 0:            Taken
+ *              - ETIMEDOUT:    Not available within `ticks`
+ *              - EBUSY:        `ticks` is 0 and the count is 0
+ */
+int audio_sem_take(audio_sem_handle_t sem, TickType_t ticks);
+
+/**
+ * @brief       Give the semaphore
+ *
+ * @param       sem             The semaphore handle
+ *
+ * @return      - 0:            Given
+ *              - EOVERFLOW:    The count is already at its maximum
+ */
+int audio_sem_give(audio_sem_handle_t sem);
+
+/**
+ * @brief       Get the current count
+ *
+ * @param       sem             The semaphore handle
+ *
+ * @return      The count
+ */
+uint32_t audio_sem_get_count(audio_sem_handle_t sem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef __AUDIO_SEM_H__ */
@@ -27,23 +27,64 @@
 
 #include "esp_err.h"
 #include "stdbool.h"
+#include <stdint.h>
 #include <pthread.h>
+#include <sched.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define audio_thread_t pthread_t
 
+/**
+ * @brief       How the threads started by audio_thread_create are scheduled and placed
+ */
+typedef struct {
+    int         policy;         /*!< SCHED_OTHER by default, it ignores the task priorities. SCHED_FIFO or SCHED_RR map
+                                     them to real-time ones, from the lowest one of the policy up. Without the
+                                     privilege for real-time scheduling the threads fall back to SCHED_OTHER */
+    bool        pin_core;       /*!< Pin each thread to the CPU given as its core_id, if that CPU is in cpu_mask */
+    uint64_t    cpu_mask;       /*!< CPUs the threads may run on, bit n for CPU n. 0 for all of them */
+    bool        mlock_stack;    /*!< Lock the thread stacks in RAM so they never fault */
+} audio_thread_attr_t;
+
+#define AUDIO_THREAD_DEFAULT_ATTR() {   \
+    .policy         = SCHED_OTHER,      \
+    .pin_core       = false,            \
+    .cpu_mask       = 0,                \
+    .mlock_stack    = false,            \
+}
+
+/**
+ * @brief       Set how the threads created from now on are scheduled and placed
+ *
+ * @param       attr            The thread attributes
+ *
+ * @return      - ESP_OK
+ *              - ESP_ERR_INVALID_ARG:  NULL attr or unsupported policy
+ */
+esp_err_t audio_thread_set_attr(const audio_thread_attr_t *attr);
+
+/**
+ * @brief       Get the attributes the threads are created with
+ *
+ * @param       attr            Filled with the current thread attributes
+ *
+ * @return      - ESP_OK
+ *              - ESP_ERR_INVALID_ARG
+ */
+esp_err_t audio_thread_get_attr(audio_thread_attr_t *attr);
+
 /**
  * @brief       Allocate handle if not allocated and create a thread
  *
  * @param       p_handle        pointer to audio_thread_t handle
  * @param       name            Task name
  * @param       main_func       The function which task will execute
- * @param       stack           Task stack
- * @param       prio            Task priority
- * @param       stack_in_ext    If task should reside in external memory
- * @param       core_id         Core to which task will be pinned
+ * @param       stack           Task stack in bytes, raised to CONFIG_AUDIO_THREAD_STACK_MIN (64K by default)
+ * @param       prio            Task priority, see audio_thread_attr_t
+ * @param       stack_in_ext    If task should reside in external memory, unused on Linux
+ * @param       core_id         Core to which task will be pinned when audio_thread_attr_t.pin_core is set
  *
  * @return      - ESP_OK :      Task creation successful
  *              - ESP_FAIL:     Failed to create task
@@ -56,6 +97,19 @@ extern "C" {
 esp_err_t audio_thread_create(audio_thread_t *p_handle, const char* name, void*(*main_func)(void*), void *arg,
                               uint32_t stack, int prio, bool stack_in_ext, int core_id);
 
+/**
+ * @brief       Create a thread like audio_thread_create, with attributes of its own instead of the ones set with
+ *              audio_thread_set_attr
+ *
+ * @param       attr            The attributes of this thread only, NULL for the ones of audio_thread_set_attr
+ *
+ * @return      - ESP_OK :      Task creation successful
+ *              - ESP_FAIL:     Failed to create task, or unsupported policy
+ */
+esp_err_t audio_thread_create_with_attr(audio_thread_t *p_handle, const char* name, void*(*main_func)(void*),
+                                        void *arg, uint32_t stack, int prio, bool stack_in_ext, int core_id,
+                                        const audio_thread_attr_t *attr);
+
 /**
  * @brief       Cleanup all the task memory
  *
@@ -64,14 +118,14 @@ esp_err_t audio_thread_create(audio_thread_t *p_handle, const char* name, void*(
  * @return      - ESP_OK :      Task cleanup successful
  *              - ESP_FAIL:     Task is already cleaned up
  *
- * @note        must be called from different task after this task is deleted.
+ * @note        must be called from different task after this task is deleted. It joins the thread.
  */
 esp_err_t audio_thread_cleanup(audio_thread_t *p_handle);
 
 /**
  * @brief       Delete the task
  *
- * @param       p_handle        The pointer to audio_thread_t handle
+ * @param       p_handle        The pointer to audio_thread_t handle, NULL for the calling task
  *
  * @return      - ESP_OK :      Task deleted successfully
  *              - ESP_FAIL:     Task is not running or cleaned up
@@ -0,0 +1,95 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __AUDIO_TIME_H__
+#define __AUDIO_TIME_H__
+
+#include <stdint.h>
+#include <time.h>
+#include "portmacro.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUDIO_TIME_FOREVER      (-1LL)      /*!< Timeout in nanoseconds of portMAX_DELAY */
+
+/**
+ * @brief       Convert a timeout in ticks to nanoseconds
+ *
+ *              A tick is one second, unless portTICK_MS_FLAG is set (see pdMS_TO_TICKS), then it is one millisecond.
+ *
+ * @param       ticks           The ticks to wait
+ *
+ * @return      - The timeout in nanoseconds
+ *              - AUDIO_TIME_FOREVER: `ticks` is portMAX_DELAY
+ */
+int64_t audio_time_ticks_to_ns(TickType_t ticks);
+
+/**
+ * @brief       Get the current CLOCK_MONOTONIC time
+ *
+ * @return      - Nanoseconds since an unspecified point in the past
+ */
+int64_t audio_time_now_ns(void);
+
+/**
+ * @brief       Convert a relative timeout to an absolute deadline on `clock`
+ *
+ * @param       ts              The deadline to fill in
+ * @param       clock           The clock the deadline is measured on, CLOCK_MONOTONIC unless the API demands otherwise
+ * @param       timeout_ns      The timeout in nanoseconds
+ *
+ * @return      - ts:           The deadline
+ *              - NULL:         `timeout_ns` is AUDIO_TIME_FOREVER (or negative), wait forever
+ */
+struct timespec *audio_time_deadline_ns(struct timespec *ts, clockid_t clock, int64_t timeout_ns);
+
+/**
+ * @brief       Same as `audio_time_deadline_ns` with the timeout given in ticks
+ *
+ * @param       ts              The deadline to fill in
+ * @param       clock           The clock the deadline is measured on
+ * @param       ticks           The ticks to wait
+ *
+ * @return      - ts:           The deadline
+ *              - NULL:         `ticks` is portMAX_DELAY, wait forever
+ */
+struct timespec *audio_time_deadline(struct timespec *ts, clockid_t clock, TickType_t ticks);
+
+/**
+ * @brief       Get the time left until a CLOCK_MONOTONIC deadline
+ *
+ * @param       deadline        The deadline, NULL to wait forever
+ *
+ * @return      - Nanoseconds left, 0 once the deadline has passed
+ *              - AUDIO_TIME_FOREVER: `deadline` is NULL
+ */
+int64_t audio_time_left_ns(const struct timespec *deadline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef __AUDIO_TIME_H__ */
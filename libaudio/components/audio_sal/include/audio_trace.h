@@ -0,0 +1,152 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __AUDIO_TRACE_H__
+#define __AUDIO_TRACE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "audio_time.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Timeline of pipeline activity in the Chrome trace-event format, which chrome://tracing and the Perfetto UI open.
+ * Every thread records into a buffer of its own, so a record is a clock read and a few stores, with no lock and no
+ * shared cache line. While tracing is stopped a call site costs one relaxed load.
+ */
+#ifndef CONFIG_AUDIO_TRACE
+#define CONFIG_AUDIO_TRACE          1           /* 0 compiles the call sites out */
+#endif
+
+#ifndef CONFIG_AUDIO_TRACE_EVENTS
+#define CONFIG_AUDIO_TRACE_EVENTS   (8192)      /* Events kept per thread, later ones are dropped and counted */
+#endif
+
+#define AUDIO_TRACE_OBJ_LEN         (24)        /* Longest object name kept with an event, tags are cut to fit */
+
+#if CONFIG_AUDIO_TRACE
+
+extern int g_audio_trace_on;
+
+/**
+ * @brief       Whether events are being recorded
+ */
+static inline bool audio_trace_enabled(void)
+{
+    return __atomic_load_n(&g_audio_trace_on, __ATOMIC_RELAXED);
+}
+
+#else
+
+static inline bool audio_trace_enabled(void)
+{
+    return false;
+}
+
+#endif /* CONFIG_AUDIO_TRACE */
+
+/**
+ * @brief       Start a span, pass the result to `audio_trace_span` once it ends
+ *
+ * @return      - The current CLOCK_MONOTONIC time
+ *              - 0:            Tracing is off, the span is not recorded
+ */
+static inline int64_t audio_trace_begin(void)
+{
+    return audio_trace_enabled() ? audio_time_now_ns() : 0;
+}
+
+/**
+ * @brief       Record a span of the calling thread that started at `start_ns` and ends now
+ *
+ * @param       cat             Category, a string literal
+ * @param       name            Name, a string literal
+ * @param       obj             Object the span is about, e.g. an element tag, copied; NULL for none
+ * @param       id              Object address or other identifier, 0 for none
+ * @param       arg             A value shown with the span
+ * @param       start_ns        The result of `audio_trace_begin`, nothing is recorded if it is 0
+ */
+void audio_trace_span(const char *cat, const char *name, const char *obj, uint64_t id, int64_t arg, int64_t start_ns);
+
+/**
+ * @brief       Record an instant event of the calling thread, if tracing is on
+ *
+ * @param       cat             Category, a string literal
+ * @param       name            Name, a string literal
+ * @param       obj             Object the event is about, copied; NULL for none
+ * @param       id              Object address or other identifier, 0 for none
+ * @param       arg             A value shown with the event
+ */
+void audio_trace_instant(const char *cat, const char *name, const char *obj, uint64_t id, int64_t arg);
+
+/**
+ * @brief       Discard the previous trace and start recording
+ *
+ *              A thread drops what it recorded before the first time it records into the new trace.
+ *              Do not start a trace while another thread saves one.
+ *
+ * @return      - ESP_OK
+ *              - ESP_ERR_NOT_SUPPORTED:    Compiled out with CONFIG_AUDIO_TRACE
+ */
+esp_err_t audio_trace_start(void);
+
+/**
+ * @brief       Stop recording, the trace is kept until the next start
+ *
+ * @return      - ESP_OK
+ *              - ESP_ERR_NOT_SUPPORTED:    Compiled out with CONFIG_AUDIO_TRACE
+ */
+esp_err_t audio_trace_stop(void);
+
+/**
+ * @brief       Write the trace as Chrome trace-event JSON
+ *
+ *              Each thread is a track named after the thread, timestamps are microseconds since the start of the
+ *              trace. Saving while recording is safe, events recorded meanwhile may be left out.
+ *
+ * @param       path            The file to write, replaced if it exists
+ *
+ * @return      - ESP_OK
+ *              - ESP_FAIL:                 The file could not be written
+ *              - ESP_ERR_INVALID_ARG
+ *              - ESP_ERR_NOT_SUPPORTED:    Compiled out with CONFIG_AUDIO_TRACE
+ */
+esp_err_t audio_trace_save(const char *path);
+
+/**
+ * @brief       Get the number of events of the current trace that did not fit in the buffer of their thread
+ *
+ * @return      - The number of dropped events
+ */
+uint32_t audio_trace_get_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AUDIO_TRACE_H__ */
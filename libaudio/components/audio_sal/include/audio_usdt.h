@@ -0,0 +1,90 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2018 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on all ESPRESSIF SYSTEMS products, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __AUDIO_USDT_H__
+#define __AUDIO_USDT_H__
+
+/**
+ * SystemTap SDT (USDT) probes of provider `libaudio`, for bpftrace, perf and stap to attach to a running process
+ * without a rebuild. A probe is a single nop plus an ELF note until a tracer attaches, and its arguments are only
+ * read by the tracer. Without <sys/sdt.h> (systemtap-sdt-dev), or with CONFIG_AUDIO_USDT set to 0, the probes
+ * compile to nothing and their arguments are not evaluated.
+ *
+ *   Probe                      Arguments
+ *   rb_read_entry              ringbuf, wanted bytes, ticks to wait
+ *   rb_read_block              ringbuf
+ *   rb_read_unblock            ringbuf, 0 if woken up or the error of the wait
+ *   rb_read_return             ringbuf, bytes read or RB_* error
+ *   rb_write_entry             ringbuf, bytes to write, ticks to wait
+ *   rb_write_block             ringbuf
+ *   rb_write_unblock           ringbuf, 0 if woken up or the error of the wait
+ *   rb_write_return            ringbuf, bytes written or RB_* error
+ *   element_input_entry        element, tag, wanted bytes
+ *   element_input_return       element, tag, bytes read or AEL_IO_* error
+ *   element_output_entry       element, tag, bytes to write
+ *   element_output_return      element, tag, bytes written or AEL_IO_* error
+ *   element_process_entry      element, tag
+ *   element_process_return     element, tag, process result
+ *   mp3_frame_entry            decoder, bytes left in the input
+ *   mp3_frame_return           decoder, ERR_MP3_* result, bytes of the input the frame took
+ *   http_read_entry            client, wanted bytes
+ *   http_read_return           client, bytes read or -1
+ *
+ * e.g. the process time of each element as a histogram:
+ *
+ *   bpftrace -e 'usdt:./pipeline_test:libaudio:element_process_entry { @start[tid] = nsecs; }
+ *                usdt:./pipeline_test:libaudio:element_process_return /@start[tid]/ {
+ *                    @us[str(arg1)] = hist((nsecs - @start[tid]) / 1000); delete(@start[tid]); }'
+ */
+#ifndef CONFIG_AUDIO_USDT
+#define CONFIG_AUDIO_USDT           1           /* 0 compiles the probes out */
+#endif
+
+#if CONFIG_AUDIO_USDT && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define AUDIO_USDT_AVAILABLE        1
+#endif
+#endif
+
+#ifndef AUDIO_USDT_AVAILABLE
+#define AUDIO_USDT_AVAILABLE        0
+#endif
+
+#if AUDIO_USDT_AVAILABLE
+
+#define AUDIO_USDT1(name, a1)                   DTRACE_PROBE1(libaudio, name, a1)
+#define AUDIO_USDT2(name, a1, a2)               DTRACE_PROBE2(libaudio, name, a1, a2)
+#define AUDIO_USDT3(name, a1, a2, a3)           DTRACE_PROBE3(libaudio, name, a1, a2, a3)
+
+#else
+
+/* sizeof keeps the arguments used for the compiler without evaluating them */
+#define AUDIO_USDT1(name, a1)                   do { (void)sizeof(a1); } while (0)
+#define AUDIO_USDT2(name, a1, a2)               do { (void)sizeof(a1); (void)sizeof(a2); } while (0)
+#define AUDIO_USDT3(name, a1, a2, a3)           do { (void)sizeof(a1); (void)sizeof(a2); (void)sizeof(a3); } while (0)
+
+#endif /* AUDIO_USDT_AVAILABLE */
+
+#endif /* __AUDIO_USDT_H__ */
@@ -34,6 +34,7 @@
 #include "audio_element.h"
 #include "wav_head.h"
 #include "esp_log.h"
+#include "audio_time.h"
 #include "unistd.h"
 #include "fcntl.h"
 
@@ -61,6 +62,7 @@ typedef struct fatfs_stream {
     int file;
     wr_stream_type_t w_type;
     bool write_header;
+    bool at_start;          /* The next chunk read starts the file, at media time 0 */
 } fatfs_stream_t;
 
 
@@ -121,6 +123,7 @@ static esp_err_t _fatfs_open(audio_element_handle_t self)
         stat(path, &siz);
         info.total_bytes = siz.st_size;
         ESP_LOGI(TAG, "File size: %d byte, file position: %d", (int)siz.st_size, (int)info.byte_pos);
+        fatfs->at_start = (info.byte_pos == 0);
         if (info.byte_pos > 0) {
             if (lseek(fatfs->file, info.byte_pos, SEEK_SET) < 0) {
                 ESP_LOGE(TAG, "Error seek file. Error message: %s, line: %d", strerror(errno), __LINE__);
@@ -157,10 +160,8 @@ static esp_err_t _fatfs_open(audio_element_handle_t self)
 static int _fatfs_read(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context)
 {
     fatfs_stream_t *fatfs = (fatfs_stream_t *)audio_element_getdata(self);
-    audio_element_info_t info;
-    audio_element_getinfo(self, &info);
 
-    ESP_LOGD(TAG, "read len=%d, pos=%d/%d", len, (int)info.byte_pos, (int)info.total_bytes);
+    ESP_LOGD(TAG, "read len=%d, pos=%d/%d", len, (int)audio_element_get_byte_pos(self), (int)audio_element_get_total_bytes(self));
     /* use file descriptors to access files */
     int rlen = read(fatfs->file, buffer, len);
     if (rlen == 0) {
@@ -168,6 +169,9 @@ static int _fatfs_read(audio_element_handle_t self, char *buffer, int len, TickT
     } else if (rlen == -1) {
         ESP_LOGE(TAG, "The error is happened in reading data. Error message: %s", strerror(errno));
     } else {
+        /* The media time after a seek is up to the decoder, which knows the bitrate */
+        audio_element_set_output_timestamp(self, fatfs->at_start ? 0 : RB_PTS_NONE, audio_time_now_ns());
+        fatfs->at_start = false;
         audio_element_update_byte_pos(self, rlen);
     }
     return rlen;
@@ -176,8 +180,6 @@ static int _fatfs_read(audio_element_handle_t self, char *buffer, int len, TickT
 static int _fatfs_write(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context)
 {
     fatfs_stream_t *fatfs = (fatfs_stream_t *)audio_element_getdata(self);
-    audio_element_info_t info;
-    audio_element_getinfo(self, &info);
     int wlen =  write(fatfs->file, buffer, len);
     fsync(fatfs->file);
     if (wlen > 0) {
@@ -191,14 +193,13 @@ static int _fatfs_write(audio_element_handle_t self, char *buffer, int len, Tick
 
 static int _fatfs_process(audio_element_handle_t self, char *in_buffer, int in_len)
 {
-    int r_size = audio_element_input(self, in_buffer, in_len);
-    int w_size = 0;
-    if (r_size > 0) {
-        w_size = audio_element_output(self, in_buffer, r_size);
-    } else {
-        w_size = r_size;
+    /* Passthrough: the buffer read from the file or the input goes out as is */
+    audio_buf_t *buf = NULL;
+    int r_size = audio_element_input_buf(self, &buf);
+    if (r_size <= 0) {
+        return r_size;
     }
-    return w_size;
+    return audio_element_output_buf(self, buf);
 }
 
 static esp_err_t _fatfs_close(audio_element_handle_t self)
@@ -32,6 +32,7 @@
 #include "audio_mem.h"
 #include "audio_element.h"
 #include "esp_http_client.h"
+#include "audio_time.h"
 #include <strings.h>
 
 static const char *TAG = "HTTP_STREAM";
@@ -40,6 +41,7 @@ static const char *TAG = "HTTP_STREAM";
 typedef struct http_stream {
     audio_stream_type_t             type;
     bool                            is_open;
+    bool                            at_start;   /* The next chunk read starts the stream, at media time 0 */
     esp_http_client_handle_t        client;
 } http_stream_t;
 
@@ -88,6 +90,7 @@ static esp_err_t _http_open(audio_element_handle_t self)
 
     audio_element_set_total_bytes(self, info.total_bytes);
 
+    http->at_start = true;
     http->is_open = true;
     return ESP_OK;
 }
@@ -109,12 +112,14 @@ static esp_err_t _http_close(audio_element_handle_t self)
 static int _http_read(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context)
 {
     http_stream_t *http = (http_stream_t *)audio_element_getdata(self);
-    audio_element_info_t info;
-    audio_element_getinfo(self, &info);
     int rlen = esp_http_client_read(http->client, buffer, len);
+    if (rlen > 0) {
+        audio_element_set_output_timestamp(self, http->at_start ? 0 : RB_PTS_NONE, audio_time_now_ns());
+        http->at_start = false;
+    }
     audio_element_update_byte_pos(self, rlen);
     
-    ESP_LOGD(TAG, "req lengh=%d, read=%d, pos=%d/%d", len, rlen, (int)info.byte_pos, (int)info.total_bytes);
+    ESP_LOGD(TAG, "req lengh=%d, read=%d, pos=%d/%d", len, rlen, (int)audio_element_get_byte_pos(self), (int)audio_element_get_total_bytes(self));
     return rlen;
 }
 
@@ -130,20 +135,17 @@ static int _http_write(audio_element_handle_t self, char *buffer, int len, TickT
 
 static int _http_process(audio_element_handle_t self, char *in_buffer, int in_len)
 {
-    int r_size = audio_element_input(self, in_buffer, in_len);
+    audio_buf_t *buf = NULL;
+    int r_size = audio_element_input_buf(self, &buf);
     if (audio_element_is_stopping(self) == true) {
         ESP_LOGW(TAG, "No output due to stopping");
+        audio_buf_unref(buf);
         return AEL_IO_ABORT;
     }
-    int w_size = 0;
-    if (r_size > 0){
-        w_size = audio_element_output(self, in_buffer, r_size);
+    if (r_size <= 0) {
+        return r_size;
     }
-    else{
-        w_size = r_size;
-    }
-    
-    return w_size;
+    return audio_element_output_buf(self, buf);
 }
 
 static esp_err_t _http_destroy(audio_element_handle_t self)
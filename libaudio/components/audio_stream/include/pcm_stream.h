@@ -81,6 +81,7 @@ typedef struct {
     int                     task_stack;         /*!< Task stack size */
     int                     task_core;          /*!< Task running in core (0 or 1) */
     int                     task_prio;          /*!< Task priority (based on freeRTOS priority) */
+    bool                    real_time;          /*!< Writer only, run the task of this element as SCHED_FIFO */
     struct   pcm            pcm;               /*!< pcm struct */
     unsigned int            card;               /* The card that the pcm belongs to.The default card is zero. */
     unsigned int            device;             /* The device that the pcm belongs to. The default device is zero. */
@@ -100,6 +101,7 @@ typedef struct {
     .task_stack = PCM_STREAM_TASK_STACK,             \
     .task_core = PCM_STREAM_TASK_CORE,               \
     .task_prio = PCM_STREAM_TASK_PRIO,               \
+    .real_time = false,                              \
     .pcm = {                                         \
         .fd = 0,                                     \
         .flags = 0,                                  \
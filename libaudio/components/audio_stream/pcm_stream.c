@@ -34,6 +34,7 @@
 #include "audio_element.h"
 #include "wav_head.h"
 #include "esp_log.h"
+#include "audio_time.h"
 #include "unistd.h"
 #include "fcntl.h"
 
@@ -43,6 +44,7 @@ typedef struct pcm_stream {
     pcm_stream_cfg_t config;
     audio_stream_type_t type;
     bool is_open;
+    int64_t frames;     /* Frames read since the open, the media time of a reader */
     // bool use_alc;
     // void *volume_handle;
     // int volume
@@ -62,7 +64,7 @@ static esp_err_t _pcm_open(audio_element_handle_t self) {
         flags = PCM_IN;
     }
     if (cfg) {
-        free(cfg);
+        audio_free(cfg);
     }
     struct pcm *pcm_t = audio_calloc(1, sizeof(struct pcm));
     pcm_t = pcm_open(card, device, flags, &(pcm_stream->config.pcm.config));
@@ -73,6 +75,7 @@ static esp_err_t _pcm_open(audio_element_handle_t self) {
         return ESP_FAIL;
     }
     memcpy(&pcm_stream->config.pcm, pcm_t, sizeof(struct pcm));
+    pcm_stream->frames = 0;
     audio_element_setdata(self, pcm_stream);
     if (pcm_t) {
         free(pcm_t);
@@ -97,14 +100,12 @@ static esp_err_t _pcm_close(audio_element_handle_t self) {
 }
 
 static int _pcm_process(audio_element_handle_t self, char *in_buffer, int in_len) {
-    int r_size = audio_element_input(self, in_buffer, in_len);
-    int w_size = 0;
-    if (r_size > 0) {
-        w_size = audio_element_output(self, in_buffer, r_size);
-    } else {
-        w_size = r_size;
+    audio_buf_t *buf = NULL;
+    int r_size = audio_element_input_buf(self, &buf);
+    if (r_size <= 0) {
+        return r_size;
     }
-    return w_size;
+    return audio_element_output_buf(self, buf);
 }
 
 static esp_err_t _pcm_destroy(audio_element_handle_t self) {
@@ -115,8 +116,6 @@ static esp_err_t _pcm_destroy(audio_element_handle_t self) {
 
 static int _pcm_write(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context) {
     pcm_stream_t *pcm_stream = (pcm_stream_t *)audio_element_getdata(self);
-    audio_element_info_t info;
-    audio_element_getinfo(self, &info);
     struct pcm *pcm_t = &pcm_stream->config.pcm;
     int written_frames = pcm_writei(pcm_t, buffer, pcm_bytes_to_frames(pcm_t, len));
     if (written_frames < 0) {
@@ -124,15 +123,22 @@ static int _pcm_write(audio_element_handle_t self, char *buffer, int len, TickTy
         return written_frames;
     }
     int written_bytes = pcm_frames_to_bytes(pcm_t, written_frames);
-    info.byte_pos += written_bytes;
-    audio_element_setinfo(self, &info);
+    audio_element_update_byte_pos(self, written_bytes);
+
+    /* What leaves the DAC now is the delay behind the end of this write */
+    rb_timestamp_t ts;
+    unsigned int rate = pcm_get_rate(pcm_t);
+    if (rate && audio_element_get_input_timestamp(self, &ts) == ESP_OK && ts.pts != RB_PTS_NONE) {
+        long delay = pcm_get_delay(pcm_t);
+        int64_t ahead_us = (int64_t)pcm_bytes_to_frames(pcm_t, ts.offset + written_bytes) * 1000000 / rate
+                           - (int64_t)(delay > 0 ? delay : 0) * 1000000 / rate;
+        audio_element_set_presentation(self, ts.pts + ahead_us, ts.origin_ns ? ts.origin_ns + ahead_us * 1000 : 0);
+    }
     return written_bytes;
 }
 
 static int _pcm_read(audio_element_handle_t self, char *buffer, int len, TickType_t ticks_to_wait, void *context) {
     pcm_stream_t *pcm_stream = (pcm_stream_t *)audio_element_getdata(self);
-    audio_element_info_t info;
-    audio_element_getinfo(self, &info);
     struct pcm *pcm_t = &pcm_stream->config.pcm;
     // int read_frames = pcm_readi(pcm_t, buffer, pcm_bytes_to_frames(pcm_t, len));
     int read_frames = pcm_readi(pcm_t, buffer, pcm_get_buffer_size(pcm_t));
@@ -141,8 +147,16 @@ static int _pcm_read(audio_element_handle_t self, char *buffer, int len, TickTyp
         return read_frames;
     }
     int read_bytes = pcm_frames_to_bytes(pcm_t, read_frames);
-    info.byte_pos += read_bytes;
-    audio_element_setinfo(self, &info);
+    audio_element_update_byte_pos(self, read_bytes);
+
+    /* The first frame read was captured the frames still queued plus the frames read ago */
+    unsigned int rate = pcm_get_rate(pcm_t);
+    if (rate) {
+        long delay = pcm_get_delay(pcm_t);
+        int64_t age_ns = ((delay > 0 ? delay : 0) + (int64_t)read_frames) * 1000000000 / rate;
+        audio_element_set_output_timestamp(self, pcm_stream->frames * 1000000 / rate, audio_time_now_ns() - age_ns);
+    }
+    pcm_stream->frames += read_frames;
     return read_bytes;
 }
 
@@ -172,6 +186,8 @@ audio_element_handle_t pcm_stream_init(pcm_stream_cfg_t *config)
 
     if (config->type == AUDIO_STREAM_WRITER) {
         cfg.write = _pcm_write;
+        /* The sound card drains on a deadline */
+        cfg.task_real_time = config->real_time;
     } else {
         cfg.read = _pcm_read;
     }
@@ -17,6 +17,9 @@ typedef struct mp3_decoder
     short output[2304];
     //mp3_file_type mp3_type;
     bool is_open;
+    int64_t pts;            /* Media time of the next frame out, in microseconds */
+    int64_t origin_ns;      /* When the source produced the input of the frames */
+    rb_timestamp_t sync;    /* Input stamp the media time was last set from */
 } mp3_decoder_t;
 
 audio_element_handle_t mp3_decoder_init(mp3_decoder_cfg_t *config)
@@ -72,6 +75,9 @@ esp_err_t mp3_decoder_open(audio_element_handle_t el)
         return ESP_FAIL;
     }
     mp3Decder->is_open = true;
+    mp3Decder->pts = 0;
+    mp3Decder->origin_ns = 0;
+    mp3Decder->sync.pts = RB_PTS_NONE;
     ESP_LOGI(TAG, "open down");
     return ESP_OK;
 }
@@ -94,10 +100,157 @@ esp_err_t mp3_decoder_close(audio_element_handle_t el)
     return ESP_OK;
 }
 
+/*
+ * Refresh the stream info from the last decoded frame and send its PCM out
+ */
+static esp_err_t mp3_decoder_output_frame(audio_element_handle_t el, mp3_decoder_t *mp3Decder, audio_element_info_t *info, int *w_size)
+{
+    MP3FrameInfo *Mp3FrameInfo = &mp3Decder->Mp3FrameInfo;
+    int pcm_num_per_frame = 0;
+
+    MP3GetLastFrameInfo(mp3Decder->Mp3Dec_ptr, Mp3FrameInfo);
+    pcm_num_per_frame = Mp3FrameInfo->outputSamps;
+
+    if(info->bits != Mp3FrameInfo->bitsPerSample || info->channels != Mp3FrameInfo->nChans  || \
+        info->sample_rates != Mp3FrameInfo->samprate || info->bps != Mp3FrameInfo->bitrate  || \
+        info->codec_fmt != ESP_CODEC_TYPE_MP3  ||  info->reserve_data.user_data_0 != (int)144*Mp3FrameInfo->bitrate/Mp3FrameInfo->samprate+1)
+    {
+        info->bits = Mp3FrameInfo->bitsPerSample;
+        info->channels = Mp3FrameInfo->nChans;
+        info->sample_rates = Mp3FrameInfo->samprate;
+        info->bps = Mp3FrameInfo->bitrate;
+        info->codec_fmt = ESP_CODEC_TYPE_MP3;
+        info->reserve_data.user_data_0 = (int)144*Mp3FrameInfo->bitrate/Mp3FrameInfo->samprate+1;
+        audio_element_setinfo(el, info);
+        audio_element_report_info(el);
+    }
+
+    /* Take the media time from the input when it has one, between stamps count the samples decoded */
+    rb_timestamp_t ts;
+    if (audio_element_get_input_timestamp(el, &ts) == ESP_OK)
+    {
+        if (ts.pts != RB_PTS_NONE && (ts.pts != mp3Decder->sync.pts || ts.origin_ns != mp3Decder->sync.origin_ns))
+        {
+            mp3Decder->pts = ts.pts;
+            mp3Decder->sync = ts;
+        }
+        mp3Decder->origin_ns = ts.origin_ns;
+    }
+
+    if (pcm_num_per_frame > 0)
+    {
+        audio_element_set_output_timestamp(el, mp3Decder->pts, mp3Decder->origin_ns);
+        if (Mp3FrameInfo->nChans > 0 && Mp3FrameInfo->samprate > 0)
+        {
+            mp3Decder->pts += (int64_t)pcm_num_per_frame / Mp3FrameInfo->nChans * 1000000 / Mp3FrameInfo->samprate;
+        }
+        if (Mp3FrameInfo->nChans == 1){
+            for(int i = pcm_num_per_frame - 1; i >= 0; i--){
+                mp3Decder->output[i * 2] = mp3Decder->output[i];
+                mp3Decder->output[i * 2 + 1] = mp3Decder->output[i];
+            }
+            pcm_num_per_frame =pcm_num_per_frame * 2;
+        }
+
+        pcm_num_per_frame = pcm_num_per_frame * sizeof(short);
+        *w_size = audio_element_output(el, (char *)mp3Decder->output, pcm_num_per_frame);
+        if (*w_size != pcm_num_per_frame)
+        {
+            ESP_LOGE(TAG, "audio_element_output Failed!");
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+static int mp3_decoder_frame_size(audio_element_info_t *info)
+{
+    if(info->reserve_data.user_data_0>200)
+    {
+        return info->reserve_data.user_data_0;
+    }
+    return 512;
+}
+
+/*
+ * Decode straight out of a mirrored input ringbuf. Every span the ring hands out is contiguous, so frames are
+ * parsed in place, even across the wrap, and nothing is copied into in_buffer or memmoved.
+ */
+static esp_codec_err_t mp3_decoder_process_in_place(audio_element_handle_t el, char *in_buffer, int in_len)
+{
+    mp3_decoder_t *mp3Decder = (mp3_decoder_t *)audio_element_getdata(el);
+    audio_element_info_t info;
+    audio_element_getinfo(el, &info);
+    int framesize = mp3_decoder_frame_size(&info);
+    int wanted = in_len > framesize * 2 ? in_len : framesize * 2;
+    char *start = NULL;
+    int w_size = 0;
+
+    int left = audio_element_input_peek(el, &start, wanted);
+    if (left == AEL_IO_TIMEOUT)
+    {
+        memset(in_buffer, 0x00, in_len);
+        return audio_element_output(el, in_buffer, in_len);
+    }
+    if (left <= 0)
+    {
+        return left;
+    }
+    /* End of stream only once the peeked span holds everything the writer will ever send */
+    ringbuf_handle_t in_rb = audio_element_get_input_ringbuf(el);
+    bool eos = rb_is_done_write(in_rb) && rb_bytes_filled(in_rb) <= left;
+    char *readPtr = start;
+
+    while (1)
+    {
+        int offset = MP3FindSyncWord((unsigned char *)readPtr, left);
+        if (offset < 0)
+        {
+            /* Keep the last bytes, a sync word may straddle the end of the data */
+            readPtr += (eos || left < 3) ? left : left - 3;
+            break;
+        }
+        if (!eos && (left - offset) < framesize)
+        {
+            readPtr += offset;
+            break;
+        }
+        readPtr += offset;
+        left -= offset;
+        if (MP3Decode(mp3Decder->Mp3Dec_ptr, (unsigned char **)&readPtr, &left, mp3Decder->output, 0) != 0)
+        {
+            if (eos)
+            {
+                ESP_LOGW(TAG, "MP3Decode Failed at end of stream, left: %d", left);
+                audio_element_input_consume(el, readPtr - start + left);
+                return ESP_CODEC_ERR_DONE;
+            }
+            ESP_LOGE(TAG, "MP3Decode Failed!");
+            return ESP_CODEC_ERR_FAIL;
+        }
+        audio_element_input_consume(el, readPtr - start);
+        start = readPtr;
+        if (mp3_decoder_output_frame(el, mp3Decder, &info, &w_size) != ESP_OK)
+        {
+            return w_size;
+        }
+        if (left <= 0)
+        {
+            return w_size;
+        }
+    }
+    audio_element_input_consume(el, readPtr - start);
+    return ESP_CODEC_ERR_CONTINUE;
+}
+
 esp_codec_err_t mp3_decoder_process(audio_element_handle_t el, char *in_buffer, int in_len)
 {
     static int last_left;
     int w_size = 0;
+    if (last_left == 0 && rb_is_mirrored(audio_element_get_input_ringbuf(el)))
+    {
+        return mp3_decoder_process_in_place(el, in_buffer, in_len);
+    }
     int r_size = audio_element_input(el, in_buffer + last_left, in_len - last_left);
     int framesize;
 
@@ -113,22 +266,14 @@ esp_codec_err_t mp3_decoder_process(audio_element_handle_t el, char *in_buffer,
     {
         mp3_decoder_t *mp3Decder = (mp3_decoder_t *)audio_element_getdata(el);
         HMP3Decoder Mp3Decoder = mp3Decder->Mp3Dec_ptr;
-        MP3FrameInfo *Mp3FrameInfo = &mp3Decder->Mp3FrameInfo;
         audio_element_info_t info;
         audio_element_getinfo(el, &info);
-        if(info.reserve_data.user_data_0>200)
-        {
-            framesize = info.reserve_data.user_data_0;
-        }
-        else{
-            framesize =512;
-        }
+        framesize = mp3_decoder_frame_size(&info);
 
         // int framesize = info.reserve_data.user_data_0;
-        printf("framesize=%d\n", framesize);
+        ESP_LOGD(TAG, "framesize=%d", framesize);
 
         int decoder_err = 0;
-        int pcm_num_per_frame = 0;
         int offset = 0;
         int left = last_left + r_size;
         char *readPtr = in_buffer;
@@ -139,7 +284,7 @@ esp_codec_err_t mp3_decoder_process(audio_element_handle_t el, char *in_buffer,
             offset = MP3FindSyncWord(readPtr, left);
             if ((offset < 0) || (left - offset) < framesize)
             { // not find sync
-                ESP_LOGI(TAG, "no found sync!");
+                ESP_LOGD(TAG, "no found sync!");
                 memmove(in_buffer, readPtr, left);
                 last_left = left;
                 //printf("process down\n");
@@ -149,7 +294,7 @@ esp_codec_err_t mp3_decoder_process(audio_element_handle_t el, char *in_buffer,
             readPtr += offset;
             left = left - offset;
 
-            printf("after findSyncword left=%d\n", left);
+            ESP_LOGD(TAG, "after findSyncword left=%d", left);
 
             decoder_err = MP3Decode(Mp3Decoder, &readPtr, &left, output, 0);
             if (decoder_err != 0)
@@ -158,61 +303,19 @@ esp_codec_err_t mp3_decoder_process(audio_element_handle_t el, char *in_buffer,
                 return ESP_CODEC_ERR_FAIL;
             }
 
-            MP3GetLastFrameInfo(Mp3Decoder, Mp3FrameInfo);
-            pcm_num_per_frame = Mp3FrameInfo->outputSamps;
-
-            if(info.bits != Mp3FrameInfo->bitsPerSample || info.channels != Mp3FrameInfo->nChans  || \
-                info.sample_rates != Mp3FrameInfo->samprate || info.bps != Mp3FrameInfo->bitrate  || \
-                info.codec_fmt != ESP_CODEC_TYPE_MP3  ||  info.reserve_data.user_data_0 != (int)144*Mp3FrameInfo->bitrate/Mp3FrameInfo->samprate+1)
+            if (mp3_decoder_output_frame(el, mp3Decder, &info, &w_size) != ESP_OK)
             {
-                info.bits = Mp3FrameInfo->bitsPerSample;
-                info.channels = Mp3FrameInfo->nChans;
-                info.sample_rates = Mp3FrameInfo->samprate;
-                info.bps = Mp3FrameInfo->bitrate;
-                info.codec_fmt = ESP_CODEC_TYPE_MP3;
-                info.reserve_data.user_data_0 = (int)144*Mp3FrameInfo->bitrate/Mp3FrameInfo->samprate+1;
-                audio_element_setinfo(el, &info);
-                audio_element_report_info(el);
-            }
-            // printf(" \r\n Bitrate       %dKbps", Mp3FrameInfo->bitrate / 1000);
-            // printf(" \r\n Samprate      %dHz", Mp3FrameInfo->samprate);
-            // printf(" \r\n BitsPerSample %db", Mp3FrameInfo->bitsPerSample);
-            // printf(" \r\n nChans        %d", Mp3FrameInfo->nChans);
-            // printf(" \r\n Layer         %d", Mp3FrameInfo->layer);
-            // printf(" \r\n Version       %d", Mp3FrameInfo->version);
-            // printf(" \r\n OutputSamps   %d", Mp3FrameInfo->outputSamps);
-            // printf(" \r\n ");
-
-
-            if (pcm_num_per_frame > 0)
-            {
-                if (Mp3FrameInfo->nChans == 1){
-                    for(int i = pcm_num_per_frame - 1; i >= 0; i--){
-                        mp3Decder->output[i * 2] = mp3Decder->output[i];
-                        mp3Decder->output[i * 2 + 1] = mp3Decder->output[i];
-                    }
-                    pcm_num_per_frame =pcm_num_per_frame * 2;
-                }
-
-                pcm_num_per_frame = pcm_num_per_frame * sizeof(short);
-                w_size = audio_element_output(el, output, pcm_num_per_frame);
-                if (w_size != pcm_num_per_frame)
-                {
-                    ESP_LOGE(TAG, "audio_element_output Failed!");
-                    break;
-                }
+                break;
             }
         }
     }
     else if ((r_size == AEL_IO_DONE) && last_left > 0) {
         mp3_decoder_t *mp3Decder = (mp3_decoder_t *)audio_element_getdata(el);
         HMP3Decoder Mp3Decoder = mp3Decder->Mp3Dec_ptr;
-        MP3FrameInfo *Mp3FrameInfo = &mp3Decder->Mp3FrameInfo;
         audio_element_info_t info;
         audio_element_getinfo(el, &info);
 
         int decoder_err = 0;
-        int pcm_num_per_frame = 0;
         int offset = 0;
         int left = last_left;
         char *readPtr = in_buffer;
@@ -224,7 +327,7 @@ esp_codec_err_t mp3_decoder_process(audio_element_handle_t el, char *in_buffer,
             readPtr += offset;
             left = left - offset;
 
-            printf("after findSyncword left=%d\n", left);
+            ESP_LOGD(TAG, "after findSyncword left=%d", left);
 
             decoder_err = MP3Decode(Mp3Decoder, &readPtr, &left, output, 0);
             if (decoder_err != 0)
@@ -235,40 +338,9 @@ esp_codec_err_t mp3_decoder_process(audio_element_handle_t el, char *in_buffer,
                 return ESP_CODEC_ERR_DONE;
             }
 
-            MP3GetLastFrameInfo(Mp3Decoder, Mp3FrameInfo);
-            pcm_num_per_frame = Mp3FrameInfo->outputSamps;
-
-            if(info.bits != Mp3FrameInfo->bitsPerSample || info.channels != Mp3FrameInfo->nChans  || \
-                info.sample_rates != Mp3FrameInfo->samprate || info.bps != Mp3FrameInfo->bitrate  || \
-                info.codec_fmt != ESP_CODEC_TYPE_MP3  ||  info.reserve_data.user_data_0 != (int)144*Mp3FrameInfo->bitrate/Mp3FrameInfo->samprate+1)
-            {
-                info.bits = Mp3FrameInfo->bitsPerSample;
-                info.channels = Mp3FrameInfo->nChans;
-                info.sample_rates = Mp3FrameInfo->samprate;
-                info.bps = Mp3FrameInfo->bitrate;
-                info.codec_fmt = ESP_CODEC_TYPE_MP3;
-                info.reserve_data.user_data_0 = (int)144*Mp3FrameInfo->bitrate/Mp3FrameInfo->samprate+1;
-                audio_element_setinfo(el, &info);
-                audio_element_report_info(el);
-            }
-
-            if (pcm_num_per_frame > 0)
+            if (mp3_decoder_output_frame(el, mp3Decder, &info, &w_size) != ESP_OK)
             {
-                if (Mp3FrameInfo->nChans == 1){
-                    for(int i = pcm_num_per_frame - 1; i >= 0; i--){
-                        mp3Decder->output[i * 2] = mp3Decder->output[i];
-                        mp3Decder->output[i * 2 + 1] = mp3Decder->output[i];
-                    }
-                    pcm_num_per_frame =pcm_num_per_frame * 2;
-                }
-
-                pcm_num_per_frame = pcm_num_per_frame * sizeof(short);
-                w_size = audio_element_output(el, output, pcm_num_per_frame);
-                if (w_size != pcm_num_per_frame)
-                {
-                    ESP_LOGE(TAG, "audio_element_output Failed!");
-                    break;
-                }
+                break;
             }
         }
     }
@@ -44,6 +44,7 @@
 #include <string.h>	/* for memmove, memcpy (can replace with different implementations if desired) */
 #include "mp3common.h"	/* includes mp3dec.h (public API) and internal, platform-independent API */
 #include "coder.h"
+#include "audio_usdt.h"
 /**************************************************************************************
  * Function:    MP3InitDecoder
  *
@@ -275,7 +276,7 @@ static void MP3ClearBadFrame(MP3DecInfo *mp3DecInfo, short *outbuf)
  * Notes:       switching useSize on and off between frames in the same stream 
  *                is not supported (bit reservoir is not maintained if useSize on)
  **************************************************************************************/
-int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, short *outbuf, int useSize)
+static int MP3DecodeFrame(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, short *outbuf, int useSize)
 {
 	int offset, bitOffset, mainBits, gr, ch, fhBytes, siBytes, freeFrameBytes;
 	int prevBitOffset, sfBlockBits, huffBlockBits;
@@ -413,3 +414,15 @@ int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, sh
 	}
 	return ERR_MP3_NONE;
 }
+
+/* frame boundaries for tracers, see audio_usdt.h */
+int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, short *outbuf, int useSize)
+{
+	int err, left = *bytesLeft;
+
+	AUDIO_USDT2(mp3_frame_entry, hMP3Decoder, left);
+	err = MP3DecodeFrame(hMP3Decoder, inbuf, bytesLeft, outbuf, useSize);
+	AUDIO_USDT3(mp3_frame_return, hMP3Decoder, err, left - *bytesLeft);
+
+	return err;
+}
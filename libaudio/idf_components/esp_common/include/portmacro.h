@@ -27,6 +27,11 @@ typedef unsigned portBASE_TYPE	UBaseType_t;
 typedef uint32_t TickType_t;
 #define portMAX_DELAY ( TickType_t ) 0xffffUL
 
+/* A tick is one second. Timeouts with portTICK_MS_FLAG set count milliseconds instead. */
+#define portTICK_MS_FLAG        ( ( TickType_t ) 0x80000000UL )
+#define pdMS_TO_TICKS( xTimeInMs )  \
+    ( ( TickType_t ) ( ( xTimeInMs ) ? ( portTICK_MS_FLAG | ( ( TickType_t ) ( xTimeInMs ) & ~portTICK_MS_FLAG ) ) : 0 ) )
+
 typedef int portMUX_TYPE;
 
 #ifdef __cplusplus
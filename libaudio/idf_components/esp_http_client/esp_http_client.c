@@ -9,6 +9,7 @@
 #include "esp_log.h"
 #include "esp_check.h"
 #include "esp_http_client.h"
+#include "audio_usdt.h"
 #include "errno.h"
 
 #include <stdio.h>//printf
@@ -139,7 +140,9 @@ int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len)
     if((!client->response->head_buffer) || (!client->response->headers.content_length)){
         return 0;
     }
+    AUDIO_USDT2(http_read_entry, client, len);
     int ridx = read(client->client_socket,buffer,len);
+    AUDIO_USDT2(http_read_return, client, ridx);
 
     return ridx;
 }
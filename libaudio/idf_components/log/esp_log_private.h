@@ -1,6 +1,39 @@
 #pragma once
 #include <stdbool.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include "esp_log.h"
+
+#ifndef CONFIG_LOG_ASYNC
+#define CONFIG_LOG_ASYNC 0                  // 1 to start the async backend on the first log
+#endif
+
+#ifndef CONFIG_LOG_ASYNC_RECORDS
+#define CONFIG_LOG_ASYNC_RECORDS 64         // Records per thread, power of 2
+#endif
+
+#ifndef CONFIG_LOG_ASYNC_RECORD_SIZE
+#define CONFIG_LOG_ASYNC_RECORD_SIZE 256    // Longer messages are cut, also the largest binary record
+#endif
 
 void esp_log_impl_lock(void);
 bool esp_log_impl_lock_timeout(void);
 void esp_log_impl_unlock(void);
+
+// Print through the function set with esp_log_set_vprintf
+int esp_log_impl_print(const char *format, ...) __attribute__ ((format (printf, 1, 2)));
+
+// Queue the message on the async backend, false when it is not running
+bool esp_log_async_writev(const char *format, va_list args);
+
+// Start the async backend once if CONFIG_LOG_ASYNC is set
+void esp_log_async_auto_start(void);
+
+// Queue a record of the binary stream on the async backend, false when it is not running
+bool esp_log_async_write_binary(const void *data, size_t len);
+
+// Write the message to the binary stream, false when there is none
+bool esp_log_binary_writev(esp_log_level_t level, const char *format, va_list args);
+
+// Write records to the binary stream
+void esp_log_binary_output(const void *data, size_t len);
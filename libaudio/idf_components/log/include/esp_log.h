@@ -7,6 +7,7 @@
 #ifndef __ESP_LOG_H__
 #define __ESP_LOG_H__
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdarg.h>
 #include "sdkconfig.h"
@@ -40,6 +41,15 @@ typedef int (*vprintf_like_t)(const char *, va_list);
  */
 extern esp_log_level_t esp_log_default_level;
 
+/**
+ * @brief Highest level any tag may log at
+ *
+ * Kept by esp_log_level_set, the ESP_LOGx macros check it before they
+ * evaluate their arguments, so a message no tag is set to show costs a
+ * compare. It is an upper bound, lowering the level of a tag keeps it.
+ */
+extern esp_log_level_t esp_log_max_level;
+
 /**
  * @brief Set log level for given tag
  *
@@ -86,6 +96,67 @@ esp_log_level_t esp_log_level_get(const char* tag);
  */
 vprintf_like_t esp_log_set_vprintf(vprintf_like_t func);
 
+/**
+ * @brief Start the asynchronous log backend
+ *
+ * From then on a log call formats the message into a ring of its own thread
+ * and returns, a writer thread prints the messages of all threads in order
+ * through the function set with esp_log_set_vprintf. A message that finds the
+ * ring of its thread full is dropped and counted, the writer reports the count.
+ * The log call never waits for the output or the log lock.
+ * CONFIG_LOG_ASYNC=1 starts the backend on the first log. What is still queued
+ * at exit is printed.
+ *
+ * @return 0 on success, an errno value if the writer thread could not be created
+ */
+int esp_log_async_start(void);
+
+/**
+ * @brief Stop the asynchronous log backend once the queued messages are printed,
+ *        log calls print synchronously again
+ */
+void esp_log_async_stop(void);
+
+/**
+ * @brief Wait until the messages queued so far are printed
+ */
+void esp_log_async_flush(void);
+
+/**
+ * @brief Get the number of messages dropped by the asynchronous backend
+ *
+ * @return Messages dropped since the start of the process
+ */
+uint32_t esp_log_async_get_dropped(void);
+
+/**
+ * @brief Write log messages to a file descriptor in binary form
+ *
+ * A log call then copies the raw arguments of the message next to an id of
+ * its format and a timestamp instead of formatting it, each format goes into
+ * the stream once. With the asynchronous backend running the records are
+ * written by its writer thread. Decode the stream with esp_log_binary_decode,
+ * or the esp_log_decode tool built from tools/esp_log_decode.c.
+ *
+ * @param fd Descriptor to write to, -1 to go back to text output
+ *
+ * @return 0 on success, -1 if the stream header could not be written
+ */
+int esp_log_set_binary_output(int fd);
+
+/**
+ * @brief Turn a binary log stream back into text
+ *
+ * The stream must have been written on a host with the same ABI.
+ *
+ * @param in_fd     Descriptor to read the stream from, up to its end
+ * @param out_fd    Descriptor to write the messages to
+ * @param show_time Prefix each message with the monotonic time it was logged at
+ *
+ * @return Number of messages decoded, -1 if the input is not a binary log stream
+ */
+int esp_log_binary_decode(int in_fd, int out_fd, bool show_time);
+
 /**
  * @brief Function which returns timestamp to be used in log output
  *
@@ -148,6 +219,8 @@ void esp_log_writev(esp_log_level_t level, const char* tag, const char* format,
 
 #include "esp_log_internal.h"
 
+// Calls above LOG_LOCAL_LEVEL are compiled out. The Makefile and BUILD.gn set it per
+// component (LOG_LEVEL_AUDIO_PIPELINE=2 and the like), a file can define it before the include.
 #ifndef LOG_LOCAL_LEVEL
 #ifndef BOOTLOADER_BUILD
 #define LOG_LOCAL_LEVEL  CONFIG_LOG_MAXIMUM_LEVEL
@@ -424,12 +497,13 @@ void esp_log_writev(esp_log_level_t level, const char* tag, const char* format,
 #endif //CONFIG_LOG_TIMESTAMP_SOURCE_xxx
 #endif // !(defined(__cplusplus) && (__cplusplus >  201703L))
 
-/** runtime macro to output logs at a specified level. Also check the level with ``LOG_LOCAL_LEVEL``.
+/** runtime macro to output logs at a specified level. Also check the level with ``LOG_LOCAL_LEVEL``,
+ *  which compiles the call out when below it, and with ``esp_log_max_level``.
  *
  * @see ``printf``, ``ESP_LOG_LEVEL``
  */
 #define ESP_LOG_LEVEL_LOCAL(level, tag, format, ...) do {               \
-        if ( LOG_LOCAL_LEVEL >= level ) ESP_LOG_LEVEL(level, tag, format, ##__VA_ARGS__); \
+        if ( LOG_LOCAL_LEVEL >= level && esp_log_max_level >= level ) ESP_LOG_LEVEL(level, tag, format, ##__VA_ARGS__); \
     } while(0)
 
 
@@ -35,6 +35,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <stdatomic.h>
 #include "esp_log.h"
 #include "esp_log_private.h"
 
@@ -50,12 +51,21 @@
 // Number of tags to be cached. Must be 2**n - 1, n >= 2.
 #define TAG_CACHE_SIZE 31
 
+// Number of tags each thread keeps a copy of the level for, so that a log call takes no lock once warm.
+#define TLS_TAG_CACHE_SIZE 8
+
 typedef struct {
     const char *tag;
     uint32_t level : 3;
     uint32_t generation : 29;
 } cached_tag_entry_t;
 
+typedef struct {
+    const char *tag;
+    uint32_t generation;
+    esp_log_level_t level;
+} tls_tag_entry_t;
+
 typedef struct uncached_tag_entry_ {
     SLIST_ENTRY(uncached_tag_entry_) entries;
     uint8_t level;  // esp_log_level_t as uint8_t
@@ -63,11 +73,16 @@ typedef struct uncached_tag_entry_ {
 } uncached_tag_entry_t;
 
 esp_log_level_t esp_log_default_level = CONFIG_LOG_DEFAULT_LEVEL;
+esp_log_level_t esp_log_max_level = CONFIG_LOG_DEFAULT_LEVEL;
 static SLIST_HEAD(log_tags_head, uncached_tag_entry_) s_log_tags = SLIST_HEAD_INITIALIZER(s_log_tags);
 static cached_tag_entry_t s_log_cache[TAG_CACHE_SIZE];
 static uint32_t s_log_cache_max_generation = 0;
 static uint32_t s_log_cache_entry_count = 0;
 static vprintf_like_t s_log_print_func = &vprintf;
+// Bumped by every level change, entries of the per-thread caches from an older generation are stale
+static atomic_uint s_log_level_generation = 1;
+static __thread tls_tag_entry_t s_tls_cache[TLS_TAG_CACHE_SIZE];
+static __thread uint32_t s_tls_cache_next;
 
 #ifdef LOG_BUILTIN_CHECKS
 static uint32_t s_log_cache_misses = 0;
@@ -98,11 +113,18 @@ void esp_log_level_set(const char *tag, esp_log_level_t level)
     // for wildcard tag, remove all linked list items and clear the cache
     if (strcmp(tag, "*") == 0) {
         esp_log_default_level = level;
+        esp_log_max_level = level;
         clear_log_level_list();
+        atomic_fetch_add_explicit(&s_log_level_generation, 1, memory_order_release);
         esp_log_impl_unlock();
         return;
     }
 
+    // lowering a tag keeps the maximum, which is only an upper bound
+    if (level > esp_log_max_level) {
+        esp_log_max_level = level;
+    }
+
     // search for existing tag
     uncached_tag_entry_t *it = NULL;
     SLIST_FOREACH(it, &s_log_tags, entries) {
@@ -138,6 +160,7 @@ void esp_log_level_set(const char *tag, esp_log_level_t level)
             break;
         }
     }
+    atomic_fetch_add_explicit(&s_log_level_generation, 1, memory_order_release);
     esp_log_impl_unlock();
 }
 
@@ -170,6 +193,34 @@ esp_log_level_t esp_log_level_get(const char *tag)
     return s_log_level_get_and_unlock(tag);
 }
 
+/* Level lookup of the log calls, the lock is only taken when the tag is not in the cache of the thread */
+static esp_log_level_t s_log_level_get_cached(const char *tag)
+{
+    uint32_t generation = atomic_load_explicit(&s_log_level_generation, memory_order_acquire);
+    for (int i = 0; i < TLS_TAG_CACHE_SIZE; i++) {
+        if (s_tls_cache[i].tag == tag && s_tls_cache[i].generation == generation) {
+            return s_tls_cache[i].level;
+        }
+    }
+    esp_log_impl_lock();
+    esp_log_level_t level = s_log_level_get_and_unlock(tag);
+    s_tls_cache[s_tls_cache_next++ % TLS_TAG_CACHE_SIZE] = (tls_tag_entry_t) {
+        .tag = tag,
+        .generation = generation,
+        .level = level
+    };
+    return level;
+}
+
+int esp_log_impl_print(const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    int ret = (*s_log_print_func)(format, list);
+    va_end(list);
+    return ret;
+}
+
 void clear_log_level_list(void)
 {
     uncached_tag_entry_t *it;
@@ -189,11 +240,12 @@ void esp_log_writev(esp_log_level_t level,
                    const char *format,
                    va_list args)
 {
-    if (!esp_log_impl_lock_timeout()) {
+    esp_log_level_t level_for_tag = s_log_level_get_cached(tag);
+    if (!should_output(level, level_for_tag)) {
         return;
     }
-    esp_log_level_t level_for_tag = s_log_level_get_and_unlock(tag);
-    if (!should_output(level, level_for_tag)) {
+    esp_log_async_auto_start();
+    if (esp_log_binary_writev(level, format, args) || esp_log_async_writev(format, args)) {
         return;
     }
 
@@ -0,0 +1,338 @@
+/*
+ * SPDX-FileCopyrightText: 2015-2021 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Asynchronous log backend.
+ *
+ * Every thread that logs gets a ring of records of its own, with that
+ * thread as the only producer and the writer thread as the only consumer.
+ * The caller formats the message into the next free record and returns;
+ * the writer prints the records of all rings in the order they were made
+ * (a global sequence number) through the function set with
+ * esp_log_set_vprintf. A full ring drops the message and counts it, the
+ * writer reports the count once the ring has room again. A caller never
+ * waits for the output or for another thread.
+ *
+ * Rings are kept for the life of the process. When a thread exits its
+ * ring is released and the next new thread that logs takes it over.
+ */
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "esp_log.h"
+#include "esp_log_private.h"
+
+#define LOG_ASYNC_IDLE_NS   (100 * 1000 * 1000)
+
+typedef struct {
+    uint64_t seq;
+    uint32_t len;
+    bool binary;                        // A record of the binary stream rather than text
+    char text[CONFIG_LOG_ASYNC_RECORD_SIZE];
+} log_record_t;
+
+typedef struct log_ring_ {
+    struct log_ring_ *next;             // Never unlinked
+    atomic_int owned;                   // A live thread writes into this ring
+    atomic_uint head;                   // Written by the owner
+    atomic_uint tail;                   // Written by the writer thread
+    atomic_uint dropped;                // Written by the owner
+    uint32_t dropped_reported;          // Written by the writer thread
+    log_record_t records[CONFIG_LOG_ASYNC_RECORDS];
+} log_ring_t;
+
+static _Atomic(log_ring_t *) s_rings;
+static __thread log_ring_t *s_ring;
+static pthread_key_t s_ring_key;
+static pthread_once_t s_ring_key_once = PTHREAD_ONCE_INIT;
+static atomic_ullong s_seq;
+static atomic_uint s_lost;              // Messages of threads that could not get a ring
+static atomic_int s_running;
+static atomic_int s_writer_parked;
+static atomic_uint s_wake;
+static pthread_t s_writer;
+static pthread_mutex_t s_control = PTHREAD_MUTEX_INITIALIZER;
+
+static void log_async_release_ring(void *arg)
+{
+    log_ring_t *ring = (log_ring_t *)arg;
+    atomic_store_explicit(&ring->owned, 0, memory_order_release);
+}
+
+static void log_async_make_key(void)
+{
+    pthread_key_create(&s_ring_key, log_async_release_ring);
+}
+
+static log_ring_t *log_async_ring(void)
+{
+    if (s_ring) {
+        return s_ring;
+    }
+    log_ring_t *ring;
+    for (ring = atomic_load_explicit(&s_rings, memory_order_acquire); ring; ring = ring->next) {
+        int expected = 0;
+        if (atomic_load_explicit(&ring->owned, memory_order_relaxed) == 0
+            && atomic_compare_exchange_strong_explicit(&ring->owned, &expected, 1,
+                                                       memory_order_acquire, memory_order_relaxed)) {
+            break;
+        }
+    }
+    if (ring == NULL) {
+        ring = calloc(1, sizeof(log_ring_t));
+        if (ring == NULL) {
+            return NULL;
+        }
+        atomic_init(&ring->owned, 1);
+        ring->next = atomic_load_explicit(&s_rings, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&s_rings, &ring->next, ring,
+                                                      memory_order_release, memory_order_relaxed)) {
+        }
+    }
+    pthread_once(&s_ring_key_once, log_async_make_key);
+    pthread_setspecific(s_ring_key, ring);
+    s_ring = ring;
+    return ring;
+}
+
+static void log_async_wake(void)
+{
+    atomic_fetch_add_explicit(&s_wake, 1, memory_order_release);
+    syscall(SYS_futex, &s_wake, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// The next free record of the ring of this thread, NULL with the message counted as dropped
+static log_record_t *log_async_claim(log_ring_t **ring_out)
+{
+    log_ring_t *ring = log_async_ring();
+    if (ring == NULL) {
+        atomic_fetch_add_explicit(&s_lost, 1, memory_order_relaxed);
+        return NULL;
+    }
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= CONFIG_LOG_ASYNC_RECORDS) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return NULL;
+    }
+    *ring_out = ring;
+    return &ring->records[head & (CONFIG_LOG_ASYNC_RECORDS - 1)];
+}
+
+static void log_async_publish(log_ring_t *ring, log_record_t *rec)
+{
+    rec->seq = atomic_fetch_add_explicit(&s_seq, 1, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, atomic_load_explicit(&ring->head, memory_order_relaxed) + 1,
+                          memory_order_release);
+    // Pairs with the fence of the writer between parking and the last look at the rings
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&s_writer_parked, memory_order_relaxed)) {
+        log_async_wake();
+    }
+}
+
+bool esp_log_async_writev(const char *format, va_list args)
+{
+    if (!atomic_load_explicit(&s_running, memory_order_acquire)) {
+        return false;
+    }
+    log_ring_t *ring;
+    log_record_t *rec = log_async_claim(&ring);
+    if (rec == NULL) {
+        return true;
+    }
+    int len = vsnprintf(rec->text, sizeof(rec->text), format, args);
+    if (len < 0) {
+        len = 0;
+    } else if (len >= (int)sizeof(rec->text)) {
+        // Cut, but keep the line break the format ends with
+        len = sizeof(rec->text) - 1;
+        rec->text[len - 1] = '\n';
+    }
+    rec->len = len;
+    rec->binary = false;
+    log_async_publish(ring, rec);
+    return true;
+}
+
+bool esp_log_async_write_binary(const void *data, size_t len)
+{
+    if (!atomic_load_explicit(&s_running, memory_order_acquire)) {
+        return false;
+    }
+    log_ring_t *ring;
+    log_record_t *rec = log_async_claim(&ring);
+    if (rec == NULL) {
+        return true;
+    }
+    memcpy(rec->text, data, len);
+    rec->len = len;
+    rec->binary = true;
+    log_async_publish(ring, rec);
+    return true;
+}
+
+static bool log_async_pending(void)
+{
+    for (log_ring_t *ring = atomic_load_explicit(&s_rings, memory_order_acquire); ring; ring = ring->next) {
+        // Acquire on the tail, so that a flush returns after the output of the records
+        if (atomic_load_explicit(&ring->head, memory_order_acquire) != atomic_load_explicit(&ring->tail, memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Print everything queued so far, oldest first across the rings. Only the writer thread, or the caller of stop once it is gone.
+static int log_async_drain(void)
+{
+    int printed = 0;
+    while (1) {
+        log_ring_t *oldest = NULL;
+        log_record_t *rec = NULL;
+        for (log_ring_t *ring = atomic_load_explicit(&s_rings, memory_order_acquire); ring; ring = ring->next) {
+            uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+            if (atomic_load_explicit(&ring->head, memory_order_acquire) == tail) {
+                continue;
+            }
+            log_record_t *cur = &ring->records[tail & (CONFIG_LOG_ASYNC_RECORDS - 1)];
+            if (rec == NULL || cur->seq < rec->seq) {
+                oldest = ring;
+                rec = cur;
+            }
+        }
+        if (oldest == NULL) {
+            break;
+        }
+        if (rec->binary) {
+            esp_log_binary_output(rec->text, rec->len);
+        } else {
+            esp_log_impl_print("%.*s", (int)rec->len, rec->text);
+        }
+        atomic_store_explicit(&oldest->tail, atomic_load_explicit(&oldest->tail, memory_order_relaxed) + 1,
+                              memory_order_release);
+        printed++;
+    }
+    for (log_ring_t *ring = atomic_load_explicit(&s_rings, memory_order_acquire); ring; ring = ring->next) {
+        uint32_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        if (dropped != ring->dropped_reported) {
+            esp_log_impl_print("W (%u) LOG: %u messages dropped\n", esp_log_timestamp(), dropped - ring->dropped_reported);
+            ring->dropped_reported = dropped;
+            printed++;
+        }
+    }
+    if (printed) {
+        fflush(stdout);
+    }
+    return printed;
+}
+
+static void *log_async_writer(void *arg)
+{
+    (void)arg;
+    while (1) {
+        bool running = atomic_load_explicit(&s_running, memory_order_acquire);
+        if (log_async_drain() > 0) {
+            continue;
+        }
+        if (!running) {
+            break;
+        }
+        uint32_t wake = atomic_load_explicit(&s_wake, memory_order_acquire);
+        atomic_store_explicit(&s_writer_parked, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!log_async_pending() && atomic_load_explicit(&s_running, memory_order_relaxed)) {
+            // The timeout bounds how late a drop report can be
+            struct timespec idle = { 0, LOG_ASYNC_IDLE_NS };
+            syscall(SYS_futex, &s_wake, FUTEX_WAIT_PRIVATE, wake, &idle, NULL, 0);
+        }
+        atomic_store_explicit(&s_writer_parked, 0, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+static void log_async_atexit(void)
+{
+    esp_log_async_stop();
+}
+
+int esp_log_async_start(void)
+{
+    static bool s_atexit;
+    int ret = 0;
+    pthread_mutex_lock(&s_control);
+    if (!atomic_load_explicit(&s_running, memory_order_relaxed)) {
+        atomic_store_explicit(&s_running, 1, memory_order_release);
+        ret = pthread_create(&s_writer, NULL, log_async_writer, NULL);
+        if (ret != 0) {
+            atomic_store_explicit(&s_running, 0, memory_order_relaxed);
+        } else if (!s_atexit) {
+            // Whatever is still queued at exit gets printed
+            s_atexit = true;
+            atexit(log_async_atexit);
+        }
+    }
+    pthread_mutex_unlock(&s_control);
+    return ret;
+}
+
+void esp_log_async_stop(void)
+{
+    pthread_mutex_lock(&s_control);
+    if (atomic_load_explicit(&s_running, memory_order_relaxed)) {
+        atomic_store_explicit(&s_running, 0, memory_order_release);
+        log_async_wake();
+        pthread_join(s_writer, NULL);
+        // Messages queued by callers that saw the backend running just before
+        log_async_drain();
+    }
+    pthread_mutex_unlock(&s_control);
+}
+
+void esp_log_async_flush(void)
+{
+    while (atomic_load_explicit(&s_running, memory_order_acquire) && log_async_pending()) {
+        log_async_wake();
+        usleep(1000);
+    }
+}
+
+uint32_t esp_log_async_get_dropped(void)
+{
+    uint32_t dropped = atomic_load_explicit(&s_lost, memory_order_relaxed);
+    for (log_ring_t *ring = atomic_load_explicit(&s_rings, memory_order_acquire); ring; ring = ring->next) {
+        dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    }
+    return dropped;
+}
+
+#if CONFIG_LOG_ASYNC
+static pthread_once_t s_auto_start = PTHREAD_ONCE_INIT;
+
+static void log_async_auto_start(void)
+{
+    esp_log_async_start();
+}
+
+void esp_log_async_auto_start(void)
+{
+    pthread_once(&s_auto_start, log_async_auto_start);
+}
+#else
+void esp_log_async_auto_start(void)
+{
+}
+#endif
@@ -0,0 +1,246 @@
+/*
+ * SPDX-FileCopyrightText: 2015-2021 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Binary log output.
+ *
+ * Instead of formatting, a log call copies the raw arguments after a small
+ * header naming the format by id, see log_binary.h. A format gets its id
+ * the first time it is logged: the id is the slot of the format pointer in
+ * a lock-free table, and the format itself goes into the stream once, ahead
+ * of its first message. Records go through the async backend when it runs,
+ * otherwise straight to the descriptor. esp_log_binary_decode turns the
+ * stream back into text offline.
+ */
+
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_log_private.h"
+#include "log_binary.h"
+
+#ifndef CONFIG_LOG_BINARY_FORMATS
+#define CONFIG_LOG_BINARY_FORMATS 1024      // Formats with an id, power of 2, the others are sent as text
+#endif
+
+#define LOG_BIN_NO_ID   UINT32_MAX
+
+static atomic_int s_bin_fd = -1;
+// Bumped for every new stream, each stream needs the formats sent again
+static atomic_uint s_bin_epoch = 1;
+static _Atomic(const char *) s_bin_formats[CONFIG_LOG_BINARY_FORMATS];
+static atomic_uint s_bin_sent[CONFIG_LOG_BINARY_FORMATS];
+static pthread_mutex_t s_bin_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t log_bin_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void esp_log_binary_output(const void *data, size_t len)
+{
+    int fd = atomic_load_explicit(&s_bin_fd, memory_order_acquire);
+    const uint8_t *p = (const uint8_t *)data;
+    while (fd >= 0 && len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+static void log_bin_put(uint8_t *record, log_bin_header_t *hdr)
+{
+    memcpy(record, hdr, sizeof(*hdr));
+    if (!esp_log_async_write_binary(record, sizeof(*hdr) + hdr->len)) {
+        esp_log_binary_output(record, sizeof(*hdr) + hdr->len);
+    }
+}
+
+static uint32_t log_bin_format_id(const char *format, uint8_t level, uint64_t now, unsigned epoch)
+{
+    uint32_t mask = CONFIG_LOG_BINARY_FORMATS - 1;
+    uint32_t hash = (uint32_t)(((uintptr_t)format >> 3) * 2654435761u);
+    for (uint32_t probe = 0; probe < CONFIG_LOG_BINARY_FORMATS; probe++) {
+        uint32_t slot = (hash + probe) & mask;
+        const char *cur = atomic_load_explicit(&s_bin_formats[slot], memory_order_acquire);
+        if (cur == NULL && atomic_compare_exchange_strong_explicit(&s_bin_formats[slot], &cur, format,
+                                                                   memory_order_acq_rel, memory_order_acquire)) {
+            cur = format;
+        }
+        if (cur != format) {
+            continue;
+        }
+        if (atomic_load_explicit(&s_bin_sent[slot], memory_order_acquire) != epoch) {
+            // A thread racing us here sends the format as well, the decoder takes the last one
+            uint8_t record[CONFIG_LOG_ASYNC_RECORD_SIZE];
+            size_t len = strlen(format);
+            if (sizeof(log_bin_header_t) + len > sizeof(record)) {
+                return LOG_BIN_NO_ID;
+            }
+            log_bin_header_t hdr = {
+                .type = LOG_BIN_DEF,
+                .level = level,
+                .len = len,
+                .id = slot,
+                .time_ns = now,
+            };
+            memcpy(record + sizeof(hdr), format, len);
+            log_bin_put(record, &hdr);
+            atomic_store_explicit(&s_bin_sent[slot], epoch, memory_order_release);
+        }
+        return slot;
+    }
+    return LOG_BIN_NO_ID;
+}
+
+#define LOG_BIN_TAKE(type, out, end, ap) do {       \
+        type _v = va_arg(ap, type);                 \
+        if ((out) + sizeof(_v) > (end)) {           \
+            goto _full;                             \
+        }                                           \
+        memcpy((out), &_v, sizeof(_v));             \
+        (out) += sizeof(_v);                        \
+    } while (0)
+
+// Copy the arguments of the format, false if they do not fit
+static bool log_bin_pack(uint8_t *buf, size_t size, const char *format, va_list args, size_t *len)
+{
+    uint8_t *out = buf;
+    uint8_t *end = buf + size;
+    log_bin_spec_t spec;
+    va_list ap;
+    va_copy(ap, args);
+    for (const char *p = format; log_bin_next_spec(p, &spec) != NULL; p = spec.end) {
+        for (int i = 0; i < spec.stars; i++) {
+            LOG_BIN_TAKE(int, out, end, ap);
+        }
+        switch (spec.arg) {
+            case LOG_BIN_ARG_NONE:
+                if (spec.conv == 'n') {
+                    (void)va_arg(ap, void *);
+                }
+                break;
+            case LOG_BIN_ARG_INT:
+                LOG_BIN_TAKE(int, out, end, ap);
+                break;
+            case LOG_BIN_ARG_LONG:
+                LOG_BIN_TAKE(long, out, end, ap);
+                break;
+            case LOG_BIN_ARG_LLONG:
+                LOG_BIN_TAKE(long long, out, end, ap);
+                break;
+            case LOG_BIN_ARG_INTMAX:
+                LOG_BIN_TAKE(intmax_t, out, end, ap);
+                break;
+            case LOG_BIN_ARG_SIZE:
+                LOG_BIN_TAKE(size_t, out, end, ap);
+                break;
+            case LOG_BIN_ARG_PTRDIFF:
+                LOG_BIN_TAKE(ptrdiff_t, out, end, ap);
+                break;
+            case LOG_BIN_ARG_DOUBLE:
+                LOG_BIN_TAKE(double, out, end, ap);
+                break;
+            case LOG_BIN_ARG_LDOUBLE: {
+                double v = (double)va_arg(ap, long double);
+                if (out + sizeof(v) > end) {
+                    goto _full;
+                }
+                memcpy(out, &v, sizeof(v));
+                out += sizeof(v);
+                break;
+            }
+            case LOG_BIN_ARG_STRING: {
+                const char *str = va_arg(ap, const char *);
+                if (str == NULL) {
+                    str = "(null)";
+                }
+                size_t len = strlen(str);
+                uint16_t len16 = len;
+                if (len > UINT16_MAX || out + sizeof(len16) + len > end) {
+                    goto _full;
+                }
+                memcpy(out, &len16, sizeof(len16));
+                memcpy(out + sizeof(len16), str, len);
+                out += sizeof(len16) + len;
+                break;
+            }
+            case LOG_BIN_ARG_POINTER:
+                LOG_BIN_TAKE(void *, out, end, ap);
+                break;
+        }
+    }
+    va_end(ap);
+    *len = out - buf;
+    return true;
+_full:
+    va_end(ap);
+    return false;
+}
+
+bool esp_log_binary_writev(esp_log_level_t level, const char *format, va_list args)
+{
+    if (atomic_load_explicit(&s_bin_fd, memory_order_relaxed) < 0) {
+        return false;
+    }
+    unsigned epoch = atomic_load_explicit(&s_bin_epoch, memory_order_acquire);
+    uint8_t record[CONFIG_LOG_ASYNC_RECORD_SIZE];
+    uint8_t *payload = record + sizeof(log_bin_header_t);
+    size_t size = sizeof(record) - sizeof(log_bin_header_t);
+    log_bin_header_t hdr = {
+        .type = LOG_BIN_MSG,
+        .level = level,
+        .time_ns = log_bin_now_ns(),
+    };
+    hdr.id = log_bin_format_id(format, level, hdr.time_ns, epoch);
+    size_t len;
+    if (hdr.id != LOG_BIN_NO_ID && log_bin_pack(payload, size, format, args, &len)) {
+        hdr.len = len;
+    } else {
+        // No id or too long: format here, which is what the binary stream saves in the common case
+        int n = vsnprintf((char *)payload, size, format, args);
+        hdr.type = LOG_BIN_TEXT;
+        hdr.id = 0;
+        hdr.len = (n < 0) ? 0 : ((size_t)n >= size ? size - 1 : (size_t)n);
+    }
+    log_bin_put(record, &hdr);
+    return true;
+}
+
+int esp_log_set_binary_output(int fd)
+{
+    int ret = 0;
+    pthread_mutex_lock(&s_bin_lock);
+    // What is queued for the old stream goes there
+    esp_log_async_flush();
+    atomic_store_explicit(&s_bin_fd, -1, memory_order_release);
+    if (fd >= 0) {
+        if (write(fd, LOG_BIN_MAGIC, LOG_BIN_MAGIC_LEN) != (ssize_t)LOG_BIN_MAGIC_LEN) {
+            ret = -1;
+        } else {
+            atomic_fetch_add_explicit(&s_bin_epoch, 1, memory_order_release);
+            atomic_store_explicit(&s_bin_fd, fd, memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&s_bin_lock);
+    return ret;
+}
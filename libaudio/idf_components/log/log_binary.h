@@ -0,0 +1,183 @@
+/*
+ * SPDX-FileCopyrightText: 2015-2021 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Binary log stream, shared by the encoder and the decoder.
+ *
+ * The stream starts with LOG_BIN_MAGIC and is a sequence of records, each
+ * a log_bin_header_t followed by `len` bytes of payload:
+ *
+ *   LOG_BIN_DEF   the format string of `id`, sent before its first message
+ *   LOG_BIN_MSG   the raw arguments of a message with the format of `id`
+ *   LOG_BIN_TEXT  an already formatted message, for what does not fit the above
+ *
+ * An argument is stored as the value of its promoted type, in host byte
+ * order, a string as a uint16_t length and the bytes. A stream can only be
+ * decoded on a host with the same ABI as the one that wrote it.
+ */
+
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOG_BIN_MAGIC       "ESPLOGB1"
+#define LOG_BIN_MAGIC_LEN   (sizeof(LOG_BIN_MAGIC) - 1)
+
+enum {
+    LOG_BIN_DEF = 1,
+    LOG_BIN_MSG,
+    LOG_BIN_TEXT,
+};
+
+typedef struct {
+    uint8_t type;
+    uint8_t level;
+    uint16_t len;
+    uint32_t id;
+    uint64_t time_ns;       // CLOCK_MONOTONIC
+} log_bin_header_t;
+
+typedef enum {
+    LOG_BIN_ARG_NONE,       // %% and %n
+    LOG_BIN_ARG_INT,
+    LOG_BIN_ARG_LONG,
+    LOG_BIN_ARG_LLONG,
+    LOG_BIN_ARG_INTMAX,
+    LOG_BIN_ARG_SIZE,
+    LOG_BIN_ARG_PTRDIFF,
+    LOG_BIN_ARG_DOUBLE,
+    LOG_BIN_ARG_LDOUBLE,    // Stored as a double
+    LOG_BIN_ARG_STRING,
+    LOG_BIN_ARG_POINTER,
+} log_bin_arg_t;
+
+typedef struct {
+    const char *start;      // The '%'
+    const char *end;        // Past the conversion
+    int stars;              // '*' width and precision, each an int argument ahead of the value
+    char conv;
+    log_bin_arg_t arg;
+} log_bin_spec_t;
+
+static inline size_t log_bin_arg_size(log_bin_arg_t arg)
+{
+    switch (arg) {
+        case LOG_BIN_ARG_NONE:
+        case LOG_BIN_ARG_STRING:
+            return 0;
+        case LOG_BIN_ARG_INT:
+            return sizeof(int);
+        case LOG_BIN_ARG_LONG:
+            return sizeof(long);
+        case LOG_BIN_ARG_LLONG:
+            return sizeof(long long);
+        case LOG_BIN_ARG_INTMAX:
+            return sizeof(intmax_t);
+        case LOG_BIN_ARG_SIZE:
+            return sizeof(size_t);
+        case LOG_BIN_ARG_PTRDIFF:
+            return sizeof(ptrdiff_t);
+        case LOG_BIN_ARG_DOUBLE:
+        case LOG_BIN_ARG_LDOUBLE:
+            return sizeof(double);
+        case LOG_BIN_ARG_POINTER:
+            return sizeof(void *);
+    }
+    return 0;
+}
+
+/* Find the next conversion of a printf format, NULL at the end of the format */
+static inline const char *log_bin_next_spec(const char *p, log_bin_spec_t *spec)
+{
+    while (*p && *p != '%') {
+        p++;
+    }
+    if (*p == '\0') {
+        return NULL;
+    }
+    spec->start = p++;
+    spec->stars = 0;
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'') {
+        p++;
+    }
+    if (*p == '*') {
+        spec->stars++;
+        p++;
+    }
+    while (*p >= '0' && *p <= '9') {
+        p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec->stars++;
+            p++;
+        }
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    log_bin_arg_t integer = LOG_BIN_ARG_INT;
+    bool long_double = false;
+    switch (*p) {
+        case 'h':
+            p += (p[1] == 'h') ? 2 : 1;
+            break;
+        case 'l':
+            integer = (p[1] == 'l') ? LOG_BIN_ARG_LLONG : LOG_BIN_ARG_LONG;
+            p += (p[1] == 'l') ? 2 : 1;
+            break;
+        case 'q':
+            integer = LOG_BIN_ARG_LLONG;
+            p++;
+            break;
+        case 'j':
+            integer = LOG_BIN_ARG_INTMAX;
+            p++;
+            break;
+        case 'z':
+            integer = LOG_BIN_ARG_SIZE;
+            p++;
+            break;
+        case 't':
+            integer = LOG_BIN_ARG_PTRDIFF;
+            p++;
+            break;
+        case 'L':
+            long_double = true;
+            p++;
+            break;
+    }
+    spec->conv = *p;
+    switch (*p) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+            spec->arg = integer;
+            break;
+        case 'c':
+            spec->arg = LOG_BIN_ARG_INT;
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            spec->arg = long_double ? LOG_BIN_ARG_LDOUBLE : LOG_BIN_ARG_DOUBLE;
+            break;
+        case 's':
+            spec->arg = LOG_BIN_ARG_STRING;
+            break;
+        case 'p':
+            spec->arg = LOG_BIN_ARG_POINTER;
+            break;
+        case '\0':
+            spec->arg = LOG_BIN_ARG_NONE;
+            spec->end = p;
+            return spec->start;
+        default:
+            // %%, %n and anything not known print nothing of the arguments
+            spec->arg = LOG_BIN_ARG_NONE;
+            break;
+    }
+    spec->end = p + 1;
+    return spec->start;
+}
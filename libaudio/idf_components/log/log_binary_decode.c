@@ -0,0 +1,205 @@
+/*
+ * SPDX-FileCopyrightText: 2015-2021 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Decoder of the binary log stream, see log_binary.h. It only needs the
+ * stream, the formats travel in it. Also built into tools/esp_log_decode.
+ */
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "log_binary.h"
+
+typedef struct {
+    char **formats;
+    uint32_t count;
+    char *str;              // Room for the longest string argument
+} log_bin_decoder_t;
+
+static bool log_bin_read(int fd, void *buf, size_t len)
+{
+    uint8_t *p = (uint8_t *)buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool log_bin_define(log_bin_decoder_t *dec, uint32_t id, const uint8_t *payload, size_t len)
+{
+    if (id >= dec->count) {
+        uint32_t count = id + 1;
+        char **formats = realloc(dec->formats, count * sizeof(char *));
+        if (formats == NULL) {
+            return false;
+        }
+        memset(formats + dec->count, 0, (count - dec->count) * sizeof(char *));
+        dec->formats = formats;
+        dec->count = count;
+    }
+    free(dec->formats[id]);
+    dec->formats[id] = strndup((const char *)payload, len);
+    return dec->formats[id] != NULL;
+}
+
+#define LOG_BIN_GIVE(type, in, end, fd, conv) do {  \
+        type _v;                                    \
+        if ((in) + sizeof(_v) > (end)) {            \
+            goto _short;                            \
+        }                                           \
+        memcpy(&_v, (in), sizeof(_v));              \
+        (in) += sizeof(_v);                         \
+        dprintf((fd), (conv), _v);                  \
+    } while (0)
+
+static void log_bin_print(log_bin_decoder_t *dec, int out_fd, const char *format, const uint8_t *in, size_t len)
+{
+    const uint8_t *end = in + len;
+    const char *p = format;
+    log_bin_spec_t spec;
+    for (; log_bin_next_spec(p, &spec) != NULL; p = spec.end) {
+        dprintf(out_fd, "%.*s", (int)(spec.start - p), p);
+        // Rebuild the conversion with the '*' width and precision filled in
+        char conv[64];
+        size_t n = 0;
+        for (const char *c = spec.start; c < spec.end && n < sizeof(conv) - 12; c++) {
+            int star;
+            if (*c != '*') {
+                conv[n++] = *c;
+                continue;
+            }
+            if (in + sizeof(star) > end) {
+                goto _short;
+            }
+            memcpy(&star, in, sizeof(star));
+            in += sizeof(star);
+            n += snprintf(conv + n, sizeof(conv) - n, "%d", star);
+        }
+        conv[n] = '\0';
+        switch (spec.arg) {
+            case LOG_BIN_ARG_NONE:
+                if (spec.conv == '%') {
+                    dprintf(out_fd, "%%");
+                }
+                break;
+            case LOG_BIN_ARG_INT:
+                LOG_BIN_GIVE(int, in, end, out_fd, conv);
+                break;
+            case LOG_BIN_ARG_LONG:
+                LOG_BIN_GIVE(long, in, end, out_fd, conv);
+                break;
+            case LOG_BIN_ARG_LLONG:
+                LOG_BIN_GIVE(long long, in, end, out_fd, conv);
+                break;
+            case LOG_BIN_ARG_INTMAX:
+                LOG_BIN_GIVE(intmax_t, in, end, out_fd, conv);
+                break;
+            case LOG_BIN_ARG_SIZE:
+                LOG_BIN_GIVE(size_t, in, end, out_fd, conv);
+                break;
+            case LOG_BIN_ARG_PTRDIFF:
+                LOG_BIN_GIVE(ptrdiff_t, in, end, out_fd, conv);
+                break;
+            case LOG_BIN_ARG_DOUBLE:
+                LOG_BIN_GIVE(double, in, end, out_fd, conv);
+                break;
+            case LOG_BIN_ARG_LDOUBLE: {
+                double v;
+                if (in + sizeof(v) > end) {
+                    goto _short;
+                }
+                memcpy(&v, in, sizeof(v));
+                in += sizeof(v);
+                dprintf(out_fd, conv, (long double)v);
+                break;
+            }
+            case LOG_BIN_ARG_STRING: {
+                uint16_t slen;
+                if (in + sizeof(slen) > end) {
+                    goto _short;
+                }
+                memcpy(&slen, in, sizeof(slen));
+                in += sizeof(slen);
+                if (in + slen > end) {
+                    goto _short;
+                }
+                memcpy(dec->str, in, slen);
+                dec->str[slen] = '\0';
+                in += slen;
+                dprintf(out_fd, conv, dec->str);
+                break;
+            }
+            case LOG_BIN_ARG_POINTER:
+                LOG_BIN_GIVE(void *, in, end, out_fd, conv);
+                break;
+        }
+    }
+    dprintf(out_fd, "%s", p);
+    return;
+_short:
+    dprintf(out_fd, "<truncated record>\n");
+}
+
+int esp_log_binary_decode(int in_fd, int out_fd, bool show_time)
+{
+    char magic[LOG_BIN_MAGIC_LEN];
+    if (!log_bin_read(in_fd, magic, sizeof(magic)) || memcmp(magic, LOG_BIN_MAGIC, sizeof(magic)) != 0) {
+        return -1;
+    }
+    log_bin_decoder_t dec = { 0 };
+    uint8_t *payload = malloc(UINT16_MAX + 1);
+    dec.str = malloc(UINT16_MAX + 1);
+    int messages = -1;
+    if (payload == NULL || dec.str == NULL) {
+        goto _exit;
+    }
+    messages = 0;
+    log_bin_header_t hdr;
+    while (log_bin_read(in_fd, &hdr, sizeof(hdr)) && log_bin_read(in_fd, payload, hdr.len)) {
+        if (hdr.type == LOG_BIN_DEF) {
+            if (!log_bin_define(&dec, hdr.id, payload, hdr.len)) {
+                messages = -1;
+                break;
+            }
+            continue;
+        }
+        if (show_time) {
+            dprintf(out_fd, "[%llu.%06llu] ", (unsigned long long)(hdr.time_ns / 1000000000ULL),
+                    (unsigned long long)(hdr.time_ns % 1000000000ULL / 1000));
+        }
+        if (hdr.type == LOG_BIN_TEXT) {
+            dprintf(out_fd, "%.*s", (int)hdr.len, (const char *)payload);
+        } else if (hdr.type == LOG_BIN_MSG && hdr.id < dec.count && dec.formats[hdr.id]) {
+            log_bin_print(&dec, out_fd, dec.formats[hdr.id], payload, hdr.len);
+        } else {
+            dprintf(out_fd, "<record of unknown format %u>\n", hdr.id);
+        }
+        messages++;
+    }
+_exit:
+    for (uint32_t i = 0; i < dec.count; i++) {
+        free(dec.formats[i]);
+    }
+    free(dec.formats);
+    free(dec.str);
+    free(payload);
+    return messages;
+}
@@ -0,0 +1,48 @@
+/*
+ * SPDX-FileCopyrightText: 2015-2021 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Turn a binary log stream, written after esp_log_set_binary_output, back
+ * into text. Build it from the log directory with
+ *
+ *   gcc -I include -I ../esp_common/include -I . tools/esp_log_decode.c log_binary_decode.c -o esp_log_decode
+ *
+ * and run `esp_log_decode [-t] [file]`, -t prefixes each message with the
+ * time it was logged at. Without a file the stream is read from stdin.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "esp_log.h"
+
+int main(int argc, char **argv)
+{
+    bool show_time = false;
+    int in_fd = STDIN_FILENO;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0) {
+            show_time = true;
+        } else if (in_fd == STDIN_FILENO) {
+            in_fd = open(argv[i], O_RDONLY);
+            if (in_fd < 0) {
+                perror(argv[i]);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "usage: %s [-t] [file]\n", argv[0]);
+            return 1;
+        }
+    }
+    int messages = esp_log_binary_decode(in_fd, STDOUT_FILENO, show_time);
+    if (messages < 0) {
+        fprintf(stderr, "not a binary log stream\n");
+        return 1;
+    }
+    return 0;
+}